@@ -0,0 +1,400 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Crash-Surviving Block Database
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "stdafx.h"
+#ifndef _WIN32
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#endif
+
+#define VLDBUILD
+#include "blockdb.h"    // This class' header.
+#include "callstack.h"  // Provides the frames of the call stacks.
+
+// toUtf16 - Copies a path to a module record's path, which is null terminated
+//   UTF-16. The rest of the buffer is zeroed, and a path which is too long is
+//   truncated.
+//
+//  - dest (OUT): Buffer which receives the path.
+//
+//  - count (IN): Size of the buffer, in characters.
+//
+//  - path (IN): The path.
+//
+//  Return Value:
+//
+//    None.
+//
+static VOID toUtf16 (unsigned short *dest, SIZE_T count, LPCWSTR path)
+{
+    SIZE_T length = 0;
+    for (; (*path != L'\0') && (length + 1 < count); path++) {
+        ULONG code = (ULONG)*path;
+        if (code < 0x10000) {
+            dest[length++] = (unsigned short)code;
+        }
+        else if (length + 2 < count) {
+            // A code point outside the basic plane, when wchar_t is 32 bits.
+            code -= 0x10000;
+            dest[length++] = (unsigned short)(0xD800 | (code >> 10));
+            dest[length++] = (unsigned short)(0xDC00 | (code & 0x3FF));
+        }
+        else {
+            break;
+        }
+    }
+    memset(dest + length, 0, (count - length) * sizeof(unsigned short));
+}
+
+// Constructor - Initializes the BlockDatabase, closed.
+//
+BlockDatabase::BlockDatabase ()
+{
+#ifdef _WIN32
+    m_file    = INVALID_HANDLE_VALUE;
+    m_mapping = NULL;
+#else
+    m_fd       = -1;
+    m_capacity = 0;
+#endif
+    m_view    = NULL;
+}
+
+// open - Creates the block database file and maps it.
+//
+//  - path (IN): Path of the file. An existing file is replaced.
+//
+//  - capacity (IN): Size of the file, in bytes.
+//
+//  Return Value:
+//
+//    Returns TRUE if the blocks are being recorded. Otherwise, the error is
+//    available from GetLastError (errno on Linux).
+//
+BOOL BlockDatabase::open (LPCWSTR path, ULONG64 capacity)
+{
+#ifdef _WIN32
+    if ((capacity < 2 * sizeof(VLD_BLOCKDB_HEADER)) || (capacity > (SIZE_T)-1)) {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    capacity &= ~(ULONG64)7;
+
+    m_file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file != INVALID_HANDLE_VALUE)
+        m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READWRITE, (DWORD)(capacity >> 32), (DWORD)capacity, NULL);
+    if (m_mapping != NULL)
+        m_view = (BYTE*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)capacity);
+    if (m_view == NULL) {
+        DWORD error = GetLastError();
+        close();
+        SetLastError(error);
+        return FALSE;
+    }
+
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    ULONG64 startTime = ((ULONG64)now.dwHighDateTime << 32) | now.dwLowDateTime;
+#else
+    CHAR filepath [MAX_PATH];
+    if ((capacity < 2 * sizeof(VLD_BLOCKDB_HEADER)) || (capacity > (SIZE_T)-1) ||
+        (wcstombs(filepath, path, MAX_PATH) >= MAX_PATH)) {
+        errno = EINVAL;
+        return FALSE;
+    }
+    capacity &= ~(ULONG64)7;
+
+    m_fd = ::open(filepath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if ((m_fd != -1) && (ftruncate(m_fd, (off_t)capacity) == 0)) {
+        void *view = mmap(NULL, (SIZE_T)capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (view != MAP_FAILED) {
+            m_view = (BYTE*)view;
+            m_capacity = (SIZE_T)capacity;
+        }
+    }
+    if (m_view == NULL) {
+        int error = errno;
+        close();
+        errno = error;
+        return FALSE;
+    }
+
+    // The start time is stored as a FILETIME: 100 ns units since 1601.
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    ULONG64 startTime = ((ULONG64)now.tv_sec + 11644473600ULL) * 10000000 + (ULONG64)now.tv_nsec / 100;
+#endif
+
+    // The new file is filled with zeros: every record is free.
+    VLD_BLOCKDB_HEADER *dbheader = header();
+    memcpy(dbheader->magic, VLD_BLOCKDB_MAGIC, sizeof(dbheader->magic));
+    dbheader->version = VLD_BLOCKDB_VERSION;
+    dbheader->headerSize = sizeof(VLD_BLOCKDB_HEADER);
+    dbheader->blockSize = sizeof(VLD_BLOCKDB_BLOCK);
+    dbheader->pointerSize = sizeof(void*);
+    dbheader->processId = GetCurrentProcessId();
+    dbheader->status = VLD_BLOCKDB_RUNNING;
+    dbheader->startTime = startTime;
+    dbheader->capacity = capacity;
+    dbheader->blockEnd = sizeof(VLD_BLOCKDB_HEADER);
+    dbheader->blockLimit = (capacity / 2) & ~(ULONG64)7;
+    dbheader->stackEnd = dbheader->blockLimit;
+    dbheader->freeList = 0;
+    dbheader->modules = 0;
+    return TRUE;
+}
+
+// close - Records that the process exited normally, and closes the file.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockDatabase::close ()
+{
+#ifdef _WIN32
+    if (m_view != NULL) {
+        header()->status = VLD_BLOCKDB_EXITED;
+        UnmapViewOfFile(m_view);
+        m_view = NULL;
+    }
+    if (m_mapping != NULL) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (m_view != NULL) {
+        header()->status = VLD_BLOCKDB_EXITED;
+        munmap(m_view, m_capacity);
+        m_view = NULL;
+        m_capacity = 0;
+    }
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+}
+
+// addblock - Records a newly tracked block. Must be called while holding
+//   g_heapMapLock.
+//
+//  - heap (IN): Handle to the heap from which the block was allocated.
+//
+//  - mem (IN): Address of the block.
+//
+//  - size (IN): Size of the block, in bytes.
+//
+//  - serialNumber (IN): Allocation request number of the block.
+//
+//  - threadId (IN): ID of the allocating thread.
+//
+//  Return Value:
+//
+//    Returns the offset of the block's record, or 0 if the database is closed
+//    or full.
+//
+SIZE_T BlockDatabase::addBlock (HANDLE heap, LPCVOID mem, SIZE_T size, SIZE_T serialNumber, DWORD threadId)
+{
+    if (m_view == NULL)
+        return 0;
+
+    VLD_BLOCKDB_HEADER *dbheader = header();
+    SIZE_T record = (SIZE_T)dbheader->freeList;
+    if (record != 0) {
+        dbheader->freeList = block(record)->next;
+    }
+    else if (dbheader->blockEnd + sizeof(VLD_BLOCKDB_BLOCK) <= dbheader->blockLimit) {
+        record = (SIZE_T)dbheader->blockEnd;
+        dbheader->blockEnd += sizeof(VLD_BLOCKDB_BLOCK);
+    }
+    else {
+        dbheader->status = VLD_BLOCKDB_FULL;
+        return 0;
+    }
+
+    VLD_BLOCKDB_BLOCK *dbblock = block(record);
+    dbblock->address = (ULONG64)(UINT_PTR)mem;
+    dbblock->size = size;
+    dbblock->heap = (ULONG64)(UINT_PTR)heap;
+    dbblock->serialNumber = serialNumber;
+    dbblock->stack = 0;
+    dbblock->next = 0;
+    dbblock->threadId = threadId;
+    // The record is only valid once it is complete.
+    *(UINT32 volatile*)&dbblock->state = VLD_BLOCKDB_ALLOCATED;
+    return record;
+}
+
+// removeblock - Records that a block is no longer tracked, and makes its record
+//   available for reuse. Must be called while holding g_heapMapLock.
+//
+//  - record (IN): Offset of the block's record, as returned by addBlock.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockDatabase::removeBlock (SIZE_T record)
+{
+    if ((m_view == NULL) || (record == 0))
+        return;
+
+    VLD_BLOCKDB_BLOCK *dbblock = block(record);
+    *(UINT32 volatile*)&dbblock->state = VLD_BLOCKDB_FREE;
+    dbblock->next = header()->freeList;
+    header()->freeList = record;
+}
+
+// resizeblock - Records that a block was reallocated in place. Its call stack
+//   is cleared until setStack attaches the new one. Must be called while
+//   holding g_heapMapLock.
+//
+//  - record (IN): Offset of the block's record, as returned by addBlock.
+//
+//  - size (IN): New size of the block, in bytes.
+//
+//  - threadId (IN): ID of the reallocating thread.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockDatabase::resizeBlock (SIZE_T record, SIZE_T size, DWORD threadId)
+{
+    if ((m_view == NULL) || (record == 0))
+        return;
+
+    VLD_BLOCKDB_BLOCK *dbblock = block(record);
+    dbblock->stack = 0;
+    dbblock->size = size;
+    dbblock->threadId = threadId;
+}
+
+// setstack - Records the call stack of a block. The stack is written to the
+//   database the first time that it is used by any block.
+//
+//  - record (IN): Offset of the block's record, as returned by addBlock.
+//
+//  - callstack (IN): The block's interned call stack.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockDatabase::setStack (SIZE_T record, CallStack *callstack)
+{
+    if ((m_view == NULL) || (record == 0) || (callstack == NULL))
+        return;
+
+    SIZE_T stack = callstack->getDbOffset();
+    if (stack == 0) {
+        UINT32 count = callstack->size();
+        stack = append(sizeof(VLD_BLOCKDB_STACK) + count * sizeof(ULONG64));
+        if (stack == 0)
+            return;
+        VLD_BLOCKDB_STACK *dbstack = (VLD_BLOCKDB_STACK*)(m_view + stack);
+        dbstack->frameCount = count;
+        ULONG64 *frames = (ULONG64*)(dbstack + 1);
+        for (UINT32 index = 0; index < count; index++) {
+            frames[index] = (*callstack)[index];
+        }
+        // If another thread wrote the same stack in the meantime, use its
+        // record. This one is wasted.
+        stack = callstack->setDbOffset(stack);
+    }
+    *(unsigned long long volatile*)&block(record)->stack = stack;
+}
+
+// addmodule - Records a module loaded in the process, so that the call stacks
+//   can be resolved once the process is gone. Must be called while holding
+//   the loader lock.
+//
+//  - base (IN): Base address of the module.
+//
+//  - size (IN): Size of the module's image, in bytes.
+//
+//  - path (IN): Full path of the module.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockDatabase::addModule (UINT_PTR base, SIZE_T size, LPCWSTR path)
+{
+    if (m_view == NULL)
+        return;
+
+    // The paths are stored in UTF-16, whatever the size of wchar_t.
+    unsigned short modulepath [_countof(((VLD_BLOCKDB_MODULE*)NULL)->path)];
+    toUtf16(modulepath, _countof(modulepath), path);
+
+    // A module may be unloaded and loaded again at the same address.
+    VLD_BLOCKDB_HEADER *dbheader = header();
+    for (SIZE_T offset = (SIZE_T)dbheader->modules; offset != 0; ) {
+        VLD_BLOCKDB_MODULE *dbmodule = (VLD_BLOCKDB_MODULE*)(m_view + offset);
+        if ((dbmodule->base == base) && (dbmodule->size == size) &&
+            (memcmp(dbmodule->path, modulepath, sizeof(modulepath)) == 0))
+            return;
+        offset = (SIZE_T)dbmodule->next;
+    }
+
+    SIZE_T record = append(sizeof(VLD_BLOCKDB_MODULE));
+    if (record == 0)
+        return;
+    VLD_BLOCKDB_MODULE *dbmodule = (VLD_BLOCKDB_MODULE*)(m_view + record);
+    dbmodule->base = base;
+    dbmodule->size = size;
+    memcpy(dbmodule->path, modulepath, sizeof(modulepath));
+    dbmodule->next = dbheader->modules;
+    *(unsigned long long volatile*)&dbheader->modules = record;
+}
+
+// append - Reserves space for a stack or module record. Safe to call from any
+//   thread without holding a lock.
+//
+//  - bytes (IN): Size of the record, in bytes.
+//
+//  Return Value:
+//
+//    Returns the offset of the record, or 0 if the database is full.
+//
+SIZE_T BlockDatabase::append (SIZE_T bytes)
+{
+    VLD_BLOCKDB_HEADER *dbheader = header();
+    bytes = (bytes + 7) & ~(SIZE_T)7;
+    ULONG64 offset = (ULONG64)InterlockedExchangeAdd64((LONG64 volatile*)&dbheader->stackEnd, (LONG64)bytes);
+    if (offset + bytes > dbheader->capacity) {
+        dbheader->status = VLD_BLOCKDB_FULL;
+        return 0;
+    }
+    return (SIZE_T)offset;
+}
@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Crash-Surviving Block Database
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+"This header should only be included by Visual Leak Detector when building it from source. \
+Applications should never include this header."
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "linux/platform.h"
+#endif
+#include "vld_blockdb.h"
+
+#define BLOCKDB_DEFAULT_SIZE  256       // Default size of the block database file, in megabytes.
+
+class CallStack;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The BlockDatabase Class
+//
+//    Mirrors the tracked blocks, their call stacks and the loaded modules in a
+//    memory-mapped file (see vld_blockdb.h for the format), which survives the
+//    process if it crashes or is killed. The file is created at its full size
+//    and mapped once, so recording a block only takes plain memory stores.
+//
+//    The first half of the file holds the block records. They are only
+//    updated while holding g_heapMapLock, like the block maps. The second
+//    half holds the stack and module records, which are appended without a
+//    lock, since call stacks are attached to their blocks outside of
+//    g_heapMapLock.
+//
+class BlockDatabase
+{
+public:
+    BlockDatabase ();
+    BOOL open (LPCWSTR path, ULONG64 capacity);
+    VOID close ();
+    BOOL isOpen () const
+    {
+        return (m_view != NULL);
+    }
+    SIZE_T addBlock (HANDLE heap, LPCVOID mem, SIZE_T size, SIZE_T serialNumber, DWORD threadId);
+    VOID removeBlock (SIZE_T record);
+    VOID resizeBlock (SIZE_T record, SIZE_T size, DWORD threadId);
+    VOID setStack (SIZE_T record, CallStack *callstack);
+    VOID addModule (UINT_PTR base, SIZE_T size, LPCWSTR path);
+
+private:
+    SIZE_T append (SIZE_T bytes);
+    VLD_BLOCKDB_BLOCK* block (SIZE_T record) const
+    {
+        return (VLD_BLOCKDB_BLOCK*)(m_view + record);
+    }
+    VLD_BLOCKDB_HEADER* header () const
+    {
+        return (VLD_BLOCKDB_HEADER*)m_view;
+    }
+
+#ifdef _WIN32
+    HANDLE  m_file;       // The block database file.
+    HANDLE  m_mapping;    // Mapping of the whole file.
+#else
+    int     m_fd;         // The block database file, or -1.
+    SIZE_T  m_capacity;   // Size of the mapping, in bytes.
+#endif
+    BYTE   *m_view;       // View of the whole file, or NULL if the database isn't open.
+};
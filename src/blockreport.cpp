@@ -0,0 +1,440 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - BlockTracker Report Functions
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+// The report half of the BlockTracker class: the leak report, the snapshot
+// diffs, the leak growth monitor and the peak snapshot report. Unlike the
+// bookkeeping in blocktracker.cpp, these resolve and dump call stacks, so
+// they are built into the backends only.
+
+#include "stdafx.h"
+#include <stdlib.h>
+
+#define VLDBUILD         // Declares that we are building Visual Leak Detector.
+#include "blocktracker.h" // Provides the BlockTracker class.
+#ifdef _WIN32
+#include "loaderlock.h"  // Provides the loader lock, held while resolving call stacks.
+#endif
+#include "utility.h"     // Provides various utility functions.
+#include "vldheap.h"     // Provides internal new and delete operators.
+
+// getleakscount - Calculate number of memory leaks.
+//
+//  - heapinfo (IN): The heap for which to count the leaks.
+//
+//  - threadId (IN): Only count the leaks of this thread, unless it is -1.
+//
+//  Return Value:
+//
+//    Returns the number of leaks.
+//
+SIZE_T BlockTracker::getLeaksCount (heapinfo_t* heapinfo, DWORD threadId)
+{
+    BlockMap* blockmap   = &heapinfo->blockMap;
+    SIZE_T memoryleaks = 0;
+
+    for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
+    {
+        // Found a block which is still in the BlockMap. We've identified a
+        // potential memory leak.
+        blockinfo_t* info = (*blockit).second;
+        if (info->reported)
+            continue;
+
+        if (threadId != ((DWORD)-1) && info->threadId != threadId)
+            continue;
+
+        LPCVOID address;
+        SIZE_T size;
+        if (!getLeakData((*blockit).first, info, address, size))
+            continue;
+
+        if (m_options & VLD_OPT_SKIP_CRTSTARTUP_LEAKS) {
+            // Check for crt startup allocations
+            if (info->callStack && info->callStack->isCrtStartupAlloc()) {
+                info->reported = true;
+                continue;
+            }
+        }
+
+        memoryleaks ++;
+    }
+
+    return memoryleaks;
+}
+
+// reportleaks - Generates a memory leak report for the specified heap.
+//
+//  - heapinfo (IN): The heap for which to generate a memory leak report.
+//
+//  - firstLeak (IN/OUT): Set if no leak has been reported yet.
+//
+//  - aggregatedLeaks (IN/OUT): The leaks which have been reported as the
+//      duplicates of another one.
+//
+//  - threadId (IN): Only report the leaks of this thread, unless it is -1.
+//
+//  Return Value:
+//
+//    Returns the number of leaks reported.
+//
+SIZE_T BlockTracker::reportLeaks (heapinfo_t* heapinfo, bool &firstLeak, Set<blockinfo_t*> &aggregatedLeaks, DWORD threadId)
+{
+    BlockMap* blockmap   = &heapinfo->blockMap;
+    SIZE_T leaksFound = 0;
+
+    for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
+    {
+        // Found a block which is still in the BlockMap. We've identified a
+        // potential memory leak.
+        LPCVOID block = (*blockit).first;
+        blockinfo_t* info = (*blockit).second;
+        if (info->reported)
+            continue;
+
+        if (threadId != ((DWORD)-1) && info->threadId != threadId)
+            continue;
+
+        Set<blockinfo_t*>::Iterator it = aggregatedLeaks.find(info);
+        if (it != aggregatedLeaks.end())
+            continue;
+
+        // The runtime's header, if any, is more or less transparent to the
+        // user, so the information about the contained block will probably
+        // be more useful to the user. Accordingly, that's the information
+        // we'll include in the report.
+        LPCVOID address;
+        SIZE_T size;
+        if (!getLeakData(block, info, address, size))
+            continue;
+
+        if (m_options & VLD_OPT_SKIP_CRTSTARTUP_LEAKS) {
+            // Check for crt startup allocations
+            if (info->callStack && info->callStack->isCrtStartupAlloc()) {
+                info->reported = true;
+                continue;
+            }
+        }
+
+        if (info->callStack == NULL) {
+            // Allocated without capturing a call stack. These leaks are
+            // summarized by reportUntracedLeaks instead.
+            continue;
+        }
+
+        // It looks like a real memory leak.
+        if (firstLeak) { // A confusing way to only display this message once
+            Report(L"WARNING: Visual Leak Detector detected memory leaks!\n");
+            firstLeak = false;
+        }
+        SIZE_T blockLeaksCount = 1;
+        Report(L"---------- Block %zu at " ADDRESSFORMAT L": %zu bytes ----------\n", info->serialNumber, (UINT_PTR)address, size);
+#if defined(_WIN32) && defined(_DEBUG)
+        if (info->debugCrtAlloc)
+        {
+            crtdbgblockheader_t* crtheader = (crtdbgblockheader_t*)block;
+            Report(L"  CRT Alloc ID: %zu\n", (SIZE_T)crtheader->request);
+        }
+#endif
+        if (m_options & VLD_OPT_AGGREGATE_DUPLICATES) {
+            // Aggregate all other leaks which are duplicates of this one
+            // under this same heading, to cut down on clutter.
+            SIZE_T erased = eraseDuplicates(blockit, aggregatedLeaks);
+
+            // add only the number that were erased, since the 'one left over'
+            // is already recorded as a leak
+            blockLeaksCount += erased;
+        }
+
+        DWORD callstackCRC = CalculateCRC32(info->size, info->callStack->getHashValue());
+        Report(L"  Leak Hash: 0x%08X, Count: %zu, Total %zu bytes\n", callstackCRC, blockLeaksCount, size * blockLeaksCount);
+        if (m_sampleRate != 0) {
+            double estimate = sampleWeight(info->size) * blockLeaksCount;
+            Report(L"  Estimated from sampling: Count: %.0f, Total %.0f bytes\n", estimate, estimate * size);
+        }
+        leaksFound += blockLeaksCount;
+
+        // Dump the call stack.
+        if (blockLeaksCount == 1)
+            Report(L"  Call Stack (TID %u):\n", info->threadId);
+        else
+            Report(L"  Call Stack:\n");
+        info->callStack->dump(m_options & VLD_OPT_TRACE_INTERNAL_FRAMES);
+
+        // Dump the data in the user data section of the memory block.
+        if (m_maxDataDump != 0) {
+            Report(L"  Data:\n");
+            if (m_options & VLD_OPT_UNICODE_REPORT) {
+                DumpMemoryW(address, (m_maxDataDump < size) ? m_maxDataDump : size);
+            }
+            else {
+                DumpMemoryA(address, (m_maxDataDump < size) ? m_maxDataDump : size);
+            }
+        }
+        Report(L"\n\n");
+    }
+
+    return leaksFound;
+}
+
+// reportuntracedleaks - Summarizes the leaks that were allocated without
+//   capturing a call stack (see VLD_OPT_NO_STACK_CAPTURE). Without call stacks
+//   there is nothing to tell them apart, so instead of being listed they are
+//   counted per heap, per thread and per size class. Size class n holds the
+//   blocks of 2^n to 2^(n+1)-1 bytes. The per heap counts are left out when
+//   a single heap is tracked.
+//
+//  - heap (IN): Only leaks from this heap are reported. If NULL, all heaps are.
+//
+//  - threadId (IN): Only leaks from this thread are reported. If (DWORD)-1,
+//      all threads are.
+//
+//  Return Value:
+//
+//    Returns the number of leaks found.
+//
+SIZE_T BlockTracker::reportUntracedLeaks (HANDLE heap, DWORD threadId)
+{
+    leakcount_t total = { 0, 0 };
+    leakcount_t sizeClasses [sizeof(SIZE_T) * 8] = { };
+    Map<DWORD, leakcount_t*> threads;
+
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    HeapMap::Iterator secondheap = m_heapMap->begin();
+    if (secondheap != m_heapMap->end())
+        ++secondheap;
+    bool severalHeaps = (secondheap != m_heapMap->end());
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        if ((heap != NULL) && ((*heapit).first != heap))
+            continue;
+
+        leakcount_t heapLeaks = { 0, 0 };
+        BlockMap *blockmap = &(*heapit).second->blockMap;
+        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
+            blockinfo_t *info = (*blockit).second;
+            if (info->reported || (info->callStack != NULL))
+                continue;
+            if ((threadId != ((DWORD)-1)) && (info->threadId != threadId))
+                continue;
+            LPCVOID address;
+            SIZE_T size;
+            if (!getLeakData((*blockit).first, info, address, size))
+                continue;
+
+            heapLeaks.count++;
+            heapLeaks.bytes += size;
+
+            Map<DWORD, leakcount_t*>::Iterator threadit = threads.find(info->threadId);
+            if (threadit == threads.end()) {
+                leakcount_t *threadLeaks = new leakcount_t;
+                threadLeaks->count = 0;
+                threadLeaks->bytes = 0;
+                threadit = threads.insert(info->threadId, threadLeaks);
+            }
+            (*threadit).second->count++;
+            (*threadit).second->bytes += size;
+
+            unsigned long sizeClass = 0;
+#if defined(_WIN64) || defined(VLD_64BIT_ADDRESSES)
+            _BitScanReverse64(&sizeClass, (size != 0) ? size : 1);
+#else
+            _BitScanReverse(&sizeClass, (size != 0) ? size : 1);
+#endif
+            sizeClasses[sizeClass].count++;
+            sizeClasses[sizeClass].bytes += size;
+        }
+
+        if (heapLeaks.count == 0)
+            continue;
+        if (total.count == 0)
+            Report(L"WARNING: Visual Leak Detector detected memory leaks without call stacks!\n");
+        if (severalHeaps)
+            Report(L"  Heap " ADDRESSFORMAT L": %zu leaks, %zu bytes\n", (UINT_PTR)(*heapit).first, heapLeaks.count, heapLeaks.bytes);
+        total.count += heapLeaks.count;
+        total.bytes += heapLeaks.bytes;
+    }
+
+    for (Map<DWORD, leakcount_t*>::Iterator threadit = threads.begin(); threadit != threads.end(); ++threadit) {
+        Report(L"  TID %u: %zu leaks, %zu bytes\n", (*threadit).first, (*threadit).second->count, (*threadit).second->bytes);
+        delete (*threadit).second;
+    }
+    for (UINT32 sizeClass = 0; sizeClass < _countof(sizeClasses); sizeClass++) {
+        if (sizeClasses[sizeClass].count == 0)
+            continue;
+        Report(L"  %zu - %zu bytes: %zu leaks, %zu bytes\n", (SIZE_T)1 << sizeClass,
+            ((SIZE_T)2 << sizeClass) - 1, sizeClasses[sizeClass].count, sizeClasses[sizeClass].bytes);
+    }
+    if (total.count != 0)
+        Report(L"\n");
+
+    return total.count;
+}
+
+// reportsummary - Reports the totals which follow the leak report: the
+//   number and size of the leaks, the statistics, the estimated leaks when
+//   only sampled allocations were tracked, and the last peak snapshot.
+//
+//  - leaksCount (IN): Number of leaks reported.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::reportSummary (SIZE_T leaksCount)
+{
+    if (leaksCount == 0) {
+        Report(L"No memory leaks detected.\n");
+    }
+    else {
+        VLD_STATISTICS stats;
+        m_stats.get(&stats);
+        Report(L"Visual Leak Detector detected %zu memory leak", leaksCount);
+        Report((leaksCount > 1) ? L"s (%zu bytes).\n" : L" (%zu bytes).\n", (SIZE_T)stats.currentBytes);
+        Report(L"Largest number used: %zu bytes.\n", (SIZE_T)stats.peakBytes);
+        Report(L"Total allocations: %zu bytes.\n", (SIZE_T)stats.totalBytes);
+        if (m_sampleRate != 0) {
+            double count, bytes;
+            estimateLeaks(count, bytes);
+            Report(L"Only sampled allocations were tracked. Estimated leaks: %.0f (%.0f bytes).\n", count, bytes);
+        }
+    }
+    if (m_peak.time != 0) {
+        reportPeakSnapshot();
+    }
+}
+
+SIZE_T BlockTracker::DiffSnapshots (VLD_SNAPSHOT before, VLD_SNAPSHOT after, VLD_SNAPSHOT_CALLBACK callback, LPVOID context)
+{
+    if ((after == NULL) || (after->count == 0) || (m_options & VLD_OPT_VLDOFF))
+        return 0;
+
+    // Both snapshots are sorted by serial number, so the blocks which are new
+    // in the later one are found by merging them. Blocks allocated after the
+    // earlier snapshot was taken can't be in it.
+    SIZE_T *added = new SIZE_T [after->count];
+    SIZE_T count = 0;
+    SIZE_T index = 0;
+    for (SIZE_T afterIndex = 0; afterIndex < after->count; afterIndex++) {
+        SIZE_T serialNumber = after->serialNumbers[afterIndex];
+        if ((before != NULL) && (serialNumber < before->watermark)) {
+            while ((index < before->count) && (before->serialNumbers[index] < serialNumber))
+                index++;
+            if ((index < before->count) && (before->serialNumbers[index] == serialNumber))
+                continue;
+        }
+        added[count++] = serialNumber;
+    }
+
+    // Only the blocks found by the diff are looked up. Those which have been
+    // freed since the later snapshot was taken are left out.
+    diffblock_t *found = (count != 0) ? new diffblock_t [count] : NULL;
+    count = findBlocks(added, count, found);
+    delete [] added;
+
+    if ((callback != NULL) && (count != 0)) {
+        // Call stacks are interned, so grouping the blocks by call stack only
+        // needs the pointers to be compared.
+        qsort(found, count, sizeof(diffblock_t), compareDiffBlocks);
+        VLD_SNAPSHOT_BLOCK *blocks = new VLD_SNAPSHOT_BLOCK [count];
+        for (SIZE_T first = 0; first < count; ) {
+            CallStack *callstack = found[first].callStack;
+            SIZE_T last = first;
+            while ((last < count) && (found[last].callStack == callstack)) {
+                blocks[last] = found[last].block;
+                last++;
+            }
+
+            const WCHAR *resolved = NULL;
+            if (callstack != NULL) {
+                // Each call stack is only resolved once. The locks are released
+                // before calling back, as the callback may allocate memory.
+#ifdef _WIN32
+                LoaderLock ll;
+#endif
+                CriticalSectionLocker<> cs(g_heapMapLock);
+                resolved = callstack->getResolvedCallstack(m_options & VLD_OPT_TRACE_INTERNAL_FRAMES);
+            }
+            callback(resolved, &blocks[first], last - first, context);
+            first = last;
+        }
+        delete [] blocks;
+    }
+
+    delete [] found;
+    return count;
+}
+
+// checkgrowingsites - Reports the allocation sites whose bytes in use have
+//   grown in each of the last MonitorIntervals intervals. The sites are found
+//   without taking any lock; the heap map lock is only taken to print the
+//   call stacks of the sites reported, which are resolved once.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::checkGrowingSites ()
+{
+    growingsite_t sites [VLD_MONITOR_MAX_SITES];
+    SIZE_T count = m_stackTable.findGrowingSites(m_monitorIntervals, sites, VLD_MONITOR_MAX_SITES);
+    if (count == 0)
+        return;
+
+    Report(L"Visual Leak Detector: %zu allocation site%ls grew during each of the last %u intervals of %u ms.\n",
+        count, (count > 1) ? L"s" : L"", m_monitorIntervals, m_monitorInterval);
+    for (SIZE_T index = 0; index < count; index++) {
+        Report(L"---------- Growing site: %lld bytes in use (%lld bytes more) ----------\n",
+            (long long)sites[index].bytes, (long long)sites[index].growth);
+        Report(L"  Call Stack:\n");
+        {
+            CriticalSectionLocker<> cs(g_heapMapLock);
+            sites[index].callStack->dump(m_options & VLD_OPT_TRACE_INTERNAL_FRAMES);
+        }
+        Report(L"\n");
+    }
+}
+
+// reportpeaksnapshot - Reports the largest allocation sites recorded by the
+//   last peak snapshot.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::reportPeakSnapshot ()
+{
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    Report(L"At the last recorded peak, %zu bytes were in use in %zu blocks (system uptime %llu ms).\n",
+        m_peak.bytes, m_peak.blocks, (unsigned long long)m_peak.time);
+    Report(L"The largest allocation sites at that time were:\n");
+    for (SIZE_T index = 0; index < m_peak.siteCount; index++) {
+        const heapsite_t &site = m_peak.sites[index];
+        Report(L"---------- Peak site %zu: %zu bytes in %zu blocks ----------\n", index + 1, site.bytes, site.count);
+        Report(L"  Call Stack:\n");
+        if (site.callStack != NULL)
+            site.callStack->dump(m_options & VLD_OPT_TRACE_INTERNAL_FRAMES);
+        else
+            Report(L"    Not captured.\n");
+        Report(L"\n");
+    }
+}
@@ -0,0 +1,1069 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - BlockTracker Class Implementation
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+// The bookkeeping half of the BlockTracker class: the heap and block maps, the
+// block index, the sampling and size filters, the heap snapshots and the peak
+// snapshots. The report functions are in blockreport.cpp.
+
+#include "stdafx.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define VLDBUILD         // Declares that we are building Visual Leak Detector.
+#include "blocktracker.h" // This class' header.
+#include "utility.h"     // Provides various utility functions.
+#include "vldheap.h"     // Provides internal new and delete operators.
+
+#define BLOCK_MAP_RESERVE   64  // This should strike a balance between memory use and a desire to minimize heap hits.
+#define HEAP_MAP_RESERVE    2   // Usually there won't be more than a few heaps in the process, so this should be small.
+
+// Global variables.
+CriticalSection  g_heapMapLock;    // Serializes access to the heap and block maps.
+
+// Constructor - Sets the options to their defaults. Nothing is allocated
+//   until initializeTracking is called: on Windows, VLD's private heap
+//   doesn't exist yet.
+//
+BlockTracker::BlockTracker ()
+{
+    m_heapMap          = NULL;
+    m_blockIndex       = NULL;
+    m_unindexedBlocks  = 0;
+    m_requestCurr      = 1;
+    m_maxDataDump      = 0xffffffff;
+    m_maxTraceFrames   = 0xffffffff;
+    m_minTrackedSize   = 0;
+    m_maxTrackedSize   = (SIZE_T)-1;
+    m_mapUntrackedSizes = true;
+    m_captureMinSize   = (SIZE_T)-1;
+    m_captureMaxSize   = 0;
+    m_captureThreadId  = 0;
+    m_sampleRate       = 0;
+    m_peakHysteresis   = 0;
+    m_peakInterval     = VLD_DEFAULT_PEAK_INTERVAL;
+    ZeroMemory(&m_peak, sizeof(m_peak));
+    m_monitorInterval  = 0;
+    m_monitorIntervals = VLD_DEFAULT_MONITOR_INTERVALS;
+    m_blockDbPath[0]   = '\0';
+    m_blockDbSize      = (ULONG64)BLOCKDB_DEFAULT_SIZE * 1024 * 1024;
+    m_options          = 0x0;
+}
+
+// Destructor - The backend frees the maps with freeTracking, while its own
+//   resources are still available.
+//
+BlockTracker::~BlockTracker ()
+{
+}
+
+// initializetracking - Creates the heap map and the block index. Called by
+//   the backend once the configuration has been loaded.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::initializeTracking ()
+{
+    m_heapMap         = new HeapMap;
+    m_heapMap->reserve(HEAP_MAP_RESERVE);
+    m_blockIndex      = new BlockIndex;
+    m_unindexedBlocks = 0;
+    m_requestCurr     = 1;
+    m_optionsLock.Initialize(L"m_optionsLock");
+}
+
+// freetracking - Stops tracking blocks, and frees the heap map, the block
+//   index and the call stacks. Blocks freed afterwards are ignored.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::freeTracking ()
+{
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap != NULL) {
+        for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+            BlockMap *blockmap = &(*heapit).second->blockMap;
+            for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
+                delete (*blockit).second;
+            }
+            delete (*heapit).second;
+        }
+    }
+    delete m_heapMap;
+    m_heapMap = NULL;
+    delete m_blockIndex;
+    m_blockIndex = NULL;
+    m_stackTable.clear();
+}
+
+// getleakdata - Determines whether a mapped block counts as a leak, and
+//   obtains the address and size of its user data. The backends override it
+//   to leave out the blocks which their runtime frees after VLD is destroyed.
+//
+//  - block (IN): Pointer to the mapped block.
+//
+//  - info (IN): The block's information.
+//
+//  - address (OUT): Receives the address of the block's user data.
+//
+//  - size (OUT): Receives the size, in bytes, of the block's user data.
+//
+//  Return Value:
+//
+//    Returns true if the block counts as a leak.
+//
+bool BlockTracker::getLeakData (LPCVOID block, blockinfo_t *info, LPCVOID &address, SIZE_T &size)
+{
+    address = block;
+    size = info->size;
+    return true;
+}
+
+// reportmismatchedfree - Called when a block is freed to a heap which it
+//   wasn't allocated from, and VLD_OPT_VALIDATE_HEAPFREE is set. Nothing is
+//   reported by default: only the Windows backend tracks several heaps.
+//   Called while holding g_heapMapLock.
+//
+//  - heap (IN): Handle to the heap to which the block is being freed.
+//
+//  - mem (IN): Pointer to the memory block being freed.
+//
+//  - context (IN): Context at which the free entered VLD's code.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::reportMismatchedFree (HANDLE heap, LPCVOID mem, const context_t &context)
+{
+    UNREFERENCED_PARAMETER(heap);
+    UNREFERENCED_PARAMETER(mem);
+    UNREFERENCED_PARAMETER(context);
+}
+
+// nextsampleinterval - Chooses the number of bytes a thread may allocate
+//   before its next allocation is sampled. The intervals are drawn from an
+//   exponential distribution with a mean of m_sampleRate bytes, so that every
+//   allocated byte is equally likely to trigger a sample.
+//
+//  - random (IN/OUT): State of the calling thread's random number generator.
+//      Must not be 0.
+//
+//  Return Value:
+//
+//    Returns the number of bytes until the next sample, at least 1.
+//
+LONG64 BlockTracker::nextSampleInterval (UINT32 &random) const
+{
+    // Xorshift: cheap, and good enough for choosing intervals.
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+
+    // Uniform in (0, 1], using the top 24 bits.
+    double uniform = ((double)(random >> 8) + 1.0) / 16777216.0;
+    return (LONG64)(-log(uniform) * (double)m_sampleRate) + 1;
+}
+
+// sampleweight - Obtains the number of allocations that a sampled block stands
+//   for. A block of "size" bytes is sampled with probability
+//   1 - exp(-size / m_sampleRate), so weighting it by the inverse of that
+//   probability gives unbiased estimates of leak counts and sizes.
+//
+//  - size (IN): Size, in bytes, of the sampled block.
+//
+//  Return Value:
+//
+//    Returns the block's weight, which is 1 if sampling is disabled.
+//
+double BlockTracker::sampleWeight (SIZE_T size) const
+{
+    if ((m_sampleRate == 0) || (size == 0))
+        return 1.0;
+    double probability = 1.0 - exp(-(double)size / (double)m_sampleRate);
+    return (probability > 0.0) ? 1.0 / probability : (double)m_sampleRate / (double)size;
+}
+
+// isblockmapped - Determines whether a block is being tracked. Looks the
+//   block up in the block index without taking any lock, and only falls back
+//   to searching the heap map if some blocks could not be indexed.
+//
+//  - heap (IN): Handle to the heap to which the block belongs.
+//
+//  - mem (IN): Pointer to the memory block.
+//
+//  Return Value:
+//
+//    Returns true if the block is mapped.
+//
+bool BlockTracker::isBlockMapped (HANDLE heap, LPCVOID mem)
+{
+    if ((m_blockIndex != NULL) && (m_blockIndex->find(mem) != NULL))
+        return true;
+    if (m_unindexedBlocks == 0)
+        return false;
+
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap == NULL)
+        return false;
+    HeapMap::Iterator heapit = m_heapMap->find(heap);
+    if (heapit == m_heapMap->end())
+        return false;
+    BlockMap *blockmap = &(*heapit).second->blockMap;
+    return (blockmap->find(mem) != blockmap->end());
+}
+
+// mapblock - Tracks memory allocations. Information about allocated blocks is
+//   collected and then the block is mapped to this information.
+//
+//  - heap (IN): Handle to the heap from which the block has been allocated.
+//
+//  - mem (IN): Pointer to the memory block being allocated.
+//
+//  - size (IN): Size, in bytes, of the memory block being allocated.
+//
+//  - debugcrtalloc (IN): Should be set to true if this allocation is a debug
+//      CRT memory block. Otherwise should be false.
+//
+//  - ucrt (IN): Should be set to true if the debug CRT header is in the UCRT
+//      format.
+//
+//  - threadId (IN): ID of the allocating thread.
+//
+//  - pblockInfo (OUT): Receives the block's information. It is left unchanged
+//      if VLD isn't tracking blocks (anymore).
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::mapBlock (HANDLE heap, LPCVOID mem, SIZE_T size, bool debugcrtalloc, bool ucrt, DWORD threadId, blockinfo_t* &pblockInfo)
+{
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap == NULL)
+        return;
+
+    // Record the block's information.
+    blockinfo_t* blockinfo = new blockinfo_t();
+    blockinfo->callStack = NULL;
+    pblockInfo = blockinfo;
+    blockinfo->threadId = threadId;
+    blockinfo->serialNumber = m_requestCurr++;
+    blockinfo->size = size;
+    blockinfo->reported = false;
+    blockinfo->debugCrtAlloc = debugcrtalloc;
+    blockinfo->ucrt = ucrt;
+    blockinfo->dbRecord = m_blockDb.addBlock(heap, mem, size, blockinfo->serialNumber, threadId);
+
+    m_stats.allocated(size);
+
+    // Insert the block's information into the block map.
+    HeapMap::Iterator heapit = m_heapMap->find(heap);
+    if (heapit == m_heapMap->end()) {
+        // We haven't mapped this heap to a block map yet. Do it now.
+        mapHeap(heap);
+        heapit = m_heapMap->find(heap);
+        assert(heapit != m_heapMap->end());
+    }
+    BlockMap* blockmap = &(*heapit).second->blockMap;
+    BlockMap::Iterator blockit = blockmap->insert(mem, blockinfo);
+    if (blockit == blockmap->end()) {
+        // A block with this address has already been allocated. The
+        // previously allocated block must have been freed (probably by some
+        // mechanism unknown to VLD), or the heap wouldn't have allocated it
+        // again. Replace the previously allocated info with the new info.
+        blockit = blockmap->find(mem);
+        blockinfo_t* info = (*blockit).second;
+        m_stats.freed(info->size);
+        Report(L"VLD: New allocation at already allocated address: 0x%p with size: %zu and new size: %zu\n", mem, info->size, size);
+        untrackSiteBytes(info);
+        unindexBlock(mem, info);
+        m_blockDb.removeBlock(info->dbRecord);
+        delete info;
+        blockmap->erase(blockit);
+        blockmap->insert(mem, blockinfo);
+    }
+    indexBlock(mem, blockinfo);
+}
+
+// mapheap - Tracks heap creation. Creates a block map for tracking individual
+//   allocations from the newly created heap and then maps the heap to this
+//   block map.
+//
+//  - heap (IN): Handle to the newly created heap.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::mapHeap (HANDLE heap)
+{
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap == NULL)
+        return;
+
+    // Create a new block map for this heap and insert it into the heap map.
+    heapinfo_t* heapinfo = new heapinfo_t;
+    heapinfo->blockMap.reserve(BLOCK_MAP_RESERVE);
+    heapinfo->flags = 0x0;
+
+    HeapMap::Iterator heapit = m_heapMap->insert(heap, heapinfo);
+    if (heapit == m_heapMap->end()) {
+        // Somehow this heap has been created twice without being destroyed,
+        // or at least it was destroyed without VLD's knowledge. Unmap the heap
+        // from the existing heapinfo, and remap it to the new one.
+        Report(L"WARNING: Visual Leak Detector detected a duplicate heap (" ADDRESSFORMAT L").\n", (UINT_PTR)heap);
+        heapit = m_heapMap->find(heap);
+        unmapHeap((*heapit).first);
+        m_heapMap->insert(heap, heapinfo);
+    }
+}
+
+// unmapblock - Tracks memory blocks that are freed. Unmaps the specified block
+//   from the block's information, relinquishing internally allocated resources.
+//
+//  - heap (IN): Handle to the heap to which this block is being freed.
+//
+//  - mem (IN): Pointer to the memory block being freed.
+//
+//  - context (IN): Context at which the free entered VLD's code, for
+//      reporting blocks freed to the wrong heap.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::unmapBlock (HANDLE heap, LPCVOID mem, const context_t &context)
+{
+    if (NULL == mem)
+        return;
+
+    // Find this heap's block map.
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap == NULL)
+        return;
+    if ((m_unindexedBlocks == 0) && (m_blockIndex->find(mem) == NULL) &&
+        !(m_options & VLD_OPT_VALIDATE_HEAPFREE)) {
+        // Every mapped block is in the index, so this block was never mapped.
+        // There is no need to search the heap map.
+        return;
+    }
+    HeapMap::Iterator heapit = m_heapMap->find(heap);
+    if (heapit == m_heapMap->end()) {
+        // We don't have a block map for this heap. We must not have monitored
+        // this allocation (probably happened before VLD was initialized).
+        return;
+    }
+
+    // Find this block in the block map.
+    BlockMap           *blockmap = &(*heapit).second->blockMap;
+    BlockMap::Iterator  blockit = blockmap->find(mem);
+    if (blockit == blockmap->end())
+    {
+        // This memory block is not in the block map. We must not have monitored this
+        // allocation (probably happened before VLD was initialized).
+
+        // This can also result from allocating on one heap, and freeing on another heap.
+        // This is an especially bad way to corrupt the application.
+        if (m_options & VLD_OPT_VALIDATE_HEAPFREE)
+            reportMismatchedFree(heap, mem, context);
+        return;
+    }
+
+    // Free the blockinfo_t structure and erase it from the block map.
+    blockinfo_t *info = (*blockit).second;
+    m_stats.freed(info->size);
+    untrackSiteBytes(info);
+    unindexBlock(mem, info);
+    m_blockDb.removeBlock(info->dbRecord);
+    delete info;
+    blockmap->erase(blockit);
+}
+
+// unmapheap - Tracks heap destruction. Unmaps the specified heap from its block
+//   map. The block map is cleared and deleted, relinquishing internally
+//   allocated resources.
+//
+//  - heap (IN): Handle to the heap which is being destroyed.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::unmapHeap (HANDLE heap)
+{
+    // Find this heap's block map.
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap == NULL)
+        return;
+    HeapMap::Iterator heapit = m_heapMap->find(heap);
+    if (heapit == m_heapMap->end()) {
+        // This heap hasn't been mapped. We must not have monitored this heap's
+        // creation (probably happened before VLD was initialized).
+        return;
+    }
+
+    // Free all of the blockinfo_t structures stored in the block map.
+    heapinfo_t *heapinfo = (*heapit).second;
+    BlockMap   *blockmap = &heapinfo->blockMap;
+    for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
+        m_stats.freed((*blockit).second->size);
+        untrackSiteBytes((*blockit).second);
+        unindexBlock((*blockit).first, (*blockit).second);
+        m_blockDb.removeBlock((*blockit).second->dbRecord);
+        delete (*blockit).second;
+    }
+    delete heapinfo;
+
+    // Remove this heap's block map from the heap map.
+    m_heapMap->erase(heapit);
+}
+
+// indexblock - Adds a newly mapped block to the block index. Blocks whose
+//   address can't be stored in the index are counted instead, so that lookups
+//   know when they must fall back to searching the heap map. Must be called
+//   while holding g_heapMapLock.
+//
+//  - mem (IN): Pointer to the memory block that was mapped.
+//
+//  - info (IN): The block's information, as stored in its heap's block map.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::indexBlock (LPCVOID mem, blockinfo_t* info)
+{
+    if (!BlockIndex::isMappable(mem)) {
+        InterlockedIncrement(&m_unindexedBlocks);
+        return;
+    }
+    if (!m_blockIndex->insert(mem, info)) {
+        // The address is still indexed for a block on another heap, which
+        // must have been freed without VLD's knowledge. The newest block wins.
+        m_blockIndex->erase(mem);
+        m_blockIndex->insert(mem, info);
+    }
+}
+
+// unindexblock - Removes a block from the block index. The index entry is
+//   only removed if it still refers to the same block information. Must be
+//   called while holding g_heapMapLock.
+//
+//  - mem (IN): Pointer to the memory block that is being unmapped.
+//
+//  - info (IN): The block's information, as stored in its heap's block map.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::unindexBlock (LPCVOID mem, blockinfo_t* info)
+{
+    if (!BlockIndex::isMappable(mem)) {
+        assert(m_unindexedBlocks > 0);
+        InterlockedDecrement(&m_unindexedBlocks);
+        return;
+    }
+    if (m_blockIndex->find(mem) == info)
+        m_blockIndex->erase(mem);
+}
+
+// remapblock - Tracks reallocations. Unmaps a block from its previously
+//   collected information and remaps it to updated information.
+//
+//  Note: If the block itself remains at the same address, then the block's
+//   information can simply be updated rather than having to actually erase and
+//   reinsert the block.
+//
+//  - heap (IN): Handle to the heap from which the memory is being reallocated.
+//
+//  - mem (IN): Pointer to the memory block being reallocated.
+//
+//  - newmem (IN): Pointer to the memory block being returned to the caller
+//      that requested the reallocation. This pointer may or may not be the same
+//      as the original memory block (as pointed to by "mem").
+//
+//  - size (IN): Size, in bytes, of the new memory block.
+//
+//  - debugcrtalloc (IN): Should be set to true if this reallocation is for a
+//      debug CRT memory block. Otherwise should be set to false.
+//
+//  - ucrt (IN): Should be set to true if the debug CRT header is in the UCRT
+//      format.
+//
+//  - threadId (IN): ID of the reallocating thread.
+//
+//  - pblockInfo (OUT): Receives the block's information. It is left unchanged
+//      if VLD isn't tracking blocks (anymore).
+//
+//  - context (IN): Context at which the reallocation entered VLD's code.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::remapBlock (HANDLE heap, LPCVOID mem, LPCVOID newmem, SIZE_T size,
+    bool debugcrtalloc, bool ucrt, DWORD threadId, blockinfo_t* &pblockInfo, const context_t &context)
+{
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap == NULL)
+        return;
+
+    if (newmem != mem) {
+        // The block was not reallocated in-place. Instead the old block was
+        // freed and a new block allocated to satisfy the new size.
+        unmapBlock(heap, mem, context);
+        mapBlock(heap, newmem, size, debugcrtalloc, ucrt, threadId, pblockInfo);
+        return;
+    }
+
+    // The block was reallocated in-place. Find the existing blockinfo_t
+    // entry in the block map and update it with the new callstack and size.
+    HeapMap::Iterator heapit = m_heapMap->find(heap);
+    if (heapit == m_heapMap->end()) {
+        // We haven't mapped this heap to a block map yet. Obviously the
+        // block has also not been mapped to a blockinfo_t entry yet either,
+        // so treat this reallocation as a brand-new allocation (this will
+        // also map the heap to a new block map).
+        mapBlock(heap, newmem, size, debugcrtalloc, ucrt, threadId, pblockInfo);
+        return;
+    }
+
+    // Find the block's blockinfo_t structure so that we can update it.
+    BlockMap           *blockmap = &(*heapit).second->blockMap;
+    BlockMap::Iterator  blockit = blockmap->find(mem);
+    if (blockit == blockmap->end()) {
+        // The block hasn't been mapped to a blockinfo_t entry yet.
+        // Treat this reallocation as a new allocation.
+        mapBlock(heap, newmem, size, debugcrtalloc, ucrt, threadId, pblockInfo);
+        return;
+    }
+
+    // Found the blockinfo_t entry for this block. Update it with
+    // a new callstack and new size.
+    blockinfo_t* info = (*blockit).second;
+    untrackSiteBytes(info);
+    info->callStack = NULL;
+
+    m_stats.resized(info->size, size);
+
+    info->threadId = threadId;
+    // Update the block's size.
+    info->size = size;
+    m_blockDb.resizeBlock(info->dbRecord, size, threadId);
+    pblockInfo = info;
+}
+
+// attachstack - Attaches the call stack captured for a newly mapped, or
+//   remapped, block to it. The stack is captured without holding
+//   g_heapMapLock, once the block has been mapped.
+//
+//  - info (IN): The block's information, as obtained from mapBlock or
+//      remapBlock.
+//
+//  - callstack (IN): The block's interned call stack.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::attachStack (blockinfo_t *info, CallStack *callstack)
+{
+    info->callStack = callstack;
+    m_blockDb.setStack(info->dbRecord, callstack);
+    if (tracksSites() && (callstack != NULL))
+        callstack->addLiveBlock(info->size);
+}
+
+// capturestack - Determines whether a call stack is captured for a newly
+//   allocated block. Blocks outside the tracked size range never get a stack.
+//   Other blocks always do, unless counting-only mode
+//   (VLD_OPT_NO_STACK_CAPTURE) is on, in which case only the blocks that match
+//   the filter set with SetCaptureFilter get a stack.
+//
+//  - size (IN): Size, in bytes, requested by the allocation of the block.
+//
+//  - threadId (IN): ID of the thread that allocated the block.
+//
+//  Return Value:
+//
+//    Returns true if a call stack must be captured.
+//
+bool BlockTracker::captureStack (SIZE_T size, DWORD threadId) const
+{
+    if (!isTrackedSize(size))
+        return false;
+    if (!(m_options & VLD_OPT_NO_STACK_CAPTURE))
+        return true;
+    return (size >= m_captureMinSize) && (size <= m_captureMaxSize) &&
+        ((m_captureThreadId == 0) || (m_captureThreadId == threadId));
+}
+
+VOID BlockTracker::SetCaptureFilter (SIZE_T minSize, SIZE_T maxSize, DWORD threadId)
+{
+    if (m_options & VLD_OPT_VLDOFF) {
+        // VLD has been turned off.
+        return;
+    }
+
+    CriticalSectionLocker<> cs(m_optionsLock);
+    m_captureMinSize = minSize;
+    m_captureMaxSize = maxSize;
+    m_captureThreadId = threadId;
+}
+
+VOID BlockTracker::SetTrackedSizeRange (SIZE_T minSize, SIZE_T maxSize, BOOL mapOthers)
+{
+    if (m_options & VLD_OPT_VLDOFF) {
+        // VLD has been turned off.
+        return;
+    }
+
+    CriticalSectionLocker<> cs(m_optionsLock);
+    m_minTrackedSize = minSize;
+    m_maxTrackedSize = (maxSize != 0) ? maxSize : (SIZE_T)-1;
+    m_mapUntrackedSizes = (mapOthers != FALSE);
+}
+
+// eraseduplicates - Erases, from the block maps, blocks that appear to be
+//   duplicate leaks of an already identified leak.
+//
+//  - element (IN): BlockMap Iterator referencing the block of which to search
+//      for duplicates.
+//
+//  Return Value:
+//
+//    Returns the number of duplicate blocks erased from the block map.
+//
+SIZE_T BlockTracker::eraseDuplicates (const BlockMap::Iterator &element, Set<blockinfo_t*> &aggregatedLeaks)
+{
+    blockinfo_t *elementinfo = (*element).second;
+
+    if (elementinfo->callStack == NULL)
+        return 0;
+
+    SIZE_T       erased = 0;
+    // Iterate through all block maps, looking for blocks with the same size
+    // and callstack as the specified element.
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        BlockMap *blockmap = &(*heapit).second->blockMap;
+        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
+            if (blockit == element) {
+                // Don't delete the element of which we are searching for
+                // duplicates.
+                continue;
+            }
+            blockinfo_t *info = (*blockit).second;
+            if (info->callStack == NULL)
+                continue;
+            Set<blockinfo_t*>::Iterator it = aggregatedLeaks.find(info);
+            if (it != aggregatedLeaks.end())
+                continue;
+            if ((info->size == elementinfo->size) && (*(info->callStack) == *(elementinfo->callStack))) {
+                // Found a duplicate. Mark it.
+                aggregatedLeaks.insert(info);
+                erased++;
+            }
+        }
+    }
+
+    return erased;
+}
+
+VOID BlockTracker::markAllLeaksAsReported (heapinfo_t* heapinfo, DWORD threadId)
+{
+    BlockMap* blockmap   = &heapinfo->blockMap;
+
+    for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
+    {
+        blockinfo_t* info = (*blockit).second;
+        if (threadId == ((DWORD)-1) || info->threadId == threadId)
+            info->reported = true;
+    }
+}
+
+// FindAllocedBlock - Find if a particular memory allocation is tracked inside of VLD.
+//     This is a really good example of how to iterate through the data structures
+//     that represent heaps and their associated memory blocks.
+// Pre Condition: Be VERY sure that this is only called within a block that already has
+// acquired a critical section for m_maplock.
+//
+// mem - The particular memory address to search for.
+//
+//  Return Value:
+//   If mem is found, it will return the blockinfo_t pointer, otherwise NULL
+//
+blockinfo_t* BlockTracker::findAllocedBlock(LPCVOID mem, HANDLE& heap)
+{
+    heap = NULL;
+    blockinfo_t* result = NULL;
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    // Look the block up in the index, then find the heap which owns it.
+    blockinfo_t* indexed = m_blockIndex->find(mem);
+    if (indexed != NULL) {
+        for (HeapMap::Iterator it = m_heapMap->begin(); it != m_heapMap->end(); ++it) {
+            BlockMap::Iterator blockit = (*it).second->blockMap.find(mem);
+            if ((blockit != (*it).second->blockMap.end()) && ((*blockit).second == indexed)) {
+                heap = (*it).first;
+                return indexed;
+            }
+        }
+    }
+    if (m_unindexedBlocks == 0)
+        return NULL;
+
+    // Iterate through all heaps
+    for (HeapMap::Iterator it = m_heapMap->begin();
+        it != m_heapMap->end();
+        ++it)
+    {
+        HANDLE heap_handle  = (*it).first;
+        UNREFERENCED_PARAMETER(heap_handle);
+        heapinfo_t* heapPtr = (*it).second;
+
+        // Iterate through all memory blocks in each heap
+        BlockMap& p_block_map = heapPtr->blockMap;
+        for (BlockMap::Iterator iter = p_block_map.begin();
+            iter != p_block_map.end();
+            ++iter)
+        {
+            if ((*iter).first == mem)
+            {
+                // Found the block.
+                blockinfo_t* alloc_block = (*iter).second;
+                heap = heap_handle;
+                result = alloc_block;
+                break;
+            }
+        }
+
+        if (result)
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+// estimateleaks - Estimates the number and total size of the leaks in the
+//   process, when only sampled allocations are tracked. Each unreported leak
+//   is weighted by the number of allocations it stands for.
+//
+//  - count (OUT): Receives the estimated number of leaks.
+//
+//  - bytes (OUT): Receives the estimated number of leaked bytes.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::estimateLeaks (double &count, double &bytes)
+{
+    count = 0.0;
+    bytes = 0.0;
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        BlockMap *blockmap = &(*heapit).second->blockMap;
+        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
+            blockinfo_t *info = (*blockit).second;
+            if (info->reported)
+                continue;
+
+            LPCVOID address;
+            SIZE_T size;
+            if (!getLeakData((*blockit).first, info, address, size))
+                continue;
+
+            double weight = sampleWeight(info->size);
+            count += weight;
+            bytes += weight * size;
+        }
+    }
+}
+
+// Orders serial numbers.
+int __cdecl BlockTracker::compareSerialNumbers (const void *first, const void *second)
+{
+    SIZE_T a = *(const SIZE_T*)first;
+    SIZE_T b = *(const SIZE_T*)second;
+    return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+// Orders live blocks by call stack.
+int __cdecl BlockTracker::compareBlockCallStacks (const void *first, const void *second)
+{
+    UINT_PTR a = (UINT_PTR)((const liveblock_t*)first)->callStack;
+    UINT_PTR b = (UINT_PTR)((const liveblock_t*)second)->callStack;
+    return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+// Orders the blocks found by a snapshot diff by call stack, then by serial
+// number.
+int __cdecl BlockTracker::compareDiffBlocks (const void *first, const void *second)
+{
+    const diffblock_t *a = (const diffblock_t*)first;
+    const diffblock_t *b = (const diffblock_t*)second;
+    if (a->callStack != b->callStack)
+        return ((UINT_PTR)a->callStack < (UINT_PTR)b->callStack) ? -1 : 1;
+    return compareSerialNumbers(&a->block.serialNumber, &b->block.serialNumber);
+}
+
+// Orders heap sites by call stack.
+int __cdecl BlockTracker::compareSiteCallStacks (const void *first, const void *second)
+{
+    UINT_PTR a = (UINT_PTR)((const heapsite_t*)first)->callStack;
+    UINT_PTR b = (UINT_PTR)((const heapsite_t*)second)->callStack;
+    return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+// Orders heap sites by decreasing bytes, then by decreasing number of blocks.
+int __cdecl BlockTracker::compareSiteBytes (const void *first, const void *second)
+{
+    const heapsite_t *a = (const heapsite_t*)first;
+    const heapsite_t *b = (const heapsite_t*)second;
+    if (a->bytes != b->bytes)
+        return (a->bytes > b->bytes) ? -1 : 1;
+    if (a->count != b->count)
+        return (a->count > b->count) ? -1 : 1;
+    return compareSiteCallStacks(a, b);
+}
+
+// copyliveblocks - Copies the call stack and size of all of the tracked
+//   blocks which are currently allocated, in a single pass under the heap map
+//   lock. Blocks which don't count as leaks (see getLeakData) are left out.
+//
+//  - count (OUT): Receives the number of blocks copied.
+//
+//  - watermark (OUT): Receives the serial number of the next block to be
+//      allocated.
+//
+//  Return Value:
+//
+//    Returns the blocks, in no particular order, or NULL if there are none.
+//    The caller must delete the array.
+//
+liveblock_t* BlockTracker::copyLiveBlocks (SIZE_T &count, SIZE_T &watermark)
+{
+    count = 0;
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    watermark = m_requestCurr;
+    if (m_heapMap == NULL)
+        return NULL;
+
+    SIZE_T capacity = 0;
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        BlockMap *blockmap = &(*heapit).second->blockMap;
+        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
+            capacity++;
+    }
+    liveblock_t *blocks = NULL;
+    if (capacity != 0)
+        blocks = new liveblock_t [capacity];
+
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        BlockMap *blockmap = &(*heapit).second->blockMap;
+        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
+            blockinfo_t *info  = (*blockit).second;
+            LPCVOID      address;
+            SIZE_T       size;
+            if (!getLeakData((*blockit).first, info, address, size))
+                continue;
+            liveblock_t &entry = blocks[count++];
+            entry.callStack = info->callStack;
+            entry.size      = size;
+        }
+    }
+    return blocks;
+}
+
+// copyserialnumbers - Copies the serial numbers of all of the tracked blocks
+//   which are currently allocated, in a single pass under the heap map lock.
+//   Nothing else is copied: the details of a block are only looked up if a
+//   snapshot diff finds it (see findBlocks).
+//
+//  - count (OUT): Receives the number of serial numbers copied.
+//
+//  - watermark (OUT): Receives the serial number of the next block to be
+//      allocated.
+//
+//  Return Value:
+//
+//    Returns the serial numbers, in no particular order, or NULL if there are
+//    none. The caller must delete the array.
+//
+SIZE_T* BlockTracker::copySerialNumbers (SIZE_T &count, SIZE_T &watermark)
+{
+    count = 0;
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    watermark = m_requestCurr;
+    if (m_heapMap == NULL)
+        return NULL;
+
+    SIZE_T capacity = 0;
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        BlockMap *blockmap = &(*heapit).second->blockMap;
+        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
+            capacity++;
+    }
+    SIZE_T *serialNumbers = NULL;
+    if (capacity != 0)
+        serialNumbers = new SIZE_T [capacity];
+
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        BlockMap *blockmap = &(*heapit).second->blockMap;
+        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
+            serialNumbers[count++] = (*blockit).second->serialNumber;
+    }
+    return serialNumbers;
+}
+
+// findblocks - Looks up the tracked blocks which have the given serial
+//   numbers, in a single pass under the heap map lock. Blocks which have been
+//   freed since, and blocks which don't count as leaks (see getLeakData), are
+//   left out.
+//
+//  - serialNumbers (IN): The serial numbers, sorted.
+//
+//  - count (IN): Number of serial numbers.
+//
+//  - blocks (OUT): Receives the blocks found, in no particular order. Must
+//      have room for count blocks.
+//
+//  Return Value:
+//
+//    Returns the number of blocks found.
+//
+SIZE_T BlockTracker::findBlocks (const SIZE_T *serialNumbers, SIZE_T count, diffblock_t *blocks)
+{
+    if (count == 0)
+        return 0;
+
+    SIZE_T found = 0;
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap == NULL)
+        return 0;
+
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        BlockMap *blockmap = &(*heapit).second->blockMap;
+        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
+            blockinfo_t *info = (*blockit).second;
+            if ((info->serialNumber < serialNumbers[0]) || (info->serialNumber > serialNumbers[count - 1]))
+                continue;
+            if (bsearch(&info->serialNumber, serialNumbers, count, sizeof(SIZE_T), compareSerialNumbers) == NULL)
+                continue;
+            LPCVOID address;
+            SIZE_T  size;
+            if (!getLeakData((*blockit).first, info, address, size))
+                continue;
+            diffblock_t &entry = blocks[found++];
+            entry.callStack          = info->callStack;
+            entry.block.serialNumber = info->serialNumber;
+            entry.block.address      = address;
+            entry.block.size         = size;
+            entry.block.threadId     = info->threadId;
+        }
+    }
+    return found;
+}
+
+VLD_SNAPSHOT BlockTracker::TakeSnapshot ()
+{
+    if (m_options & VLD_OPT_VLDOFF)
+        return NULL;
+
+    VLD_SNAPSHOT snapshot = new _VLD_SNAPSHOT;
+    snapshot->serialNumbers = copySerialNumbers(snapshot->count, snapshot->watermark);
+
+    // The block maps are ordered by address. Sort by serial number without
+    // holding the lock.
+    qsort(snapshot->serialNumbers, snapshot->count, sizeof(SIZE_T), compareSerialNumbers);
+    return snapshot;
+}
+
+VOID BlockTracker::FreeSnapshot (VLD_SNAPSHOT snapshot)
+{
+    if (snapshot == NULL)
+        return;
+    delete [] snapshot->serialNumbers;
+    delete snapshot;
+}
+
+// takepeaksnapshot - Records the largest allocation sites, once the bytes in
+//   use have grown by PeakSnapshotHysteresis bytes since the last snapshot.
+//   Snapshots are taken at most once every PeakSnapshotInterval milliseconds.
+//   The interval is checked, and the snapshot claimed, with a compare-exchange
+//   on the time of the last snapshot, so the allocations which come too soon
+//   or race with a snapshot don't wait for the lock. The sites are read from
+//   the per-stack counters of the stack table, so the blocks aren't walked.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID BlockTracker::takePeakSnapshot ()
+{
+    LONG64 claimed = m_peak.claimed;
+    ULONGLONG now = GetTickCount64();
+    if ((claimed != 0) && (now - (ULONGLONG)claimed < m_peakInterval)) {
+        // Too soon. The next allocation will check again.
+        return;
+    }
+    if ((m_stats.current() < m_peak.trigger) ||
+        (InterlockedCompareExchange64(&m_peak.claimed, (LONG64)now, claimed) != claimed)) {
+        // Another thread took the snapshot first, or is taking it.
+        return;
+    }
+
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (m_heapMap == NULL)
+        return;
+
+    // The blocks without a call stack are grouped in a site of their own: the
+    // bytes and blocks in use which none of the call stacks accounts for.
+    heapsite_t sites [PEAKSNAPSHOT_SITES + 1];
+    SIZE_T sitebytes, siteblocks;
+    SIZE_T siteCount = m_stackTable.findLargestSites(sites, PEAKSNAPSHOT_SITES, sitebytes, siteblocks);
+    VLD_STATISTICS stats;
+    m_stats.get(&stats);
+    if ((stats.currentBlocks > siteblocks) && (stats.currentBytes >= sitebytes)) {
+        heapsite_t &site = sites[siteCount++];
+        site.callStack = NULL;
+        site.bytes = stats.currentBytes - sitebytes;
+        site.count = stats.currentBlocks - siteblocks;
+        qsort(sites, siteCount, sizeof(heapsite_t), compareSiteBytes);
+    }
+
+    m_peak.siteCount = (siteCount < PEAKSNAPSHOT_SITES) ? siteCount : PEAKSNAPSHOT_SITES;
+    memcpy(m_peak.sites, sites, m_peak.siteCount * sizeof(heapsite_t));
+    m_peak.bytes = stats.currentBytes;
+    m_peak.blocks = stats.currentBlocks;
+    m_peak.time = now;
+    InterlockedExchange64(&m_peak.trigger, (LONG64)stats.currentBytes + (LONG64)m_peakHysteresis);
+}
@@ -0,0 +1,288 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - BlockTracker Class Definition
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+    "This header should only be included by Visual Leak Detector when building it from source. \
+    Applications should never include this header."
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "linux/platform.h"
+#endif
+#include "vld_def.h"
+#include "blockdb.h"    // Provides the crash-surviving block database.
+#include "callstack.h"  // Provides a custom class for handling call stacks.
+#include "criticalsection.h"
+#include "map.h"        // Provides a custom STL-like map template.
+#include "pagemap.h"    // Provides a radix page map for address lookups.
+#include "set.h"        // Provides a custom STL-like set template.
+#include "statistics.h" // Provides sharded allocation statistics.
+
+// Data is collected for every block allocated from any heap in the process.
+// The data is stored in this structure and these structures are stored in
+// a BlockMap which maps each of these structures to its corresponding memory
+// block. One is kept for every tracked block, so the layout is kept compact:
+// the pointer-sized members come first and the flags are packed into the
+// padding after the thread ID (40 bytes on 64-bit platforms, 24 bytes on x86).
+struct blockinfo_t {
+    CallStack *callStack;                     // Call stack at allocation time. Owned by the StackTable.
+    SIZE_T     serialNumber;                  // Allocation request number.
+    SIZE_T     size;                          // Size of the block, in bytes.
+    SIZE_T     dbRecord;                      // Offset of the block's record in the block database, or 0.
+    DWORD      threadId;                      // ID of the allocating thread.
+    bool       reported      : 1;             // The block has been reported as a leak.
+    bool       debugCrtAlloc : 1;             // The block carries a debug CRT header.
+    bool       ucrt          : 1;             // The debug CRT header is in the UCRT format.
+};
+typedef char checkBlockInfoSize[
+    (sizeof(blockinfo_t) == 4 * sizeof(SIZE_T) + 2 * sizeof(DWORD)) ? 1 : -1];
+
+// BlockMaps map memory blocks (via their addresses) to blockinfo_t structures.
+typedef Map<LPCVOID, blockinfo_t*> BlockMap;
+
+// Information about each heap in the process is kept in this map. Primarily
+// this is used for mapping heaps to all of the blocks allocated from those
+// heaps.
+struct heapinfo_t {
+    BlockMap blockMap;   // Map of all blocks allocated from this heap.
+    UINT32   flags;      // Heap status flags
+};
+
+// HeapMaps map heaps (via their handles) to BlockMaps.
+typedef Map<HANDLE, heapinfo_t*> HeapMap;
+
+// The BlockIndex maps the address of every block, regardless of its heap, to
+// the same blockinfo_t structure that is stored in the heap's BlockMap. It
+// gives constant-time lookups by address, and lookups of interior pointers.
+typedef PageMap<blockinfo_t*> BlockIndex;
+
+// A tracked block, as copied for a heap profile.
+struct liveblock_t {
+    CallStack *callStack;     // Interned call stack, or NULL if none was captured.
+    SIZE_T     size;          // Size of the block's user data, in bytes.
+};
+
+// A block found by VLDDiffSnapshots. Its details are looked up when the
+// snapshots are compared.
+struct diffblock_t {
+    CallStack          *callStack; // Interned call stack, or NULL if none was captured.
+    VLD_SNAPSHOT_BLOCK  block;     // The details passed to the callback.
+};
+
+// The largest allocation sites when memory use last reached a new peak (see
+// the PeakSnapshotHysteresis option).
+#define PEAKSNAPSHOT_SITES 16
+struct peaksnapshot_t {
+    LONG64 volatile trigger;  // Bytes in use at which the next snapshot is taken.
+    LONG64 volatile claimed;  // System uptime, in milliseconds, when the last snapshot was claimed (see
+                              // takePeakSnapshot). 0 if none was.
+    SIZE_T      bytes;        // Bytes in use when the snapshot was taken.
+    SIZE_T      blocks;       // Blocks in use when the snapshot was taken.
+    ULONGLONG   time;         // System uptime, in milliseconds, when the snapshot was taken. 0 if none was.
+    SIZE_T      siteCount;    // Number of sites.
+    heapsite_t  sites [PEAKSNAPSHOT_SITES]; // The largest sites, by bytes.
+};
+
+// Heap snapshots, as returned by VLDTakeSnapshot. Only the serial numbers of
+// the blocks are recorded, sorted, so that two snapshots can be compared with
+// a linear merge.
+struct _VLD_SNAPSHOT {
+    SIZE_T  watermark;     // Serial number of the first block allocated after the snapshot.
+    SIZE_T  count;         // Number of blocks in the snapshot.
+    SIZE_T *serialNumbers; // Serial numbers of the blocks which were alive.
+};
+
+// Number and total size of a group of leaks.
+struct leakcount_t {
+    SIZE_T count;
+    SIZE_T bytes;
+};
+
+// The lock which serializes access to the heap and block maps. It is
+// recursive: the report functions call back into the tracker while they hold
+// it.
+extern CriticalSection g_heapMapLock;
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// The BlockTracker Class
+//
+//   The platform-neutral part of the VisualLeakDetector class: the heap and
+//   block maps, the block index, the statistics, the sampling and size
+//   filters, the heap snapshots, the peak snapshots and the block database.
+//   Both backends (vld.cpp on Windows, linux/vld.cpp on Linux) derive from it
+//   and call it from their allocator hooks, so that every feature of the
+//   tracking core works the same way on both.
+//
+//   The bookkeeping (blocktracker.cpp) doesn't depend on the symbol handler,
+//   so the core's tests and the trace replay tool link it alone. The report
+//   functions, which resolve and dump call stacks, are in blockreport.cpp.
+//
+//   The little which differs between the platforms goes through the two
+//   virtual functions: whether a block counts as a leak (the CRT headers on
+//   Windows, the C library's own blocks on Linux), and what to report when a
+//   block is freed to the wrong heap.
+//
+class BlockTracker
+{
+public:
+    ////////////////////////////////////////////////////////////////////////////////
+    // Block tracking, called by the allocator hooks.
+    ////////////////////////////////////////////////////////////////////////////////
+    VOID   mapBlock (HANDLE heap, LPCVOID mem, SIZE_T size, bool debugcrtalloc, bool ucrt, DWORD threadId, blockinfo_t* &pblockInfo);
+    VOID   mapHeap (HANDLE heap);
+    VOID   remapBlock (HANDLE heap, LPCVOID mem, LPCVOID newmem, SIZE_T size,
+        bool debugcrtalloc, bool ucrt, DWORD threadId, blockinfo_t* &pblockInfo, const context_t &context);
+    VOID   unmapBlock (HANDLE heap, LPCVOID mem, const context_t &context);
+    VOID   unmapHeap (HANDLE heap);
+    bool   isBlockMapped (HANDLE heap, LPCVOID mem);
+    VOID   attachStack (blockinfo_t *info, CallStack *callstack);
+    bool   captureStack (SIZE_T size, DWORD threadId) const;
+    LONG64 nextSampleInterval (UINT32 &random) const;
+
+    // Size filters. Inline, because the heap hooks check them before doing
+    // any other work.
+    bool   isTrackedSize (SIZE_T size) const
+    {
+        return (size >= m_minTrackedSize) && (size <= m_maxTrackedSize);
+    }
+    bool   isMappedSize (SIZE_T size) const
+    {
+        return m_mapUntrackedSizes || isTrackedSize(size);
+    }
+    // Peak snapshots. Inline, because it is checked after every allocation.
+    VOID   checkPeak ()
+    {
+        if ((m_peakHysteresis != 0) && (m_stats.current() >= m_peak.trigger))
+            takePeakSnapshot();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Public API functions - see each function definition for details.
+    ////////////////////////////////////////////////////////////////////////////////
+    VOID SetCaptureFilter (SIZE_T minSize, SIZE_T maxSize, DWORD threadId);
+    VOID SetTrackedSizeRange (SIZE_T minSize, SIZE_T maxSize, BOOL mapOthers);
+    VLD_SNAPSHOT TakeSnapshot ();
+    SIZE_T DiffSnapshots (VLD_SNAPSHOT before, VLD_SNAPSHOT after, VLD_SNAPSHOT_CALLBACK callback, LPVOID context);
+    VOID FreeSnapshot (VLD_SNAPSHOT snapshot);
+
+    // Sort orders of the snapshots, of the blocks and of the heap sites.
+    static int __cdecl compareSerialNumbers (const void *first, const void *second);
+    static int __cdecl compareBlockCallStacks (const void *first, const void *second);
+    static int __cdecl compareDiffBlocks (const void *first, const void *second);
+    static int __cdecl compareSiteCallStacks (const void *first, const void *second);
+    static int __cdecl compareSiteBytes (const void *first, const void *second);
+
+protected:
+    BlockTracker ();
+    virtual ~BlockTracker ();
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Platform hooks - see each function definition for details.
+    ////////////////////////////////////////////////////////////////////////////////
+    virtual bool getLeakData (LPCVOID block, blockinfo_t *info, LPCVOID &address, SIZE_T &size);
+    virtual VOID reportMismatchedFree (HANDLE heap, LPCVOID mem, const context_t &context);
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Bookkeeping functions (blocktracker.cpp).
+    ////////////////////////////////////////////////////////////////////////////////
+    VOID   initializeTracking ();
+    VOID   freeTracking ();
+    double sampleWeight (SIZE_T size) const;
+    VOID   estimateLeaks (double &count, double &bytes);
+    SIZE_T eraseDuplicates (const BlockMap::Iterator &element, Set<blockinfo_t*> &aggregatedLeaks);
+    VOID   markAllLeaksAsReported (heapinfo_t* heapinfo, DWORD threadId = (DWORD)-1);
+    blockinfo_t* findAllocedBlock (LPCVOID mem, HANDLE &heap);
+    liveblock_t* copyLiveBlocks (SIZE_T &count, SIZE_T &watermark);
+    SIZE_T* copySerialNumbers (SIZE_T &count, SIZE_T &watermark);
+    SIZE_T findBlocks (const SIZE_T *serialNumbers, SIZE_T count, diffblock_t *blocks);
+    VOID   takePeakSnapshot ();
+    VOID   indexBlock (LPCVOID mem, blockinfo_t* info);
+    VOID   unindexBlock (LPCVOID mem, blockinfo_t* info);
+    // Per-site counters of the leak growth monitor and of the peak snapshots.
+    // Inline, because they are updated for every block.
+    bool   tracksSites () const
+    {
+        return (m_monitorInterval != 0) || (m_peakHysteresis != 0);
+    }
+    VOID   untrackSiteBytes (const blockinfo_t *info)
+    {
+        if (tracksSites() && (info->callStack != NULL))
+            info->callStack->removeLiveBlock(info->size);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Report functions (blockreport.cpp).
+    ////////////////////////////////////////////////////////////////////////////////
+    SIZE_T getLeaksCount (heapinfo_t* heapinfo, DWORD threadId = (DWORD)-1);
+    SIZE_T reportLeaks (heapinfo_t* heapinfo, bool &firstLeak, Set<blockinfo_t*> &aggregatedLeaks, DWORD threadId = (DWORD)-1);
+    SIZE_T reportUntracedLeaks (HANDLE heap = NULL, DWORD threadId = (DWORD)-1);
+    VOID   reportSummary (SIZE_T leaksCount);
+    VOID   checkGrowingSites ();
+    VOID   reportPeakSnapshot ();
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Tracking data
+    ////////////////////////////////////////////////////////////////////////////////
+    HeapMap             *m_heapMap;           // Map of all active heaps in the process. NULL before and after tracking.
+    BlockIndex          *m_blockIndex;        // Index of all mapped blocks by address.
+    LONG volatile        m_unindexedBlocks;   // Number of mapped blocks whose address could not be indexed. Changed
+                                              // under g_heapMapLock, read without it by isBlockMapped.
+    SIZE_T               m_requestCurr;       // Current request number.
+    Statistics           m_stats;             // Sum of all allocations, amount currently allocated and largest ever allocated at once.
+    StackTable           m_stackTable;        // Interned call stacks of the tracked blocks.
+    SIZE_T               m_maxDataDump;       // Maximum number of user-data bytes to dump for each leaked block.
+    UINT32               m_maxTraceFrames;    // Maximum number of frames per stack trace for each leaked block.
+    SIZE_T               m_minTrackedSize;    // Smallest block for which a call stack is captured.
+    SIZE_T               m_maxTrackedSize;    // Largest block for which a call stack is captured.
+    bool                 m_mapUntrackedSizes; // If false, blocks outside the tracked size range are not mapped at all.
+    SIZE_T               m_captureMinSize;    // In counting-only mode, smallest block for which a call stack is captured.
+    SIZE_T               m_captureMaxSize;    // In counting-only mode, largest block for which a call stack is captured.
+    DWORD                m_captureThreadId;   // In counting-only mode, thread whose blocks get call stacks, or 0 for any thread.
+    SIZE_T               m_sampleRate;        // Average number of bytes allocated between tracked allocations, or 0 to track every allocation.
+    SIZE_T               m_peakHysteresis;    // Growth in use, in bytes, past the last peak snapshot that triggers a new one, or 0 for no snapshots.
+    UINT32               m_peakInterval;      // Minimum time between two peak snapshots, in milliseconds.
+    peaksnapshot_t       m_peak;              // The last peak snapshot.
+    UINT32               m_monitorInterval;   // Interval, in milliseconds, of the leak growth monitor, or 0 if it is off.
+    UINT32               m_monitorIntervals;  // Number of intervals a site must grow for to be reported by the monitor.
+    WCHAR                m_blockDbPath [MAX_PATH]; // Path of the block database file, or empty if there is none.
+    ULONG64              m_blockDbSize;       // Size of the block database file, in bytes.
+    BlockDatabase        m_blockDb;           // Copy of the tracked blocks that survives a crash.
+    CriticalSection      m_optionsLock;       // Serializes changes to the capture filter and the tracked size range.
+    UINT32               m_options;           // Configuration options.
+
+private:
+    // Disallow certain operations
+    BlockTracker (const BlockTracker&);
+    BlockTracker& operator = (const BlockTracker&);
+};
+
+// Configuration option default values
+#define VLD_DEFAULT_PEAK_INTERVAL    1000
+#define VLD_DEFAULT_MONITOR_INTERVALS 5
+#define VLD_MONITOR_MAX_SITES        16    // Maximum number of growing sites reported by the monitor at a time.
@@ -54,146 +54,19 @@ bool endWith(const LPCWSTR filename, size_t len, wchar_t const (&substr)[N])
     return ((len >= count) && wcsncmp(filename + len - count, substr, count) == 0);
 }
 
-// Constructor - Initializes the CallStack with an initial size of zero and one
-//   Chunk of capacity.
-//
-CallStack::CallStack ()
-{
-    m_capacity   = CALLSTACK_CHUNK_SIZE;
-    m_size       = 0;
-    m_status     = 0x0;
-    m_store.next = NULL;
-    m_topChunk   = &m_store;
-    m_topIndex   = 0;
-    m_resolved   = NULL;
-    m_resolvedCapacity   = 0;
-    m_resolvedLength = 0;
-}
-
-// Destructor - Frees all memory allocated to the CallStack.
-//
-CallStack::~CallStack ()
-{
-    CallStack::chunk_t *chunk = m_store.next;
-    CallStack::chunk_t *temp;
-
-    while (chunk) {
-        temp = chunk;
-        chunk = temp->next;
-        delete temp;
-    }
-
-    delete [] m_resolved;
-
-    m_resolved = NULL;
-    m_resolvedCapacity = 0;
-    m_resolvedLength = 0;
-}
-
-CallStack* CallStack::Create()
-{
-    CallStack* result = NULL;
-    if (g_vld.GetOptions() & VLD_OPT_SAFE_STACK_WALK) {
-        result = new SafeCallStack();
-    }
-    else {
-        result = new FastCallStack();
-    }
-    return result;
-}
-
-// operator == - Equality operator. Compares the CallStack to another CallStack
-//   for equality. Two CallStacks are equal if they are the same size and if
-//   every frame in each is identical to the corresponding frame in the other.
-//
-//  other (IN) - Reference to the CallStack to compare the current CallStack
-//    against for equality.
+// Create - Creates a CallStack which walks the stack using the method selected
+//   by the "StackWalkMethod" option.
 //
 //  Return Value:
 //
-//    Returns true if the two CallStacks are equal. Otherwise returns false.
-//
-BOOL CallStack::operator == (const CallStack &other) const
-{
-    if (m_size != other.m_size) {
-        // They can't be equal if the sizes are different.
-        return FALSE;
-    }
-
-    // Walk the chunk list and within each chunk walk the frames array until we
-    // either find a mismatch, or until we reach the end of the call stacks.
-    const CallStack::chunk_t *prevChunk = NULL;
-    const CallStack::chunk_t *chunk = &m_store;
-    const CallStack::chunk_t *otherChunk = &other.m_store;
-    while (prevChunk != m_topChunk) {
-        UINT32 size = (chunk == m_topChunk) ? m_topIndex : CALLSTACK_CHUNK_SIZE;
-        for (UINT32 index = 0; index < size; index++) {
-            if (chunk->frames[index] != otherChunk->frames[index]) {
-                // Found a mismatch. They are not equal.
-                return FALSE;
-            }
-        }
-        prevChunk = chunk;
-        chunk = chunk->next;
-        otherChunk = otherChunk->next;
-    }
-
-    // Reached the end of the call stacks. They are equal.
-    return TRUE;
-}
-
-// operator [] - Random access operator. Retrieves the frame at the specified
-//   index.
-//
-//   Note: We give up a bit of efficiency here, in favor of efficiency of push
-//     operations. This is because walking of a CallStack is done infrequently
-//     (only if a leak is found), whereas pushing is done very frequently (for
-//     each frame in the program's call stack when the program allocates some
-//     memory).
-//
-//  - index (IN): Specifies the index of the frame to retrieve.
-//
-//  Return Value:
-//
-//    Returns the program counter for the frame at the specified index. If the
-//    specified index is out of range for the CallStack, the return value is
-//    undefined.
-//
-UINT_PTR CallStack::operator [] (UINT32 index) const
-{
-    UINT32                    chunknumber = index / CALLSTACK_CHUNK_SIZE;
-    const CallStack::chunk_t *chunk = &m_store;
-
-    for (UINT32 count = 0; count < chunknumber; count++) {
-        chunk = chunk->next;
-    }
-
-    return chunk->frames[index % CALLSTACK_CHUNK_SIZE];
-}
-
-// clear - Resets the CallStack, returning it to a state where no frames have
-//   been pushed onto it, readying it for reuse.
+//    Returns a new, empty, CallStack.
 //
-//   Note: Calling this function does not release any memory allocated to the
-//     CallStack. We give up a bit of memory-usage efficiency here in favor of
-//     performance of push operations.
-//
-//  Return Value:
-//
-//    None.
-//
-VOID CallStack::clear ()
+CallStack* CallStack::Create()
 {
-    m_size     = 0;
-    m_topChunk = &m_store;
-    m_topIndex = 0;
-    if (m_resolved)
-    {
-        delete [] m_resolved;
-        m_resolved = NULL;
+    if (g_vld.GetOptions() & VLD_OPT_SAFE_STACK_WALK) {
+        return new CallStack(safe);
     }
-    m_resolvedCapacity = 0;
-    m_resolvedLength = 0;
+    return new CallStack(fast);
 }
 
 LPCWSTR CallStack::getFunctionName(SIZE_T programCounter, DWORD64& displacement64,
@@ -332,9 +205,7 @@ bool CallStack::isCrtStartupAlloc()
 //
 void CallStack::dump(BOOL showInternalFrames)
 {
-    if (!m_resolved) {
-        resolve(showInternalFrames);
-    }
+    resolve(showInternalFrames);
 
     // The stack was reoslved already
     if (m_resolved) {
@@ -358,7 +229,7 @@ void CallStack::dump(BOOL showInternalFrames)
 //
 int CallStack::resolve(BOOL showInternalFrames)
 {
-    if (m_resolved)
+    if (isResolved(showInternalFrames))
     {
         // already resolved, no need to do it again
         // resolving twice may report an incorrect module for the stack frames
@@ -393,9 +264,9 @@ int CallStack::resolve(BOOL showInternalFrames)
     CriticalSectionLocker<DbgHelp> locker(g_DbgHelp);
 
     const size_t max_line_length = MAXREPORTLENGTH + 1;
-    m_resolvedCapacity = m_size * max_line_length;
-    const size_t allocedBytes = m_resolvedCapacity * sizeof(WCHAR);
-    m_resolved = new WCHAR[m_resolvedCapacity];
+    const size_t resolvedCapacity = m_size * max_line_length;
+    const size_t allocedBytes = resolvedCapacity * sizeof(WCHAR);
+    m_resolved = new WCHAR[resolvedCapacity];
     if (m_resolved) {
         ZeroMemory(m_resolved, allocedBytes);
     }
@@ -420,8 +291,6 @@ int CallStack::resolve(BOOL showInternalFrames)
             if (m_status & CALLSTACK_STATUS_STARTUPCRT) {
                 delete[] m_resolved;
                 m_resolved = NULL;
-                m_resolvedCapacity = 0;
-                m_resolvedLength = 0;
                 return 0;
             }
         }
@@ -443,9 +312,8 @@ int CallStack::resolve(BOOL showInternalFrames)
 
         // show one allocation function for context
         if (NumChars > 0 && !isFrameInternal && isPrevFrameInternal) {
-            m_resolvedLength += NumChars;
             if (m_resolved) {
-                wcsncat_s(m_resolved, m_resolvedCapacity, stack_line, NumChars);
+                wcsncat_s(m_resolved, resolvedCapacity, stack_line, NumChars);
             }
         }
         isPrevFrameInternal = isFrameInternal;
@@ -456,14 +324,15 @@ int CallStack::resolve(BOOL showInternalFrames)
             displacement, functionName, stack_line, _countof( stack_line ));
 
         if (NumChars > 0 && !isFrameInternal) {
-            m_resolvedLength += NumChars;
             if (m_resolved) {
-                wcsncat_s(m_resolved, m_resolvedCapacity, stack_line, NumChars);
+                wcsncat_s(m_resolved, resolvedCapacity, stack_line, NumChars);
             }
         }
     } // end for loop
 
     m_status |= CALLSTACK_STATUS_NOTSTARTUPCRT;
+    if (showInternalFrames)
+        m_status |= CALLSTACK_STATUS_INTERNALFRAMES;
     return unresolvedFunctionsCount;
 }
 
@@ -473,43 +342,6 @@ const WCHAR* CallStack::getResolvedCallstack( BOOL showinternalframes )
     return m_resolved;
 }
 
-// push_back - Pushes a frame's program counter onto the CallStack. Pushes are
-//   always appended to the back of the chunk list (aka the "top" chunk).
-//
-//   Note: This function will allocate additional memory as necessary to make
-//     room for new program counter addresses.
-//
-//  - programcounter (IN): The program counter address of the frame to be pushed
-//      onto the CallStack.
-//
-//  Return Value:
-//
-//    None.
-//
-VOID CallStack::push_back (const UINT_PTR programcounter)
-{
-    if (m_size == m_capacity) {
-        // At current capacity. Allocate additional storage.
-        CallStack::chunk_t *chunk = new CallStack::chunk_t;
-        chunk->next = NULL;
-        m_topChunk->next = chunk;
-        m_topChunk = chunk;
-        m_topIndex = 0;
-        m_capacity += CALLSTACK_CHUNK_SIZE;
-    }
-    else if (m_topIndex >= CALLSTACK_CHUNK_SIZE) {
-        // There is more capacity, but not in this chunk. Go to the next chunk.
-        // Note that this only happens if this CallStack has previously been
-        // cleared (clearing resets the data, but doesn't give up any allocated
-        // space).
-        m_topChunk = m_topChunk->next;
-        m_topIndex = 0;
-    }
-
-    m_topChunk->frames[m_topIndex++] = programcounter;
-    m_size++;
-}
-
 UINT CallStack::isCrtStartupFunction( LPCWSTR functionName ) const
 {
     size_t len = wcslen(functionName);
@@ -602,33 +434,34 @@ bool CallStack::isInternalModule( const PWSTR filename ) const
         (false);
 }
 
-// getStackTrace - Traces the stack as far back as possible, or until 'maxdepth'
-//   frames have been traced. Populates the CallStack with one entry for each
-//   stack frame traced.
-//
-//   Note: This function uses a very efficient method to walk the stack from
-//     frame to frame, so it is quite fast. However, unconventional stack frames
-//     (such as those created when frame pointer omission optimization is used)
-//     will not be successfully walked by this function and will cause the
-//     stack trace to terminate prematurely.
+// captureFast - Traces the stack with RtlCaptureStackBackTrace into a buffer
+//   supplied by the caller, without allocating any memory.
 //
 //  - maxdepth (IN): Maximum number of frames to trace back.
 //
-//  - framepointer (IN): Frame (base) pointer at which to begin the stack trace.
-//      If NULL, then the stack trace will begin at this function.
+//  - context (IN): The context at which VLD's code was entered. Frames above
+//      it are dropped.
+//
+//  - frames (OUT): Receives the frames. Must have room for
+//      CALLSTACK_FAST_FRAMES + 1 frames.
+//
+//  - hash (OUT): Receives the sum of the frames stored in the buffer. The
+//      hash computed by RtlCaptureStackBackTrace is not used: it also covers
+//      the frames above the context, which are dropped.
 //
 //  Return Value:
 //
-//    None.
+//    Returns the number of frames stored in the buffer.
 //
-VOID FastCallStack::getStackTrace (UINT32 maxdepth, const context_t& context)
+UINT32 CallStack::captureFast (UINT32 maxdepth, const context_t& context, UINT_PTR *frames, DWORD &hash)
 {
+    UINT32  size = 0;
     UINT32  count = 0;
     UINT_PTR function = context.func;
     if (function != NULL)
     {
         count++;
-        push_back(function);
+        frames[size++] = function;
     }
 
 /*#if defined(_M_IX86)
@@ -665,12 +498,10 @@ VOID FastCallStack::getStackTrace (UINT32 maxdepth, const context_t& context)
         framePointer = (UINT_PTR*)*framePointer;
     }
 #elif defined(_M_X64)*/
-    UINT32 maxframes = min(62, maxdepth + 10);
-    UINT_PTR* myFrames = new UINT_PTR[maxframes];
+    UINT32 maxframes = min(CALLSTACK_FAST_FRAMES, maxdepth + 10);
+    UINT_PTR myFrames [CALLSTACK_FAST_FRAMES];
     ZeroMemory(myFrames, sizeof(UINT_PTR) * maxframes);
-    ULONG BackTraceHash;
-    maxframes = RtlCaptureStackBackTrace(0, maxframes, reinterpret_cast<PVOID*>(myFrames), &BackTraceHash);
-    m_hashValue = BackTraceHash;
+    maxframes = RtlCaptureStackBackTrace(0, maxframes, reinterpret_cast<PVOID*>(myFrames), NULL);
     UINT32  startIndex = 0;
     while (count < maxframes) {
         if (myFrames[count] == 0)
@@ -683,16 +514,20 @@ VOID FastCallStack::getStackTrace (UINT32 maxdepth, const context_t& context)
     while (count < maxframes) {
         if (myFrames[count] == 0)
             break;
-        push_back(myFrames[count]);
+        frames[size++] = myFrames[count];
         count++;
     }
-    delete [] myFrames;
+    hash = 0;
+    for (UINT32 index = 0; index < size; index++) {
+        hash += (DWORD)frames[index];
+    }
+    return size;
 //#endif
 }
 
-// getStackTrace - Traces the stack as far back as possible, or until 'maxdepth'
-//   frames have been traced. Populates the CallStack with one entry for each
-//   stack frame traced.
+// getStackTraceSafe - Traces the stack as far back as possible, or until
+//   'maxdepth' frames have been traced. Populates the CallStack with one entry
+//   for each stack frame traced.
 //
 //   Note: This function uses a documented Windows API to walk the stack. This
 //     API is supposed to be the most reliable way to walk the stack. It claims
@@ -709,7 +544,7 @@ VOID FastCallStack::getStackTrace (UINT32 maxdepth, const context_t& context)
 //
 //    None.
 //
-VOID SafeCallStack::getStackTrace (UINT32 maxdepth, const context_t& context)
+VOID CallStack::getStackTraceSafe (UINT32 maxdepth, const context_t& context)
 {
     UINT32 count = 0;
     UINT_PTR function = context.func;
@@ -769,21 +604,3 @@ VOID SafeCallStack::getStackTrace (UINT32 maxdepth, const context_t& context)
         push_back((UINT_PTR)frame.AddrPC.Offset);
     }
 }
-
-// getHashValue - Generate callstack hash value.
-//
-//  Return Value:
-//
-//    None.
-//
-DWORD SafeCallStack::getHashValue() const
-{
-    DWORD       hashcode = 0xD202EF8D;
-
-    // Iterate through each frame in the call stack.
-    for (UINT32 frame = 0; frame < m_size; frame++) {
-        UINT_PTR programcounter = (*this)[frame];
-        hashcode = CalculateCRC32(programcounter, hashcode);
-    }
-    return hashcode;
-}
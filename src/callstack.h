@@ -29,10 +29,17 @@
     Applications should never include this header."
 #endif
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "linux/platform.h"
+#endif
 #include "utility.h"
 
-#define CALLSTACK_CHUNK_SIZE    32	// Number of frame slots in each CallStack chunk.
+#define CALLSTACK_MIN_CAPACITY  16  // Initial number of frame slots allocated when frames are pushed.
+#define CALLSTACK_FAST_FRAMES   62  // Maximum number of frames captured by RtlCaptureStackBackTrace.
+#define STACKTABLE_BITS         14  // The StackTable has 2^STACKTABLE_BITS hash buckets.
+#define STACKTABLE_BUCKETS      (1 << STACKTABLE_BITS)
 #define MAX_SYMBOL_NAME_LENGTH  256 // Maximum symbol name length that we will allow. Longer names will be truncated.
 #define MAX_SYMBOL_NAME_SIZE    ((MAX_SYMBOL_NAME_LENGTH * sizeof(WCHAR)) - 1)
 
@@ -43,17 +50,12 @@
 //    CallStack objects can be used for obtaining, storing, and displaying the
 //    call stack at a given point during program execution.
 //
-//    The primary data structure used by the CallStack is similar in concept to
-//    a STL vector, but is specifically tailored for use by VLD, making it more
-//    efficient than a standard STL vector.
-//
-//    Inside the CallStack are a number of "chunks" which are arranged in a
-//    linked list. Each chunk contains an array of frames (each frame is
-//    represented by a program counter address). If we run out of space when
-//    pushing new frames onto an existing chunk in the CallStack chunk list,
-//    then a new chunk is allocated and appended to the end of the list. In this
-//    way, the CallStack can grow dynamically as needed. New frames are always
-//    pushed onto the chunk at the end of the list known as the "top" chunk.
+//    The frames (each frame is represented by a program counter address) are
+//    stored in a single array which is trimmed to its exact size once the
+//    stack has been traced, because a CallStack is kept for every tracked
+//    block. For the same reason, the stack walking method is not selected
+//    through virtual functions: each CallStack records the method that it was
+//    created with, and getStackTrace dispatches on it.
 //
 //    IMPORTANT NOTE: This class as originally written makes two fatal assumptions:
 //    First: That the application will never load modules (call LoadLibrary) during the
@@ -78,8 +80,17 @@
 class CallStack
 {
 public:
-    CallStack ();
-    virtual ~CallStack ();
+    // Stack walking methods.
+    enum method_e {
+        fast,   // Uses RtlCaptureStackBackTrace (on Linux, walks the frame
+                // pointers). Very fast, but frames built without frame
+                // pointers may end the trace prematurely.
+        safe    // Uses StackWalk64 (on Linux, _Unwind_Backtrace). More
+                // robust, but quite slow.
+    };
+
+    CallStack (method_e method = fast);
+    ~CallStack ();
     static CallStack* Create();
     // Public APIs - see each function definition for details.
     VOID clear ();
@@ -90,89 +101,180 @@ public:
     int resolve(BOOL showinternalframes);
     // Formats the stack frame into a human readable format, and saves it for later retrieval.
     CONST WCHAR* getResolvedCallstack(BOOL showinternalframes);
-    virtual DWORD getHashValue() const = 0;
-    virtual VOID getStackTrace (UINT32 maxdepth, const context_t& context) = 0;
+    DWORD getHashValue() const
+    {
+        return m_hashValue;
+    }
+    // Bytes and number of blocks in use, allocated from this (interned) call
+    // stack. Only maintained while the leak growth monitor is running or
+    // peak snapshots are taken.
+    LONG64 getLiveBytes() const
+    {
+        return m_liveBytes;
+    }
+    LONG64 getLiveBlocks() const
+    {
+        return m_liveBlocks;
+    }
+    VOID addLiveBlock(SIZE_T size)
+    {
+        InterlockedExchangeAdd64(&m_liveBytes, (LONG64)size);
+        InterlockedIncrement64(&m_liveBlocks);
+    }
+    VOID removeLiveBlock(SIZE_T size)
+    {
+        InterlockedExchangeAdd64(&m_liveBytes, -(LONG64)size);
+        InterlockedDecrement64(&m_liveBlocks);
+    }
+    // Offset of this (interned) call stack's record in the block database,
+    // or 0 if it hasn't been written to the database yet.
+    SIZE_T getDbOffset() const
+    {
+        return (SIZE_T)m_dbOffset;
+    }
+    // Sets the offset, unless another thread has already set it. Returns the
+    // offset that is set.
+    SIZE_T setDbOffset(SIZE_T offset)
+    {
+        LONG64 previous = InterlockedCompareExchange64(&m_dbOffset, (LONG64)offset, 0);
+        return (previous != 0) ? (SIZE_T)previous : offset;
+    }
+    VOID getStackTrace (UINT32 maxdepth, const context_t& context);
+    static UINT32 captureFast (UINT32 maxdepth, const context_t& context, UINT_PTR *frames, DWORD &hash);
     bool isCrtStartupAlloc();
 
     BOOL operator == (const CallStack &other) const;
-    UINT_PTR operator [] (UINT32 index) const;
+    UINT_PTR operator [] (UINT32 index) const
+    {
+        return m_frames[index];
+    }
     VOID push_back (const UINT_PTR programcounter);
+    UINT32 size () const
+    {
+        return m_size;
+    }
 
-protected:
-    // Protected data.
-    UINT32 m_status;                       // Status flags:
+private:
+    // Private data. The members are ordered to keep the object small: a
+    // CallStack is 56 bytes on x64, plus its array of frames.
+    UINT_PTR           *m_frames;    // Pushed frames (program counter addresses).
+    // The string that contains the stack converted into a human readable format.
+    // This is always NULL if the callstack has not been 'converted'.
+    WCHAR              *m_resolved;
+    UINT32              m_size;      // Current size (in frames)
+    UINT32              m_capacity;  // Current capacity limit (in frames)
+    DWORD               m_hashValue; // Hash of the frames, computed when the stack is traced.
+    UINT16              m_status;    // Status flags:
 #define CALLSTACK_STATUS_INCOMPLETE    0x1 //   If set, the stack trace stored in this CallStack appears to be incomplete.
 #define CALLSTACK_STATUS_STARTUPCRT    0x2 //   If set, the stack trace is startup CRT.
 #define CALLSTACK_STATUS_NOTSTARTUPCRT 0x4 //   If set, the stack trace is not startup CRT.
+#define CALLSTACK_STATUS_INTERNALFRAMES 0x8 //  If set, m_resolved includes the frames internal to the heap.
+    UINT8               m_method;    // The method_e used by getStackTrace.
+    LONG64 volatile     m_liveBytes; // Bytes in use in blocks with this call stack (see getLiveBytes).
+    LONG64 volatile     m_liveBlocks; // Blocks in use with this call stack (see getLiveBlocks).
+    LONG64 volatile     m_dbOffset;  // Offset of the call stack in the block database (see getDbOffset).
 
-    // The chunk list is made of a linked list of Chunks.
-    struct chunk_t {
-        chunk_t*    next;					    // Pointer to the next chunk in the chunk list.
-        UINT_PTR    frames[CALLSTACK_CHUNK_SIZE]; // Pushed frames (program counter addresses) are stored in this array.
-    };
-
-    // Private data.
-    UINT32              m_capacity; // Current capacity limit (in frames)
-    UINT32              m_size;     // Current size (in frames)
-    CallStack::chunk_t  m_store;    // Pointer to the underlying data store (i.e. head of the chunk list)
-    CallStack::chunk_t* m_topChunk; // Pointer to the chunk at the top of the stack
-    UINT32              m_topIndex; // Index, within the top chunk, of the top of the stack
+    friend class StackTable;
 
-    // The string that contains the stack converted into a human readable format.
-    // This is always NULL if the callstack has not been 'converted'.
-    WCHAR*              m_resolved;
-    int                 m_resolvedCapacity;
-    int                 m_resolvedLength;
+    bool matches (DWORD hash, const UINT_PTR *frames, UINT32 count) const
+    {
+        return (m_hashValue == hash) && (m_size == count) &&
+            ((count == 0) || (memcmp(m_frames, frames, count * sizeof(UINT_PTR)) == 0));
+    }
+    VOID assign (const UINT_PTR *frames, UINT32 count);
+    VOID dropResolved ();
+    bool isResolved (BOOL showInternalFrames);
+    VOID getStackTraceFast (UINT32 maxdepth, const context_t& context);
+    VOID getStackTraceSafe (UINT32 maxdepth, const context_t& context);
+    VOID trim ();
 
+#ifdef _WIN32
     bool isInternalModule( const PWSTR filename ) const;
     UINT isCrtStartupFunction( LPCWSTR functionName ) const;
     LPCWSTR getFunctionName(SIZE_T programCounter, DWORD64& displacement64,
         SYMBOL_INFO* functionInfo, CriticalSectionLocker<DbgHelp>& locker) const;
     DWORD resolveFunction(SIZE_T programCounter, IMAGEHLP_LINEW64* sourceInfo, DWORD displacement,
         LPCWSTR functionName, LPWSTR stack_line, DWORD stackLineSize) const;
+#else
+    DWORD resolveFunction(SIZE_T programCounter, LPWSTR stack_line, DWORD stackLineSize) const;
+#endif
 
-private:
     // Don't allow this!!
     CallStack(const CallStack &other);
     // Don't allow this!!
     CallStack& operator = (const CallStack &other);
 };
 
-
 ////////////////////////////////////////////////////////////////////////////////
 //
-//  The FastCallStack Class
+//  The StackTable Class
 //
-//    This class is a specialization of the CallStack class which provides a
-//    very fast stack tracing function.
+//    Interns the call stacks of tracked blocks. Blocks allocated from the same
+//    place (typically inside a loop) have identical call stacks, so the table
+//    keeps one canonical CallStack for each distinct stack and the blocks
+//    simply reference it.
 //
-class FastCallStack : public CallStack
+//    With the fast stack walking method, a new trace is captured into a buffer
+//    on the stack and looked up by the sum of its frames, verified against the
+//    frames. The frames are only copied to the heap the first time a stack is
+//    seen. With the safe method the stack is walked as before, hashed with a
+//    CRC, and only the storage is shared.
+//
+//    Lookups don't take any lock. New stacks are pushed onto the front of their
+//    bucket with an interlocked compare-exchange and are never removed before
+//    clear() is called at shutdown, so a stack remains valid for as long as
+//    any block may reference it. This also means that a stack is resolved
+//    once, however many blocks share it, unless the module of one of its
+//    frames is unloaded (see dropResolved).
+//
+// An allocation site whose bytes in use keep growing, as found by
+// StackTable::findGrowingSites.
+struct growingsite_t {
+    CallStack *callStack;  // The site's call stack.
+    LONG64     bytes;      // Bytes in use.
+    LONG64     growth;     // Bytes added since the site started growing.
+};
+
+// In-use bytes and number of blocks allocated from one call stack.
+struct heapsite_t {
+    CallStack *callStack;     // Interned call stack, or NULL for blocks without one.
+    SIZE_T     bytes;         // Sum of the sizes of the blocks.
+    SIZE_T     count;         // Number of blocks.
+};
+
+class StackTable
 {
 public:
-    FastCallStack()
-        : m_hashValue(0)
-    {
-    }
-    virtual VOID getStackTrace (UINT32 maxdepth, const context_t& context);
-    virtual DWORD getHashValue() const
+    StackTable ();
+    CallStack* capture (CallStack::method_e method, UINT32 maxdepth, const context_t& context);
+    VOID clear ();
+    VOID dropResolved (UINT_PTR low, UINT_PTR high);
+    SIZE_T findGrowingSites (UINT32 intervals, growingsite_t *sites, SIZE_T maxsites);
+    SIZE_T findLargestSites (heapsite_t *sites, SIZE_T maxsites, SIZE_T &bytes, SIZE_T &blocks) const;
+    SIZE_T size () const
     {
-        return m_hashValue;
+        return m_count;
     }
 
 private:
-    UINT32 m_hashValue;
-};
+    struct entry_t {
+        entry_t   *next;      // Next entry in the same bucket.
+        CallStack *callStack; // The canonical call stack.
+        // Used by findGrowingSites only.
+        LONG64     lastBytes;  // Live bytes at the previous interval.
+        LONG64     startBytes; // Live bytes when the site started growing.
+        UINT32     intervals;  // Number of intervals the site has been growing for.
+    };
 
-////////////////////////////////////////////////////////////////////////////////
-//
-//  The SafeCallStack Class
-//
-//    This class is a specialization of the CallStack class which provides a
-//    more robust, but quite slow, stack tracing function.
-//
-class SafeCallStack : public CallStack
-{
-public:
-    virtual VOID getStackTrace (UINT32 maxdepth, const context_t& context);
-    virtual DWORD getHashValue() const;
+    static UINT32 bucket (DWORD hash)
+    {
+        // The hash of the fast walker is a plain sum of the frames. Mix it
+        // before selecting a bucket.
+        return (UINT32)(hash * 0x9E3779B1u) >> (32 - STACKTABLE_BITS);
+    }
+    CallStack* find (const entry_t *first, const entry_t *last, DWORD hash, const UINT_PTR *frames, UINT32 count) const;
+    CallStack* insert (CallStack *callstack);
+
+    entry_t * volatile  m_buckets [STACKTABLE_BUCKETS];
+    LONG volatile       m_count;     // Number of distinct call stacks in the table.
 };
@@ -1,16 +1,130 @@
 #pragma once
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #define NOMINMAX
 #include <windows.h>
+#else
+#include "linux/platform.h"
+#include "linux/futexlock.h"
+#endif
 
+#if defined(VLD_LOCK_PROFILING) && !defined(_WIN32)
+#error "Lock contention profiling is only available on Windows."
+#endif
+
+#ifdef VLD_LOCK_PROFILING
+#include <intrin.h>
+
+// Lock contention profiling. Define VLD_LOCK_PROFILING when building VLD to
+// have every named CriticalSection count its acquisitions, contended
+// acquisitions, total wait time and maximum hold time. Without it, none of the
+// code below is compiled and CriticalSection is a plain wrapper.
+#define LOCKPROFILE_MAX_LOCKS 16
+
+// Counters kept by a named CriticalSection. They are only updated by the
+// thread that owns the lock, so no interlocked operations are needed. Times
+// are in time stamp counter ticks.
+struct lockprofile_t
+{
+	LPCWSTR name;			// Name under which the lock is reported, or NULL if it is not profiled.
+	ULONG64 acquisitions;	// Number of times the lock was acquired, including recursive acquisitions.
+	ULONG64 contentions;	// Number of acquisitions that had to wait for another thread.
+	ULONG64 waitTicks;		// Total time spent waiting for the lock.
+	ULONG64 maxHoldTicks;	// Longest time the lock was held at a time.
+	ULONG64 enterTicks;		// When the current owner acquired the lock.
+};
+
+// Keeps track of the named locks, so that their counters can be reported.
+class LockProfiler
+{
+public:
+	static void Register(lockprofile_t *profile)
+	{
+		registry_t &registry = Registry();
+		LONG index = InterlockedIncrement(&registry.count) - 1;
+		if (index == 0) {
+			// Remember a reference point for converting ticks to time.
+			QueryPerformanceCounter(&registry.startTime);
+			registry.startTicks = __rdtsc();
+		}
+		if (index < LOCKPROFILE_MAX_LOCKS)
+			registry.locks[index] = profile;
+	}
+
+	static void Unregister(lockprofile_t *profile)
+	{
+		registry_t &registry = Registry();
+		for (LONG index = 0; index < GetCount(); index++) {
+			if (registry.locks[index] == profile)
+				registry.locks[index] = NULL;
+		}
+	}
+
+	static LONG GetCount()
+	{
+		LONG count = Registry().count;
+		return (count < LOCKPROFILE_MAX_LOCKS) ? count : LOCKPROFILE_MAX_LOCKS;
+	}
+
+	// Returns NULL if the lock at this index has been deleted.
+	static const lockprofile_t* Get(LONG index)
+	{
+		return Registry().locks[index];
+	}
+
+	// Converts time stamp counter ticks to nanoseconds, by comparing the
+	// ticks elapsed since the first lock was registered with the
+	// performance counter.
+	static ULONG64 TicksToNanoseconds(ULONG64 ticks)
+	{
+		registry_t &registry = Registry();
+		LARGE_INTEGER now, frequency;
+		QueryPerformanceCounter(&now);
+		QueryPerformanceFrequency(&frequency);
+		ULONG64 elapsedTicks = __rdtsc() - registry.startTicks;
+		double elapsedSeconds = (double)(now.QuadPart - registry.startTime.QuadPart) / (double)frequency.QuadPart;
+		if ((elapsedTicks == 0) || (elapsedSeconds <= 0.0))
+			return 0;
+		return (ULONG64)((double)ticks * elapsedSeconds * 1e9 / (double)elapsedTicks);
+	}
+
+private:
+	// Plain data, so that it is zero initialized before any constructor runs.
+	struct registry_t
+	{
+		lockprofile_t * volatile locks[LOCKPROFILE_MAX_LOCKS];
+		LONG volatile            count;
+		LARGE_INTEGER            startTime;
+		ULONG64                  startTicks;
+	};
+
+	static registry_t& Registry()
+	{
+		static registry_t registry;
+		return registry;
+	}
+};
+#endif // VLD_LOCK_PROFILING
+
+#ifdef _WIN32
 // you should consider CriticalSectionLocker<> whenever possible instead of
 // directly working with CriticalSection class - it is safer
 class CriticalSection
 {
 public:
-	void Initialize()
+	// name is the name under which the lock is reported when lock profiling
+	// is enabled. Unnamed locks are never profiled.
+	void Initialize(LPCWSTR name = NULL)
 	{
+#ifdef VLD_LOCK_PROFILING
+		ZeroMemory(&m_profile, sizeof(m_profile));
+		m_profile.name = name;
+		if (name != NULL)
+			LockProfiler::Register(&m_profile);
+#else
+		UNREFERENCED_PARAMETER(name);
+#endif
 		m_critRegion.OwningThread = 0;
 		__try {
 			InitializeCriticalSection(&m_critRegion);
@@ -18,13 +132,34 @@ public:
 			assert(FALSE);
 		}
 	}
-	void Delete()		{ DeleteCriticalSection(&m_critRegion); }
+	void Delete()
+	{
+#ifdef VLD_LOCK_PROFILING
+		if (m_profile.name != NULL)
+			LockProfiler::Unregister(&m_profile);
+#endif
+		DeleteCriticalSection(&m_critRegion);
+	}
 
 	// enter the section
 	void Enter()
 	{
 		ULONG_PTR ownerThreadId = (ULONG_PTR)m_critRegion.OwningThread;
 		UNREFERENCED_PARAMETER(ownerThreadId);
+#ifdef VLD_LOCK_PROFILING
+		if (m_profile.name != NULL) {
+			ULONG64 waitTicks = 0;
+			if (!TryEnterCriticalSection(&m_critRegion)) {
+				ULONG64 start = __rdtsc();
+				EnterCriticalSection(&m_critRegion);
+				waitTicks = __rdtsc() - start;
+				m_profile.contentions++;
+			}
+			m_profile.waitTicks += waitTicks;
+			Acquired();
+			return;
+		}
+#endif
 		EnterCriticalSection(&m_critRegion);
 	}
 
@@ -42,14 +177,93 @@ public:
 	}
 
 	// try enter the section
-	bool TryEnter()		{ return (TryEnterCriticalSection(&m_critRegion) != 0); }
+	bool TryEnter()
+	{
+		if (TryEnterCriticalSection(&m_critRegion) == 0)
+			return false;
+#ifdef VLD_LOCK_PROFILING
+		if (m_profile.name != NULL)
+			Acquired();
+#endif
+		return true;
+	}
 
 	// leave the critical section
-	void Leave()		{ LeaveCriticalSection(&m_critRegion); }
+	void Leave()
+	{
+#ifdef VLD_LOCK_PROFILING
+		if ((m_profile.name != NULL) && (m_critRegion.RecursionCount == 1)) {
+			ULONG64 holdTicks = __rdtsc() - m_profile.enterTicks;
+			if (holdTicks > m_profile.maxHoldTicks)
+				m_profile.maxHoldTicks = holdTicks;
+		}
+#endif
+		LeaveCriticalSection(&m_critRegion);
+	}
 
 private:
+#ifdef VLD_LOCK_PROFILING
+	void Acquired()
+	{
+		m_profile.acquisitions++;
+		if (m_critRegion.RecursionCount == 1)
+			m_profile.enterTicks = __rdtsc();
+	}
+
+	lockprofile_t    m_profile;
+#endif
 	CRITICAL_SECTION m_critRegion;
 };
+#else
+// Same as above, on the platform lock. The platform lock provides Enter,
+// TryEnter, Leave, IsLocked and IsLockedByCurrentThread with the semantics of
+// a Win32 critical section (recursive, owned by a thread); on Linux it is a
+// single futex word.
+class CriticalSection
+{
+public:
+	void Initialize(LPCWSTR name = NULL)
+	{
+		UNREFERENCED_PARAMETER(name);
+		m_lock.Initialize();
+	}
+	void Delete()
+	{
+		m_lock.Delete();
+	}
+
+	// enter the section
+	void Enter()
+	{
+		m_lock.Enter();
+	}
+
+	bool IsLocked()
+	{
+		return m_lock.IsLocked();
+	}
+
+	bool IsLockedByCurrentThread()
+	{
+		return m_lock.IsLockedByCurrentThread();
+	}
+
+	// try enter the section
+	bool TryEnter()
+	{
+		return m_lock.TryEnter();
+	}
+
+	// leave the critical section
+	void Leave()
+	{
+		m_lock.Leave();
+	}
+
+private:
+	FutexLock m_lock;
+};
+#endif // _WIN32
 
 template<typename T = CriticalSection>
 class CriticalSectionLocker
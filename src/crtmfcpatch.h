@@ -198,8 +198,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__calloc_dbg (size_t      num,
     _calloc_dbg_t pcrtxxd__calloc_dbg = (_calloc_dbg_t)data.pcrtd__calloc_dbg;
     assert(pcrtxxd__calloc_dbg);
 
+    if (!g_vld.isMappedSize(num * size) || !g_vld.isSampled(num * size)) {
+        UntrackedContext uc;
+        return pcrtxxd__calloc_dbg(num, size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__calloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__calloc_dbg, context_, num * size, debug, (CRTVersion >= 140));
 
     return pcrtxxd__calloc_dbg(num, size, type, file, line);
 }
@@ -230,8 +235,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__malloc_dbg (size_t      size,
     _malloc_dbg_t pcrtxxd__malloc_dbg = (_malloc_dbg_t)data.pcrtd__malloc_dbg;
     assert(pcrtxxd__malloc_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd__malloc_dbg(size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__malloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__malloc_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd__malloc_dbg(size, type, file, line);
 }
 
@@ -264,8 +274,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__realloc_dbg (void       *mem,
     _realloc_dbg_t pcrtxxd__realloc_dbg = (_realloc_dbg_t)data.pcrtd__realloc_dbg;
     assert(pcrtxxd__realloc_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd__realloc_dbg(mem, size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__realloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__realloc_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd__realloc_dbg(mem, size, type, file, line);
 }
 
@@ -299,8 +314,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__recalloc_dbg (void       *mem,
     _recalloc_dbg_t pcrtxxd__recalloc_dbg = (_recalloc_dbg_t)data.pcrtd__recalloc_dbg;
     assert(pcrtxxd__recalloc_dbg);
 
+    if (!g_vld.isMappedSize(num * size) || !g_vld.isSampled(num * size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd__recalloc_dbg(mem, num, size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__recalloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__recalloc_dbg, context_, num * size, debug, (CRTVersion >= 140));
     return pcrtxxd__recalloc_dbg(mem, num, size, type, file, line);
 }
 
@@ -315,8 +335,14 @@ char* CrtPatch<CRTVersion, debug>::crtd__strdup_dbg (const char* src,
     _strdup_dbg_t pcrtxxd__strdup_dbg = (_strdup_dbg_t)data.pcrtd__strdup_dbg;
     assert(pcrtxxd__strdup_dbg);
 
+    size_t size = (src != NULL) ? (strlen(src) + 1) : 0;
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd__strdup_dbg(src, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__strdup_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__strdup_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd__strdup_dbg(src, type, file, line);
 }
 
@@ -331,8 +357,14 @@ wchar_t* CrtPatch<CRTVersion, debug>::crtd__wcsdup_dbg (const wchar_t* src,
     _wcsdup_dbg_t pcrtxxd__wcsdup_dbg = (_wcsdup_dbg_t)data.pcrtd__wcsdup_dbg;
     assert(pcrtxxd__wcsdup_dbg);
 
+    size_t size = (src != NULL) ? (wcslen(src) + 1) * sizeof(wchar_t) : 0;
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd__wcsdup_dbg(src, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__wcsdup_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__wcsdup_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd__wcsdup_dbg(src, type, file, line);
 }
 
@@ -362,8 +394,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__scalar_new_dbg (size_t      size,
     new_dbg_crt_t pcrtxxd_new_dbg = (new_dbg_crt_t)data.pcrtd__scalar_new_dbg;
     assert(pcrtxxd_new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_new_dbg(size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_new_dbg(size, type, file, line);
 }
 
@@ -393,8 +430,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__vector_new_dbg (size_t      size,
     new_dbg_crt_t pcrtxxd_new_dbg = (new_dbg_crt_t)data.pcrtd__vector_new_dbg;
     assert(pcrtxxd_new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_new_dbg(size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_new_dbg(size, type, file, line);
 }
 
@@ -418,8 +460,13 @@ void* CrtPatch<CRTVersion, debug>::crtd_calloc (size_t num, size_t size)
     calloc_t pcrtxxd_calloc = (calloc_t)data.pcrtd_calloc;
     assert(pcrtxxd_calloc);
 
+    if (!g_vld.isMappedSize(num * size) || !g_vld.isSampled(num * size)) {
+        UntrackedContext uc;
+        return pcrtxxd_calloc(num, size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_calloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_calloc, context_, num * size, debug, (CRTVersion >= 140));
     return pcrtxxd_calloc(num, size);
 }
 
@@ -441,8 +488,13 @@ void* CrtPatch<CRTVersion, debug>::crtd_malloc (size_t size)
     malloc_t pcrtxxd_malloc = (malloc_t)data.pcrtd_malloc;
     assert(pcrtxxd_malloc);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_malloc(size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_malloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_malloc, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_malloc(size);
 }
 
@@ -466,8 +518,13 @@ void* CrtPatch<CRTVersion, debug>::crtd_realloc (void *mem, size_t size)
     realloc_t pcrtxxd_realloc = (realloc_t)data.pcrtd_realloc;
     assert(pcrtxxd_realloc);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd_realloc(mem, size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_realloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_realloc, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_realloc(mem, size);
 }
 
@@ -491,8 +548,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__recalloc (void *mem, size_t num, size_t
     _recalloc_t pcrtxxd_recalloc = (_recalloc_t)data.pcrtd_recalloc;
     assert(pcrtxxd_recalloc);
 
+    if (!g_vld.isMappedSize(num * size) || !g_vld.isSampled(num * size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd_recalloc(mem, num, size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_recalloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_recalloc, context_, num * size, debug, (CRTVersion >= 140));
     return pcrtxxd_recalloc(mem, num, size);
 }
 
@@ -504,8 +566,14 @@ char* CrtPatch<CRTVersion, debug>::crtd__strdup (const char* src)
     _strdup_t pcrtxxd_strdup = (_strdup_t)data.pcrtd__strdup;
     assert(pcrtxxd_strdup);
 
+    size_t size = (src != NULL) ? (strlen(src) + 1) : 0;
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_strdup(src);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_strdup, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_strdup, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_strdup(src);
 }
 
@@ -516,8 +584,14 @@ wchar_t* CrtPatch<CRTVersion, debug>::crtd__wcsdup (const wchar_t* src)
     _wcsdup_t pcrtxxd_wcsdup = (_wcsdup_t)data.pcrtd__wcsdup;
     assert(pcrtxxd_wcsdup);
 
+    size_t size = (src != NULL) ? (wcslen(src) + 1) * sizeof(wchar_t) : 0;
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_wcsdup(src);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_wcsdup, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_wcsdup, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_wcsdup(src);
 }
 
@@ -548,8 +622,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_malloc_dbg (size_t      size,
     _aligned_malloc_dbg_t pcrtxxd__aligned_malloc_dbg = (_aligned_malloc_dbg_t)data.pcrtd__aligned_malloc_dbg;
     assert(pcrtxxd__aligned_malloc_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd__aligned_malloc_dbg(size, alignment, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__aligned_malloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__aligned_malloc_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd__aligned_malloc_dbg(size, alignment, type, file, line);
 }
 
@@ -581,8 +660,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_offset_malloc_dbg (size_t
     _aligned_offset_malloc_dbg_t pcrtxxd__malloc_dbg = (_aligned_offset_malloc_dbg_t)data.pcrtd__aligned_offset_malloc_dbg;
     assert(pcrtxxd__malloc_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd__malloc_dbg(size, alignment, offset, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__malloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__malloc_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd__malloc_dbg(size, alignment, offset, type, file, line);
 }
 
@@ -616,8 +700,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_realloc_dbg (void       *mem,
     _aligned_realloc_dbg_t pcrtxxd__realloc_dbg = (_aligned_realloc_dbg_t)data.pcrtd__aligned_realloc_dbg;
     assert(pcrtxxd__realloc_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd__realloc_dbg(mem, size, alignment, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__realloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__realloc_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd__realloc_dbg(mem, size, alignment, type, file, line);
 }
 
@@ -652,8 +741,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_offset_realloc_dbg (void
     _aligned_offset_realloc_dbg_t pcrtxxd__realloc_dbg = (_aligned_offset_realloc_dbg_t)data.pcrtd__aligned_offset_realloc_dbg;
     assert(pcrtxxd__realloc_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd__realloc_dbg(mem, size, alignment, offset, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__realloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__realloc_dbg, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd__realloc_dbg(mem, size, alignment, offset, type, file, line);
 }
 
@@ -690,8 +784,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_recalloc_dbg (void       *mem,
     _aligned_recalloc_dbg_t pcrtxxd__recalloc_dbg = (_aligned_recalloc_dbg_t)data.pcrtd__aligned_recalloc_dbg;
     assert(pcrtxxd__recalloc_dbg);
 
+    if (!g_vld.isMappedSize(num * size) || !g_vld.isSampled(num * size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd__recalloc_dbg(mem, num, size, alignment, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__recalloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__recalloc_dbg, context_, num * size, debug, (CRTVersion >= 140));
     return pcrtxxd__recalloc_dbg(mem, num, size, alignment, type, file, line);
 }
 
@@ -729,8 +828,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_offset_recalloc_dbg (void
     _aligned_offset_recalloc_dbg_t pcrtxxd__recalloc_dbg = (_aligned_offset_recalloc_dbg_t)data.pcrtd__aligned_offset_recalloc_dbg;
     assert(pcrtxxd__recalloc_dbg);
 
+    if (!g_vld.isMappedSize(num * size) || !g_vld.isSampled(num * size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd__recalloc_dbg(mem, num, size, alignment, offset, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd__recalloc_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd__recalloc_dbg, context_, num * size, debug, (CRTVersion >= 140));
     return pcrtxxd__recalloc_dbg(mem, num, size, alignment, offset, type, file, line);
 }
 
@@ -752,8 +856,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_malloc (size_t size, size_t ali
     _aligned_malloc_t pcrtxxd_malloc = (_aligned_malloc_t)data.pcrtd_aligned_malloc;
     assert(pcrtxxd_malloc);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_malloc(size, alignment);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_malloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_malloc, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_malloc(size, alignment);
 }
 
@@ -775,8 +884,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_offset_malloc (size_t size, siz
     _aligned_offset_malloc_t pcrtxxd_malloc = (_aligned_offset_malloc_t)data.pcrtd_aligned_offset_malloc;
     assert(pcrtxxd_malloc);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_malloc(size, alignment, offset);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_malloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_malloc, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_malloc(size, alignment, offset);
 }
 
@@ -800,8 +914,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_realloc (void *mem, size_t size
     _aligned_realloc_t pcrtxxd_realloc = (_aligned_realloc_t)data.pcrtd_aligned_realloc;
     assert(pcrtxxd_realloc);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd_realloc(mem, size, alignment);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_realloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_realloc, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_realloc(mem, size, alignment);
 }
 
@@ -825,8 +944,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_offset_realloc (void *mem, size
     _aligned_offset_realloc_t pcrtxxd_realloc = (_aligned_offset_realloc_t)data.pcrtd_aligned_offset_realloc;
     assert(pcrtxxd_realloc);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd_realloc(mem, size, alignment, offset);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_realloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_realloc, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_realloc(mem, size, alignment, offset);
 }
 
@@ -852,8 +976,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_recalloc (void *mem, size_t num
     _aligned_recalloc_t pcrtxxd_recalloc = (_aligned_recalloc_t)data.pcrtd_aligned_recalloc;
     assert(pcrtxxd_recalloc);
 
+    if (!g_vld.isMappedSize(num * size) || !g_vld.isSampled(num * size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd_recalloc(mem, num, size, alignment);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_recalloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_recalloc, context_, num * size, debug, (CRTVersion >= 140));
     return pcrtxxd_recalloc(mem, num, size, alignment);
 }
 
@@ -879,8 +1008,13 @@ void* CrtPatch<CRTVersion, debug>::crtd__aligned_offset_recalloc (void *mem, siz
     _aligned_offset_recalloc_t pcrtxxd_recalloc = (_aligned_offset_recalloc_t)data.pcrtd_aligned_offset_recalloc;
     assert(pcrtxxd_recalloc);
 
+    if (!g_vld.isMappedSize(num * size) || !g_vld.isSampled(num * size, mem)) {
+        UntrackedContext uc;
+        return pcrtxxd_recalloc(mem, num, size, alignment, offset);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_recalloc, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_recalloc, context_, num * size, debug, (CRTVersion >= 140));
     return pcrtxxd_recalloc(mem, num, size, alignment, offset);
 }
 
@@ -900,8 +1034,13 @@ void* CrtPatch<CRTVersion, debug>::crtd_scalar_new (size_t size)
     new_t pcrtxxd_scalar_new = (new_t)data.pcrtd_scalar_new;
     assert(pcrtxxd_scalar_new);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_scalar_new(size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_scalar_new, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_scalar_new, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_scalar_new(size);
 }
 
@@ -921,8 +1060,13 @@ void* CrtPatch<CRTVersion, debug>::crtd_vector_new (size_t size)
     new_t pcrtxxd_vector_new = (new_t)data.pcrtd_vector_new;
     assert(pcrtxxd_vector_new);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pcrtxxd_vector_new(size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pcrtxxd_vector_new, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pcrtxxd_vector_new, context_, size, debug, (CRTVersion >= 140));
     return pcrtxxd_vector_new(size);
 }
 
@@ -958,8 +1102,13 @@ void* MfcPatch<CRTVersion, debug>::mfcd__scalar_new_dbg_4p (size_t       size,
     new_dbg_crt_t pmfcxxd__new_dbg = (new_dbg_crt_t)data.pmfcd__scalar_new_dbg_4p;
     assert(pmfcxxd__new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd__new_dbg(size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd__new_dbg(size, type, file, line);
 }
 
@@ -986,8 +1135,13 @@ void* MfcPatch<CRTVersion, debug>::mfcd__scalar_new_dbg_3p (size_t       size,
     new_dbg_mfc_t pmfcxxd__new_dbg = (new_dbg_mfc_t)data.pmfcd__scalar_new_dbg_3p;
     assert(pmfcxxd__new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd__new_dbg(size, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd__new_dbg(size, file, line);
 }
 
@@ -1017,8 +1171,13 @@ void* MfcPatch<CRTVersion, debug>::mfcd__vector_new_dbg_4p (size_t       size,
     new_dbg_crt_t pmfcxxd__new_dbg = (new_dbg_crt_t)data.pmfcd__vector_new_dbg_4p;
     assert(pmfcxxd__new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd__new_dbg(size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd__new_dbg(size, type, file, line);
 }
 
@@ -1045,8 +1204,13 @@ void* MfcPatch<CRTVersion, debug>::mfcd__vector_new_dbg_3p (size_t       size,
     new_dbg_mfc_t pmfcxxd__new_dbg = (new_dbg_mfc_t)data.pmfcd__vector_new_dbg_3p;
     assert(pmfcxxd__new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd__new_dbg(size, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd__new_dbg(size, file, line);
 }
 
@@ -1066,8 +1230,13 @@ void* MfcPatch<CRTVersion, debug>::mfcd_scalar_new (size_t size)
     new_t pmfcxxd_new = (new_t)data.pmfcd_scalar_new;
     assert(pmfcxxd_new);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd_new(size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd_new, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd_new, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd_new(size);
 }
 
@@ -1087,8 +1256,13 @@ void* MfcPatch<CRTVersion, debug>::mfcd_vector_new (size_t size)
     new_t pmfcxxd_new = (new_t)data.pmfcd_vector_new;
     assert(pmfcxxd_new);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd_new(size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd_new, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd_new, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd_new(size);
 }
 
@@ -1118,8 +1292,13 @@ void* MfcPatch<CRTVersion, debug>::mfcud__scalar_new_dbg_4p (size_t      size,
     new_dbg_crt_t pmfcxxd__new_dbg = (new_dbg_crt_t)data.pmfcud__scalar_new_dbg_4p;
     assert(pmfcxxd__new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd__new_dbg(size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd__new_dbg(size, type, file, line);
 }
 
@@ -1146,8 +1325,13 @@ void* MfcPatch<CRTVersion, debug>::mfcud__scalar_new_dbg_3p (size_t      size,
     new_dbg_mfc_t pmfcxxd__new_dbg = (new_dbg_mfc_t)data.pmfcud__scalar_new_dbg_3p;
     assert(pmfcxxd__new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd__new_dbg(size, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd__new_dbg(size, file, line);
 }
 
@@ -1177,8 +1361,13 @@ void* MfcPatch<CRTVersion, debug>::mfcud__vector_new_dbg_4p (size_t      size,
     new_dbg_crt_t pmfcxxd__new_dbg = (new_dbg_crt_t)data.pmfcud__vector_new_dbg_4p;
     assert(pmfcxxd__new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd__new_dbg(size, type, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, size, debug, (CRTVersion >= 140));
 
     return pmfcxxd__new_dbg(size, type, file, line);
 }
@@ -1206,8 +1395,13 @@ void* MfcPatch<CRTVersion, debug>::mfcud__vector_new_dbg_3p (size_t      size,
     new_dbg_mfc_t pmfcxxd__new_dbg = (new_dbg_mfc_t)data.pmfcud__vector_new_dbg_3p;
     assert(pmfcxxd__new_dbg);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd__new_dbg(size, file, line);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd__new_dbg, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd__new_dbg(size, file, line);
 }
 
@@ -1227,8 +1421,13 @@ void* MfcPatch<CRTVersion, debug>::mfcud_scalar_new (size_t size)
     new_t pmfcxxd_new = (new_t)data.pmfcud_scalar_new;
     assert(pmfcxxd_new);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd_new(size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd_new, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd_new, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd_new(size);
 }
 
@@ -1248,8 +1447,13 @@ void* MfcPatch<CRTVersion, debug>::mfcud_vector_new (size_t size)
     new_t pmfcxxd_new = (new_t)data.pmfcud_vector_new;
     assert(pmfcxxd_new);
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pmfcxxd_new(size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pmfcxxd_new, context_, debug, (CRTVersion >= 140));
+    CaptureContext cc((void*)pmfcxxd_new, context_, size, debug, (CRTVersion >= 140));
     return pmfcxxd_new(size);
 }
 
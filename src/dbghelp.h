@@ -9,7 +9,7 @@ class DbgHelp
 {
 public:
     DbgHelp() {
-        m_lock.Initialize();
+        m_lock.Initialize(L"g_DbgHelp");
     }
     ~DbgHelp() {
         m_lock.Delete();
@@ -116,7 +116,7 @@ class ImageDirectoryEntries
 {
 public:
     ImageDirectoryEntries() {
-        m_lock.Initialize();
+        m_lock.Initialize(L"g_Ide");
     }
     ~ImageDirectoryEntries() {
         m_lock.Delete();
@@ -150,7 +150,7 @@ class LoadedModules
 {
 public:
     LoadedModules() {
-        m_lock.Initialize();
+        m_lock.Initialize(L"g_LoadedModules");
     }
     ~LoadedModules() {
         m_lock.Delete();
@@ -0,0 +1,389 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Allocation Event Trace
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#include "stdafx.h"
+#define VLDBUILD
+#include "eventtrace.h" // This class' header.
+#include "callstack.h"  // Provides the frames of the call stacks.
+#include "vldheap.h"    // Provides internal new and delete operators.
+
+// Constructor - Initializes the EventTrace, closed.
+//
+EventTrace::EventTrace ()
+{
+    m_rings     = NULL;
+    m_file      = INVALID_HANDLE_VALUE;
+    m_mapping   = NULL;
+    m_view      = NULL;
+    m_capacity  = 0;
+    m_size      = 0;
+    m_dropped   = 0;
+    m_stackFile = INVALID_HANDLE_VALUE;
+    m_stacks    = NULL;
+    m_writer    = NULL;
+    m_wake      = NULL;
+    m_done      = NULL;
+    m_stop      = 0;
+    m_open      = FALSE;
+    m_start.QuadPart = 0;
+}
+
+// open - Creates the trace files and starts the writer thread.
+//
+//  - path (IN): Path of the event file. The stack file has the same path
+//      followed by ".stacks". Existing files are replaced.
+//
+//  Return Value:
+//
+//    Returns TRUE if events are being recorded.
+//
+BOOL EventTrace::open (LPCWSTR path)
+{
+    WCHAR stackpath [MAX_PATH];
+    if ((wcscpy_s(stackpath, MAX_PATH, path) != 0) || (wcscat_s(stackpath, MAX_PATH, L".stacks") != 0))
+        return FALSE;
+
+    m_file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    m_stackFile = CreateFileW(stackpath, GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    m_wake = CreateEventW(NULL, FALSE, FALSE, NULL);
+    m_done = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if ((m_file == INVALID_HANDLE_VALUE) || (m_stackFile == INVALID_HANDLE_VALUE) ||
+        (m_wake == NULL) || (m_done == NULL) || !reserve(sizeof(VLD_TRACE_HEADER))) {
+        close();
+        return FALSE;
+    }
+
+    VLD_TRACE_STACK_HEADER stackheader = { 0 };
+    memcpy(stackheader.magic, VLD_TRACE_STACK_MAGIC, sizeof(stackheader.magic));
+    stackheader.version = VLD_TRACE_VERSION;
+    stackheader.headerSize = sizeof(stackheader);
+    DWORD written;
+    WriteFile(m_stackFile, &stackheader, sizeof(stackheader), &written, NULL);
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&m_start);
+    VLD_TRACE_HEADER *header = (VLD_TRACE_HEADER*)m_view;
+    memcpy(header->magic, VLD_TRACE_MAGIC, sizeof(header->magic));
+    header->version = VLD_TRACE_VERSION;
+    header->headerSize = sizeof(VLD_TRACE_HEADER);
+    header->eventSize = sizeof(VLD_TRACE_EVENT);
+    header->pointerSize = sizeof(void*);
+    header->processId = GetCurrentProcessId();
+    header->frequency = frequency.QuadPart;
+    header->startTime = m_start.QuadPart;
+    header->eventCount = 0;
+    header->droppedEvents = 0;
+    m_size = sizeof(VLD_TRACE_HEADER);
+    m_dropped = 0;
+
+    m_stacks = new Set<const CallStack*>;
+    m_stop = 0;
+    m_writer = CreateThread(NULL, 0, writerProc, this, 0, NULL);
+    if (m_writer == NULL) {
+        close();
+        return FALSE;
+    }
+    m_open = TRUE;
+    return TRUE;
+}
+
+// close - Stops recording events, writes the events that are still in the
+//   ring buffers and closes the trace files.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID EventTrace::close ()
+{
+    m_open = FALSE;
+    BOOL stopped = TRUE;
+    if (m_writer != NULL) {
+        // If the process is exiting, the writer thread has already been
+        // terminated. Otherwise it signals m_done once it has stopped (it
+        // can't exit while the loader lock is held).
+        InterlockedExchange(&m_stop, 1);
+        SetEvent(m_wake);
+        HANDLE handles [2] = { m_writer, m_done };
+        stopped = (WaitForMultipleObjects(2, handles, FALSE, EVENTTRACE_STOP_TIMEOUT) != WAIT_TIMEOUT);
+        CloseHandle(m_writer);
+        m_writer = NULL;
+    }
+    if (!stopped) {
+        // The writer thread may still be using the rings. Leave them alone.
+        return;
+    }
+    if (m_view != NULL) {
+        drain();
+        UnmapViewOfFile(m_view);
+        m_view = NULL;
+    }
+    if (m_mapping != NULL) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    if (m_file != INVALID_HANDLE_VALUE) {
+        // The mapping grows in large steps. Cut off what wasn't used.
+        LARGE_INTEGER size;
+        size.QuadPart = (LONGLONG)m_size;
+        SetFilePointerEx(m_file, size, NULL, FILE_BEGIN);
+        SetEndOfFile(m_file);
+        CloseHandle(m_file);
+        m_file = INVALID_HANDLE_VALUE;
+    }
+    if (m_stackFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(m_stackFile);
+        m_stackFile = INVALID_HANDLE_VALUE;
+    }
+    if (m_wake != NULL) {
+        CloseHandle(m_wake);
+        m_wake = NULL;
+    }
+    if (m_done != NULL) {
+        CloseHandle(m_done);
+        m_done = NULL;
+    }
+    while (m_rings != NULL) {
+        tracering_t *ring = m_rings;
+        m_rings = ring->next;
+        delete ring;
+    }
+    delete m_stacks;
+    m_stacks = NULL;
+    m_capacity = 0;
+    m_size = 0;
+}
+
+// append - Appends an event to the calling thread's ring buffer.
+//
+//  - ring (IN/OUT): The calling thread's ring buffer. Created if NULL.
+//
+//  - op (IN): VLD_TRACE_ALLOC, VLD_TRACE_FREE or VLD_TRACE_REALLOC.
+//
+//  - heap (IN): Handle of the heap.
+//
+//  - address (IN): Address of the block.
+//
+//  - oldAddress (IN): Previous address of a reallocated block, or NULL.
+//
+//  - size (IN): Size of the block, or 0 if it was freed.
+//
+//  - callstack (IN): Interned call stack of the allocation, or NULL.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID EventTrace::append (tracering_t *&ring, UINT32 op, HANDLE heap, LPCVOID address, LPCVOID oldAddress,
+    SIZE_T size, const CallStack *callstack)
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    if (ring == NULL)
+        ring = newRing();
+
+    // Only this thread writes head. The barrier after reading tail keeps the
+    // event from being written before the writer thread is done with its
+    // slot.
+    ULONG head = (ULONG)ring->head;
+    ULONG tail = (ULONG)ring->tail;
+    MemoryBarrier();
+    if (head - tail >= EVENTTRACE_RING_SIZE) {
+        // The ring is full. Waiting for the writer thread could deadlock, so
+        // drop the event, and make sure the writer is awake.
+        InterlockedIncrement(&ring->dropped);
+        SetEvent(m_wake);
+        return;
+    }
+
+    VLD_TRACE_EVENT &event = ring->events[head & (EVENTTRACE_RING_SIZE - 1)];
+    event.time       = (ULONG64)(now.QuadPart - m_start.QuadPart);
+    event.heap       = (ULONG64)(UINT_PTR)heap;
+    event.address    = (ULONG64)(UINT_PTR)address;
+    event.oldAddress = (ULONG64)(UINT_PTR)oldAddress;
+    event.size       = size;
+    event.stackId    = (ULONG64)(UINT_PTR)callstack;
+    event.threadId   = GetCurrentThreadId();
+    event.op         = op;
+
+    // Publish the event: the writer thread sees it before the new head.
+    InterlockedExchange(&ring->head, (LONG)(head + 1));
+    if (head + 1 - tail == EVENTTRACE_RING_SIZE / 2)
+        SetEvent(m_wake);
+}
+
+// writerproc - Thread procedure of the writer thread. Drains the rings until
+//   m_stop is set.
+//
+//  - param (IN): The EventTrace.
+//
+//  Return Value:
+//
+//    Returns 0.
+//
+DWORD __stdcall EventTrace::writerProc (LPVOID param)
+{
+    EventTrace *trace = (EventTrace*)param;
+    while (!trace->m_stop) {
+        WaitForSingleObject(trace->m_wake, EVENTTRACE_FLUSH_INTERVAL);
+        trace->drain();
+    }
+    SetEvent(trace->m_done);
+    return 0;
+}
+
+// drain - Moves the events from all of the rings to the event file, and writes
+//   the call stacks that they refer to which haven't been written yet. Only
+//   called by one thread at a time: the writer thread, or the thread closing
+//   the trace once the writer thread has stopped.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID EventTrace::drain ()
+{
+    ULONG64 dropped = m_dropped;
+    for (tracering_t *ring = m_rings; ring != NULL; ring = ring->next) {
+        // The barrier after reading head keeps the events from being read
+        // before the owning thread has written them.
+        ULONG head = (ULONG)ring->head;
+        MemoryBarrier();
+        ULONG tail = (ULONG)ring->tail;
+        dropped += (ULONG)ring->dropped;
+        if (head == tail)
+            continue;
+        if (!reserve(m_size + (ULONG64)(head - tail) * sizeof(VLD_TRACE_EVENT))) {
+            // Out of disk or address space. Drop the events.
+            dropped += head - tail;
+            m_dropped += head - tail;
+            InterlockedExchange(&ring->tail, (LONG)head);
+            continue;
+        }
+        for (; tail != head; tail++) {
+            const VLD_TRACE_EVENT &event = ring->events[tail & (EVENTTRACE_RING_SIZE - 1)];
+            const CallStack *callstack = (const CallStack*)(UINT_PTR)event.stackId;
+            if ((callstack != NULL) && (m_stacks->find(callstack) == m_stacks->end())) {
+                writeStack(callstack);
+                m_stacks->insert(callstack);
+            }
+            memcpy(m_view + m_size, &event, sizeof(VLD_TRACE_EVENT));
+            m_size += sizeof(VLD_TRACE_EVENT);
+        }
+
+        // Hand the slots back to the owning thread, once the events have been
+        // copied.
+        InterlockedExchange(&ring->tail, (LONG)tail);
+    }
+    if (m_view != NULL) {
+        VLD_TRACE_HEADER *header = (VLD_TRACE_HEADER*)m_view;
+        header->eventCount = (m_size - sizeof(VLD_TRACE_HEADER)) / sizeof(VLD_TRACE_EVENT);
+        header->droppedEvents = dropped;
+    }
+}
+
+// newring - Creates a ring buffer and adds it to the list of rings.
+//
+//  Return Value:
+//
+//    Returns the new ring buffer.
+//
+tracering_t* EventTrace::newRing ()
+{
+    tracering_t *ring = new tracering_t;
+    ring->head = 0;
+    ring->dropped = 0;
+    ring->tail = 0;
+    tracering_t *first;
+    do {
+        first = m_rings;
+        ring->next = first;
+    } while (InterlockedCompareExchangePointer((PVOID volatile*)&m_rings, ring, first) != first);
+    return ring;
+}
+
+// reserve - Makes sure that the event file mapping is large enough, growing
+//   the file in steps of EVENTTRACE_MAP_GROWTH bytes.
+//
+//  - bytes (IN): Required size of the event file, in bytes.
+//
+//  Return Value:
+//
+//    Returns TRUE if the mapping is large enough.
+//
+BOOL EventTrace::reserve (ULONG64 bytes)
+{
+    if (bytes <= m_capacity)
+        return (m_view != NULL);
+
+    ULONG64 capacity = m_capacity + EVENTTRACE_MAP_GROWTH;
+    if (capacity < bytes)
+        capacity = bytes;
+    if (m_view != NULL) {
+        UnmapViewOfFile(m_view);
+        m_view = NULL;
+    }
+    if (m_mapping != NULL) {
+        CloseHandle(m_mapping);
+        m_mapping = NULL;
+    }
+    if ((capacity > (SIZE_T)-1))
+        return FALSE;
+
+    m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READWRITE, (DWORD)(capacity >> 32), (DWORD)capacity, NULL);
+    if (m_mapping != NULL)
+        m_view = (BYTE*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)capacity);
+    if (m_view == NULL)
+        return FALSE;
+    m_capacity = capacity;
+    return TRUE;
+}
+
+// writestack - Writes a call stack to the stack file.
+//
+//  - callstack (IN): The call stack.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID EventTrace::writeStack (const CallStack *callstack)
+{
+    VLD_TRACE_STACK record = { 0 };
+    record.stackId = (ULONG64)(UINT_PTR)callstack;
+    record.frameCount = callstack->size();
+    DWORD written;
+    WriteFile(m_stackFile, &record, sizeof(record), &written, NULL);
+
+    ULONG64 frames [64];
+    UINT32 count = 0;
+    for (UINT32 index = 0; index < record.frameCount; index++) {
+        frames[count++] = (*callstack)[index];
+        if ((count == _countof(frames)) || (index + 1 == record.frameCount)) {
+            WriteFile(m_stackFile, frames, count * sizeof(ULONG64), &written, NULL);
+            count = 0;
+        }
+    }
+}
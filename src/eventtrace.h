@@ -0,0 +1,112 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Allocation Event Trace
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+"This header should only be included by Visual Leak Detector when building it from source. \
+Applications should never include this header."
+#endif
+
+#include <windows.h>
+#include "set.h"
+#include "vld_trace.h"
+
+#define EVENTTRACE_RING_SIZE      1024      // Events per thread ring buffer. Must be a power of two.
+#define EVENTTRACE_FLUSH_INTERVAL 10        // Longest time, in milliseconds, between two batches of events.
+#define EVENTTRACE_MAP_GROWTH     (64 * 1024 * 1024) // Bytes by which the event file grows when it is full.
+#define EVENTTRACE_STOP_TIMEOUT   5000      // Time, in milliseconds, to wait for the writer thread to stop.
+#define EVENTTRACE_CACHE_LINE     64
+
+class CallStack;
+
+// Each thread appends its events to a ring buffer of its own, which is drained
+// by the writer thread. The owning thread only writes head and dropped, and
+// the writer only writes tail, so no lock is needed. Each side publishes its
+// index with an interlocked exchange (release), after it is done with the
+// events, and reads the other side's index followed by a memory barrier
+// (acquire), before it touches them.
+struct tracering_t {
+    tracering_t      *next;     // Next ring in the list of all rings.
+    LONG volatile     head;     // Number of events appended by the owning thread.
+    LONG volatile     dropped;  // Number of events the owning thread dropped because the ring was full.
+    BYTE              padding [EVENTTRACE_CACHE_LINE - 2 * sizeof(LONG)];
+    LONG volatile     tail;     // Number of events drained by the writer thread.
+    VLD_TRACE_EVENT   events [EVENTTRACE_RING_SIZE];
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The EventTrace Class
+//
+//    Records every allocation, reallocation and free in a binary trace file
+//    (see vld_trace.h for the format). Threads append fixed size events to
+//    their own ring buffer, which costs a timestamp and a copy. A background
+//    thread drains the rings every EVENTTRACE_FLUSH_INTERVAL milliseconds, or
+//    as soon as one is half full, into a memory-mapped event file, and writes
+//    each call stack to the stack file the first time an event refers to it.
+//    If a ring is full, the event is dropped and counted in the trace header:
+//    the allocating thread never waits for the writer, which may itself be
+//    blocked on the loader lock, or allocating from the hooked heap.
+//
+//    Events identify call stacks by the address of their interned CallStack,
+//    which remains valid until Visual Leak Detector exits.
+//
+class EventTrace
+{
+public:
+    EventTrace ();
+    BOOL open (LPCWSTR path);
+    VOID close ();
+    BOOL isOpen () const
+    {
+        return m_open;
+    }
+    VOID append (tracering_t *&ring, UINT32 op, HANDLE heap, LPCVOID address, LPCVOID oldAddress,
+        SIZE_T size, const CallStack *callstack);
+
+private:
+    static DWORD __stdcall writerProc (LPVOID param);
+    VOID drain ();
+    tracering_t* newRing ();
+    BOOL reserve (ULONG64 bytes);
+    VOID writeStack (const CallStack *callstack);
+
+    tracering_t * volatile  m_rings;     // All of the ring buffers.
+    HANDLE                  m_file;      // The event file.
+    HANDLE                  m_mapping;   // Mapping of the event file.
+    BYTE                   *m_view;      // View of the whole event file.
+    ULONG64                 m_capacity;  // Size of the event file mapping, in bytes.
+    ULONG64                 m_size;      // Bytes written to the event file.
+    ULONG64                 m_dropped;   // Events dropped by the writer thread because the event file couldn't grow.
+    HANDLE                  m_stackFile; // The stack file.
+    Set<const CallStack*>  *m_stacks;    // Call stacks written to the stack file.
+    HANDLE                  m_writer;    // The writer thread.
+    HANDLE                  m_wake;      // Signaled to wake up the writer thread early.
+    HANDLE                  m_done;      // Signaled by the writer thread when it has stopped.
+    LONG volatile           m_stop;      // Set to stop the writer thread.
+    BOOL volatile           m_open;      // Events are being recorded.
+    LARGE_INTEGER           m_start;     // When the trace was opened.
+};
@@ -0,0 +1,237 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - CallStack Class Implementations (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// The symbol resolution of the CallStack class on Linux. The stack walkers
+// are in stackcapture.cpp, and the storage of the frames and the StackTable,
+// which are shared with Windows, in stacktable.cpp.
+
+#include "stdafx.h"
+
+#include <dlfcn.h>
+
+#define VLDBUILD
+#include "callstack.h"  // This class' header.
+#include "utility.h"    // Provides various utility functions.
+#include "vldheap.h"    // Provides internal new and delete operators.
+#include "linux/vldint.h" // Provides access to VLD internals.
+
+// Imported global variables.
+extern CriticalSection    g_heapMapLock;
+extern VisualLeakDetector g_vld;
+
+// Create - Creates a CallStack which walks the stack using the method selected
+//   by the "StackWalkMethod" option.
+//
+//  Return Value:
+//
+//    Returns a new CallStack.
+//
+CallStack* CallStack::Create()
+{
+    if (g_vld.GetOptions() & VLD_OPT_SAFE_STACK_WALK) {
+        return new CallStack(safe);
+    }
+    return new CallStack(fast);
+}
+
+// resolveFunction - Formats one frame of the call stack, like the Windows
+//   version does: "file (line): module!function() + 0x10 bytes", where the
+//   displacement is from the start of the line, or
+//   "module!function() + 0x10 bytes" when no source information is available,
+//   where it is from the start of the function. The module is found in the
+//   module registry, which also knows the modules that have been unloaded,
+//   the function in the module's symbol table and the line in its DWARF line
+//   tables (see symbolizer.h). C++ names are demangled, including their
+//   parameter list.
+//
+//  - programCounter (IN): The program counter address of the frame.
+//
+//  - stack_line (OUT): Buffer which receives the formatted frame.
+//
+//  - stackLineSize (IN): Size of the buffer, in characters.
+//
+//  Return Value:
+//
+//    Returns the length of the formatted frame, in characters.
+//
+DWORD CallStack::resolveFunction(SIZE_T programCounter, LPWSTR stack_line, DWORD stackLineSize) const
+{
+    LPCSTR  moduleName = "(Module name unavailable)";
+    LPCSTR  functionName = NULL;
+    SIZE_T  displacement = 0;
+    LPCSTR  fileName = NULL;
+    UINT32  lineNumber = 0;
+    // The program counter is a return address, which may be the first
+    // address after the end of the calling function. Look up the call
+    // instruction instead.
+    moduleinfo_t moduleinfo;
+    symbolinfo_t info;
+    if (g_vld.findModule(programCounter - 1, moduleinfo)) {
+        g_vld.m_symbolizer.resolve(programCounter - 1, moduleinfo.path.c_str(), moduleinfo.bias, info);
+        moduleName = strrchr(info.module, '/');
+        if (moduleName != NULL)
+            moduleName++;
+        else
+            moduleName = info.module;
+        if (info.function != NULL) {
+            functionName = info.function;
+            displacement = info.displacement + 1;
+        }
+        if (info.hasLine) {
+            fileName = info.line.file;
+            lineNumber = info.line.line;
+            displacement = info.line.displacement + 1;
+        }
+    }
+
+    // Without a function name, the address stands in for it.
+    CHAR address [32];
+    if (functionName == NULL) {
+        snprintf(address, sizeof(address), "0x%.*lX", (int)(2 * sizeof(UINT_PTR)), (unsigned long)programCounter);
+        functionName = address;
+    }
+    // Demangled C++ names already end with their parameter list.
+    LPCWSTR parameters = (strchr(functionName, '(') != NULL) ? L"" : L"()";
+
+    int NumChars;
+    if (fileName != NULL) {
+        if (displacement == 0) {
+            NumChars = swprintf(stack_line, stackLineSize, L"    %s (%u): %s!%s%ls\n",
+                fileName, lineNumber, moduleName, functionName, parameters);
+        }
+        else {
+            NumChars = swprintf(stack_line, stackLineSize, L"    %s (%u): %s!%s%ls + 0x%zX bytes\n",
+                fileName, lineNumber, moduleName, functionName, parameters, displacement);
+        }
+    }
+    else if (displacement == 0) {
+        NumChars = swprintf(stack_line, stackLineSize, L"    %s!%s%ls\n",
+            moduleName, functionName, parameters);
+    }
+    else {
+        NumChars = swprintf(stack_line, stackLineSize, L"    %s!%s%ls + 0x%zX bytes\n",
+            moduleName, functionName, parameters, displacement);
+    }
+    if (NumChars < 0) {
+        // Truncated.
+        stack_line[stackLineSize - 1] = L'\0';
+        NumChars = (int)wcslen(stack_line);
+    }
+    return (DWORD)NumChars;
+}
+
+// isCrtStartupAlloc - Determines whether the memory leak was generated from crt
+//   startup code. The C library on Linux has no such allocations.
+//
+//  Return Value:
+//
+//    Always false.
+//
+bool CallStack::isCrtStartupAlloc()
+{
+    return false;
+}
+
+// dump - Dumps a nicely formatted rendition of the CallStack, including
+//   symbolic information (function names) if available.
+//
+//  - showinternalframes (IN): If true, then all frames in the CallStack will be
+//      dumped. Otherwise, frames internal to VLD will not be dumped.
+//
+//  Return Value:
+//
+//    None.
+//
+void CallStack::dump(BOOL showInternalFrames)
+{
+    resolve(showInternalFrames);
+
+    // The stack was resolved already
+    if (m_resolved) {
+        return Print(m_resolved);
+    }
+}
+
+// resolve - Creates a nicely formatted rendition of the CallStack, including
+//   symbolic information (function names) if available, and saves it for
+//   later retrieval.
+//
+//  - showInternalFrames (IN): If true, then all frames in the CallStack will be
+//      dumped. Otherwise, frames internal to VLD will not be dumped.
+//
+//  Return Value:
+//
+//    Returns the number of frames that could not be resolved.
+//
+int CallStack::resolve(BOOL showInternalFrames)
+{
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    if (isResolved(showInternalFrames))
+    {
+        // already resolved, no need to do it again
+        // resolving twice may report an incorrect module for the stack frames
+        // if the memory was leaked in a dynamic library that was already unloaded.
+        return 0;
+    }
+
+    // Use static here to increase performance, and avoid heap allocs.
+    // It's thread safe because of g_heapMapLock lock.
+    static WCHAR stack_line[MAXREPORTLENGTH + 1] = L"";
+
+    const size_t max_line_length = MAXREPORTLENGTH + 1;
+    const size_t resolvedCapacity = m_size * max_line_length + 1;
+    m_resolved = new WCHAR[resolvedCapacity];
+    m_resolved[0] = L'\0';
+    size_t resolvedLength = 0;
+
+    // Iterate through each frame in the call stack.
+    for (UINT32 frame = 0; frame < m_size; frame++)
+    {
+        SIZE_T programCounter = (*this)[frame];
+        if (!showInternalFrames) {
+            Dl_info info;
+            if ((dladdr((void*)(programCounter - 1), &info) != 0) &&
+                ((UINT_PTR)info.dli_fbase == g_vld.m_vldBase)) {
+                // Don't show frames in VLD itself.
+                continue;
+            }
+        }
+
+        DWORD NumChars = resolveFunction(programCounter, stack_line, _countof(stack_line));
+        wcsncpy(m_resolved + resolvedLength, stack_line, NumChars + 1);
+        resolvedLength += NumChars;
+    }
+
+    if (showInternalFrames)
+        m_status |= CALLSTACK_STATUS_INTERNALFRAMES;
+    return 0;
+}
+
+// getResolvedCallstack - Resolves the call stack, if it hasn't been resolved
+//   yet, and returns the formatted call stack.
+//
+const WCHAR* CallStack::getResolvedCallstack( BOOL showinternalframes )
+{
+    resolve(showinternalframes);
+    return m_resolved;
+}
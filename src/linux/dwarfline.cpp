@@ -0,0 +1,896 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - DWARF Line Tables (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+
+#define VLDBUILD
+#include "linux/dwarfline.h"
+#include "vldheap.h"    // Provides internal new and delete operators.
+
+// Standard opcodes of the line number programs.
+#define DW_LNS_copy               0x01
+#define DW_LNS_advance_pc         0x02
+#define DW_LNS_advance_line       0x03
+#define DW_LNS_set_file           0x04
+#define DW_LNS_const_add_pc       0x08
+#define DW_LNS_fixed_advance_pc   0x09
+
+// Extended opcodes.
+#define DW_LNE_end_sequence       0x01
+#define DW_LNE_set_address        0x02
+#define DW_LNE_define_file        0x03
+
+// Content types of the DWARF 5 directory and file name entries.
+#define DW_LNCT_path              0x1
+#define DW_LNCT_directory_index   0x2
+
+// Forms which may appear in the DWARF 5 directory and file name entries.
+#define DW_FORM_block2            0x03
+#define DW_FORM_block4            0x04
+#define DW_FORM_data2             0x05
+#define DW_FORM_data4             0x06
+#define DW_FORM_data8             0x07
+#define DW_FORM_string            0x08
+#define DW_FORM_block             0x09
+#define DW_FORM_block1            0x0a
+#define DW_FORM_data1             0x0b
+#define DW_FORM_sdata             0x0d
+#define DW_FORM_strp              0x0e
+#define DW_FORM_udata             0x0f
+#define DW_FORM_strx              0x1a
+#define DW_FORM_data16            0x1e
+#define DW_FORM_line_strp         0x1f
+#define DW_FORM_strx1             0x25
+#define DW_FORM_strx2             0x26
+#define DW_FORM_strx3             0x27
+#define DW_FORM_strx4             0x28
+
+#define ROW_END_SEQUENCE          0xFFFFFFFF // row_t::file of the rows which end a sequence.
+
+namespace {
+
+// Reads the encoded values of a section, checking every read against the end
+// of the data. Reading past the end returns zeros and marks the reader as
+// failed, so that callers need only check once.
+class Reader
+{
+public:
+    Reader (const BYTE *data, SIZE_T size) : m_pos(data), m_end(data + size), m_ok(true) {}
+
+    bool ok () const { return m_ok; }
+    const BYTE* pos () const { return m_pos; }
+    SIZE_T remaining () const { return (SIZE_T)(m_end - m_pos); }
+
+    void seek (const BYTE *pos)
+    {
+        if ((pos < m_pos) || (pos > m_end)) {
+            fail();
+            return;
+        }
+        m_pos = pos;
+    }
+
+    void skip (SIZE_T size)
+    {
+        if (need(size))
+            m_pos += size;
+    }
+
+    UINT64 fixed (UINT32 size)
+    {
+        // DWARF data is in the object's byte order, which is the native one.
+        UINT64 value = 0;
+        if ((size > sizeof(value)) || !need(size))
+            return 0;
+        switch (size) {
+        case 1: { UINT8  v; memcpy(&v, m_pos, 1); value = v; break; }
+        case 2: { UINT16 v; memcpy(&v, m_pos, 2); value = v; break; }
+        case 4: { UINT32 v; memcpy(&v, m_pos, 4); value = v; break; }
+        case 8: { UINT64 v; memcpy(&v, m_pos, 8); value = v; break; }
+        default:
+            fail();
+            return 0;
+        }
+        m_pos += size;
+        return value;
+    }
+
+    UINT8  u8 ()  { return (UINT8)fixed(1); }
+    UINT16 u16 () { return (UINT16)fixed(2); }
+    UINT32 u32 () { return (UINT32)fixed(4); }
+    UINT64 u64 () { return fixed(8); }
+
+    // offset - Reads a section offset, which is 8 bytes wide in the 64-bit
+    //   DWARF format and 4 bytes wide otherwise.
+    UINT64 offset (bool dwarf64) { return dwarf64 ? u64() : u32(); }
+
+    UINT64 uleb ()
+    {
+        UINT64 value = 0;
+        UINT32 shift = 0;
+        for (;;) {
+            if (!need(1))
+                return 0;
+            BYTE byte = *m_pos++;
+            if (shift < 64)
+                value |= (UINT64)(byte & 0x7F) << shift;
+            shift += 7;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+    }
+
+    INT64 sleb ()
+    {
+        INT64  value = 0;
+        UINT32 shift = 0;
+        BYTE   byte;
+        do {
+            if (!need(1))
+                return 0;
+            byte = *m_pos++;
+            if (shift < 64)
+                value |= (INT64)((UINT64)(byte & 0x7F) << shift);
+            shift += 7;
+        } while ((byte & 0x80) != 0);
+        if ((shift < 64) && ((byte & 0x40) != 0))
+            value |= -((INT64)1 << shift);
+        return value;
+    }
+
+    // cstr - Reads a null terminated string, which is returned in place.
+    LPCSTR cstr ()
+    {
+        const BYTE *end = (const BYTE*)memchr(m_pos, 0, remaining());
+        if (end == NULL) {
+            fail();
+            return "";
+        }
+        LPCSTR string = (LPCSTR)m_pos;
+        m_pos = end + 1;
+        return string;
+    }
+
+private:
+    bool need (SIZE_T size)
+    {
+        if (remaining() < size) {
+            fail();
+            return false;
+        }
+        return true;
+    }
+
+    void fail ()
+    {
+        m_ok = false;
+        m_pos = m_end;
+    }
+
+    const BYTE *m_pos;
+    const BYTE *m_end;
+    bool        m_ok;
+};
+
+// A growable array of plain data, allocated from VLD's heap.
+template <typename T>
+class Buffer
+{
+public:
+    Buffer () : m_items(NULL), m_count(0), m_capacity(0) {}
+    ~Buffer () { delete [] m_items; }
+
+    void push (const T &item)
+    {
+        if (m_count == m_capacity) {
+            UINT32 capacity = (m_capacity == 0) ? 16 : m_capacity * 2;
+            T *items = new T [capacity];
+            if (m_count != 0)
+                memcpy(items, m_items, m_count * sizeof(T));
+            delete [] m_items;
+            m_items = items;
+            m_capacity = capacity;
+        }
+        m_items[m_count++] = item;
+    }
+
+    // detach - Returns the items, which the caller now owns, and empties the
+    //   buffer.
+    T* detach ()
+    {
+        T *items = m_items;
+        m_items = NULL;
+        m_count = m_capacity = 0;
+        return items;
+    }
+
+    T& operator [] (UINT32 index) { return m_items[index]; }
+    UINT32 size () const { return m_count; }
+
+private:
+    T      *m_items;
+    UINT32  m_count;
+    UINT32  m_capacity;
+
+    Buffer (const Buffer &other);
+    Buffer& operator = (const Buffer &other);
+};
+
+// joinPath - Appends a relative path to a directory. Absolute paths are
+//   returned as they are.
+//
+//  Return Value:
+//
+//    Returns the joined path, allocated with new [].
+//
+LPSTR joinPath (LPCSTR directory, LPCSTR path)
+{
+    SIZE_T pathLength = strlen(path);
+    SIZE_T directoryLength = ((directory != NULL) && (path[0] != '/')) ? strlen(directory) : 0;
+    LPSTR joined = new CHAR [directoryLength + 1 + pathLength + 1];
+    SIZE_T length = 0;
+    if (directoryLength != 0) {
+        memcpy(joined, directory, directoryLength);
+        length = directoryLength;
+        if (joined[length - 1] != '/')
+            joined[length++] = '/';
+    }
+    memcpy(joined + length, path, pathLength + 1);
+    return joined;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The LineProgram Class
+//
+//    Decodes the line number program of one compilation unit: the header,
+//    the file names, and the program itself, which is run as the state
+//    machine described by the DWARF standard. The rows it produces are passed
+//    to a sink, so that the same code builds the index of sequences and the
+//    rows of a unit.
+//
+class LineProgram
+{
+public:
+    LineProgram (const LineTable &table) : m_table(table), m_reader(NULL, 0) {}
+
+    // open - Reads the header of the unit at an offset in .debug_line.
+    //
+    //  - offset (IN): Offset of the unit.
+    //
+    //  - next (OUT): Receives the offset of the next unit, or 0 if the unit's
+    //      length is invalid (there is no next unit then).
+    //
+    //  Return Value:
+    //
+    //    Returns TRUE if the unit is supported and its header is valid.
+    //
+    BOOL open (SIZE_T offset, SIZE_T &next)
+    {
+        next = 0;
+        const elfsection_t &lines = m_table.m_lines;
+        Reader header (lines.data + offset, lines.size - offset);
+        UINT64 length = header.u32();
+        m_dwarf64 = (length == 0xFFFFFFFF);
+        if (m_dwarf64)
+            length = header.u64();
+        if (!header.ok() || (length > header.remaining()))
+            return FALSE;
+        next = (SIZE_T)(header.pos() + length - lines.data);
+        const BYTE *end = header.pos() + length;
+
+        m_version = header.u16();
+        if ((m_version < 2) || (m_version > 5))
+            return FALSE;
+        if (m_version >= 5) {
+            // DW_LNE_set_address has its own length, so the address size
+            // isn't needed.
+            header.u8(); // address_size
+            header.u8(); // segment_selector_size
+        }
+        UINT64 headerLength = header.offset(m_dwarf64);
+        if (!header.ok() || (headerLength > (UINT64)(end - header.pos())))
+            return FALSE;
+        const BYTE *program = header.pos() + headerLength;
+
+        m_minInstructionLength = header.u8();
+        if (m_version >= 4)
+            header.u8(); // maximum_operations_per_instruction: VLIW only.
+        header.u8(); // default_is_stmt: all rows are used.
+        m_lineBase = (INT8)header.u8();
+        m_lineRange = header.u8();
+        m_opcodeBase = header.u8();
+        if (!header.ok() || (m_lineRange == 0) || (m_opcodeBase == 0))
+            return FALSE;
+        m_opcodeLengths = header.pos();
+        header.skip(m_opcodeBase - 1);
+        if (!header.ok() || (header.pos() > program))
+            return FALSE;
+        m_tables = header.pos();
+        m_reader = Reader(program, (SIZE_T)(end - program));
+        m_tablesEnd = program;
+        return TRUE;
+    }
+
+    // readFiles - Reads the directory and file name tables of the unit, which
+    //   was opened with open().
+    //
+    //  - files (OUT): Receives the paths of the files, indexed by file number.
+    //
+    //  Return Value:
+    //
+    //    Returns TRUE if the tables are valid.
+    //
+    BOOL readFiles (Buffer<LPSTR> &files)
+    {
+        Reader tables (m_tables, (SIZE_T)(m_tablesEnd - m_tables));
+        Buffer<LPCSTR> directories;
+        if (m_version < 5) {
+            // The compilation directory isn't recorded here: directory 0 and
+            // the files in it are left relative.
+            directories.push(NULL);
+            for (;;) {
+                LPCSTR directory = tables.cstr();
+                if (!tables.ok() || (directory[0] == '\0'))
+                    break;
+                directories.push(directory);
+            }
+            // File numbers start at 1.
+            files.push(NULL);
+            for (;;) {
+                LPCSTR name = tables.cstr();
+                if (!tables.ok() || (name[0] == '\0'))
+                    break;
+                UINT64 directory = tables.uleb();
+                tables.uleb(); // Modification time.
+                tables.uleb(); // Length.
+                files.push(makePath(directories, directory, name));
+            }
+            return tables.ok();
+        }
+
+        // DWARF 5: the entries are described by lists of (content, form).
+        // Directory 0 is the compilation directory.
+        Buffer<UINT64> formats;
+        UINT32 formatCount = tables.u8();
+        for (UINT32 index = 0; index < 2 * formatCount; index++)
+            formats.push(tables.uleb());
+        UINT64 count = tables.uleb();
+        for (UINT64 entry = 0; (entry < count) && tables.ok(); entry++) {
+            LPCSTR path = NULL;
+            UINT64 directory = 0;
+            if (!readEntry(tables, formats, path, directory))
+                return FALSE;
+            directories.push(path);
+        }
+
+        Buffer<UINT64> fileFormats;
+        formatCount = tables.u8();
+        for (UINT32 index = 0; index < 2 * formatCount; index++)
+            fileFormats.push(tables.uleb());
+        count = tables.uleb();
+        for (UINT64 entry = 0; (entry < count) && tables.ok(); entry++) {
+            LPCSTR path = NULL;
+            UINT64 directory = 0;
+            if (!readEntry(tables, fileFormats, path, directory))
+                return FALSE;
+            files.push((path != NULL) ? makePath(directories, directory, path) : NULL);
+        }
+        return tables.ok();
+    }
+
+    // run - Runs the line number program of the unit, which was opened with
+    //   open(), and passes the rows it produces to a sink:
+    //
+    //     sink.row(address, line, file) for each row,
+    //     sink.endSequence(address) at the end of each sequence, with the
+    //       address after the last address of the sequence,
+    //     sink.defineFile(name, directory) for each DW_LNE_define_file.
+    //
+    template <typename Sink>
+    VOID run (Sink &sink)
+    {
+        Reader &program = m_reader;
+        UINT_PTR address = 0;
+        UINT32   file = 1;
+        INT64    line = 1;
+        while (program.ok() && (program.remaining() != 0)) {
+            UINT8 opcode = program.u8();
+            if (opcode >= m_opcodeBase) {
+                // Special opcode: advances the address and the line at once.
+                UINT32 adjusted = opcode - m_opcodeBase;
+                address += (adjusted / m_lineRange) * m_minInstructionLength;
+                line += m_lineBase + (INT64)(adjusted % m_lineRange);
+                sink.row(address, (UINT32)line, file);
+                continue;
+            }
+
+            switch (opcode) {
+            case 0: {
+                // Extended opcode.
+                UINT64 length = program.uleb();
+                if (!program.ok() || (length == 0) || (length > program.remaining()))
+                    return;
+                const BYTE *next = program.pos() + length;
+                switch (program.u8()) {
+                case DW_LNE_end_sequence:
+                    sink.endSequence(address);
+                    address = 0;
+                    file = 1;
+                    line = 1;
+                    break;
+                case DW_LNE_set_address:
+                    address = (UINT_PTR)program.fixed((UINT32)length - 1);
+                    break;
+                case DW_LNE_define_file: {
+                    LPCSTR name = program.cstr();
+                    UINT64 directory = program.uleb();
+                    if (program.ok())
+                        sink.defineFile(name, directory);
+                    break;
+                }
+                default:
+                    break;
+                }
+                program.seek(next);
+                break;
+            }
+            case DW_LNS_copy:
+                sink.row(address, (UINT32)line, file);
+                break;
+            case DW_LNS_advance_pc:
+                address += (UINT_PTR)program.uleb() * m_minInstructionLength;
+                break;
+            case DW_LNS_advance_line:
+                line += program.sleb();
+                break;
+            case DW_LNS_set_file:
+                file = (UINT32)program.uleb();
+                break;
+            case DW_LNS_const_add_pc:
+                address += ((255 - m_opcodeBase) / m_lineRange) * m_minInstructionLength;
+                break;
+            case DW_LNS_fixed_advance_pc:
+                address += program.u16();
+                break;
+            default:
+                // Other standard opcodes don't affect the rows. Skip their
+                // operands, whose number the header gives.
+                for (UINT32 operand = 0; operand < m_opcodeLengths[opcode - 1]; operand++)
+                    program.uleb();
+                break;
+            }
+        }
+    }
+
+    // makePath - Builds the path of a file from its directory and its name.
+    LPSTR makePath (Buffer<LPCSTR> &directories, UINT64 directory, LPCSTR name)
+    {
+        if ((directory >= directories.size()) || (directories[(UINT32)directory] == NULL))
+            return joinPath(NULL, name);
+        LPCSTR path = directories[(UINT32)directory];
+        if ((m_version >= 5) && (directory != 0) && (path[0] != '/') && (directories[0] != NULL)) {
+            // Relative to the compilation directory.
+            LPSTR base = joinPath(directories[0], path);
+            LPSTR joined = joinPath(base, name);
+            delete [] base;
+            return joined;
+        }
+        return joinPath(path, name);
+    }
+
+private:
+    // readEntry - Reads one DWARF 5 directory or file name entry.
+    BOOL readEntry (Reader &tables, Buffer<UINT64> &formats, LPCSTR &path, UINT64 &directory)
+    {
+        for (UINT32 index = 0; index + 1 < formats.size(); index += 2) {
+            UINT64 content = formats[index];
+            UINT64 form = formats[index + 1];
+            LPCSTR string = NULL;
+            UINT64 value = 0;
+            switch (form) {
+            case DW_FORM_string:    string = tables.cstr(); break;
+            case DW_FORM_line_strp: string = sectionString(m_table.m_lineStrings, tables.offset(m_dwarf64)); break;
+            case DW_FORM_strp:      string = sectionString(m_table.m_strings, tables.offset(m_dwarf64)); break;
+            case DW_FORM_strx:      tables.uleb(); break; // Needs .debug_str_offsets: unsupported.
+            case DW_FORM_strx1:     tables.skip(1); break;
+            case DW_FORM_strx2:     tables.skip(2); break;
+            case DW_FORM_strx3:     tables.skip(3); break;
+            case DW_FORM_strx4:     tables.skip(4); break;
+            case DW_FORM_udata:     value = tables.uleb(); break;
+            case DW_FORM_sdata:     value = (UINT64)tables.sleb(); break;
+            case DW_FORM_data1:     value = tables.u8(); break;
+            case DW_FORM_data2:     value = tables.u16(); break;
+            case DW_FORM_data4:     value = tables.u32(); break;
+            case DW_FORM_data8:     value = tables.u64(); break;
+            case DW_FORM_data16:    tables.skip(16); break;
+            case DW_FORM_block:     tables.skip((SIZE_T)tables.uleb()); break;
+            case DW_FORM_block1:    tables.skip(tables.u8()); break;
+            case DW_FORM_block2:    tables.skip(tables.u16()); break;
+            case DW_FORM_block4:    tables.skip(tables.u32()); break;
+            default:
+                // The size of an unknown form is unknown.
+                return FALSE;
+            }
+            if (content == DW_LNCT_path)
+                path = string;
+            else if (content == DW_LNCT_directory_index)
+                directory = value;
+        }
+        return tables.ok();
+    }
+
+    static LPCSTR sectionString (const elfsection_t &section, UINT64 offset)
+    {
+        if ((section.data == NULL) || (offset >= section.size))
+            return NULL;
+        LPCSTR string = (LPCSTR)section.data + offset;
+        if (memchr(string, 0, section.size - (SIZE_T)offset) == NULL)
+            return NULL;
+        return string;
+    }
+
+    const LineTable &m_table;
+    Reader      m_reader;               // Reads the program.
+    const BYTE *m_tables;               // The directory and file name tables.
+    const BYTE *m_tablesEnd;
+    const BYTE *m_opcodeLengths;        // Number of operands of each standard opcode.
+    UINT16      m_version;
+    bool        m_dwarf64;
+    UINT8       m_minInstructionLength;
+    INT8        m_lineBase;
+    UINT8       m_lineRange;
+    UINT8       m_opcodeBase;
+};
+
+namespace {
+
+// Sink which records the address range of each sequence of a unit.
+struct sequencesink_t {
+    Buffer<UINT_PTR> *ranges;   // Pairs of (low, high).
+    UINT_PTR          low;
+    bool              started;  // A row of the current sequence has been seen.
+
+    void row (UINT_PTR address, UINT32, UINT32)
+    {
+        if (!started) {
+            low = address;
+            started = true;
+        }
+    }
+
+    void endSequence (UINT_PTR address)
+    {
+        // Sequences of code which the linker discarded are left at address 0
+        // (or at -1 or -2 with some linkers).
+        if (started && (low != 0) && (low < address)) {
+            ranges->push(low);
+            ranges->push(address);
+        }
+        started = false;
+    }
+
+    void defineFile (LPCSTR, UINT64) {}
+};
+
+struct rowsort_t {
+    UINT_PTR low;      // First address of the sequence.
+    UINT32   first;    // Index of the sequence's first row.
+    UINT32   count;    // Number of rows, including the end of the sequence.
+
+    bool operator < (const rowsort_t &other) const
+    {
+        return low < other.low;
+    }
+};
+
+// Sink which stores the rows of a unit.
+// It is a template because the row type is private to LineTable.
+template <typename Row>
+struct rowsink_t {
+    Buffer<Row>       *rows;
+    Buffer<rowsort_t> *sequences;
+    Buffer<LPSTR>     *files;
+    UINT32             first;   // Index of the first row of the current sequence.
+
+    void row (UINT_PTR address, UINT32 line, UINT32 file)
+    {
+        Row row = { address, line, file };
+        rows->push(row);
+    }
+
+    void endSequence (UINT_PTR address)
+    {
+        if (rows->size() == first)
+            return;
+        Row row = { address, 0, ROW_END_SEQUENCE };
+        rows->push(row);
+        rowsort_t sequence = { (*rows)[first].address, first, rows->size() - first };
+        if (sequence.low != 0)
+            sequences->push(sequence);
+        first = rows->size();
+    }
+
+    void defineFile (LPCSTR name, UINT64 directory)
+    {
+        // Only in DWARF 4 and earlier, whose directories aren't kept.
+        UNREFERENCED_PARAMETER(directory);
+        files->push(joinPath(NULL, name));
+    }
+};
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// LineTable Class Implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Constructor - Initializes the LineTable with no line information.
+//
+LineTable::LineTable ()
+{
+    ZeroMemory(&m_lines, sizeof(m_lines));
+    ZeroMemory(&m_lineStrings, sizeof(m_lineStrings));
+    ZeroMemory(&m_strings, sizeof(m_strings));
+    m_index = NULL;
+}
+
+// Destructor - Frees the index and the decoded units.
+//
+LineTable::~LineTable ()
+{
+    clear();
+}
+
+// load - Locates the line number information of an ELF object. Nothing is
+//   decoded until the first lookup.
+//
+//  - file (IN): The object. It must stay open for as long as the table is
+//      used.
+//
+//  Return Value:
+//
+//    Returns TRUE if the object has line number information.
+//
+BOOL LineTable::load (const ElfFile &file)
+{
+    clear();
+    if (!file.findSection(".debug_line", m_lines))
+        return FALSE;
+    if (!file.findSection(".debug_line_str", m_lineStrings))
+        ZeroMemory(&m_lineStrings, sizeof(m_lineStrings));
+    if (!file.findSection(".debug_str", m_strings))
+        ZeroMemory(&m_strings, sizeof(m_strings));
+    return TRUE;
+}
+
+// clear - Frees the index and the decoded units. Must not be called while
+//   other threads may look up addresses.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID LineTable::clear ()
+{
+    index_t *index = m_index;
+    if (index != NULL) {
+        for (UINT32 unit = 0; unit < index->unitCount; unit++) {
+            if (index->units[unit] != NULL)
+                freeUnit(index->units[unit]);
+        }
+        delete [] index->sequences;
+        delete [] index->unitOffsets;
+        delete [] index->units;
+        delete index;
+    }
+    m_index = NULL;
+    ZeroMemory(&m_lines, sizeof(m_lines));
+    ZeroMemory(&m_lineStrings, sizeof(m_lineStrings));
+    ZeroMemory(&m_strings, sizeof(m_strings));
+}
+
+VOID LineTable::freeUnit (unit_t *unit)
+{
+    for (UINT32 file = 0; file < unit->fileCount; file++)
+        delete [] unit->files[file];
+    delete [] unit->files;
+    delete [] unit->rows;
+    delete unit;
+}
+
+// getIndex - Obtains the index of sequences, building it if this is the first
+//   lookup.
+//
+//  Return Value:
+//
+//    Returns the index.
+//
+LineTable::index_t* LineTable::getIndex ()
+{
+    index_t *index = __atomic_load_n(&m_index, __ATOMIC_ACQUIRE);
+    if (index != NULL)
+        return index;
+
+    Buffer<SIZE_T>   offsets;
+    Buffer<UINT_PTR> ranges;
+    Buffer<UINT32>   rangeUnits;
+    SIZE_T offset = 0;
+    while (offset < m_lines.size) {
+        LineProgram program (*this);
+        SIZE_T next;
+        if (program.open(offset, next)) {
+            UINT32 first = ranges.size();
+            sequencesink_t sink = { &ranges, 0, false };
+            program.run(sink);
+            for (UINT32 range = first; range < ranges.size(); range += 2)
+                rangeUnits.push(offsets.size());
+        }
+        offsets.push(offset);
+        if (next <= offset)
+            break;
+        offset = next;
+    }
+
+    index = new index_t;
+    index->sequenceCount = ranges.size() / 2;
+    index->sequences = new sequence_t [(index->sequenceCount != 0) ? index->sequenceCount : 1];
+    for (UINT32 sequence = 0; sequence < index->sequenceCount; sequence++) {
+        index->sequences[sequence].low = ranges[2 * sequence];
+        index->sequences[sequence].high = ranges[2 * sequence + 1];
+        index->sequences[sequence].unit = rangeUnits[sequence];
+    }
+    std::sort(index->sequences, index->sequences + index->sequenceCount,
+        [] (const sequence_t &a, const sequence_t &b) { return a.low < b.low; });
+    index->unitCount = offsets.size();
+    index->unitOffsets = offsets.detach();
+    index->units = new unit_t* [(index->unitCount != 0) ? index->unitCount : 1];
+    ZeroMemory((PVOID)index->units, index->unitCount * sizeof(unit_t*));
+
+    // Publish it, unless another thread has built it in the meantime.
+    index_t *existing = NULL;
+    if (!__atomic_compare_exchange_n(&m_index, &existing, index, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        delete [] index->sequences;
+        delete [] index->unitOffsets;
+        delete [] index->units;
+        delete index;
+        return existing;
+    }
+    return index;
+}
+
+// getUnit - Obtains the decoded rows of a unit, decoding them if this is the
+//   first lookup in the unit.
+//
+//  - index (IN): The index.
+//
+//  - unit (IN): Index of the unit.
+//
+//  Return Value:
+//
+//    Returns the decoded unit, or NULL if the unit is invalid.
+//
+LineTable::unit_t* LineTable::getUnit (index_t *index, UINT32 unit)
+{
+    unit_t *decoded = __atomic_load_n(&index->units[unit], __ATOMIC_ACQUIRE);
+    if (decoded != NULL)
+        return decoded;
+
+    LineProgram program (*this);
+    SIZE_T next;
+    if (!program.open(index->unitOffsets[unit], next))
+        return NULL;
+    Buffer<LPSTR> files;
+    if (!program.readFiles(files)) {
+        for (UINT32 file = 0; file < files.size(); file++)
+            delete [] files[file];
+        return NULL;
+    }
+    Buffer<row_t>     rows;
+    Buffer<rowsort_t> sequences;
+    rowsink_t<row_t> sink = { &rows, &sequences, &files, 0 };
+    program.run(sink);
+
+    // Sequences may be in any order: sort them by address, keeping the rows
+    // of each sequence in order.
+    std::sort(&sequences[0], &sequences[0] + sequences.size());
+    decoded = new unit_t;
+    UINT32 rowCount = 0;
+    for (UINT32 sequence = 0; sequence < sequences.size(); sequence++)
+        rowCount += sequences[sequence].count;
+    decoded->rows = new row_t [(rowCount != 0) ? rowCount : 1];
+    decoded->rowCount = 0;
+    for (UINT32 sequence = 0; sequence < sequences.size(); sequence++) {
+        memcpy(decoded->rows + decoded->rowCount, &rows[sequences[sequence].first],
+            sequences[sequence].count * sizeof(row_t));
+        decoded->rowCount += sequences[sequence].count;
+    }
+    decoded->fileCount = files.size();
+    decoded->files = files.detach();
+
+    // Publish it, unless another thread has decoded it in the meantime.
+    unit_t *existing = NULL;
+    if (!__atomic_compare_exchange_n(&index->units[unit], &existing, decoded, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        freeUnit(decoded);
+        return existing;
+    }
+    return decoded;
+}
+
+// find - Finds the source line which contains an address.
+//
+//  - address (IN): The address, relative to the object's load address.
+//
+//  - info (OUT): Receives the file and the line. The file name remains valid
+//      until the table is cleared.
+//
+//  Return Value:
+//
+//    Returns TRUE if the address has line information, FALSE otherwise.
+//
+BOOL LineTable::find (UINT_PTR address, lineinfo_t &info)
+{
+    if (m_lines.data == NULL)
+        return FALSE;
+    index_t *index = getIndex();
+
+    // Find the sequence which contains the address.
+    UINT32 low = 0;
+    UINT32 high = index->sequenceCount;
+    while (low < high) {
+        UINT32 middle = low + (high - low) / 2;
+        if (index->sequences[middle].low <= address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if ((low == 0) || (address >= index->sequences[low - 1].high))
+        return FALSE;
+    unit_t *unit = getUnit(index, index->sequences[low - 1].unit);
+    if (unit == NULL)
+        return FALSE;
+
+    // Find the last row at or before the address.
+    low = 0;
+    high = unit->rowCount;
+    while (low < high) {
+        UINT32 middle = low + (high - low) / 2;
+        if (unit->rows[middle].address <= address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0)
+        return FALSE;
+    const row_t &row = unit->rows[low - 1];
+    if ((row.file == ROW_END_SEQUENCE) || (row.file >= unit->fileCount) || (unit->files[row.file] == NULL))
+        return FALSE;
+    info.file = unit->files[row.file];
+    info.line = row.line;
+    info.displacement = address - row.address;
+    return TRUE;
+}
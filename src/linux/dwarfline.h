@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - DWARF Line Tables (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+"This header should only be included by Visual Leak Detector when building it from source. \
+Applications should never include this header."
+#endif
+
+#include "linux/platform.h"
+#include "linux/elffile.h"
+
+// The source line which contains an address, as found by LineTable::find.
+struct lineinfo_t {
+    LPCSTR file;         // Path of the source file.
+    UINT32 line;         // Line number.
+    SIZE_T displacement; // Offset of the address from the first address of the line.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The LineTable Class
+//
+//    Maps addresses to source lines using the DWARF line number programs in
+//    an ELF object's .debug_line section (DWARF versions 2 to 5), without any
+//    external tool or library.
+//
+//    Nothing is decoded when the table is loaded. The first lookup runs every
+//    line program once to build an index of the address ranges (sequences)
+//    which each compilation unit covers, without storing any row. A unit's
+//    rows are decoded the first time an address in it is looked up, and kept
+//    in a compact array sorted by address, so that further lookups in the
+//    same unit are a pair of binary searches.
+//
+//    The index and the decoded units are published with interlocked
+//    operations and never change afterwards, so lookups take no lock. Two
+//    threads may decode the same unit at once; only one result is kept.
+//
+//    Compressed debug sections (SHF_COMPRESSED) are not supported.
+//
+class LineTable
+{
+public:
+    LineTable ();
+    ~LineTable ();
+
+    BOOL load (const ElfFile &file);
+    VOID clear ();
+    BOOL find (UINT_PTR address, lineinfo_t &info);
+    BOOL isLoaded () const
+    {
+        return (m_lines.data != NULL);
+    }
+
+private:
+    // One row of a decoded unit. Rows which end a sequence have no line:
+    // their file is ROW_END_SEQUENCE.
+    struct row_t {
+        UINT_PTR address;
+        UINT32   line;
+        UINT32   file;  // Index in the unit's file names.
+    };
+
+    // The decoded rows of a compilation unit.
+    struct unit_t {
+        row_t  *rows;       // Sorted by address.
+        UINT32  rowCount;
+        LPSTR  *files;      // Paths of the source files, indexed by DWARF file number. May contain NULLs.
+        UINT32  fileCount;
+    };
+
+    // A range of contiguous addresses described by one unit.
+    struct sequence_t {
+        UINT_PTR low;       // First address.
+        UINT_PTR high;      // Address after the last address.
+        UINT32   unit;      // Index of the unit in index_t.
+    };
+
+    struct index_t {
+        sequence_t        *sequences;     // Sorted by address.
+        UINT32             sequenceCount;
+        SIZE_T            *unitOffsets;   // Offset of each unit in .debug_line.
+        unit_t * volatile *units;         // Decoded units, or NULL.
+        UINT32             unitCount;
+    };
+
+    friend class LineProgram;
+
+    index_t* getIndex ();
+    unit_t*  getUnit (index_t *index, UINT32 unit);
+    VOID     freeUnit (unit_t *unit);
+
+    elfsection_t       m_lines;       // .debug_line
+    elfsection_t       m_lineStrings; // .debug_line_str (DWARF 5)
+    elfsection_t       m_strings;     // .debug_str
+    index_t * volatile m_index;       // Built by the first lookup.
+
+    // Don't allow this!!
+    LineTable (const LineTable &other);
+    LineTable& operator = (const LineTable &other);
+};
@@ -0,0 +1,206 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - ELF File Reader (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define VLDBUILD
+#include "linux/elffile.h"
+
+#if __ELF_NATIVE_CLASS == 64
+#define ELF_NATIVE_CLASS ELFCLASS64
+#else
+#define ELF_NATIVE_CLASS ELFCLASS32
+#endif
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ELF_NATIVE_DATA  ELFDATA2LSB
+#else
+#define ELF_NATIVE_DATA  ELFDATA2MSB
+#endif
+
+// Constructor - Initializes the ElfFile with no file mapped.
+//
+ElfFile::ElfFile ()
+{
+    m_image        = NULL;
+    m_size         = 0;
+    m_sections     = NULL;
+    m_sectionCount = 0;
+    m_names        = 0;
+}
+
+// Destructor - Unmaps the file, if one is mapped.
+//
+ElfFile::~ElfFile ()
+{
+    close();
+}
+
+// open - Maps an ELF file and validates its headers.
+//
+//  - path (IN): Path of the file.
+//
+//  Return Value:
+//
+//    Returns TRUE if the file was mapped and is a valid ELF file of the native
+//    class. Otherwise returns FALSE, and no file is mapped.
+//
+BOOL ElfFile::open (LPCSTR path)
+{
+    close();
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return FALSE;
+    struct stat status;
+    void *image = MAP_FAILED;
+    if ((fstat(fd, &status) == 0) && ((SIZE_T)status.st_size >= sizeof(ElfW(Ehdr)))) {
+        image = mmap(NULL, (SIZE_T)status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (image == MAP_FAILED)
+        return FALSE;
+    m_image = (const BYTE*)image;
+    m_size = (SIZE_T)status.st_size;
+
+    const ElfW(Ehdr) *header = (const ElfW(Ehdr)*)m_image;
+    if ((memcmp(header->e_ident, ELFMAG, SELFMAG) != 0) ||
+        (header->e_ident[EI_CLASS] != ELF_NATIVE_CLASS) ||
+        (header->e_ident[EI_DATA] != ELF_NATIVE_DATA) ||
+        (header->e_ident[EI_VERSION] != EV_CURRENT) ||
+        (header->e_shoff == 0) || (header->e_shentsize != sizeof(ElfW(Shdr))) ||
+        (header->e_shoff > m_size - sizeof(ElfW(Shdr)))) {
+        close();
+        return FALSE;
+    }
+
+    // With more than SHN_LORESERVE sections, the counts are stored in the
+    // first section header instead.
+    m_sections = m_image + header->e_shoff;
+    const ElfW(Shdr) *first = (const ElfW(Shdr)*)m_sections;
+    SIZE_T count = (header->e_shnum != 0) ? header->e_shnum : (SIZE_T)first->sh_size;
+    m_names = (header->e_shstrndx != SHN_XINDEX) ? header->e_shstrndx : first->sh_link;
+    if ((count > (m_size - header->e_shoff) / sizeof(ElfW(Shdr))) || (m_names >= count)) {
+        close();
+        return FALSE;
+    }
+    m_sectionCount = (UINT32)count;
+    return TRUE;
+}
+
+// close - Unmaps the file. Sections obtained from it become invalid.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID ElfFile::close ()
+{
+    if (m_image != NULL) {
+        munmap((void*)m_image, m_size);
+    }
+    m_image        = NULL;
+    m_size         = 0;
+    m_sections     = NULL;
+    m_sectionCount = 0;
+    m_names        = 0;
+}
+
+// getSection - Obtains a section by its index in the section header table.
+//
+//  - index (IN): Index of the section.
+//
+//  - section (OUT): Receives the section.
+//
+//  Return Value:
+//
+//    Returns TRUE if the section exists and its contents are present in the
+//    file. Sections which occupy no space in the file (.bss) and compressed
+//    sections are not returned.
+//
+BOOL ElfFile::getSection (UINT32 index, elfsection_t &section) const
+{
+    if ((index == SHN_UNDEF) || (index >= m_sectionCount))
+        return FALSE;
+    const ElfW(Shdr) *header = (const ElfW(Shdr)*)m_sections + index;
+    if ((header->sh_type == SHT_NOBITS) || ((header->sh_flags & SHF_COMPRESSED) != 0))
+        return FALSE;
+    if ((header->sh_offset > m_size) || (header->sh_size > m_size - header->sh_offset))
+        return FALSE;
+    section.data      = m_image + header->sh_offset;
+    section.size      = (SIZE_T)header->sh_size;
+    section.address   = (UINT_PTR)header->sh_addr;
+    section.entrySize = (SIZE_T)header->sh_entsize;
+    section.link      = header->sh_link;
+    return TRUE;
+}
+
+// findSection - Obtains a section by its name, such as ".debug_line".
+//
+//  - name (IN): Name of the section.
+//
+//  - section (OUT): Receives the first section with this name.
+//
+//  Return Value:
+//
+//    Returns TRUE if the section was found. See getSection.
+//
+BOOL ElfFile::findSection (LPCSTR name, elfsection_t &section) const
+{
+    elfsection_t names;
+    if (!getSection(m_names, names))
+        return FALSE;
+    for (UINT32 index = 1; index < m_sectionCount; index++) {
+        const ElfW(Shdr) *header = (const ElfW(Shdr)*)m_sections + index;
+        if (header->sh_name >= names.size)
+            continue;
+        LPCSTR sectionName = (LPCSTR)names.data + header->sh_name;
+        if ((strncmp(sectionName, name, names.size - header->sh_name) == 0) && getSection(index, section))
+            return TRUE;
+    }
+    return FALSE;
+}
+
+// findSection - Obtains a section by its type, such as SHT_SYMTAB.
+//
+//  - type (IN): Type of the section.
+//
+//  - section (OUT): Receives the first section of this type.
+//
+//  Return Value:
+//
+//    Returns TRUE if the section was found. See getSection.
+//
+BOOL ElfFile::findSection (UINT32 type, elfsection_t &section) const
+{
+    for (UINT32 index = 1; index < m_sectionCount; index++) {
+        const ElfW(Shdr) *header = (const ElfW(Shdr)*)m_sections + index;
+        if ((header->sh_type == type) && getSection(index, section))
+            return TRUE;
+    }
+    return FALSE;
+}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - ELF File Reader (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+"This header should only be included by Visual Leak Detector when building it from source. \
+Applications should never include this header."
+#endif
+
+#include "linux/platform.h"
+
+// A section of an ELF file, as mapped in memory.
+struct elfsection_t {
+    const BYTE *data;       // Contents of the section.
+    SIZE_T      size;       // Size of the contents, in bytes.
+    UINT_PTR    address;    // Virtual address of the section in the object (sh_addr).
+    SIZE_T      entrySize;  // Size of each entry, for sections which hold a table.
+    UINT32      link;       // Index of the associated section (sh_link).
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The ElfFile Class
+//
+//    Maps an ELF object file (executable or shared library) into memory,
+//    read-only, and locates its sections. Only the pages which are actually
+//    read become resident, so mapping a large file with debug information is
+//    cheap. The symbol table (see symbolizer.h) and the line tables point
+//    directly into the mapping, so it stays mapped until the ElfFile is
+//    closed.
+//
+//    Only objects of the native class and byte order are accepted, since
+//    they are read from the running process's modules.
+//
+class ElfFile
+{
+public:
+    ElfFile ();
+    ~ElfFile ();
+
+    BOOL open (LPCSTR path);
+    VOID close ();
+    BOOL findSection (LPCSTR name, elfsection_t &section) const;
+    BOOL findSection (UINT32 type, elfsection_t &section) const;
+    BOOL getSection (UINT32 index, elfsection_t &section) const;
+    BOOL isOpen () const
+    {
+        return (m_image != NULL);
+    }
+
+private:
+    const BYTE *m_image;        // The mapped file.
+    SIZE_T      m_size;         // Size of the mapped file, in bytes.
+    const BYTE *m_sections;     // The section header table.
+    UINT32      m_sectionCount; // Number of entries in the section header table.
+    UINT32      m_names;        // Index of the section which holds the section names.
+
+    // Don't allow this!!
+    ElfFile (const ElfFile &other);
+    ElfFile& operator = (const ElfFile &other);
+};
@@ -0,0 +1,208 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Futex-based Lock (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cassert>
+#include <cstdlib>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "linux/platform.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The FutexLock Class
+//
+//    A recursive lock which fits in a single 32-bit word, so that it is cheap
+//    enough to embed one in every shard of a sharded container. It implements
+//    the interface CriticalSection expects from its platform lock: Enter,
+//    TryEnter, Leave, IsLocked and IsLockedByCurrentThread.
+//
+//    The word holds the ID of the owning thread, the number of times the owner
+//    has re-entered the lock, and a flag which is set when threads may be
+//    sleeping on the lock:
+//
+//      bit 31      bits 22-30          bits 0-21
+//      waiters     recursion count     owner thread ID (0 if unlocked)
+//
+//    Linux thread IDs are always below PID_MAX_LIMIT (2^22), so they fit.
+//    The owner may re-enter the lock up to MAX_RECURSION times; past that,
+//    TryEnter fails and Enter aborts the process, in release builds too,
+//    rather than let the count carry into the waiters flag.
+//    Uncontended Enter and Leave take a single atomic operation each and never
+//    enter the kernel. A zero-filled FutexLock is unlocked, so static locks
+//    work before their Initialize has been called.
+//
+class FutexLock
+{
+public:
+    void Initialize ()
+    {
+        m_word = 0;
+    }
+
+    void Delete ()
+    {
+        assert(m_word == 0);
+    }
+
+    void Enter ()
+    {
+        UINT32 thread = GetCurrentThreadId();
+        UINT32 expected = 0;
+        if (__atomic_compare_exchange_n(&m_word, &expected, thread, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+        if ((expected & OWNER_MASK) == thread) {
+            if (!reenter(expected))
+                recursionOverflow();
+            return;
+        }
+        enterContended(thread);
+    }
+
+    bool TryEnter ()
+    {
+        UINT32 thread = GetCurrentThreadId();
+        UINT32 expected = 0;
+        if (__atomic_compare_exchange_n(&m_word, &expected, thread, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return true;
+        if ((expected & OWNER_MASK) == thread)
+            return reenter(expected);
+        return false;
+    }
+
+    void Leave ()
+    {
+        UINT32 word = __atomic_load_n(&m_word, __ATOMIC_RELAXED);
+        assert((word & OWNER_MASK) == GetCurrentThreadId());
+        if ((word & RECURSION_MASK) != 0) {
+            // Only the owner changes the count, but waiters may set the flag
+            // concurrently, hence the atomic subtraction.
+            __atomic_fetch_sub(&m_word, RECURSION_ONE, __ATOMIC_RELAXED);
+            return;
+        }
+        if (__atomic_exchange_n(&m_word, 0, __ATOMIC_RELEASE) & WAITERS)
+            futex(FUTEX_WAKE_PRIVATE, 1);
+    }
+
+    bool IsLocked () const
+    {
+        return ((__atomic_load_n(&m_word, __ATOMIC_RELAXED) & OWNER_MASK) != 0);
+    }
+
+    bool IsLockedByCurrentThread () const
+    {
+        return ((__atomic_load_n(&m_word, __ATOMIC_RELAXED) & OWNER_MASK) == GetCurrentThreadId());
+    }
+
+    // Number of times the owner may re-enter the lock, on top of the first
+    // Enter.
+    static const UINT32 MAX_RECURSION = 511;
+
+private:
+    enum : UINT32 {
+        OWNER_MASK     = 0x003FFFFF,
+        RECURSION_ONE  = 0x00400000,
+        RECURSION_MASK = 0x7FC00000,
+        WAITERS        = 0x80000000
+    };
+    typedef char checkMaxRecursion[(MAX_RECURSION == RECURSION_MASK / RECURSION_ONE) ? 1 : -1];
+
+    // Number of times a contended Enter polls the lock before sleeping. Most
+    // of VLD's critical sections are a few hundred cycles long.
+    static const int SPIN_COUNT = 100;
+
+    // reenter - Counts one more recursion of the owner. Only the owner
+    //   changes the count, so the word which it read is still current, apart
+    //   from the waiters flag. Fails if the count is full.
+    bool reenter (UINT32 word)
+    {
+        if ((word & RECURSION_MASK) == RECURSION_MASK)
+            return false;
+        __atomic_fetch_add(&m_word, RECURSION_ONE, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    // recursionOverflow - Called when Enter can't count one more recursion.
+    //   The lock can't be taken without corrupting its word, and Enter can't
+    //   fail, so the process is stopped. No lock may be taken, hence the raw
+    //   write to stderr.
+    __declspec(noinline) static void recursionOverflow ()
+    {
+        static const char message [] = "Visual Leak Detector: A lock was re-entered too many times.\n";
+        ssize_t written = write(STDERR_FILENO, message, sizeof(message) - 1);
+        UNREFERENCED_PARAMETER(written);
+        abort();
+    }
+
+    __declspec(noinline) void enterContended (UINT32 thread)
+    {
+        for (int spin = 0; spin < SPIN_COUNT; spin++) {
+            UINT32 expected = 0;
+            if ((__atomic_load_n(&m_word, __ATOMIC_RELAXED) == 0) &&
+                __atomic_compare_exchange_n(&m_word, &expected, thread, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                return;
+            cpuRelax();
+        }
+
+        // Sleep until the owner leaves. A thread which has slept takes the
+        // lock with the waiters flag set, because it can't tell whether other
+        // threads are still sleeping; at worst this costs one spurious wake.
+        UINT32 word = __atomic_load_n(&m_word, __ATOMIC_RELAXED);
+        for (;;) {
+            if (word == 0) {
+                if (__atomic_compare_exchange_n(&m_word, &word, thread | WAITERS, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                    return;
+                continue;
+            }
+            if ((word & WAITERS) == 0) {
+                if (!__atomic_compare_exchange_n(&m_word, &word, word | WAITERS, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                    continue;
+                word |= WAITERS;
+            }
+            futex(FUTEX_WAIT_PRIVATE, word);
+            word = __atomic_load_n(&m_word, __ATOMIC_RELAXED);
+        }
+    }
+
+    // futex - Waits on the lock word (if it still equals value) or wakes
+    //   value threads waiting on it.
+    void futex (int op, UINT32 value)
+    {
+        syscall(SYS_futex, &m_word, op, value, NULL, NULL, 0);
+    }
+
+    static void cpuRelax ()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        __asm__ __volatile__ ("yield");
+#endif
+    }
+
+    UINT32 volatile m_word;
+};
+
+typedef char checkFutexLockSize[(sizeof(FutexLock) == 4) ? 1 : -1];
@@ -0,0 +1,195 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Linux Platform Definitions
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// VLD's tracking core (the containers, the call stack storage and the
+// statistics) is written against the Win32 types and interlocked intrinsics.
+// When building for Linux, this header is included in place of <windows.h>
+// and provides the subset of them which the core uses, with the same sizes
+// and semantics as on Windows (LONG and DWORD are 32 bits wide, even though
+// long is 64 bits wide on Linux).
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef int                 BOOL;
+typedef unsigned char       BYTE, *PBYTE;
+typedef unsigned short      WORD, *PWORD;
+typedef uint32_t            DWORD;
+typedef int32_t             LONG;
+typedef uint32_t            ULONG;
+typedef int64_t             LONG64, LONGLONG;
+typedef uint64_t            ULONG64, ULONGLONG, DWORD64;
+typedef int8_t              INT8;
+typedef uint8_t             UINT8;
+typedef int16_t             INT16;
+typedef uint16_t            UINT16;
+typedef int32_t             INT32;
+typedef uint32_t            UINT32, UINT;
+typedef int64_t             INT64;
+typedef uint64_t            UINT64;
+typedef intptr_t            INT_PTR, LONG_PTR;
+typedef uintptr_t           UINT_PTR, ULONG_PTR;
+typedef size_t              SIZE_T;
+typedef ssize_t             SSIZE_T;
+typedef void                VOID, *PVOID, *LPVOID, *HANDLE;
+typedef const void         *LPCVOID;
+typedef char                CHAR, *LPSTR;
+typedef const char         *LPCSTR;
+typedef wchar_t             WCHAR, *LPWSTR, *PWSTR;
+typedef const wchar_t      *LPCWSTR;
+
+#define TRUE                1
+#define FALSE               0
+#define CONST               const
+#define MAX_PATH            PATH_MAX
+#define MEMORY_ALLOCATION_ALIGNMENT 16  // Alignment of the blocks returned by malloc on 64-bit Linux.
+
+#define __cdecl
+#define __forceinline       inline __attribute__((always_inline))
+#define __declspec(x)       __declspec_##x
+#define __declspec_align(n) __attribute__((aligned(n)))
+#define __declspec_noinline __attribute__((noinline))
+
+#define UNREFERENCED_PARAMETER(p)   ((void)(p))
+#define ZeroMemory(d, n)            memset((d), 0, (n))
+#define _countof(a)                 (sizeof(a) / sizeof((a)[0]))
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define VLD_64BIT_ADDRESSES         // Same meaning as _WIN64 for the portable core.
+#endif
+
+// Interlocked operations. All of them are full barriers, like on Windows.
+inline LONG InterlockedIncrement (LONG volatile *target)
+{
+    return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement (LONG volatile *target)
+{
+    return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchange (LONG volatile *target, LONG value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchangeAdd (LONG volatile *target, LONG value)
+{
+    return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedCompareExchange (LONG volatile *target, LONG value, LONG comparand)
+{
+    __atomic_compare_exchange_n(target, &comparand, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+inline LONG64 InterlockedIncrement64 (LONG64 volatile *target)
+{
+    return __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedDecrement64 (LONG64 volatile *target)
+{
+    return __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedExchange64 (LONG64 volatile *target, LONG64 value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedExchangeAdd64 (LONG64 volatile *target, LONG64 value)
+{
+    return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline LONG64 InterlockedCompareExchange64 (LONG64 volatile *target, LONG64 value, LONG64 comparand)
+{
+    __atomic_compare_exchange_n(target, &comparand, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+inline PVOID InterlockedExchangePointer (PVOID volatile *target, PVOID value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+inline PVOID InterlockedCompareExchangePointer (PVOID volatile *target, PVOID value, PVOID comparand)
+{
+    __atomic_compare_exchange_n(target, &comparand, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return comparand;
+}
+
+// Bit scans, with the semantics of the MSVC intrinsics: returns 0 if no bit is
+// set, otherwise stores the index of the highest set bit.
+inline unsigned char _BitScanReverse (unsigned long *index, unsigned int mask)
+{
+    if (mask == 0)
+        return 0;
+    *index = 31 - (unsigned long)__builtin_clz(mask);
+    return 1;
+}
+
+inline unsigned char _BitScanReverse64 (unsigned long *index, unsigned long long mask)
+{
+    if (mask == 0)
+        return 0;
+    *index = 63 - (unsigned long)__builtin_clzll(mask);
+    return 1;
+}
+
+// GetCurrentThreadId - Returns the kernel's ID of the calling thread, which
+//   is what tools such as gdb and /proc show. It is cached, because it takes
+//   a system call.
+inline DWORD GetCurrentThreadId ()
+{
+    static __thread DWORD threadid = 0;
+    if (threadid == 0)
+        threadid = (DWORD)syscall(SYS_gettid);
+    return threadid;
+}
+
+inline DWORD GetCurrentProcessId ()
+{
+    return (DWORD)getpid();
+}
+
+// GetTickCount64 - Returns the number of milliseconds elapsed since an
+//   arbitrary point in the past, from the monotonic clock.
+inline ULONG64 GetTickCount64 ()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (ULONG64)now.tv_sec * 1000 + (ULONG64)now.tv_nsec / 1000000;
+}
@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - CallStack Stack Walkers (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// The stack walkers of the CallStack class on Linux. They only depend on the
+// walkers of stackwalk.cpp, not on the rest of the Linux backend, so that the
+// tracking core (the CallStack storage and the StackTable, see stacktable.cpp)
+// can be built and tested on its own.
+
+#include "stdafx.h"
+
+#define VLDBUILD
+#include "callstack.h"  // This class' header.
+#include "linux/stackwalk.h" // Provides the stack walkers.
+
+#define CALLSTACK_SAFE_FRAMES   256 // Maximum number of frames captured by the unwinder.
+
+// captureFast - Traces the stack by walking the chain of frame pointers, into
+//   a buffer supplied by the caller.
+//
+//   Note: Frames of functions compiled without frame pointers end the trace
+//     prematurely, like they do with RtlCaptureStackBackTrace on Windows.
+//
+//  - maxdepth (IN): Maximum number of frames to trace back.
+//
+//  - context (IN): The context at which VLD's code was entered. The walk
+//      starts at the frame of the hooked function.
+//
+//  - frames (OUT): Receives the frames. Must have room for
+//      CALLSTACK_FAST_FRAMES + 1 frames.
+//
+//  - hash (OUT): Receives the sum of the frames stored in the buffer, like on
+//      Windows.
+//
+//  Return Value:
+//
+//    Returns the number of frames stored in the buffer.
+//
+UINT32 CallStack::captureFast (UINT32 maxdepth, const context_t& context, UINT_PTR *frames, DWORD &hash)
+{
+    UINT32  size = 0;
+    UINT_PTR function = context.func;
+    if (function != 0)
+    {
+        frames[size++] = function;
+    }
+
+    UINT32 maxframes = (maxdepth < CALLSTACK_FAST_FRAMES) ? maxdepth : CALLSTACK_FAST_FRAMES;
+    if (size < maxframes)
+        size += WalkFramePointers(context.bp, frames + size, maxframes - size);
+    hash = 0;
+    for (UINT32 index = 0; index < size; index++) {
+        hash += (DWORD)frames[index];
+    }
+    return size;
+}
+
+// getStackTraceSafe - Traces the stack as far back as possible, or until
+//   'maxdepth' frames have been traced. Populates the CallStack with one entry
+//   for each stack frame traced.
+//
+//   Note: This function uses the system unwinder, which reads the call frame
+//     information of each module, so it walks frames built without frame
+//     pointers too. It is much slower than getStackTraceFast.
+//
+//  - maxdepth (IN): Maximum number of frames to trace back.
+//
+//  - context (IN): The context at which VLD's code was entered. The frames
+//      above the hooked function's return address are dropped.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID CallStack::getStackTraceSafe (UINT32 maxdepth, const context_t& context)
+{
+    UINT_PTR frames [CALLSTACK_SAFE_FRAMES];
+    UINT32   size = 0;
+    if (context.func != 0)
+    {
+        frames[size++] = context.func;
+    }
+
+    UINT32 maxframes = (maxdepth < CALLSTACK_SAFE_FRAMES) ? maxdepth : CALLSTACK_SAFE_FRAMES;
+    if (size < maxframes)
+        size += WalkUnwindTables(context.fp, frames + size, maxframes - size);
+    for (UINT32 index = 0; index < size; index++) {
+        push_back(frames[index]);
+    }
+}
@@ -0,0 +1,149 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Stack Walkers (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <pthread.h>
+#include <unwind.h>
+#include "linux/stackwalk.h"
+
+// Bounds of the calling thread's stack, or 0 if they haven't been looked up
+// yet. The initial-exec model keeps the accesses free of any call, which
+// matters because this runs inside the allocation hooks.
+static __thread UINT_PTR s_stackLow __attribute__((tls_model("initial-exec")));
+static __thread UINT_PTR s_stackHigh __attribute__((tls_model("initial-exec")));
+
+// GetThreadStackBounds - See stackwalk.h.
+//
+BOOL GetThreadStackBounds (UINT_PTR &low, UINT_PTR &high)
+{
+    if (s_stackHigh == 0) {
+        // For the main thread, this reads /proc/self/maps, which allocates.
+        pthread_attr_t attributes;
+        if (pthread_getattr_np(pthread_self(), &attributes) != 0)
+            return FALSE;
+        void  *address = NULL;
+        size_t size = 0;
+        int    result = pthread_attr_getstack(&attributes, &address, &size);
+        pthread_attr_destroy(&attributes);
+        if ((result != 0) || (size == 0))
+            return FALSE;
+        s_stackLow = (UINT_PTR)address;
+        s_stackHigh = (UINT_PTR)address + size;
+    }
+    low = s_stackLow;
+    high = s_stackHigh;
+    return TRUE;
+}
+
+// WalkFramePointers - See stackwalk.h.
+//
+//   On x86-64 and AArch64 alike, a frame pointer points to a record holding
+//   the caller's frame pointer, followed by the return address.
+//
+UINT32 WalkFramePointers (UINT_PTR framePointer, UINT_PTR *frames, UINT32 maxframes)
+{
+    UINT_PTR low, high;
+    if (!GetThreadStackBounds(low, high))
+        return 0;
+
+    UINT32   count = 0;
+    UINT_PTR frame = framePointer;
+    while (count < maxframes) {
+        if ((frame < low) || (frame > high - 2 * sizeof(UINT_PTR)) || ((frame & (sizeof(UINT_PTR) - 1)) != 0)) {
+            // Not a frame of this thread's stack: the chain is broken.
+            break;
+        }
+        const UINT_PTR *record = (const UINT_PTR*)frame;
+        UINT_PTR returnAddress = record[1];
+        if (returnAddress < 0x1000) {
+            // The outermost frame, or garbage.
+            break;
+        }
+        frames[count++] = returnAddress;
+
+        // Callers' frames are at higher addresses. Anything else means that
+        // this frame didn't save a frame pointer.
+        UINT_PTR next = record[0];
+        if (next <= frame)
+            break;
+        frame = next;
+    }
+    return count;
+}
+
+namespace {
+
+// State of WalkUnwindTables, passed to unwindCallback.
+struct unwindstate_t {
+    UINT_PTR  firstFrame; // Return address at which the trace starts.
+    UINT_PTR *frames;
+    UINT32    maxframes;
+    UINT32    count;      // Number of frames stored.
+    bool      started;    // Whether frames are being stored for good.
+    bool      found;      // Whether firstFrame has been found.
+};
+
+_Unwind_Reason_Code unwindCallback (struct _Unwind_Context *context, void *argument)
+{
+    unwindstate_t *state = (unwindstate_t*)argument;
+    UINT_PTR returnAddress = (UINT_PTR)_Unwind_GetIP(context);
+    if (returnAddress == 0)
+        return _URC_END_OF_STACK;
+
+    if (!state->found && (returnAddress == state->firstFrame)) {
+        // Drop the frames above the first one.
+        state->started = true;
+        state->found = true;
+        state->count = 0;
+    }
+    if (state->count < state->maxframes) {
+        state->frames[state->count++] = returnAddress;
+    }
+    else if (state->started) {
+        return _URC_END_OF_STACK;
+    }
+    // Otherwise, keep looking for firstFrame, past the end of the buffer.
+    return _URC_NO_REASON;
+}
+
+} // namespace
+
+// WalkUnwindTables - See stackwalk.h.
+//
+UINT32 WalkUnwindTables (UINT_PTR firstFrame, UINT_PTR *frames, UINT32 maxframes)
+{
+    unwindstate_t state;
+    state.firstFrame = firstFrame;
+    state.frames = frames;
+    state.maxframes = maxframes;
+    state.count = 0;
+    state.started = (firstFrame == 0);
+    state.found = false;
+    _Unwind_Backtrace(unwindCallback, &state);
+
+    if (!state.found && (state.count != 0)) {
+        // The trace starts at the caller: the first frame is this function's.
+        memmove(frames, frames + 1, (state.count - 1) * sizeof(UINT_PTR));
+        state.count--;
+    }
+    return state.count;
+}
@@ -0,0 +1,90 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Stack Walkers (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// The two ways in which VLD walks the stack on Linux. Neither depends on VLD's
+// internals, so that they can be benchmarked on their own.
+//
+//  * WalkFramePointers follows the chain of saved frame pointers. It is very
+//    fast, but the trace ends early at the first function which was compiled
+//    without frame pointers (-fomit-frame-pointer, the default at -O1 and
+//    above on x86-64). Every frame is checked against the bounds of the
+//    thread's stack, so a broken chain can't make it read invalid memory.
+//
+//  * WalkUnwindTables uses the system unwinder (_Unwind_Backtrace, from
+//    libgcc_s), which reads the DWARF call frame information that every
+//    module contains. It works whatever the compiler options, but it is much
+//    slower.
+//
+// Both store the return address of each frame, and agree on where the trace
+// starts, so they produce the same frames for code built with frame pointers.
+
+#include "linux/platform.h"
+
+// GetThreadStackBounds - Obtains the range of addresses of the calling thread's
+//   stack. They are looked up on the first call in each thread, which may
+//   allocate memory, and then cached.
+//
+//  - low (OUT): Receives the lowest address of the stack.
+//
+//  - high (OUT): Receives the address after the highest address of the stack.
+//
+//  Return Value:
+//
+//    Returns TRUE if the bounds are known, FALSE otherwise.
+//
+BOOL GetThreadStackBounds (UINT_PTR &low, UINT_PTR &high);
+
+// WalkFramePointers - Walks the chain of frame pointers, starting at the frame
+//   of a function which is still active.
+//
+//  - framePointer (IN): The frame pointer of the function at which to start,
+//      as returned by __builtin_frame_address(0). The first frame stored is
+//      the return address of that function.
+//
+//  - frames (OUT): Receives the return addresses.
+//
+//  - maxframes (IN): Size of "frames", in elements.
+//
+//  Return Value:
+//
+//    Returns the number of frames stored.
+//
+UINT32 WalkFramePointers (UINT_PTR framePointer, UINT_PTR *frames, UINT32 maxframes);
+
+// WalkUnwindTables - Walks the stack with the system unwinder.
+//
+//  - firstFrame (IN): The return address at which the trace starts. The frames
+//      above it (normally, VLD's own) are dropped. If it isn't found, or if it
+//      is 0, the trace starts at the caller of WalkUnwindTables.
+//
+//  - frames (OUT): Receives the return addresses.
+//
+//  - maxframes (IN): Size of "frames", in elements.
+//
+//  Return Value:
+//
+//    Returns the number of frames stored.
+//
+UINT32 WalkUnwindTables (UINT_PTR firstFrame, UINT_PTR *frames, UINT32 maxframes);
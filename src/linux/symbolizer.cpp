@@ -0,0 +1,491 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - ELF Symbolizer (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <link.h>
+
+#define VLDBUILD
+#include "linux/symbolizer.h"
+#include "vldheap.h"    // Provides internal new and delete operators.
+
+// Stored in SymbolTable::m_demangled for names which aren't mangled C++
+// names, or which could not be demangled.
+#define NOT_DEMANGLED ((LPSTR)1)
+
+namespace {
+
+// Orders symbols by address. Among aliases (symbols at the same address), the
+// one whose name is preferred comes first: global before weak before local
+// symbols, and symbols with a size before those without.
+struct symbolorder_t {
+    UINT_PTR address;
+    UINT32   size;
+    UINT32   name;
+    UINT32   rank;  // Lower is preferred.
+
+    bool operator < (const symbolorder_t &other) const
+    {
+        if (address != other.address)
+            return address < other.address;
+        return rank < other.rank;
+    }
+};
+
+UINT32 symbolRank (const ElfW(Sym) &symbol)
+{
+    UINT32 rank;
+    switch (ELF64_ST_BIND(symbol.st_info)) {
+    case STB_GLOBAL: rank = 0; break;
+    case STB_WEAK:   rank = 2; break;
+    default:         rank = 4; break;
+    }
+    if (symbol.st_size == 0)
+        rank++;
+    return rank;
+}
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SymbolTable Class Implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Constructor - Initializes the SymbolTable with no symbols.
+//
+SymbolTable::SymbolTable ()
+{
+    m_symbols     = NULL;
+    m_count       = 0;
+    m_strings     = NULL;
+    m_stringsSize = 0;
+    m_demangled   = NULL;
+}
+
+// Destructor - Frees the symbols and the demangled names.
+//
+SymbolTable::~SymbolTable ()
+{
+    clear();
+}
+
+// clear - Frees the symbols and the demangled names. The table is empty
+//   afterwards. Must not be called while other threads may look up symbols.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID SymbolTable::clear ()
+{
+    if (m_demangled != NULL) {
+        for (UINT32 index = 0; index < m_count; index++) {
+            if (m_demangled[index] != NOT_DEMANGLED)
+                delete [] m_demangled[index];
+        }
+        delete [] m_demangled;
+        m_demangled = NULL;
+    }
+    delete [] m_symbols;
+    m_symbols     = NULL;
+    m_count       = 0;
+    m_strings     = NULL;
+    m_stringsSize = 0;
+}
+
+// load - Reads the function symbols of an ELF object.
+//
+//  - file (IN): The object. It must stay open for as long as the table is
+//      used, because the names are read from its string table.
+//
+//  Return Value:
+//
+//    Returns TRUE if the object has a symbol table, FALSE otherwise.
+//
+BOOL SymbolTable::load (const ElfFile &file)
+{
+    clear();
+
+    elfsection_t symbols, strings;
+    if (!file.findSection((UINT32)SHT_SYMTAB, symbols) && !file.findSection((UINT32)SHT_DYNSYM, symbols))
+        return FALSE;
+    if ((symbols.entrySize != sizeof(ElfW(Sym))) || !file.getSection(symbols.link, strings))
+        return FALSE;
+
+    // Collect the defined functions, sort them, then keep one per address.
+    const ElfW(Sym) *symbol = (const ElfW(Sym)*)symbols.data;
+    SIZE_T symbolCount = symbols.size / sizeof(ElfW(Sym));
+    symbolorder_t *sorted = new symbolorder_t [symbolCount];
+    SIZE_T count = 0;
+    for (SIZE_T index = 0; index < symbolCount; index++, symbol++) {
+        UINT32 type = ELF64_ST_TYPE(symbol->st_info);
+        if (((type != STT_FUNC) && (type != STT_GNU_IFUNC)) || (symbol->st_shndx == SHN_UNDEF) ||
+            (symbol->st_value == 0) || (symbol->st_name == 0) || (symbol->st_name >= strings.size))
+            continue;
+        sorted[count].address = (UINT_PTR)symbol->st_value;
+        sorted[count].size    = (symbol->st_size <= 0xFFFFFFFF) ? (UINT32)symbol->st_size : 0;
+        sorted[count].name    = symbol->st_name;
+        sorted[count].rank    = symbolRank(*symbol);
+        count++;
+    }
+    std::sort(sorted, sorted + count);
+
+    m_symbols = new symbol_t [(count != 0) ? count : 1];
+    UINT32 unique = 0;
+    for (SIZE_T index = 0; index < count; index++) {
+        if ((unique != 0) && (m_symbols[unique - 1].address == sorted[index].address))
+            continue;
+        m_symbols[unique].address = sorted[index].address;
+        m_symbols[unique].size    = sorted[index].size;
+        m_symbols[unique].name    = sorted[index].name;
+        unique++;
+    }
+    delete [] sorted;
+
+    m_count       = unique;
+    m_strings     = (LPCSTR)strings.data;
+    m_stringsSize = strings.size;
+    return TRUE;
+}
+
+// find - Finds the function which contains an address.
+//
+//  - address (IN): The address, relative to the object's load address.
+//
+//  - displacement (OUT): Receives the offset of the address from the start of
+//      the function.
+//
+//  Return Value:
+//
+//    Returns the demangled name of the function, or NULL if the address isn't
+//    in any known function. The name remains valid until the table is
+//    cleared.
+//
+LPCSTR SymbolTable::find (UINT_PTR address, SIZE_T &displacement)
+{
+    // Find the last symbol which starts at or before the address.
+    UINT32 low = 0;
+    UINT32 high = m_count;
+    while (low < high) {
+        UINT32 middle = low + (high - low) / 2;
+        if (m_symbols[middle].address <= address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0)
+        return NULL;
+
+    const symbol_t &symbol = m_symbols[low - 1];
+    if ((symbol.size != 0) && (address - symbol.address >= symbol.size)) {
+        // Between two functions. Functions without a size are assumed to
+        // extend to the next symbol.
+        return NULL;
+    }
+    displacement = address - symbol.address;
+    return demangle(low - 1);
+}
+
+// demangle - Obtains the demangled name of a symbol, demangling it and caching
+//   the result if it hasn't been demangled yet.
+//
+//  - index (IN): Index of the symbol.
+//
+//  Return Value:
+//
+//    Returns the demangled name, or the symbol's name if it isn't a mangled
+//    C++ name.
+//
+LPCSTR SymbolTable::demangle (UINT32 index)
+{
+    LPCSTR name = m_strings + m_symbols[index].name;
+    if ((name[0] != '_') || (name[1] != 'Z'))
+        return name;
+
+    LPSTR volatile *demangled = __atomic_load_n(&m_demangled, __ATOMIC_ACQUIRE);
+    if (demangled == NULL) {
+        LPSTR volatile *names = new LPSTR [m_count];
+        ZeroMemory((PVOID)names, m_count * sizeof(LPSTR));
+        demangled = NULL;
+        if (!__atomic_compare_exchange_n(&m_demangled, &demangled, names, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            // Another thread got there first.
+            delete [] names;
+        }
+        else {
+            demangled = names;
+        }
+    }
+
+    LPSTR result = __atomic_load_n(&demangled[index], __ATOMIC_ACQUIRE);
+    if (result == NULL) {
+        // The demangler allocates the name with malloc. Copy it to VLD's
+        // heap, so that the cache doesn't hold blocks of the program's heap.
+        int status = 0;
+        LPSTR buffer = abi::__cxa_demangle(name, NULL, NULL, &status);
+        LPSTR copy = NOT_DEMANGLED;
+        if ((status == 0) && (buffer != NULL)) {
+            SIZE_T length = strlen(buffer);
+            copy = new CHAR [length + 1];
+            memcpy(copy, buffer, length + 1);
+        }
+        free(buffer);
+
+        result = NULL;
+        if (__atomic_compare_exchange_n(&demangled[index], &result, copy, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            result = copy;
+        }
+        else if (copy != NOT_DEMANGLED) {
+            delete [] copy;
+        }
+    }
+    return (result != NOT_DEMANGLED) ? result : name;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Symbolizer Class Implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Constructor - Initializes the Symbolizer with no objects loaded.
+//
+Symbolizer::Symbolizer ()
+{
+    m_modules = NULL;
+}
+
+// Destructor - Unloads all objects.
+//
+Symbolizer::~Symbolizer ()
+{
+    clear();
+}
+
+// clear - Unloads all objects. Must not be called while other threads may be
+//   resolving addresses.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID Symbolizer::clear ()
+{
+    module_t *module = m_modules;
+    while (module != NULL) {
+        module_t *next = module->next;
+        delete [] module->path;
+        delete module;
+        module = next;
+    }
+    m_modules = NULL;
+}
+
+// getModule - Obtains the loaded object for one of the process's modules,
+//   loading it if it hasn't been loaded yet.
+//
+//  - path (IN): Path of the module's file.
+//
+//  - bias (IN): Difference between the addresses in the object and in memory.
+//
+//  Return Value:
+//
+//    Returns the object. Its symbol table is empty if the object's file could
+//    not be read.
+//
+Symbolizer::module_t* Symbolizer::getModule (LPCSTR path, UINT_PTR bias)
+{
+    module_t *head = __atomic_load_n(&m_modules, __ATOMIC_ACQUIRE);
+    for (module_t *module = head; module != NULL; module = module->next) {
+        if ((module->bias == bias) && (strcmp(module->path, path) == 0))
+            return module;
+    }
+
+    module_t *module = new module_t;
+    SIZE_T length = strlen(path);
+    module->path = new CHAR [length + 1];
+    memcpy(module->path, path, length + 1);
+    module->bias = bias;
+    loadModule(module);
+
+    // Publish it, unless another thread has loaded it in the meantime.
+    for (;;) {
+        module->next = head;
+        if (__atomic_compare_exchange_n(&m_modules, &head, module, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return module;
+        for (module_t *other = head; other != module->next; other = other->next) {
+            if ((other->bias == bias) && (strcmp(other->path, path) == 0)) {
+                delete [] module->path;
+                delete module;
+                return other;
+            }
+        }
+    }
+}
+
+// loadModule - Maps an object and reads its symbol table, and locates its line
+//   tables, from its separate debug file if needed.
+//
+//  - module (IN/OUT): The module, whose path and bias are set.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID Symbolizer::loadModule (module_t *module)
+{
+    if (!module->file.open(module->path))
+        return;
+    module->symbols.load(module->file);
+    if (module->lines.load(module->file))
+        return;
+    if (!openDebugFile(module))
+        return;
+    module->lines.load(module->debugFile);
+    // The debug file has the full symbol table, even if the object only
+    // kept its dynamic symbols.
+    SymbolTable symbols;
+    if (symbols.load(module->debugFile) && (symbols.size() > module->symbols.size()))
+        module->symbols.load(module->debugFile);
+}
+
+// openDebugFile - Opens the separate debug file of an object, if there is
+//   one. The CRC recorded in .gnu_debuglink is not checked.
+//
+//  - module (IN/OUT): The module, whose file is open. Receives the debug
+//      file.
+//
+//  Return Value:
+//
+//    Returns TRUE if a debug file was opened.
+//
+BOOL Symbolizer::openDebugFile (module_t *module)
+{
+    static const CHAR debugRoot [] = "/usr/lib/debug";
+    CHAR path [PATH_MAX];
+
+    // By build ID: the descriptor of the NT_GNU_BUILD_ID note, in hex.
+    elfsection_t note;
+    if (module->file.findSection(".note.gnu.build-id", note) && (note.size >= sizeof(ElfW(Nhdr)))) {
+        const ElfW(Nhdr) *header = (const ElfW(Nhdr)*)note.data;
+        SIZE_T descriptor = sizeof(ElfW(Nhdr)) + ((header->n_namesz + 3) & ~3);
+        if ((header->n_type == NT_GNU_BUILD_ID) && (header->n_descsz >= 2) &&
+            (descriptor + header->n_descsz <= note.size)) {
+            const BYTE *id = note.data + descriptor;
+            int length = snprintf(path, sizeof(path), "%s/.build-id/%02x/", debugRoot, id[0]);
+            for (UINT32 index = 1; (index < header->n_descsz) && (length > 0) && (length < (int)sizeof(path) - 3); index++)
+                length += snprintf(path + length, sizeof(path) - length, "%02x", id[index]);
+            if ((length > 0) && (length < (int)sizeof(path) - 7)) {
+                strcpy(path + length, ".debug");
+                if (module->debugFile.open(path))
+                    return TRUE;
+            }
+        }
+    }
+
+    // By debug link: a file name, looked for next to the object, in a .debug
+    // subdirectory, and under the debug root.
+    elfsection_t link;
+    if (!module->file.findSection(".gnu_debuglink", link) || (memchr(link.data, 0, link.size) == NULL))
+        return FALSE;
+    LPCSTR name = (LPCSTR)link.data;
+    CHAR directory [PATH_MAX];
+    if (realpath(module->path, directory) == NULL)
+        return FALSE;
+    LPSTR slash = strrchr(directory, '/');
+    if (slash == NULL)
+        return FALSE;
+    *slash = '\0';
+    static const LPCSTR formats [] = { "%s/%s", "%s/.debug/%s" };
+    for (UINT32 index = 0; index < _countof(formats); index++) {
+        int length = snprintf(path, sizeof(path), formats[index], directory, name);
+        if ((length > 0) && (length < (int)sizeof(path)) && (strcmp(path, directory) != 0) && module->debugFile.open(path)) {
+            if (!module->debugFile.findSection(".debug_line", link)) {
+                // The object itself, found by its own link.
+                module->debugFile.close();
+                continue;
+            }
+            return TRUE;
+        }
+    }
+    int length = snprintf(path, sizeof(path), "%s%s/%s", debugRoot, directory, name);
+    return (length > 0) && (length < (int)sizeof(path)) && module->debugFile.open(path);
+}
+
+// resolve - Finds the function, and the source line, which contain an
+//   address.
+//
+//  - address (IN): The address. To resolve a return address, pass the address
+//      of the call instruction instead (for example, the return address - 1).
+//
+//  - path (IN): Path of the file of the module which contains the address.
+//
+//  - bias (IN): Difference between the addresses in the module's file and in
+//      memory.
+//
+//  - info (OUT): Receives the module, the function and the source line. The
+//      strings remain valid until clear() is called. The function may be
+//      unknown.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID Symbolizer::resolve (UINT_PTR address, LPCSTR path, UINT_PTR bias, symbolinfo_t &info)
+{
+    module_t *module = getModule(path, bias);
+    info.module = module->path;
+    info.displacement = 0;
+    info.function = module->symbols.find(address - bias, info.displacement);
+    info.hasLine = module->lines.find(address - bias, info.line);
+    Dl_info dlinfo;
+    if ((info.function == NULL) && (dladdr((void*)address, &dlinfo) != 0) &&
+        (dlinfo.dli_sname != NULL) && (dlinfo.dli_saddr != NULL)) {
+        // Not in the symbol table (e.g. the vDSO, whose file can't be read).
+        info.function = dlinfo.dli_sname;
+        info.displacement = address - (UINT_PTR)dlinfo.dli_saddr;
+    }
+}
+
+// retain - Loads a module ahead of time, before it is unloaded. The mapping
+//   of its file keeps the file readable, so the addresses in the module can
+//   still be resolved after it is unloaded, even if the file is deleted.
+//
+//  - path (IN): Path of the module's file.
+//
+//  - bias (IN): Difference between the addresses in the module's file and in
+//      memory.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID Symbolizer::retain (LPCSTR path, UINT_PTR bias)
+{
+    getModule(path, bias);
+}
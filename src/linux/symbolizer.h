@@ -0,0 +1,140 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - ELF Symbolizer (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+"This header should only be included by Visual Leak Detector when building it from source. \
+Applications should never include this header."
+#endif
+
+#include "linux/platform.h"
+#include "linux/elffile.h"
+#include "linux/dwarfline.h"
+
+// The symbol which contains an address, as found by Symbolizer::resolve.
+struct symbolinfo_t {
+    LPCSTR     module;       // Path of the module which contains the address.
+    LPCSTR     function;     // Name of the function, demangled, or NULL if unknown.
+    SIZE_T     displacement; // Offset of the address from the start of the function.
+    BOOL       hasLine;      // Whether "line" is valid.
+    lineinfo_t line;         // Source line which contains the address.
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The SymbolTable Class
+//
+//    The function symbols of one ELF object, read from its .symtab section,
+//    or from .dynsym if the object is stripped. They are stored as a compact
+//    array of (address, size, name offset) entries sorted by address, so that
+//    the function containing an address is found with a binary search. Names
+//    point into the object's string table, which stays mapped.
+//
+//    The table is immutable once loaded, so lookups need no lock. C++ names
+//    are demangled the first time they are looked up, and the demangled names
+//    are cached; concurrent lookups may both demangle a name, but only one
+//    result is kept.
+//
+class SymbolTable
+{
+public:
+    SymbolTable ();
+    ~SymbolTable ();
+
+    BOOL   load (const ElfFile &file);
+    VOID   clear ();
+    LPCSTR find (UINT_PTR address, SIZE_T &displacement);
+    UINT32 size () const
+    {
+        return m_count;
+    }
+
+private:
+    struct symbol_t {
+        UINT_PTR address;   // Address of the function, relative to the object's load address.
+        UINT32   size;      // Size of the function, in bytes. 0 if unknown.
+        UINT32   name;      // Offset of the name in the string table.
+    };
+
+    LPCSTR demangle (UINT32 index);
+
+    symbol_t       *m_symbols;     // Sorted by address, one per address.
+    UINT32          m_count;       // Number of symbols.
+    LPCSTR          m_strings;     // The string table, in the mapped object.
+    SIZE_T          m_stringsSize; // Size of the string table, in bytes.
+    LPSTR volatile *m_demangled;   // Demangled names, allocated on the first demangling.
+
+    // Don't allow this!!
+    SymbolTable (const SymbolTable &other);
+    SymbolTable& operator = (const SymbolTable &other);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The Symbolizer Class
+//
+//    Resolves addresses to the functions and source lines which contain them,
+//    using the symbol tables and DWARF line tables of the process's loaded
+//    ELF objects. This replaces DbgHelp on Linux. Each object is mapped and
+//    its symbol table read the first time an address in it is resolved; the
+//    caller finds the object which contains the address in VLD's module
+//    registry, which remembers the objects that have been unloaded.
+//
+//    When an object has been stripped of its debug information, it is looked
+//    for in a separate debug file, where distributions install it: first by
+//    build ID (/usr/lib/debug/.build-id/xx/yyyy.debug), then by the name in
+//    the object's .gnu_debuglink section.
+//
+//    Like the StackTable, the list of objects is updated with interlocked
+//    operations and never shrinks before clear() is called, so resolving
+//    takes no lock and may be done from several threads at once.
+//
+class Symbolizer
+{
+public:
+    Symbolizer ();
+    ~Symbolizer ();
+
+    VOID resolve (UINT_PTR address, LPCSTR path, UINT_PTR bias, symbolinfo_t &info);
+    VOID retain (LPCSTR path, UINT_PTR bias);
+    VOID clear ();
+
+private:
+    struct module_t {
+        module_t   *next;    // Next module in the list.
+        UINT_PTR    bias;    // Difference between the addresses in the object and in memory.
+        LPSTR       path;      // Path of the object.
+        ElfFile     file;      // The mapped object.
+        ElfFile     debugFile; // The object's separate debug file, if it has one.
+        SymbolTable symbols;   // The object's function symbols.
+        LineTable   lines;     // The object's line tables.
+    };
+
+    module_t* getModule (LPCSTR path, UINT_PTR bias);
+    static VOID loadModule (module_t *module);
+    static BOOL openDebugFile (module_t *module);
+
+    module_t * volatile m_modules; // Objects loaded so far.
+};
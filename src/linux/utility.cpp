@@ -0,0 +1,643 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Linux Utility Functions
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// The subset of the utility functions of utility.cpp which the portable core
+// and the Linux backend use. Reports are written as UTF-8 text: "debugger"
+// output goes to standard error, which is where tools such as valgrind and
+// the sanitizers report on Linux.
+
+#include "stdafx.h"
+#define VLDBUILD        // Declares that we are building Visual Leak Detector.
+#include "utility.h"    // Provides various utility functions and macros.
+#include "vldheap.h"    // Provides internal new and delete operators.
+#include <cassert>
+#include <cctype>
+#include <cstdarg>
+#include <cstdlib>
+#include <cwctype>
+
+// Global variables.
+static FILE        *s_reportFile = NULL;       // Pointer to the file, if any, to send the memory leak report to.
+static BOOL         s_reportToDebugger = TRUE; // If TRUE, a copy of the memory leak report will be sent to standard error.
+static BOOL         s_reportToStdOut = FALSE;  // If TRUE, a copy of the memory leak report will be sent to standard output.
+static encoding_e   s_reportEncoding = ascii;  // Output encoding of the memory leak report.
+
+// DumpMemoryA - Dumps a nicely formatted rendition of a region of memory.
+//   Includes both the hex value of each byte and its ASCII equivalent (if
+//   printable).
+//
+//  - address (IN): Pointer to the beginning of the memory region to dump.
+//
+//  - size (IN): The size, in bytes, of the region to dump.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID DumpMemoryA (LPCVOID address, SIZE_T size)
+{
+    // Each line of output is 16 bytes.
+    SIZE_T dumpLen;
+    if ((size % 16) == 0) {
+        // No padding needed.
+        dumpLen = size;
+    }
+    else {
+        // We'll need to pad the last line out to 16 bytes.
+        dumpLen = size + (16 - (size % 16));
+    }
+
+    // For each byte of data, get both the ASCII equivalent (if it is a
+    // printable character) and the hex representation.
+    SIZE_T bytesDone = 0;
+    WCHAR  hexDump [HEXDUMPLINELENGTH] = {0};
+    WCHAR  ascDump [18] = {0};
+    for (SIZE_T byteIndex = 0; byteIndex < dumpLen; byteIndex++) {
+        SIZE_T wordIndex = byteIndex % 16;
+        SIZE_T hexIndex = 3 * (wordIndex + (wordIndex / 4)); // 3 characters per byte, plus a 3-character space after every 4 bytes.
+        SIZE_T ascIndex = wordIndex + wordIndex / 8;         // 1 character per byte, plus a 1-character space after every 8 bytes.
+        if (byteIndex < size) {
+            BYTE byte = ((PBYTE)address)[byteIndex];
+            swprintf(hexDump + hexIndex, HEXDUMPLINELENGTH - hexIndex, L"%.2X ", byte);
+            if (isgraph(byte)) {
+                ascDump[ascIndex] = (WCHAR)byte;
+            }
+            else {
+                ascDump[ascIndex] = L'.';
+            }
+        }
+        else {
+            // Add padding to fill out the last line to 16 bytes.
+            wcsncpy(hexDump + hexIndex, L"   ", 4);
+            ascDump[ascIndex] = L'.';
+        }
+        bytesDone++;
+        if ((bytesDone % 16) == 0) {
+            // Print one line of data for every 16 bytes. Include the
+            // ASCII dump and the hex dump side-by-side.
+            Report(L"    %ls    %ls\n", hexDump, ascDump);
+        }
+        else {
+            if ((bytesDone % 8) == 0) {
+                // Add a spacer in the ASCII dump after every 8 bytes.
+                ascDump[ascIndex + 1] = L' ';
+            }
+            if ((bytesDone % 4) == 0) {
+                // Add a spacer in the hex dump after every 4 bytes.
+                wcsncpy(hexDump + hexIndex + 3, L"   ", 4);
+            }
+        }
+    }
+}
+
+// DumpMemoryW - Dumps a nicely formatted rendition of a region of memory.
+//   Includes both the hex value of each byte and its UTF-16 equivalent.
+//
+//  - address (IN): Pointer to the beginning of the memory region to dump.
+//
+//  - size (IN): The size, in bytes, of the region to dump.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID DumpMemoryW (LPCVOID address, SIZE_T size)
+{
+    // Each line of output is 16 bytes.
+    SIZE_T dumpLen;
+    if ((size % 16) == 0) {
+        // No padding needed.
+        dumpLen = size;
+    }
+    else {
+        // We'll need to pad the last line out to 16 bytes.
+        dumpLen = size + (16 - (size % 16));
+    }
+
+    // For each word of data, get both the Unicode equivalent and the hex
+    // representation.
+    WCHAR  hexDump [HEXDUMPLINELENGTH] = {0};
+    WCHAR  unidump [18] = {0};
+    SIZE_T bytesDone = 0;
+    for (SIZE_T byteIndex = 0; byteIndex < dumpLen; byteIndex++) {
+        SIZE_T hexIndex = 3 * ((byteIndex % 16) + ((byteIndex % 16) / 4));   // 3 characters per byte, plus a 3-character space after every 4 bytes.
+        SIZE_T uniIndex = ((byteIndex / 2) % 8) + ((byteIndex / 2) % 8) / 8; // 1 character every other byte, plus a 1-character space after every 8 bytes.
+        if (byteIndex < size) {
+            BYTE byte = ((PBYTE)address)[byteIndex];
+            swprintf(hexDump + hexIndex, HEXDUMPLINELENGTH - hexIndex, L"%.2X ", byte);
+            if (((byteIndex % 2) == 0) && ((byteIndex + 1) < dumpLen)) {
+                // On every even byte, print one character. WCHAR is 32 bits
+                // wide on Linux, so the data is read as UTF-16 explicitly.
+                WORD   word = ((PWORD)address)[byteIndex / 2];
+                if ((word == 0x0000) || (word == 0x0020) || ((word >= 0xD800) && (word <= 0xDFFF))) {
+                    unidump[uniIndex] = L'.';
+                }
+                else {
+                    unidump[uniIndex] = word;
+                }
+            }
+        }
+        else {
+            // Add padding to fill out the last line to 16 bytes.
+            wcsncpy(hexDump + hexIndex, L"   ", 4);
+            unidump[uniIndex] = L'.';
+        }
+        bytesDone++;
+        if ((bytesDone % 16) == 0) {
+            // Print one line of data for every 16 bytes. Include the
+            // ASCII dump and the hex dump side-by-side.
+            Report(L"    %ls    %ls\n", hexDump, unidump);
+        }
+        else {
+            if ((bytesDone % 8) == 0) {
+                // Add a spacer in the ASCII dump after every 8 bytes.
+                unidump[uniIndex + 1] = L' ';
+            }
+            if ((bytesDone % 4) == 0) {
+                // Add a spacer in the hex dump after every 4 bytes.
+                wcsncpy(hexDump + hexIndex + 3, L"   ", 4);
+            }
+        }
+    }
+}
+
+// encodeMessage - Converts a report message to the report encoding: UTF-8
+//   for "unicode" reports, or ASCII, with a question mark in place of every
+//   other character.
+//
+//  - messagew (IN): The message to convert.
+//
+//  - messagea (OUT): Buffer which receives the converted message.
+//
+//  - size (IN): Size of the buffer, in bytes.
+//
+//  Return Value:
+//
+//    Returns the length, in bytes, of the converted message.
+//
+static SIZE_T encodeMessage (LPCWSTR messagew, LPSTR messagea, SIZE_T size)
+{
+    SIZE_T length = 0;
+    for (; (*messagew != L'\0'); messagew++) {
+        UINT32 c = (UINT32)*messagew;
+        CHAR   encoded [4];
+        SIZE_T count;
+        if (c < 0x80) {
+            encoded[0] = (CHAR)c;
+            count = 1;
+        }
+        else if (s_reportEncoding != unicode) {
+            encoded[0] = '?';
+            count = 1;
+        }
+        else if (c < 0x800) {
+            encoded[0] = (CHAR)(0xC0 | (c >> 6));
+            encoded[1] = (CHAR)(0x80 | (c & 0x3F));
+            count = 2;
+        }
+        else if (c < 0x10000) {
+            encoded[0] = (CHAR)(0xE0 | (c >> 12));
+            encoded[1] = (CHAR)(0x80 | ((c >> 6) & 0x3F));
+            encoded[2] = (CHAR)(0x80 | (c & 0x3F));
+            count = 3;
+        }
+        else {
+            encoded[0] = (CHAR)(0xF0 | ((c >> 18) & 0x07));
+            encoded[1] = (CHAR)(0x80 | ((c >> 12) & 0x3F));
+            encoded[2] = (CHAR)(0x80 | ((c >> 6) & 0x3F));
+            encoded[3] = (CHAR)(0x80 | (c & 0x3F));
+            count = 4;
+        }
+        if (length + count >= size)
+            break;
+        memcpy(messagea + length, encoded, count);
+        length += count;
+    }
+    messagea[length] = '\0';
+    return length;
+}
+
+// Print - Sends a message to standard error, and to the report file and
+//   standard output if they have been selected by SetReportFile.
+//
+//  - messagew (IN): The message to print.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID Print (LPWSTR messagew)
+{
+    if (NULL == messagew)
+        return;
+
+    const size_t MAXMESSAGELENGTH = 5119;
+    CHAR    messagea [MAXMESSAGELENGTH + 1];
+    SIZE_T  length = encodeMessage(messagew, messagea, MAXMESSAGELENGTH + 1);
+
+    if (s_reportFile != NULL) {
+        // Send the report to the previously specified file.
+        fwrite(messagea, sizeof(CHAR), length, s_reportFile);
+    }
+
+    if (s_reportToStdOut)
+        fputs(messagea, stdout);
+
+    if (s_reportToDebugger) {
+        // Standard error is written directly, so that the message isn't lost
+        // if the process is terminated while the report is being written.
+        for (SIZE_T written = 0; written < length; ) {
+            ssize_t result = write(STDERR_FILENO, messagea + written, length - written);
+            if (result <= 0)
+                break;
+            written += (SIZE_T)result;
+        }
+    }
+}
+
+// Report - Sends a printf-style formatted message to the report destinations.
+//   The format follows the conventions of glibc's vswprintf: wide string
+//   arguments are passed with %ls and sizes with %zu.
+//
+//  - format (IN): Specifies a printf-compliant format string containing the
+//      message to be sent.
+//
+//  - ... (IN): Arguments to be formatted using the specified format string.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID Report (LPCWSTR format, ...)
+{
+    va_list args;
+    WCHAR   messagew [MAXREPORTLENGTH + 1];
+
+    va_start(args, format);
+    int result = vswprintf(messagew, MAXREPORTLENGTH + 1, format, args);
+    va_end(args);
+    messagew[MAXREPORTLENGTH] = L'\0';
+
+    // vswprintf fails if the message is truncated, but the buffer still
+    // holds the truncated message.
+    if ((result >= 0) || (messagew[0] != L'\0'))
+        Print(messagew);
+}
+
+// SetReportEncoding - Sets the output encoding of report messages to either
+//   ASCII (the default) or Unicode, which is UTF-8 on Linux.
+//
+//  - encoding (IN): Specifies either "ascii" or "unicode".
+//
+//  Return Value:
+//
+//    None.
+//
+VOID SetReportEncoding (encoding_e encoding)
+{
+    switch (encoding) {
+    case ascii:
+    case unicode:
+        s_reportEncoding = encoding;
+        break;
+
+    default:
+        assert(FALSE);
+    }
+}
+
+// SetReportFile - Sets a destination file to which all report messages should
+//   be sent. If this function is not called to set a destination file, then
+//   report messages will be sent to standard error instead of to a file.
+//
+//  - file (IN): Pointer to an open file, to which future report messages should
+//      be sent.
+//
+//  - copydebugger (IN): If true, in addition to sending report messages to
+//      the specified file, a copy of each message will also be sent to
+//      standard error.
+//
+//  - tostdout (IN): If true, a copy of each message will also be sent to
+//      standard output.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID SetReportFile (FILE *file, BOOL copydebugger, BOOL tostdout)
+{
+    s_reportFile = file;
+    s_reportToDebugger = copydebugger;
+    s_reportToStdOut = tostdout;
+}
+
+// AppendString - Appends the specified source string to the specified destination
+//   string. Allocates additional space so that the destination string "grows"
+//   as new strings are appended to it.
+//
+//  - dest (IN): Address of the destination string. Receives the resulting
+//      combined string after the append operation.
+//
+//  - source (IN): Source string to be appended to the destination string.
+//
+//  Return Value:
+//
+//    The new concatenated string.
+//
+LPWSTR AppendString (LPWSTR dest, LPCWSTR source)
+{
+    if ((source == NULL) || (source[0] == '\0'))
+    {
+        return dest;
+    }
+    SIZE_T length = wcslen(dest) + wcslen(source);
+    LPWSTR new_str = new WCHAR [length + 1];
+    wcscpy(new_str, dest);
+    wcscat(new_str, source);
+    delete [] dest;
+    return new_str;
+}
+
+// StrToBool - Converts string values (e.g. "yes", "no", "on", "off") to boolean
+//   values.
+//
+//  - s (IN): String value to convert.
+//
+//  Return Value:
+//
+//    Returns TRUE if the string is recognized as a "true" string. Otherwise
+//    returns FALSE.
+//
+BOOL StrToBool (LPCWSTR s) {
+    WCHAR *end;
+
+    if ((wcscasecmp(s, L"true") == 0) ||
+        (wcscasecmp(s, L"yes") == 0) ||
+        (wcscasecmp(s, L"on") == 0) ||
+        (wcstol(s, &end, 10) == 1)) {
+        return TRUE;
+    }
+    else {
+        return FALSE;
+    }
+}
+
+static const DWORD crctab[256] = {
+    0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
+    0xe963a535, 0x9e6495a3, 0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988,
+    0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91, 0x1db71064, 0x6ab020f2,
+    0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+    0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9,
+    0xfa0f3d63, 0x8d080df5, 0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172,
+    0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b, 0x35b5a8fa, 0x42b2986c,
+    0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+    0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423,
+    0xcfba9599, 0xb8bda50f, 0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924,
+    0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d, 0x76dc4190, 0x01db7106,
+    0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+    0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d,
+    0x91646c97, 0xe6635c01, 0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e,
+    0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457, 0x65b0d9c6, 0x12b7e950,
+    0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+    0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7,
+    0xa4d1c46d, 0xd3d6f4fb, 0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0,
+    0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9, 0x5005713c, 0x270241aa,
+    0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+    0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81,
+    0xb7bd5c3b, 0xc0ba6cad, 0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a,
+    0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683, 0xe3630b12, 0x94643b84,
+    0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+    0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb,
+    0x196c3671, 0x6e6b06e7, 0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc,
+    0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5, 0xd6d6a3e8, 0xa1d1937e,
+    0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+    0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55,
+    0x316e8eef, 0x4669be79, 0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236,
+    0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f, 0xc5ba3bbe, 0xb2bd0b28,
+    0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+    0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f,
+    0x72076785, 0x05005713, 0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38,
+    0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21, 0x86d3d2d4, 0xf1d4e242,
+    0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+    0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69,
+    0x616bffd3, 0x166ccf45, 0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2,
+    0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db, 0xaed16a4a, 0xd9d65adc,
+    0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+    0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693,
+    0x54de5729, 0x23d967bf, 0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94,
+    0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d,
+};
+
+DWORD CalculateCRC32(UINT_PTR p, UINT startValue)
+{
+    DWORD hash = startValue;
+    hash = (hash >> 8) ^ crctab[(hash & 0xff) ^ ((p >>  0) & 0xff)];
+    hash = (hash >> 8) ^ crctab[(hash & 0xff) ^ ((p >>  8) & 0xff)];
+    hash = (hash >> 8) ^ crctab[(hash & 0xff) ^ ((p >> 16) & 0xff)];
+    hash = (hash >> 8) ^ crctab[(hash & 0xff) ^ ((p >> 24) & 0xff)];
+#ifdef VLD_64BIT_ADDRESSES
+    hash = (hash >> 8) ^ crctab[(hash & 0xff) ^ ((p >> 32) & 0xff)];
+    hash = (hash >> 8) ^ crctab[(hash & 0xff) ^ ((p >> 40) & 0xff)];
+    hash = (hash >> 8) ^ crctab[(hash & 0xff) ^ ((p >> 48) & 0xff)];
+    hash = (hash >> 8) ^ crctab[(hash & 0xff) ^ ((p >> 56) & 0xff)];
+#endif
+    return hash;
+}
+
+// getEnvironmentOption - Reads the environment variable which overrides an
+//   option: "Vld" followed by the option name, e.g. VldMaxDataDump.
+//
+//  - optionname (IN): Option name.
+//
+//  - outputbuffer (OUT): Buffer which receives the value.
+//
+//  - buffersize (IN): Size of the buffer, in characters.
+//
+//  Return Value:
+//
+//    Returns TRUE if the variable is set.
+//
+static BOOL getEnvironmentOption (LPCWSTR optionname, LPWSTR outputbuffer, UINT buffersize)
+{
+    const UINT namebuffersize = 64;
+    CHAR  variablename [namebuffersize] = "Vld";
+    SIZE_T length = strlen(variablename);
+    for (; (*optionname != L'\0') && (length + 1 < namebuffersize); optionname++)
+        variablename[length++] = (CHAR)*optionname;
+    variablename[length] = '\0';
+
+    LPCSTR value = getenv(variablename);
+    if (value == NULL)
+        return FALSE;
+    UINT index = 0;
+    for (; (value[index] != '\0') && (index + 1 < buffersize); index++)
+        outputbuffer[index] = (WCHAR)(BYTE)value[index];
+    outputbuffer[index] = L'\0';
+    return TRUE;
+}
+
+// getProfileString - Reads an option from the [Options] section of the ini
+//   file, like GetPrivateProfileString. Leading and trailing blanks and a
+//   trailing comment are removed from the value; names are case insensitive.
+//
+//  - optionname (IN): Option name.
+//
+//  - defaultvalue (IN): Value returned if the option isn't found.
+//
+//  - outputbuffer (OUT): Buffer which receives the value.
+//
+//  - buffersize (IN): Size of the buffer, in characters.
+//
+//  - inipath (IN): Path to configuration ini file.
+//
+//  Return Value:
+//
+//    None.
+//
+static VOID getProfileString (LPCWSTR optionname, LPCWSTR defaultvalue, LPWSTR outputbuffer, UINT buffersize, LPCWSTR inipath)
+{
+    wcsncpy(outputbuffer, defaultvalue, buffersize - 1);
+    outputbuffer[buffersize - 1] = L'\0';
+
+    CHAR path [MAX_PATH];
+    if ((inipath == NULL) || (wcstombs(path, inipath, MAX_PATH) >= MAX_PATH))
+        return;
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return;
+
+    bool options = false;
+    CHAR line [512];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        LPSTR begin = line;
+        while (isspace((BYTE)*begin))
+            begin++;
+        if (*begin == '[') {
+            options = (strncasecmp(begin, "[Options]", 9) == 0);
+            continue;
+        }
+        LPSTR equals = strchr(begin, '=');
+        if (!options || (*begin == ';') || (equals == NULL))
+            continue;
+
+        // Compare the name.
+        LPSTR end = equals;
+        while ((end > begin) && isspace((BYTE)end[-1]))
+            end--;
+        SIZE_T index = 0;
+        for (; (begin + index < end) && (optionname[index] != L'\0'); index++) {
+            if (towlower((WCHAR)(BYTE)begin[index]) != towlower(optionname[index]))
+                break;
+        }
+        if ((begin + index != end) || (optionname[index] != L'\0'))
+            continue;
+
+        // Copy the value.
+        LPSTR value = equals + 1;
+        while (isspace((BYTE)*value))
+            value++;
+        end = value + strcspn(value, ";\r\n");
+        while ((end > value) && isspace((BYTE)end[-1]))
+            end--;
+        for (index = 0; (value + index < end) && (index + 1 < buffersize); index++)
+            outputbuffer[index] = (WCHAR)(BYTE)value[index];
+        outputbuffer[index] = L'\0';
+        break;
+    }
+    fclose(file);
+}
+
+// LoadBoolOption - Loads specified option from environment variables or from
+//   the ini file.
+//
+//  - optionname (IN): Option name.
+//
+//  - defaultvalue (IN): Default value if optionname in unavailable.
+//
+//  - inipath (IN): Path to configuration ini file.
+//
+//  Return Value:
+//
+//    Returns TRUE if the string is recognized as a "true" string. Otherwise
+//    returns FALSE.
+//
+BOOL LoadBoolOption(LPCWSTR optionname, LPCWSTR defaultvalue, LPCWSTR inipath)
+{
+    const UINT buffersize = 64;
+    WCHAR buffer[buffersize] = { 0 };
+
+    if (!getEnvironmentOption(optionname, buffer, buffersize)) {
+        getProfileString(optionname, defaultvalue, buffer, buffersize, inipath);
+    }
+
+    return StrToBool(buffer);
+}
+
+// LoadIntOption - Loads specified option from environment variables or from
+//   the ini file.
+//
+//  - optionname (IN): Option name.
+//
+//  - defaultvalue (IN): Default value if optionname in unavailable.
+//
+//  - inipath (IN): Path to configuration ini file.
+//
+//  Return Value:
+//
+//    Returns the value of the option.
+//
+UINT LoadIntOption(LPCWSTR optionname, UINT defaultvalue, LPCWSTR inipath)
+{
+    const UINT buffersize = 64;
+    WCHAR buffer[buffersize] = { 0 };
+
+    if (!getEnvironmentOption(optionname, buffer, buffersize)) {
+        getProfileString(optionname, L"", buffer, buffersize, inipath);
+        if (buffer[0] == L'\0')
+            return defaultvalue;
+    }
+
+    return (UINT)wcstol(buffer, NULL, 10);
+}
+
+// LoadStringOption - Loads specified option from environment variables or
+//   from the ini file.
+//
+//  - optionname (IN): Option name.
+//
+//  - outputbuffer (OUT): Buffer which receives the value.
+//
+//  - buffersize (IN): Size of the buffer, in characters.
+//
+//  - inipath (IN): Path to configuration ini file.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID LoadStringOption(LPCWSTR optionname, LPWSTR outputbuffer, UINT buffersize, LPCWSTR inipath)
+{
+    if (!getEnvironmentOption(optionname, outputbuffer, buffersize)) {
+        getProfileString(optionname, L"", outputbuffer, buffersize, inipath);
+    }
+}
@@ -0,0 +1,1169 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Linux VisualLeakDetector Class Implementation
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <cwctype>
+#include <link.h>
+#include <time.h>
+
+#define VLDBUILD         // Declares that we are building Visual Leak Detector.
+#include "callstack.h"   // Provides a class for handling call stacks.
+#include "map.h"         // Provides a lightweight STL-like map template.
+#include "set.h"         // Provides a lightweight STL-like set template.
+#include "utility.h"     // Provides various utility functions.
+#include "linux/vldint.h" // Provides access to the Visual Leak Detector internals.
+#include "linux/stackwalk.h" // Provides the stack walkers.
+#include "vldheap.h"     // Provides internal new and delete operators.
+#include "version.h"
+
+#define MODULE_SET_RESERVE  16  // There are usually a few dozen modules in a process.
+
+// The runtime libraries, which allocate memory on behalf of their callers
+// (strdup, fopen, the C++ library's containers...). Like the C runtime DLLs of
+// the Windows patch table, they are never excluded from leak detection.
+static const LPCSTR s_runtimeModules [] = {
+    "ld-linux",
+    "libc.so",
+    "libdl.so",
+    "libgcc_s.so",
+    "libm.so",
+    "libpthread.so",
+    "libstdc++.so",
+};
+
+// The C library and the dynamic linker. The blocks which they allocate for
+// their own use (stdio buffers, thread control blocks, dlerror strings...) are
+// freed after VLD is destroyed, or kept for reuse, so they aren't leaks.
+static const LPCSTR s_systemModules [] = {
+    "ld-linux",
+    "libc.so",
+};
+
+// The C library functions which allocate memory for their caller, rather than
+// for the C library's own use.
+static const LPCSTR s_callerAllocs [] = {
+    "__getdelim",
+    "__strdup",
+    "__strndup",
+    "getdelim",
+    "realpath",
+    "strdup",
+    "strndup",
+    "wcsdup",
+};
+
+// The one and only VisualLeakDetector object instance. It is constructed
+// before the other static objects of libvld.so, and destroyed after them.
+__attribute__((init_priority(101))) VisualLeakDetector g_vld;
+
+// Thread local storage of the interposed functions. It uses the initial-exec
+// model, so that accessing it never allocates memory.
+static __thread tls_t s_tls __attribute__((tls_model("initial-exec")));
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Local helper functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// getIniFilePath - Finds the ini file: vld.ini in the current directory, or
+//   next to libvld.so.
+//
+//  - path (OUT): Buffer which receives the path of the ini file.
+//
+//  - count (IN): Size of the buffer, in characters.
+//
+//  Return Value:
+//
+//    Returns TRUE if an ini file was found.
+//
+static BOOL getIniFilePath (LPWSTR path, SIZE_T count)
+{
+    CHAR candidate [MAX_PATH] = "vld.ini";
+    if (access(candidate, R_OK) != 0) {
+        Dl_info info;
+        if ((dladdr((void*)&getIniFilePath, &info) == 0) || (info.dli_fname == NULL))
+            return FALSE;
+        LPCSTR slash = strrchr(info.dli_fname, '/');
+        if (slash == NULL)
+            return FALSE;
+        snprintf(candidate, MAX_PATH, "%.*s/vld.ini", (int)(slash - info.dli_fname), info.dli_fname);
+        if (access(candidate, R_OK) != 0)
+            return FALSE;
+    }
+
+    CHAR fullpath [PATH_MAX];
+    if (realpath(candidate, fullpath) == NULL)
+        return FALSE;
+    return (mbstowcs(path, fullpath, count) < count);
+}
+
+// addMilliseconds - Moves a point in time forward.
+//
+//  - time (IN/OUT): The point in time.
+//
+//  - milliseconds (IN): Number of milliseconds to add.
+//
+//  Return Value:
+//
+//    None.
+//
+static VOID addMilliseconds (struct timespec &time, UINT32 milliseconds)
+{
+    time.tv_sec += milliseconds / 1000;
+    time.tv_nsec += (long)(milliseconds % 1000) * 1000000;
+    if (time.tv_nsec >= 1000000000) {
+        time.tv_sec++;
+        time.tv_nsec -= 1000000000;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// CaptureContext Class Implementation
+//
+////////////////////////////////////////////////////////////////////////////////
+
+CaptureContext::CaptureContext(context_t& context) : m_context(context) {
+    m_tls = &s_tls;
+
+    m_bFirst = (GET_RETURN_ADDRESS(m_tls->context) == 0);
+    if (m_bFirst) {
+        // This is the first call to enter VLD for the current allocation.
+        // Record the return address.
+        m_tls->context = m_context;
+    }
+}
+
+CaptureContext::~CaptureContext() {
+    if (!m_bFirst)
+        return;
+
+    if ((m_tls->blockWithoutGuard) && g_vld.enabled() && !IsExcludedModule()) {
+        DWORD threadId = GetCurrentThreadId();
+        blockinfo_t* pblockInfo = NULL;
+        if (m_tls->newBlockWithoutGuard == NULL) {
+            g_vld.mapBlock(VLD_LIBC_HEAP,
+                m_tls->blockWithoutGuard,
+                m_tls->size,
+                false,
+                false,
+                threadId,
+                pblockInfo);
+        }
+        else {
+            g_vld.remapBlock(VLD_LIBC_HEAP,
+                m_tls->blockWithoutGuard,
+                m_tls->newBlockWithoutGuard,
+                m_tls->size,
+                false,
+                false,
+                threadId,
+                pblockInfo, m_tls->context);
+        }
+
+        if ((pblockInfo != NULL) && g_vld.captureStack(m_tls->size, threadId)) {
+            g_vld.attachStack(pblockInfo, g_vld.m_stackTable.capture((g_vld.m_options & VLD_OPT_SAFE_STACK_WALK) ?
+                CallStack::safe : CallStack::fast, g_vld.m_maxTraceFrames, m_tls->context));
+        }
+        g_vld.checkPeak();
+    }
+
+    // Reset thread local flags and variables for the next allocation.
+    Reset();
+}
+
+void CaptureContext::Set(LPVOID mem, LPVOID newmem, SIZE_T size) {
+    if (!m_bFirst) {
+        // VLD's code was reentered: the block isn't recorded.
+        return;
+    }
+    m_tls->blockWithoutGuard = mem;
+    m_tls->newBlockWithoutGuard = newmem;
+    m_tls->size = size;
+}
+
+// IsExcludedModule - Determines whether the allocation was made by a module
+//   which is excluded from leak detection by the module list.
+//
+//  Return Value:
+//
+//    Returns TRUE if the allocation must not be recorded.
+//
+BOOL CaptureContext::IsExcludedModule() {
+    if (g_vld.m_forcedModuleList[0] == L'\0') {
+        // No module is excluded.
+        return FALSE;
+    }
+    return g_vld.isModuleExcluded(GET_RETURN_ADDRESS(m_context));
+}
+
+void CaptureContext::Reset() {
+    m_tls->context.func = 0;
+    m_tls->context.fp = 0;
+    m_tls->context.bp = 0;
+    Set(NULL, NULL, 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Public Leak Detection Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Constructor - Reads the configuration and starts recording the allocations
+//   made by the interposed functions.
+//
+VisualLeakDetector::VisualLeakDetector ()
+{
+    g_heapMapLock.Initialize();
+    m_modulesLock.Initialize();
+
+    // Initialize configuration options and related private data. The
+    // tracking options have their defaults set by BlockTracker.
+    m_iniFilePath[0] = L'\0';
+    m_forcedModuleList[0] = L'\0';
+    m_loadedModules  = NULL;
+    m_moduleAdds     = 0;
+    m_moduleSubs     = 0;
+    m_monitorStop    = false;
+    m_monitorRunning = false;
+    m_reportFile     = NULL;
+    wcsncpy(m_reportFilePath, VLD_DEFAULT_REPORT_FILE_NAME, MAX_PATH);
+    m_status         = 0x0;
+    m_vldBase        = 0;
+
+    // Load configuration options.
+    configure();
+    if (m_options & VLD_OPT_VLDOFF) {
+        Report(L"Visual Leak Detector is turned off.\n");
+        return;
+    }
+
+    if (!ResolveRealAlloc()) {
+        Report(L"ERROR: Visual Leak Detector: The C library's allocator functions could not be found.\n");
+        return;
+    }
+
+    // Frames in libvld.so itself are not reported.
+    Dl_info info;
+    if (dladdr((void*)&g_vld, &info) != 0)
+        m_vldBase = (UINT_PTR)info.dli_fbase;
+
+    // The first unwind may allocate memory, and so does looking up the bounds
+    // of the main thread's stack. Get that out of the way before any
+    // allocation is recorded.
+    UINT_PTR frames [1];
+    WalkUnwindTables(0, frames, _countof(frames));
+    UINT_PTR stackLow, stackHigh;
+    GetThreadStackBounds(stackLow, stackHigh);
+
+    initializeTracking();
+
+    // Open the block database before recording the modules, so that every
+    // module and block gets recorded.
+    int blockdberror = 0;
+    if ((m_blockDbPath[0] != L'\0') && !m_blockDb.open(m_blockDbPath, m_blockDbSize))
+        blockdberror = errno;
+
+    // Record the modules which are loaded. Modules loaded later are found
+    // when an address in them is first looked up.
+    m_loadedModules = new ModuleSet;
+    RefreshModules();
+
+    // Open the report file, if the report is to be written to a file.
+    if (m_options & VLD_OPT_REPORT_TO_FILE) {
+        CHAR path [MAX_PATH];
+        if (wcstombs(path, m_reportFilePath, MAX_PATH) < MAX_PATH)
+            m_reportFile = fopen(path, "w");
+        if (m_reportFile == NULL) {
+            Report(L"WARNING: Visual Leak Detector: Couldn't open report file for writing: %ls\n"
+                L"  The report will be sent to standard error instead.\n", m_reportFilePath);
+            m_options &= ~VLD_OPT_REPORT_TO_FILE;
+            m_options |= VLD_OPT_REPORT_TO_DEBUGGER;
+        }
+        else if (m_options & VLD_OPT_UNICODE_REPORT) {
+            SetReportEncoding(unicode);
+        }
+    }
+    SetReportFile(m_reportFile, (m_options & VLD_OPT_REPORT_TO_DEBUGGER) != 0,
+        (m_options & VLD_OPT_REPORT_TO_STDOUT) != 0);
+
+    Report(L"Visual Leak Detector read settings from: %ls\n",
+        (m_iniFilePath[0] != L'\0') ? m_iniFilePath : L"(default settings)");
+    Report(L"Visual Leak Detector Version " VLDVERSION L" installed.\n");
+    if (blockdberror != 0) {
+        Report(L"WARNING: Visual Leak Detector: The block database %ls couldn't be created (error=%d).\n",
+            m_blockDbPath, blockdberror);
+        m_blockDbPath[0] = L'\0';
+    }
+    if (m_monitorInterval != 0)
+        startMonitor();
+    reportConfig();
+
+    __atomic_or_fetch(&m_status, VLD_STATUS_INSTALLED, __ATOMIC_RELEASE);
+}
+
+// Destructor - Stops recording allocations and writes the leak report.
+//
+VisualLeakDetector::~VisualLeakDetector ()
+{
+    if (m_options & VLD_OPT_VLDOFF) {
+        // VLD has been turned off.
+        return;
+    }
+
+    if (m_status & VLD_STATUS_INSTALLED) {
+        // Memory allocated while the report is written must not be recorded.
+        CAPTURE_CONTEXT();
+        CaptureContext cc(context_);
+
+        stopMonitor();
+
+        // Generate a memory leak report.
+        SIZE_T leaks_count = ReportLeaks();
+
+        // Show a summary.
+        reportSummary(leaks_count);
+
+        {
+            // Stop recording allocations, and free internally allocated
+            // resources used by the heap map.
+            CriticalSectionLocker<> cs(g_heapMapLock);
+            __atomic_and_fetch(&m_status, ~VLD_STATUS_INSTALLED, __ATOMIC_RELEASE);
+            m_blockDb.close();
+        }
+        freeTracking();
+        {
+            CriticalSectionLocker<> cs(g_heapMapLock);
+            m_symbolizer.clear();
+        }
+        {
+            CriticalSectionLocker<> cs(m_modulesLock);
+            delete m_loadedModules;
+            m_loadedModules = NULL;
+        }
+
+        Report(L"Visual Leak Detector is now exiting.\n");
+
+        if (m_reportFile != NULL) {
+            SetReportFile(NULL, TRUE, FALSE);
+            fclose(m_reportFile);
+            m_reportFile = NULL;
+        }
+    }
+    else {
+        // VLD failed to load properly.
+        m_blockDb.close();
+        freeTracking();
+        delete m_loadedModules;
+        m_loadedModules = NULL;
+    }
+}
+
+// GetLeaksCount - Returns the number of leaks found so far.
+//
+SIZE_T VisualLeakDetector::GetLeaksCount()
+{
+    if (!enabled())
+        return 0;
+
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    SIZE_T leaksCount = 0;
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        leaksCount += getLeaksCount((*heapit).second);
+    }
+    return leaksCount;
+}
+
+// ReportLeaks - Writes the memory leak report for the blocks which are
+//   allocated.
+//
+//  Return Value:
+//
+//    Returns the number of leaks reported.
+//
+SIZE_T VisualLeakDetector::ReportLeaks( )
+{
+    if (!enabled()) {
+        // VLD has been turned off.
+        return 0;
+    }
+
+    CriticalSectionLocker<> cs(g_heapMapLock);
+    bool firstLeak = true;
+    Set<blockinfo_t*> aggregatedLeaks;
+    SIZE_T leaksCount = 0;
+    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+        leaksCount += reportLeaks((*heapit).second, firstLeak, aggregatedLeaks);
+    }
+    leaksCount += reportUntracedLeaks();
+    return leaksCount;
+}
+
+UINT32 VisualLeakDetector::GetOptions()
+{
+    return m_options;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Private Leak Detection Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// sampleAllocation - Decides whether an allocation is tracked, when only
+//   sampled allocations are, by charging its size to the calling thread's
+//   sampling interval. The interposed functions call it before they construct
+//   a CaptureContext, so that the allocations which aren't sampled cost
+//   nothing else. Reallocations of tracked blocks are always tracked, so that
+//   the block map never holds stale addresses.
+//
+//  - mem (IN): Pointer to the allocated block, or to the block which was
+//      reallocated.
+//
+//  - newmem (IN): Pointer to the reallocated block, or NULL.
+//
+//  - size (IN): Size, in bytes, of the allocated block.
+//
+//  Return Value:
+//
+//    Returns true if the allocation must be recorded.
+//
+bool VisualLeakDetector::sampleAllocation (LPCVOID mem, LPCVOID newmem, SIZE_T size)
+{
+    tls_t *tls = &s_tls;
+    if (GET_RETURN_ADDRESS(tls->context) != 0) {
+        // VLD's code was reentered: the allocation isn't recorded, so it
+        // isn't charged either.
+        return false;
+    }
+    if ((newmem != NULL) && isBlockMapped(VLD_LIBC_HEAP, mem))
+        return true;
+
+    if (tls->sampleRandom == 0) {
+        // The thread local storage is zero-initialized: seed the thread's
+        // random number generator on its first allocation.
+        tls->sampleRandom = (GetCurrentThreadId() * 2654435761u) ^ (UINT32)GetTickCount64();
+        if (tls->sampleRandom == 0)
+            tls->sampleRandom = 1;
+        tls->sampleBytes = nextSampleInterval(tls->sampleRandom);
+    }
+
+    tls->sampleBytes -= (LONG64)size;
+    if (tls->sampleBytes > 0)
+        return false;
+
+    tls->sampleBytes = nextSampleInterval(tls->sampleRandom);
+    return true;
+}
+
+// configure - Configures VisualLeakDetector using values read from the vld.ini
+//   file, or from the environment variables which override them.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID VisualLeakDetector::configure ()
+{
+    getIniFilePath(m_iniFilePath, MAX_PATH);
+    LPCWSTR inipath = m_iniFilePath;
+
+    // Read the boolean options.
+    const UINT buffersize = 64;
+    WCHAR buffer[buffersize] = { 0 };
+
+    LPCSTR vld = getenv("VLD");
+    if (vld != NULL) {
+        mbstowcs(buffer, vld, buffersize - 1);
+    }
+    else {
+        LoadStringOption(L"VLD", buffer, buffersize, inipath);
+        if (buffer[0] == L'\0')
+            wcscpy(buffer, L"on");
+    }
+
+    if (StrToBool(buffer) == FALSE) {
+        m_options |= VLD_OPT_VLDOFF;
+        return;
+    }
+
+    if (LoadBoolOption(L"AggregateDuplicates", L"", inipath)) {
+        m_options |= VLD_OPT_AGGREGATE_DUPLICATES;
+    }
+
+    if (LoadBoolOption(L"TraceInternalFrames", L"", inipath)) {
+        m_options |= VLD_OPT_TRACE_INTERNAL_FRAMES;
+    }
+
+    // Read the force-include module list. On Windows, the modules which don't
+    // include vld.h are excluded unless they are listed. On Linux, preloading
+    // libvld.so opts the whole program in, so the modules are only excluded
+    // when the list isn't empty. Module names are case sensitive.
+    LoadStringOption(L"ForceIncludeModules", m_forcedModuleList, MAXMODULELISTLENGTH, inipath);
+    if (wcscmp(m_forcedModuleList, L"*") == 0)
+        m_forcedModuleList[0] = L'\0';
+    else
+        m_options |= VLD_OPT_MODULE_LIST_INCLUDE;
+
+    // Read the integer configuration options.
+    m_maxDataDump = LoadIntOption(L"MaxDataDump", VLD_DEFAULT_MAX_DATA_DUMP, inipath);
+    m_maxTraceFrames = LoadIntOption(L"MaxTraceFrames", VLD_DEFAULT_MAX_TRACE_FRAMES, inipath);
+    if (m_maxTraceFrames < 1) {
+        m_maxTraceFrames = VLD_DEFAULT_MAX_TRACE_FRAMES;
+    }
+    m_sampleRate = LoadIntOption(L"SampleRate", 0, inipath);
+    m_minTrackedSize = LoadIntOption(L"MinTrackedSize", 0, inipath);
+    m_maxTrackedSize = LoadIntOption(L"MaxTrackedSize", 0, inipath);
+    if (m_maxTrackedSize == 0) {
+        m_maxTrackedSize = (SIZE_T)-1;
+    }
+    m_mapUntrackedSizes = (LoadBoolOption(L"MapUntrackedSizes", L"yes", inipath) != FALSE);
+    m_peakHysteresis = LoadIntOption(L"PeakSnapshotHysteresis", 0, inipath);
+    m_peakInterval = LoadIntOption(L"PeakSnapshotInterval", VLD_DEFAULT_PEAK_INTERVAL, inipath);
+    m_peak.trigger = (LONG64)m_peakHysteresis;
+    m_monitorInterval = LoadIntOption(L"MonitorInterval", 0, inipath);
+    m_monitorIntervals = LoadIntOption(L"MonitorIntervals", VLD_DEFAULT_MONITOR_INTERVALS, inipath);
+    if (m_monitorIntervals < 1) {
+        m_monitorIntervals = VLD_DEFAULT_MONITOR_INTERVALS;
+    }
+
+    // Read the report destination (standard error, file, or both).
+    WCHAR filename [MAX_PATH] = {0};
+    LoadStringOption(L"ReportFile", filename, MAX_PATH, inipath);
+    if (filename[0] != '\0') {
+        wcsncpy(m_reportFilePath, filename, MAX_PATH - 1);
+        m_reportFilePath[MAX_PATH - 1] = L'\0';
+    }
+
+    // Read the block database file, if any. The event trace (TraceFile) is
+    // only recorded on Windows.
+    LoadStringOption(L"BlockDatabase", filename, MAX_PATH, inipath);
+    wcsncpy(m_blockDbPath, filename, MAX_PATH - 1);
+    m_blockDbPath[MAX_PATH - 1] = L'\0';
+    UINT blockdbsize = LoadIntOption(L"BlockDatabaseSize", BLOCKDB_DEFAULT_SIZE, inipath);
+    if (blockdbsize != 0) {
+        m_blockDbSize = (ULONG64)blockdbsize * 1024 * 1024;
+    }
+
+    LoadStringOption(L"ReportTo", buffer, buffersize, inipath);
+    if (wcscasecmp(buffer, L"both") == 0) {
+        m_options |= (VLD_OPT_REPORT_TO_DEBUGGER | VLD_OPT_REPORT_TO_FILE);
+    }
+    else if (wcscasecmp(buffer, L"file") == 0) {
+        m_options |= VLD_OPT_REPORT_TO_FILE;
+    }
+    else if (wcscasecmp(buffer, L"stdout") == 0) {
+        m_options |= VLD_OPT_REPORT_TO_STDOUT;
+    }
+    else {
+        m_options |= VLD_OPT_REPORT_TO_DEBUGGER;
+    }
+
+    // Read the report file encoding (ascii or unicode).
+    LoadStringOption(L"ReportEncoding", buffer, buffersize, inipath);
+    if (wcscasecmp(buffer, L"unicode") == 0) {
+        m_options |= VLD_OPT_UNICODE_REPORT;
+    }
+
+    // Read the stack walking method.
+    LoadStringOption(L"StackWalkMethod", buffer, buffersize, inipath);
+    if (wcscasecmp(buffer, L"safe") == 0) {
+        m_options |= VLD_OPT_SAFE_STACK_WALK;
+    }
+    else if (wcscasecmp(buffer, L"none") == 0) {
+        m_options |= VLD_OPT_NO_STACK_CAPTURE;
+    }
+}
+
+// reportConfig - Generates a brief report summarizing Visual Leak Detector's
+//   configuration, as loaded from the vld.ini file.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID VisualLeakDetector::reportConfig ()
+{
+    if (m_options & VLD_OPT_AGGREGATE_DUPLICATES) {
+        Report(L"    Aggregating duplicate leaks.\n");
+    }
+    if (m_forcedModuleList[0] != L'\0') {
+        Report(L"    Forcing %ls of these modules in leak detection: %ls\n",
+            (m_options & VLD_OPT_MODULE_LIST_INCLUDE) ? L"inclusion" : L"exclusion", m_forcedModuleList);
+    }
+    if (m_maxDataDump != VLD_DEFAULT_MAX_DATA_DUMP) {
+        if (m_maxDataDump == 0) {
+            Report(L"    Suppressing data dumps.\n");
+        }
+        else {
+            Report(L"    Limiting data dumps to %zu bytes.\n", m_maxDataDump);
+        }
+    }
+    if (m_maxTraceFrames != VLD_DEFAULT_MAX_TRACE_FRAMES) {
+        Report(L"    Limiting stack traces to %u frames.\n", m_maxTraceFrames);
+    }
+    if (m_sampleRate != 0) {
+        Report(L"    Sampling one allocation every %zu bytes on average.\n", m_sampleRate);
+    }
+    if (m_peakHysteresis != 0) {
+        Report(L"    Snapshotting allocation sites at each new peak of %zu more bytes (at most every %u ms).\n",
+            m_peakHysteresis, m_peakInterval);
+    }
+    if (m_monitorRunning) {
+        Report(L"    Monitoring allocation sites that grow for %u intervals of %u ms.\n",
+            m_monitorIntervals, m_monitorInterval);
+    }
+    if (m_blockDb.isOpen()) {
+        Report(L"    Recording the tracked blocks in %ls (%llu MB)\n", m_blockDbPath,
+            (unsigned long long)(m_blockDbSize / (1024 * 1024)));
+    }
+    if ((m_minTrackedSize != 0) || (m_maxTrackedSize != (SIZE_T)-1)) {
+        Report(L"    Only capturing call stacks for blocks of %zu to %zu bytes%ls.\n", m_minTrackedSize, m_maxTrackedSize,
+            m_mapUntrackedSizes ? L"" : L", ignoring other blocks");
+    }
+    if (m_options & VLD_OPT_UNICODE_REPORT) {
+        Report(L"    Generating a Unicode (UTF-8) encoded report.\n");
+    }
+    if (m_options & VLD_OPT_REPORT_TO_FILE) {
+        if (m_options & VLD_OPT_REPORT_TO_DEBUGGER) {
+            Report(L"    Outputting the report to standard error and to %ls\n", m_reportFilePath);
+        }
+        else {
+            Report(L"    Outputting the report to %ls\n", m_reportFilePath);
+        }
+    }
+    if (m_options & VLD_OPT_SAFE_STACK_WALK) {
+        Report(L"    Using the \"safe\" (but slow) stack walking method.\n");
+    }
+    if (m_options & VLD_OPT_NO_STACK_CAPTURE) {
+        Report(L"    Counting leaks without capturing call stacks.\n");
+    }
+    if (m_options & VLD_OPT_TRACE_INTERNAL_FRAMES) {
+        Report(L"    Including heap and VLD internal frames in stack traces.\n");
+    }
+}
+
+// startMonitor - Starts the leak growth monitor thread (see the
+//   MonitorInterval option).
+//
+//  Return Value:
+//
+//    None.
+//
+VOID VisualLeakDetector::startMonitor ()
+{
+    pthread_mutex_init(&m_monitorMutex, NULL);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_monitorCond, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    // The thread's own allocations, made by the C library and the dynamic
+    // linker while it is created, are not recorded.
+    CAPTURE_CONTEXT();
+    CaptureContext cc(context_);
+    int error = pthread_create(&m_monitorThread, NULL, monitorProc, NULL);
+    if (error != 0) {
+        Report(L"WARNING: Visual Leak Detector: The leak growth monitor couldn't be started (error=%d).\n", error);
+        return;
+    }
+    m_monitorRunning = true;
+}
+
+// stopMonitor - Stops the leak growth monitor thread, if it is running, and
+//   waits for it to exit.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID VisualLeakDetector::stopMonitor ()
+{
+    if (!m_monitorRunning)
+        return;
+
+    pthread_mutex_lock(&m_monitorMutex);
+    m_monitorStop = true;
+    pthread_cond_signal(&m_monitorCond);
+    pthread_mutex_unlock(&m_monitorMutex);
+    pthread_join(m_monitorThread, NULL);
+    m_monitorRunning = false;
+    pthread_cond_destroy(&m_monitorCond);
+    pthread_mutex_destroy(&m_monitorMutex);
+}
+
+// monitorProc - Thread procedure of the leak growth monitor. Checks the
+//   allocation sites once per interval until stopMonitor is called.
+//
+//  - param (IN): Unused.
+//
+//  Return Value:
+//
+//    Returns NULL.
+//
+void* VisualLeakDetector::monitorProc (void *param)
+{
+    UNREFERENCED_PARAMETER(param);
+
+    // Memory allocated while the sites are reported must not be recorded.
+    CAPTURE_CONTEXT();
+    CaptureContext cc(context_);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    addMilliseconds(deadline, g_vld.m_monitorInterval);
+    pthread_mutex_lock(&g_vld.m_monitorMutex);
+    while (!g_vld.m_monitorStop) {
+        // Wait until the next interval is over. A wake-up before the
+        // deadline is either a stop request or spurious.
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec < deadline.tv_sec) || ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec < deadline.tv_nsec))) {
+            pthread_cond_timedwait(&g_vld.m_monitorCond, &g_vld.m_monitorMutex, &deadline);
+            continue;
+        }
+        addMilliseconds(deadline, g_vld.m_monitorInterval);
+        pthread_mutex_unlock(&g_vld.m_monitorMutex);
+        g_vld.checkGrowingSites();
+        pthread_mutex_lock(&g_vld.m_monitorMutex);
+    }
+    pthread_mutex_unlock(&g_vld.m_monitorMutex);
+    return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Module Registry
+//
+//   The Linux counterpart of the ModuleSet which Windows builds with
+//   EnumerateLoadedModulesW64. It is built from the dynamic linker's list of
+//   loaded objects (dl_iterate_phdr), which has the address ranges that
+//   /proc/self/maps shows, without parsing it. Objects loaded by dlopen are
+//   picked up the first time an address in them is looked up: dlopen isn't
+//   interposed, because the dynamic linker resolves relative names against
+//   the RUNPATH and $ORIGIN of dlopen's caller, which would be libvld.so.
+//   dlclose is interposed (see vld_hooks.cpp) so that the objects which it
+//   unloads are kept in the registry, and can still be symbolized.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// RefreshModules - Rebuilds the set of loaded modules, if the dynamic linker
+//   has loaded or unloaded objects since it was last built. The modules which
+//   are no longer loaded are kept, flagged as unloaded, until a newly loaded
+//   module overlaps them; the call stacks through them are then resolved
+//   again.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID VisualLeakDetector::RefreshModules ()
+{
+    if (m_options & VLD_OPT_VLDOFF)
+        return;
+
+    ModuleSet replaced;
+    {
+        CriticalSectionLocker<> cs(m_modulesLock);
+        if (!refreshModules(replaced))
+            return;
+    }
+
+    // g_heapMapLock is taken after m_modulesLock is released: the reports
+    // take them in the other order.
+    if (replaced.begin() != replaced.end()) {
+        CriticalSectionLocker<> cs(g_heapMapLock);
+        for (ModuleSet::Iterator it = replaced.begin(); it != replaced.end(); ++it) {
+            m_stackTable.dropResolved((*it).addrLow, (*it).addrHigh);
+        }
+    }
+}
+
+// refreshModules - Rebuilds the set of loaded modules, for RefreshModules.
+//   Must be called with m_modulesLock held.
+//
+//  - replaced (OUT): Receives the modules whose address range is now used by
+//      another module.
+//
+//  Return Value:
+//
+//    Returns false if the set didn't need to be rebuilt.
+//
+bool VisualLeakDetector::refreshModules (ModuleSet &replaced)
+{
+    if (m_loadedModules == NULL) {
+        // VLD is exiting.
+        return false;
+    }
+
+    UINT64 counters [2] = { 0, 0 };
+    dl_iterate_phdr(getModuleCounters, counters);
+    if ((m_loadedModules->begin() != m_loadedModules->end()) &&
+        (counters[0] == m_moduleAdds) && (counters[1] == m_moduleSubs)) {
+        // No object was loaded or unloaded.
+        return false;
+    }
+
+    ModuleSet* newmodules = new ModuleSet();
+    newmodules->reserve(MODULE_SET_RESERVE);
+    dl_iterate_phdr(addLoadedModule, newmodules);
+
+    // Keep the modules which were unloaded, unless their address range has
+    // been reused.
+    ModuleSet* oldmodules = m_loadedModules;
+    for (ModuleSet::Iterator oldit = oldmodules->begin(); oldit != oldmodules->end(); ++oldit) {
+        ModuleSet::Iterator newit = newmodules->find(*oldit);
+        if (newit != newmodules->end()) {
+            if (((*newit).addrLow != (*oldit).addrLow) || ((*newit).path != (*oldit).path))
+                replaced.insert(*oldit);
+            continue;
+        }
+        moduleinfo_t moduleinfo = *oldit;
+        moduleinfo.flags |= VLD_MODULE_UNLOADED;
+        newmodules->insert(moduleinfo);
+    }
+
+    // Record the newly loaded modules in the block database, if there is one.
+    if (m_blockDb.isOpen()) {
+        for (ModuleSet::Iterator newit = newmodules->begin(); newit != newmodules->end(); ++newit) {
+            if ((*newit).flags & VLD_MODULE_UNLOADED)
+                continue;
+            WCHAR modulepath [MAX_PATH];
+            if (mbstowcs(modulepath, (*newit).path.c_str(), MAX_PATH) >= MAX_PATH)
+                continue;
+            m_blockDb.addModule((*newit).addrLow, (*newit).addrHigh - (*newit).addrLow + 1, modulepath);
+        }
+    }
+
+    // Start using the new set of loaded modules.
+    m_loadedModules = newmodules;
+    m_moduleAdds = counters[0];
+    m_moduleSubs = counters[1];
+
+    // Free resources used by the old module list.
+    delete oldmodules;
+    return true;
+}
+
+// RetainModule - Called before a module is closed with dlclose, which may
+//   unload it. Records the module, and maps its file for the symbolizer, so
+//   that the call stacks through it can be resolved after it is unloaded, even
+//   if its file is deleted.
+//
+//  - handle (IN): The module's handle, as returned by dlopen.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID VisualLeakDetector::RetainModule (HANDLE handle)
+{
+    struct link_map *map = NULL;
+    if ((dlinfo(handle, RTLD_DI_LINKMAP, &map) != 0) || (map == NULL) || (map->l_ld == NULL))
+        return;
+
+    // The dynamic section is in one of the module's loadable segments.
+    moduleinfo_t moduleinfo;
+    if (findModule((UINT_PTR)map->l_ld, moduleinfo))
+        m_symbolizer.retain(moduleinfo.path.c_str(), moduleinfo.bias);
+}
+
+// addLoadedModule - Callback function for dl_iterate_phdr that adds the
+//   information of one of the dynamic linker's objects to the provided
+//   ModuleSet.
+//
+//  - info (IN): The object's program headers and load address.
+//
+//  - size (IN): Size of the info structure (ignored).
+//
+//  - context (IN): Pointer to the ModuleSet to which information about each
+//      object is to be added.
+//
+//  Return Value:
+//
+//    Always returns 0, to let the enumeration continue.
+//
+int VisualLeakDetector::addLoadedModule (struct dl_phdr_info *info, size_t size, void *context)
+{
+    UNREFERENCED_PARAMETER(size);
+
+    // The module spans its loadable segments.
+    UINT_PTR low = (UINT_PTR)-1;
+    UINT_PTR high = 0;
+    for (UINT32 index = 0; index < info->dlpi_phnum; index++) {
+        const ElfW(Phdr) &segment = info->dlpi_phdr[index];
+        if ((segment.p_type != PT_LOAD) || (segment.p_memsz == 0))
+            continue;
+        UINT_PTR start = (UINT_PTR)(info->dlpi_addr + segment.p_vaddr);
+        if (start < low)
+            low = start;
+        if (start + segment.p_memsz > high)
+            high = start + segment.p_memsz;
+    }
+    if (high == 0)
+        return 0;
+
+    // The main program's name is empty.
+    BOOL mainProgram = (info->dlpi_name == NULL) || (info->dlpi_name[0] == '\0');
+    CHAR path [MAX_PATH];
+    if (!mainProgram) {
+        strncpy(path, info->dlpi_name, MAX_PATH - 1);
+        path[MAX_PATH - 1] = '\0';
+    }
+    else {
+        ssize_t length = readlink("/proc/self/exe", path, MAX_PATH - 1);
+        if (length <= 0)
+            strcpy(path, "/proc/self/exe");
+        else
+            path[length] = '\0';
+    }
+
+    // Extract just the file name from the module path.
+    LPCSTR filename = strrchr(path, '/');
+    filename = (filename != NULL) ? filename + 1 : path;
+    WCHAR modulename [MAX_PATH];
+    if (mbstowcs(modulename, filename, MAX_PATH) >= MAX_PATH)
+        modulename[0] = L'\0';
+
+    // Record the module's information and store it in the set.
+    moduleinfo_t moduleinfo;
+    moduleinfo.addrLow  = low;
+    moduleinfo.addrHigh = high - 1;
+    moduleinfo.bias     = (UINT_PTR)info->dlpi_addr;
+    moduleinfo.name     = modulename;
+    moduleinfo.path     = path;
+    moduleinfo.flags    = g_vld.getModuleFlags(moduleinfo, mainProgram);
+    for (UINT index = 0; index < _countof(s_systemModules); index++) {
+        if (strncmp(filename, s_systemModules[index], strlen(s_systemModules[index])) == 0)
+            moduleinfo.flags |= VLD_MODULE_SYSTEM;
+    }
+
+    ModuleSet* newmodules = (ModuleSet*)context;
+    newmodules->insert(moduleinfo);
+
+    return 0;
+}
+
+// getModuleCounters - Callback function for dl_iterate_phdr that obtains the
+//   number of objects which the dynamic linker has loaded and unloaded.
+//
+//  - info (IN): The first object's information, which includes the counters.
+//
+//  - size (IN): Size of the info structure.
+//
+//  - context (IN): Pointer to an array which receives the counters.
+//
+//  Return Value:
+//
+//    Always returns 1, to stop the enumeration: every object has the same
+//    counters.
+//
+int VisualLeakDetector::getModuleCounters (struct dl_phdr_info *info, size_t size, void *context)
+{
+    if (size >= offsetof(struct dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs)) {
+        ((UINT64*)context)[0] = info->dlpi_adds;
+        ((UINT64*)context)[1] = info->dlpi_subs;
+    }
+    return 1;
+}
+
+// getModuleFlags - Determines whether a module is excluded from leak detection
+//   by the module list, the way attachToLoadedModules does on Windows.
+//
+//  - moduleinfo (IN): The module, whose name and address range are set.
+//
+//  - mainProgram (IN): Whether the module is the main program.
+//
+//  Return Value:
+//
+//    Returns the module's flags.
+//
+UINT32 VisualLeakDetector::getModuleFlags (const moduleinfo_t &moduleinfo, BOOL mainProgram)
+{
+    if ((m_forcedModuleList[0] == L'\0') || mainProgram ||
+        ((m_vldBase >= moduleinfo.addrLow) && (m_vldBase <= moduleinfo.addrHigh))) {
+        // The main program, like the Windows modules which include vld.h,
+        // and VLD itself are never excluded.
+        return 0x0;
+    }
+
+    LPCSTR filename = strrchr(moduleinfo.path.c_str(), '/');
+    filename = (filename != NULL) ? filename + 1 : moduleinfo.path.c_str();
+    for (UINT index = 0; index < _countof(s_runtimeModules); index++) {
+        if (strncmp(filename, s_runtimeModules[index], strlen(s_runtimeModules[index])) == 0)
+            return 0x0;
+    }
+
+    BOOL listed = (moduleinfo.name.empty() == false) && (wcsstr(m_forcedModuleList, moduleinfo.name.c_str()) != NULL);
+    if ((m_options & VLD_OPT_MODULE_LIST_INCLUDE) != 0)
+        return listed ? 0x0 : VLD_MODULE_EXCLUDED;
+    return listed ? VLD_MODULE_EXCLUDED : 0x0;
+}
+
+// lookupModule - Finds the module which contains an address. If no known
+//   module contains it, the set of loaded modules is refreshed first, since
+//   the address may be in an object which has been loaded since it was built.
+//   The caller must hold m_modulesLock.
+//
+//  - address (IN): The address.
+//
+//  Return Value:
+//
+//    Returns an Iterator referencing the module, or the end of the set of
+//    loaded modules.
+//
+ModuleSet::Iterator VisualLeakDetector::lookupModule (UINT_PTR address)
+{
+    moduleinfo_t moduleinfo;
+    moduleinfo.addrLow  = address;
+    moduleinfo.addrHigh = address;
+    moduleinfo.flags    = 0;
+
+    ModuleSet::Iterator moduleit = m_loadedModules->find(moduleinfo);
+    if (moduleit == m_loadedModules->end()) {
+        RefreshModules();
+        moduleit = m_loadedModules->find(moduleinfo);
+    }
+    return moduleit;
+}
+
+// findModule - Obtains the information of the module which contains an
+//   address.
+//
+//  - address (IN): The address.
+//
+//  - moduleinfo (OUT): Receives the module's information.
+//
+//  Return Value:
+//
+//    Returns TRUE if the address is in a loaded, or unloaded, module.
+//
+BOOL VisualLeakDetector::findModule (UINT_PTR address, moduleinfo_t &moduleinfo)
+{
+    CriticalSectionLocker<> cs(m_modulesLock);
+    if (m_loadedModules == NULL)
+        return FALSE;
+    ModuleSet::Iterator moduleit = lookupModule(address);
+    if (moduleit == m_loadedModules->end())
+        return FALSE;
+    moduleinfo = *moduleit;
+    return TRUE;
+}
+
+// getLeakData - Determines whether a mapped block counts as a leak, and
+//   obtains the address and size of its user data. The blocks allocated by the
+//   C library or the dynamic linker for their own use are not leaks (see
+//   isSystemAlloc).
+//
+//  - block (IN): Pointer to the mapped block.
+//
+//  - info (IN): The block's information.
+//
+//  - address (OUT): Receives the address of the block's user data.
+//
+//  - size (OUT): Receives the size, in bytes, of the block's user data.
+//
+//  Return Value:
+//
+//    Returns true if the block counts as a leak.
+//
+bool VisualLeakDetector::getLeakData (LPCVOID block, blockinfo_t *info, LPCVOID &address, SIZE_T &size)
+{
+    address = block;
+    size = info->size;
+    if ((info->callStack != NULL) && isSystemAlloc(info->callStack))
+        return false;
+    return true;
+}
+
+// isSystemAlloc - Determines whether a block was allocated by the C library or
+//   the dynamic linker for their own use: the first frame of its call stack
+//   outside of VLD is in one of them. The blocks allocated by the C library
+//   functions which return them to their caller, such as strdup, are still
+//   reported.
+//
+//  - callstack (IN): The block's call stack.
+//
+//  Return Value:
+//
+//    Returns true if the block belongs to the C library or the dynamic linker.
+//
+bool VisualLeakDetector::isSystemAlloc (const CallStack *callstack)
+{
+    // Find the first frame outside of VLD.
+    moduleinfo_t moduleinfo;
+    UINT32 frame = 0;
+    for (; frame < callstack->size(); frame++) {
+        if (!findModule((*callstack)[frame] - 1, moduleinfo))
+            return false;
+        if ((m_vldBase < moduleinfo.addrLow) || (m_vldBase > moduleinfo.addrHigh))
+            break;
+    }
+    if ((frame == callstack->size()) || !(moduleinfo.flags & VLD_MODULE_SYSTEM))
+        return false;
+    if (wcsncmp(moduleinfo.name.c_str(), L"ld-linux", 8) == 0) {
+        // The dynamic linker never allocates on behalf of its caller.
+        return true;
+    }
+
+    // The frame pointers aren't kept in the C library, so the frame which
+    // follows is unreliable: the C library functions which return the memory
+    // to their caller are recognized by name instead.
+    symbolinfo_t info;
+    m_symbolizer.resolve((*callstack)[frame] - 1, moduleinfo.path.c_str(), moduleinfo.bias, info);
+    if (info.function == NULL)
+        return true;
+    for (UINT index = 0; index < _countof(s_callerAllocs); index++) {
+        if (strcmp(info.function, s_callerAllocs[index]) == 0)
+            return false;
+    }
+    return true;
+}
+
+// isModuleExcluded - Determines whether the module which contains an address
+//   is excluded from leak detection.
+//
+//  - address (IN): The address, usually the return address into the code
+//      which called an allocator function.
+//
+//  Return Value:
+//
+//    Returns true if the module is excluded.
+//
+bool VisualLeakDetector::isModuleExcluded (UINT_PTR address)
+{
+    CriticalSectionLocker<> cs(m_modulesLock);
+    if (m_loadedModules == NULL)
+        return false;
+    ModuleSet::Iterator moduleit = lookupModule(address);
+    if (moduleit != m_loadedModules->end())
+        return (*moduleit).flags & VLD_MODULE_EXCLUDED ? true : false;
+    return false;
+}
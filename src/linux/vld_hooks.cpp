@@ -0,0 +1,572 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Interposed Allocator Functions (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// The Linux counterpart of the IAT patching of vld_hooks.cpp. libvld.so
+// defines the C library's allocator functions, the global new and delete
+// operators and dlclose, so that when it is preloaded (LD_PRELOAD) or linked into the
+// program, the dynamic linker binds every call to them to these definitions.
+// Each one forwards to the next definition, normally the C library's, and
+// records the allocation with VisualLeakDetector.
+
+#include "stdafx.h"
+
+#include <dlfcn.h>
+#include <new>
+
+#define VLDBUILD         // Declares that we are building Visual Leak Detector.
+#include "utility.h"     // Provides various utility functions.
+#include "linux/vldint.h" // Provides access to the Visual Leak Detector internals.
+#undef new               // The global new operators are defined in this file.
+
+#define BOOTSTRAP_ARENA_SIZE  (64 * 1024) // Memory available before the real functions are resolved.
+#define BOOTSTRAP_ALIGNMENT   16          // Alignment of the blocks allocated from the bootstrap arena.
+
+// Imported global variables.
+extern VisualLeakDetector g_vld;
+
+// Global variables.
+realalloc_t g_realAlloc;                  // The real allocator functions.
+
+typedef int (*dlclose_t) (void *);
+static dlclose_t     s_realDlclose;       // The real dlclose.
+
+static BYTE          s_bootstrapArena [BOOTSTRAP_ARENA_SIZE] __attribute__((aligned(BOOTSTRAP_ALIGNMENT)));
+static SIZE_T        s_bootstrapUsed;     // Bytes of the arena in use.
+static LONG volatile s_resolveState;      // State of the resolution of the real functions:
+#define RESOLVE_PENDING     0             //   Not resolved yet.
+#define RESOLVE_RUNNING     1             //   Being resolved. dlsym may allocate memory meanwhile.
+#define RESOLVE_DONE        2             //   Resolved.
+#define RESOLVE_FAILED      3             //   Couldn't be resolved.
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// The Bootstrap Allocator
+//
+//   dlsym allocates memory (with calloc, for its error state) while it finds
+//   the real allocator functions, so the interposed functions are reentered
+//   before they have anything to forward to. These allocations are served
+//   from a static arena. Its blocks are never freed, and they are not
+//   recorded: they are made before VisualLeakDetector is constructed.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// bootstrapAlloc - Allocates a zeroed block from the bootstrap arena.
+//
+//  - size (IN): Size of the block.
+//
+//  - alignment (IN): Alignment of the block, a power of 2.
+//
+//  Return Value:
+//
+//    Returns the block, or NULL if the arena is exhausted.
+//
+static void* bootstrapAlloc (size_t size, size_t alignment)
+{
+    if (alignment < BOOTSTRAP_ALIGNMENT)
+        alignment = BOOTSTRAP_ALIGNMENT;
+    if (size > BOOTSTRAP_ARENA_SIZE)
+        return NULL;
+
+    // Each block is preceded by its size, which realloc needs.
+    SIZE_T used = __atomic_load_n(&s_bootstrapUsed, __ATOMIC_RELAXED);
+    SIZE_T offset;
+    do {
+        offset = (used + sizeof(SIZE_T) + alignment - 1) & ~(alignment - 1);
+        if (offset + size > BOOTSTRAP_ARENA_SIZE)
+            return NULL;
+    } while (!__atomic_compare_exchange_n(&s_bootstrapUsed, &used, offset + size, true,
+        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    ((SIZE_T*)(s_bootstrapArena + offset))[-1] = size;
+    return s_bootstrapArena + offset;
+}
+
+// isBootstrapBlock - Returns true if the block was allocated from the
+//   bootstrap arena.
+//
+static inline bool isBootstrapBlock (const void *mem)
+{
+    return ((const BYTE*)mem >= s_bootstrapArena) && ((const BYTE*)mem < s_bootstrapArena + BOOTSTRAP_ARENA_SIZE);
+}
+
+// ResolveRealAlloc - Finds the real allocator functions, which the interposed
+//   functions forward to: the next definitions after libvld.so's in the
+//   dynamic linker's search order.
+//
+//  Return Value:
+//
+//    Returns TRUE if the real functions are available. Returns FALSE if they
+//    are being resolved, by this thread or another one, or couldn't be found.
+//
+BOOL ResolveRealAlloc ()
+{
+    LONG state = InterlockedCompareExchange(&s_resolveState, RESOLVE_RUNNING, RESOLVE_PENDING);
+    if (state != RESOLVE_PENDING)
+        return (state == RESOLVE_DONE);
+
+    realalloc_t real;
+    real.malloc         = (malloc_t)dlsym(RTLD_NEXT, "malloc");
+    real.free           = (free_t)dlsym(RTLD_NEXT, "free");
+    real.calloc         = (calloc_t)dlsym(RTLD_NEXT, "calloc");
+    real.realloc        = (realloc_t)dlsym(RTLD_NEXT, "realloc");
+    real.posix_memalign = (posix_memalign_t)dlsym(RTLD_NEXT, "posix_memalign");
+    real.aligned_alloc  = (aligned_alloc_t)dlsym(RTLD_NEXT, "aligned_alloc");
+    real.memalign       = (memalign_t)dlsym(RTLD_NEXT, "memalign");
+    BOOL resolved = (real.malloc != NULL) && (real.free != NULL) && (real.calloc != NULL) &&
+        (real.realloc != NULL) && (real.posix_memalign != NULL) && (real.aligned_alloc != NULL) &&
+        (real.memalign != NULL);
+    if (resolved)
+        g_realAlloc = real;
+    InterlockedExchange(&s_resolveState, resolved ? RESOLVE_DONE : RESOLVE_FAILED);
+    return resolved;
+}
+
+// realAllocAvailable - Returns true if the real allocator functions can be
+//   called. Otherwise, memory must be allocated from the bootstrap arena.
+//
+static __forceinline bool realAllocAvailable ()
+{
+    return (__atomic_load_n(&s_resolveState, __ATOMIC_ACQUIRE) == RESOLVE_DONE) || ResolveRealAlloc();
+}
+
+// recordAllocation - Records a block which was allocated, or reallocated, by
+//   an interposed function.
+//
+//  - context (IN): The context captured by the interposed function.
+//
+//  - mem (IN): The block, or the block which was reallocated.
+//
+//  - newmem (IN): The reallocated block, or NULL.
+//
+//  - size (IN): Size of the block.
+//
+//  Return Value:
+//
+//    None.
+//
+static __forceinline void recordAllocation (context_t &context, LPVOID mem, LPVOID newmem, SIZE_T size)
+{
+    CaptureContext cc(context);
+    cc.Set(mem, newmem, size);
+}
+
+// releaseBlock - Unmaps a block which is being freed by an interposed
+//   function, and frees it.
+//
+//  - mem (IN): The block being freed.
+//
+//  Return Value:
+//
+//    None.
+//
+static __forceinline void releaseBlock (void *mem)
+{
+    if ((mem == NULL) || isBootstrapBlock(mem))
+        return;
+
+    if (g_vld.enabled()) {
+        CAPTURE_CONTEXT();
+        CaptureContext cc(context_);
+        if (cc.IsFirst()) {
+            // Unmap the block first: as soon as it is freed, another thread
+            // may be given the same address.
+            g_vld.unmapBlock(VLD_LIBC_HEAP, mem, context_);
+        }
+    }
+    g_realAlloc.free(mem);
+}
+
+// allocateNew - Allocates a block for the new operators, calling the new
+//   handler until the allocation succeeds, as the standard requires.
+//
+//  - size (IN): Size of the block.
+//
+//  - nothrow (IN): If true, NULL is returned instead of throwing bad_alloc.
+//
+//  Return Value:
+//
+//    Returns the block.
+//
+static void* allocateNew (size_t size, bool nothrow)
+{
+    if (size == 0)
+        size = 1;
+    for (;;) {
+        void *block = realAllocAvailable() ? g_realAlloc.malloc(size) : bootstrapAlloc(size, BOOTSTRAP_ALIGNMENT);
+        if (block != NULL)
+            return block;
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == NULL) {
+            if (nothrow)
+                return NULL;
+            throw std::bad_alloc();
+        }
+        if (!nothrow) {
+            handler();
+            continue;
+        }
+        try {
+            handler();
+        }
+        catch (const std::bad_alloc &) {
+            return NULL;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Interposed C Library Functions
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// malloc - Calls to malloc are bound to this function, which allocates the
+//   block with the real malloc and records it.
+//
+//  - size (IN): Size of the memory block to allocate.
+//
+//  Return Value:
+//
+//    Returns the value returned by malloc.
+//
+extern "C" void* malloc (size_t size)
+{
+    if (!realAllocAvailable())
+        return bootstrapAlloc(size, BOOTSTRAP_ALIGNMENT);
+
+    void *block = g_realAlloc.malloc(size);
+
+    // Check the size first: ignored sizes must not cost anything else.
+    if ((block != NULL) && g_vld.isMappedSize(size) && g_vld.enabled() &&
+        g_vld.isSampled(block, NULL, size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, block, NULL, size);
+    }
+    return block;
+}
+
+// free - Calls to free are bound to this function, which unmaps the block and
+//   frees it with the real free.
+//
+//  - mem (IN): Pointer to the memory block to be freed.
+//
+//  Return Value:
+//
+//    None.
+//
+extern "C" void free (void *mem)
+{
+    releaseBlock(mem);
+}
+
+// calloc - Calls to calloc are bound to this function, which allocates the
+//   block with the real calloc and records it.
+//
+//  - num (IN): Number of elements to allocate.
+//
+//  - size (IN): Size of each element.
+//
+//  Return Value:
+//
+//    Returns the value returned by calloc.
+//
+extern "C" void* calloc (size_t num, size_t size)
+{
+    if (!realAllocAvailable()) {
+        // The arena is never reused, so its memory is still zeroed.
+        size_t total;
+        if (__builtin_mul_overflow(num, size, &total))
+            return NULL;
+        return bootstrapAlloc(total, BOOTSTRAP_ALIGNMENT);
+    }
+
+    void *block = g_realAlloc.calloc(num, size);
+    if ((block != NULL) && g_vld.isMappedSize(num * size) && g_vld.enabled() &&
+        g_vld.isSampled(block, NULL, num * size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, block, NULL, num * size);
+    }
+    return block;
+}
+
+// realloc - Calls to realloc are bound to this function, which reallocates
+//   the block with the real realloc and remaps it.
+//
+//  - mem (IN): Pointer to the memory block to reallocate.
+//
+//  - size (IN): New size of the memory block.
+//
+//  Return Value:
+//
+//    Returns the value returned by realloc.
+//
+extern "C" void* realloc (void *mem, size_t size)
+{
+    if (isBootstrapBlock(mem)) {
+        // Move the block out of the arena.
+        SIZE_T oldsize = ((SIZE_T*)mem)[-1];
+        void *block = malloc(size);
+        if (block != NULL)
+            memcpy(block, mem, (oldsize < size) ? oldsize : size);
+        return block;
+    }
+    if (!realAllocAvailable())
+        return (mem == NULL) ? bootstrapAlloc(size, BOOTSTRAP_ALIGNMENT) : NULL;
+
+    void *block = g_realAlloc.realloc(mem, size);
+    if (!g_vld.enabled())
+        return block;
+
+    CAPTURE_CONTEXT();
+    if ((block != NULL) && g_vld.isMappedSize(size)) {
+        void *oldblock = (mem != NULL) ? mem : block;
+        void *newblock = (mem != NULL) ? block : NULL;
+        if (g_vld.isSampled(oldblock, newblock, size))
+            recordAllocation(context_, oldblock, newblock, size);
+    }
+    else if ((mem != NULL) && ((block != NULL) || (size == 0))) {
+        // realloc(mem, 0) freed the block, or blocks of the new size are
+        // ignored. Stop tracking the old block, if it was tracked.
+        CaptureContext cc(context_);
+        if (cc.IsFirst())
+            g_vld.unmapBlock(VLD_LIBC_HEAP, mem, context_);
+    }
+    return block;
+}
+
+// posix_memalign - Calls to posix_memalign are bound to this function, which
+//   allocates the block with the real posix_memalign and records it.
+//
+//  - memptr (OUT): Receives the block.
+//
+//  - alignment (IN): Alignment of the block.
+//
+//  - size (IN): Size of the memory block to allocate.
+//
+//  Return Value:
+//
+//    Returns the value returned by posix_memalign.
+//
+extern "C" int posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+    if (!realAllocAvailable()) {
+        *memptr = bootstrapAlloc(size, alignment);
+        return (*memptr != NULL) ? 0 : ENOMEM;
+    }
+
+    int status = g_realAlloc.posix_memalign(memptr, alignment, size);
+    if ((status == 0) && g_vld.isMappedSize(size) && g_vld.enabled() &&
+        g_vld.isSampled(*memptr, NULL, size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, *memptr, NULL, size);
+    }
+    return status;
+}
+
+// aligned_alloc - Calls to aligned_alloc are bound to this function, which
+//   allocates the block with the real aligned_alloc and records it.
+//
+//  - alignment (IN): Alignment of the block.
+//
+//  - size (IN): Size of the memory block to allocate.
+//
+//  Return Value:
+//
+//    Returns the value returned by aligned_alloc.
+//
+extern "C" void* aligned_alloc (size_t alignment, size_t size)
+{
+    if (!realAllocAvailable())
+        return bootstrapAlloc(size, alignment);
+
+    void *block = g_realAlloc.aligned_alloc(alignment, size);
+    if ((block != NULL) && g_vld.isMappedSize(size) && g_vld.enabled() &&
+        g_vld.isSampled(block, NULL, size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, block, NULL, size);
+    }
+    return block;
+}
+
+// memalign - Calls to memalign are bound to this function, which allocates
+//   the block with the real memalign and records it.
+//
+//  - alignment (IN): Alignment of the block.
+//
+//  - size (IN): Size of the memory block to allocate.
+//
+//  Return Value:
+//
+//    Returns the value returned by memalign.
+//
+extern "C" void* memalign (size_t alignment, size_t size)
+{
+    if (!realAllocAvailable())
+        return bootstrapAlloc(size, alignment);
+
+    void *block = g_realAlloc.memalign(alignment, size);
+    if ((block != NULL) && g_vld.isMappedSize(size) && g_vld.enabled() &&
+        g_vld.isSampled(block, NULL, size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, block, NULL, size);
+    }
+    return block;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Interposed C++ Operators
+//
+//   The C++ library's operators allocate with malloc, which is interposed as
+//   well, but the operators are interposed too so that the call stacks start
+//   in the code which called new. The aligned (C++17) operators are left to
+//   the C++ library: they allocate with aligned_alloc and free with free.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+void* operator new (size_t size)
+{
+    void *block = allocateNew(size, false);
+    if (g_vld.isMappedSize(size) && g_vld.enabled() &&
+        g_vld.isSampled(block, NULL, size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, block, NULL, size);
+    }
+    return block;
+}
+
+void* operator new [] (size_t size)
+{
+    void *block = allocateNew(size, false);
+    if (g_vld.isMappedSize(size) && g_vld.enabled() &&
+        g_vld.isSampled(block, NULL, size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, block, NULL, size);
+    }
+    return block;
+}
+
+void* operator new (size_t size, const std::nothrow_t &) noexcept
+{
+    void *block = allocateNew(size, true);
+    if ((block != NULL) && g_vld.isMappedSize(size) && g_vld.enabled() &&
+        g_vld.isSampled(block, NULL, size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, block, NULL, size);
+    }
+    return block;
+}
+
+void* operator new [] (size_t size, const std::nothrow_t &) noexcept
+{
+    void *block = allocateNew(size, true);
+    if ((block != NULL) && g_vld.isMappedSize(size) && g_vld.enabled() &&
+        g_vld.isSampled(block, NULL, size)) {
+        CAPTURE_CONTEXT();
+        recordAllocation(context_, block, NULL, size);
+    }
+    return block;
+}
+
+void operator delete (void *block) noexcept
+{
+    releaseBlock(block);
+}
+
+void operator delete [] (void *block) noexcept
+{
+    releaseBlock(block);
+}
+
+void operator delete (void *block, const std::nothrow_t &) noexcept
+{
+    releaseBlock(block);
+}
+
+void operator delete [] (void *block, const std::nothrow_t &) noexcept
+{
+    releaseBlock(block);
+}
+
+#if __cpp_sized_deallocation
+void operator delete (void *block, size_t) noexcept
+{
+    releaseBlock(block);
+}
+
+void operator delete [] (void *block, size_t) noexcept
+{
+    releaseBlock(block);
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Interposed Dynamic Linker Functions
+//
+//   The module registry (see vld.cpp) finds the objects loaded by dlopen by
+//   itself. dlclose is interposed so that the objects which it unloads are
+//   kept in the registry, with their symbols, for the leak report.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// dlclose - Calls to dlclose are bound to this function, which records the
+//   object before it may be unloaded, closes it with the real dlclose, and
+//   then marks it as unloaded if it was.
+//
+//  - handle (IN): Handle of the object, as returned by dlopen.
+//
+//  Return Value:
+//
+//    Returns the value returned by dlclose.
+//
+extern "C" int dlclose (void *handle)
+{
+    dlclose_t realDlclose = __atomic_load_n(&s_realDlclose, __ATOMIC_ACQUIRE);
+    if (realDlclose == NULL) {
+        realDlclose = (dlclose_t)dlsym(RTLD_NEXT, "dlclose");
+        if (realDlclose == NULL)
+            return -1;
+        __atomic_store_n(&s_realDlclose, realDlclose, __ATOMIC_RELEASE);
+    }
+
+    if (g_vld.enabled()) {
+        // Memory allocated by VLD meanwhile must not be recorded.
+        CAPTURE_CONTEXT();
+        CaptureContext cc(context_);
+        if (cc.IsFirst())
+            g_vld.RetainModule(handle);
+    }
+
+    // The object's destructors run here: they are not within VLD's code.
+    int status = realDlclose(handle);
+
+    if (g_vld.enabled()) {
+        CAPTURE_CONTEXT();
+        CaptureContext cc(context_);
+        if (cc.IsFirst())
+            g_vld.RefreshModules();
+    }
+    return status;
+}
@@ -0,0 +1,118 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Internal C++ Heap Management (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// On Linux, VLD's internal blocks are allocated directly from the C library's
+// allocator, through the real functions which the interposed ones forward to,
+// so that they are never recorded. They are freed by the interposed global
+// delete operators (see vld_hooks.cpp), which ignore them because they are
+// not in the block map.
+
+#include "stdafx.h"
+
+#define VLDBUILD     // Declares that we are building Visual Leak Detector.
+#include "vldheap.h" // Provides access to VLD's internal heap data structures.
+#include "criticalsection.h"
+#include "linux/vldint.h"
+#undef new           // Do not map "new" to VLD's new operator in this file
+
+// vldnew - Local helper function that allocates an internal block.
+//
+//  - size (IN): Size of the memory block to be allocated.
+//
+//  Return Value:
+//
+//    If the memory allocation succeeds, a pointer to the allocated memory
+//    block is returned. If the allocation fails, NULL is returned.
+//
+static inline void* vldnew (size_t size)
+{
+    if ((g_realAlloc.malloc == NULL) && !ResolveRealAlloc())
+        return NULL;
+    return g_realAlloc.malloc(size);
+}
+
+// scalar new operator - New operator used to allocate a scalar memory block
+//   for VLD's internal use.
+//
+//  - size (IN): Size of the memory block to be allocated.
+//
+//  - file (IN): The name of the file from which this function is being
+//      called.
+//
+//  - line (IN): The line number, in the above file, at which this function is
+//      being called.
+//
+//  Return Value:
+//
+//    If the allocation succeeds, a pointer to the allocated memory block is
+//    returned. If the allocation fails, NULL is returned.
+//
+void* operator new (size_t size, const char *, int)
+{
+    return vldnew(size);
+}
+
+// vector new operator - New operator used to allocate a vector memory block
+//   for VLD's internal use.
+//
+//  - size (IN): Size of the memory block to be allocated.
+//
+//  - file (IN): The name of the file from which this function is being
+//      called.
+//
+//  - line (IN): The line number, in the above file, at which this function is
+//      being called.
+//
+//  Return Value:
+//
+//    If the allocation succeeds, a pointer to the allocated memory block is
+//    returned. If the allocation fails, NULL is returned.
+//
+void* operator new [] (size_t size, const char *, int)
+{
+    return vldnew(size);
+}
+
+// scalar delete operator - Delete operator used to free memory partially
+//   allocated by new in the event that the corresponding new operator throws
+//   an exception.
+//
+//  Note: This version of the delete operator should never be called directly.
+//    The compiler automatically generates calls to this function as needed.
+//
+void operator delete (void *block, const char *, int)
+{
+    g_realAlloc.free(block);
+}
+
+// vector delete operator - Delete operator used to free memory partially
+//   allocated by new in the event that the corresponding new operator throws
+//   an exception.
+//
+//  Note: This version of the delete operator should never be called directly.
+//    The compiler automatically generates calls to this function as needed.
+//
+void operator delete [] (void *block, const char *, int)
+{
+    g_realAlloc.free(block);
+}
@@ -0,0 +1,262 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Linux VisualLeakDetector Class Definition
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+    "This header should only be included by Visual Leak Detector when building it from source. \
+    Applications should never include this header."
+#endif
+
+#include <cstdio>
+#include <pthread.h>
+#include <string>
+#include "linux/platform.h"
+#include "vld_def.h"
+#include "blocktracker.h" // Provides the platform-neutral block tracking and reporting.
+#include "callstack.h"  // Provides a custom class for handling call stacks.
+#include "criticalsection.h"
+#include "map.h"        // Provides a custom STL-like map template.
+#include "set.h"        // Provides a custom STL-like set template.
+#include "utility.h"    // Provides miscellaneous utility functions.
+#include "vldallocator.h" // Provides a custom allocator for internal strings.
+#include "linux/symbolizer.h" // Provides symbol resolution from the ELF objects.
+
+#define MAXMODULELISTLENGTH 512     // Maximum module list length, in characters.
+
+struct dl_phdr_info;
+
+// Function pointer types of the allocator functions interposed by the Linux
+// backend (see vld_hooks.cpp).
+typedef void* (*malloc_t) (size_t);
+typedef void  (*free_t) (void *);
+typedef void* (*calloc_t) (size_t, size_t);
+typedef void* (*realloc_t) (void *, size_t);
+typedef int   (*posix_memalign_t) (void **, size_t, size_t);
+typedef void* (*aligned_alloc_t) (size_t, size_t);
+typedef void* (*memalign_t) (size_t, size_t);
+
+// The allocator functions which the interposed functions forward to: the
+// next definitions of the symbols after VLD's, as found by dlsym(RTLD_NEXT).
+// They are resolved on the first call to any of the interposed functions.
+struct realalloc_t {
+    malloc_t         malloc;
+    free_t           free;
+    calloc_t         calloc;
+    realloc_t        realloc;
+    posix_memalign_t posix_memalign;
+    aligned_alloc_t  aligned_alloc;
+    memalign_t       memalign;
+};
+extern realalloc_t g_realAlloc;
+BOOL ResolveRealAlloc ();
+
+// There is a single heap on Linux: the C library's. It is identified in the
+// heap map by the address of the real allocator functions.
+#define VLD_LIBC_HEAP ((HANDLE)&g_realAlloc)
+
+typedef std::basic_string<wchar_t, std::char_traits<wchar_t>, vldallocator<wchar_t> > vldstring;
+typedef std::basic_string<char, std::char_traits<char>, vldallocator<char> > vldstringa;
+
+// This structure stores information, primarily the virtual address range, about
+// a given module and can be used with the Set template because it supports the
+// '<' operator (sorts by virtual address range).
+struct moduleinfo_t {
+    BOOL operator < (const struct moduleinfo_t& other) const
+    {
+        if (addrHigh < other.addrLow) {
+            return TRUE;
+        }
+        else {
+            return FALSE;
+        }
+    }
+
+    SIZE_T addrLow;                  // Lowest address within the module's loadable segments.
+    SIZE_T addrHigh;                 // Highest address within the module's loadable segments.
+    UINT_PTR bias;                   // Difference between the addresses in the object and in memory.
+    UINT32 flags;                    // Module flags:
+#define VLD_MODULE_EXCLUDED      0x1 //   If set, this module is excluded from leak detection.
+#define VLD_MODULE_SYSTEM        0x2 //   If set, this module is the C library or the dynamic linker.
+#define VLD_MODULE_UNLOADED      0x4 //   If set, this module has been unloaded. It is kept so that the
+                                     //   call stacks through it can still be resolved.
+    vldstring name;                  // The module's file name (e.g. "libc.so.6").
+    vldstringa path;                 // The path from where the module was loaded.
+};
+
+// ModuleSets store information about modules loaded in the process, and
+// about the modules which were unloaded.
+typedef Set<moduleinfo_t> ModuleSet;
+
+// Thread local storage structure. Every thread in the process gets its own copy
+// of this structure, which holds the allocation that is being recorded on the
+// thread.
+struct tls_t {
+    context_t   context;           // Return address at the first call that entered VLD's code for the current allocation.
+    LPVOID      blockWithoutGuard; // Store pointer to block.
+    LPVOID      newBlockWithoutGuard;
+    SIZE_T      size;
+    LONG64      sampleBytes;       // Bytes left to allocate before the next sampled allocation (see SampleRate).
+    UINT32      sampleRandom;      // State of the random number generator used for choosing sampling intervals.
+};
+
+// Allocation state:
+// 1. Allocation function sets tls->context, unless it is already set, in which
+//    case VLD's code has been reentered and the allocation isn't recorded.
+// 2. Allocation function sets tls->blockWithoutGuard, tls->newBlockWithoutGuard
+//    and tls->size
+// 3. Allocation function resets tls data, maps the block and captures the
+//    callstack of tls->blockWithoutGuard
+
+// The re-entrancy guard of the interposed functions. Memory that is allocated
+// while VLD's code is running on the thread - by VLD itself, or by the C
+// library while VLD walks the stack or writes the report - is not recorded.
+class CaptureContext {
+public:
+    CaptureContext(context_t& context);
+    ~CaptureContext();
+    void Set(LPVOID mem, LPVOID newmem, SIZE_T size);
+    // Returns true if VLD's code was entered by this allocation, rather than
+    // reentered from VLD's own code.
+    BOOL IsFirst() const
+    {
+        return m_bFirst;
+    }
+private:
+    // Disallow certain operations
+    CaptureContext();
+    CaptureContext(const CaptureContext&);
+    CaptureContext& operator=(const CaptureContext&);
+private:
+    BOOL IsExcludedModule();
+    void Reset();
+private:
+    tls_t *m_tls;
+    BOOL m_bFirst;
+    const context_t& m_context;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// The VisualLeakDetector Class (Linux)
+//
+//   One global instance of this class is instantiated by the Linux backend,
+//   libvld.so, which is either preloaded (LD_PRELOAD) or linked into the
+//   program. The allocator functions which it interposes (see vld_hooks.cpp)
+//   record every allocation and free here, just like the Windows hooks do.
+//
+//   The blocks are tracked, and the report is written, by the BlockTracker
+//   which this class shares with the Windows backend. This class adds the
+//   configuration, the module registry and the symbolizer.
+//
+//   Upon destruction, which happens after the program's own static objects
+//   have been destroyed, the leak report is written. The report has the same
+//   format as on Windows.
+//
+class VisualLeakDetector : public BlockTracker
+{
+    friend class CallStack;
+    friend class CaptureContext;
+public:
+    VisualLeakDetector();
+    ~VisualLeakDetector();
+
+    SIZE_T GetLeaksCount();
+    SIZE_T ReportLeaks();
+    UINT32 GetOptions();
+
+    // Returns true if allocations are being recorded. Allocations made before
+    // the instance is constructed or after it is destroyed aren't recorded:
+    // the flag is zero-initialized, like all static storage.
+    bool enabled () const;
+
+    // Sampling, checked by the interposed functions before they construct a
+    // CaptureContext. Inline, because it is called for every allocation.
+    bool isSampled (LPCVOID mem, LPCVOID newmem, SIZE_T size)
+    {
+        return (m_sampleRate == 0) || sampleAllocation(mem, newmem, size);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Module tracking, called by the interposed dynamic linker functions.
+    ////////////////////////////////////////////////////////////////////////////////
+    VOID RefreshModules ();
+    VOID RetainModule (HANDLE handle);
+
+private:
+    ////////////////////////////////////////////////////////////////////////////////
+    // Private leak detection functions - see each function definition for details.
+    ////////////////////////////////////////////////////////////////////////////////
+    VOID   configure ();
+    BOOL   findModule (UINT_PTR address, moduleinfo_t &moduleinfo);
+    bool   getLeakData (LPCVOID block, blockinfo_t *info, LPCVOID &address, SIZE_T &size);
+    bool   isSystemAlloc (const CallStack *callstack);
+    bool   sampleAllocation (LPCVOID mem, LPCVOID newmem, SIZE_T size);
+    UINT32 getModuleFlags (const moduleinfo_t &moduleinfo, BOOL mainProgram);
+    bool   isModuleExcluded (UINT_PTR address);
+    ModuleSet::Iterator lookupModule (UINT_PTR address);
+    bool   refreshModules (ModuleSet &replaced);
+    VOID   reportConfig ();
+    VOID   startMonitor ();
+    VOID   stopMonitor ();
+    static void* monitorProc (void *param);
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Private functions, called by the dynamic linker.
+    ////////////////////////////////////////////////////////////////////////////////
+    static int addLoadedModule (struct dl_phdr_info *info, size_t size, void *context);
+    static int getModuleCounters (struct dl_phdr_info *info, size_t size, void *context);
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Private data
+    ////////////////////////////////////////////////////////////////////////////////
+    WCHAR                m_iniFilePath [MAX_PATH];     // Path of the ini file which the options were read from.
+    WCHAR                m_forcedModuleList [MAXMODULELISTLENGTH]; // List of modules to be forcefully included in leak detection.
+    ModuleSet           *m_loadedModules;     // Contains information about all modules loaded in the process.
+    UINT64               m_moduleAdds;        // Number of modules loaded by the dynamic linker, when m_loadedModules was built.
+    UINT64               m_moduleSubs;        // Number of modules unloaded by the dynamic linker, when m_loadedModules was built.
+    CriticalSection      m_modulesLock;       // Protects accesses to the "loaded modules" ModuleSet.
+    pthread_t            m_monitorThread;     // The leak growth monitor thread.
+    pthread_mutex_t      m_monitorMutex;      // Protects m_monitorStop.
+    pthread_cond_t       m_monitorCond;       // Signaled to stop the leak growth monitor thread.
+    bool                 m_monitorStop;       // Set to stop the leak growth monitor thread.
+    bool                 m_monitorRunning;    // Set if the leak growth monitor thread was started.
+    Symbolizer           m_symbolizer;        // Resolves the frames of the call stacks.
+    FILE                *m_reportFile;        // File where the memory leak report may be sent to.
+    WCHAR                m_reportFilePath [MAX_PATH]; // Full path and name of file to send memory leak report to.
+    UINT32               m_status;            // Status flags:
+#define VLD_STATUS_INSTALLED            0x2   //   If set, VLD was successfully installed.
+    UINT_PTR             m_vldBase;           // Base address of libvld.so.
+};
+
+inline bool VisualLeakDetector::enabled () const
+{
+    return (__atomic_load_n(&m_status, __ATOMIC_ACQUIRE) & VLD_STATUS_INSTALLED) != 0;
+}
+
+// Configuration option default values
+#define VLD_DEFAULT_MAX_DATA_DUMP    256
+#define VLD_DEFAULT_MAX_TRACE_FRAMES 64
+#define VLD_DEFAULT_INI_FILE_NAME    L"vld.ini"
+#define VLD_DEFAULT_REPORT_FILE_NAME L"./memory_leak_report.txt"
@@ -0,0 +1,423 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Radix Page Map Template
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+"This header should only be included by Visual Leak Detector when building it from source. \
+Applications should never include this header."
+#endif
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#include <cassert>
+#include "vldheap.h" // Provides internal new and delete operators.
+#include "criticalsection.h"
+
+#define PAGEMAP_PAGE_SHIFT      12  // Each leaf page describes 4 KB of address space.
+#if defined(_WIN64) || defined(VLD_64BIT_ADDRESSES)
+#define PAGEMAP_ADDRESS_BITS    48  // Significant bits of a user-mode address.
+#define PAGEMAP_GRANULE_SHIFT   4   // Heap blocks are aligned to MEMORY_ALLOCATION_ALIGNMENT (16).
+#else
+#define PAGEMAP_ADDRESS_BITS    32
+#define PAGEMAP_GRANULE_SHIFT   3   // Heap blocks are aligned to MEMORY_ALLOCATION_ALIGNMENT (8).
+#endif // _WIN64 || VLD_64BIT_ADDRESSES
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The PageMap Template Class
+//
+//    This is a multi-level radix tree, in the style of the tcmalloc page map,
+//    which maps block addresses to values. The page number of an address is
+//    split into three groups of bits which index the root array, an interior
+//    node and a leaf. Each leaf entry points to a page, and each page holds one
+//    value slot per allocation granule. A lookup therefore costs a fixed
+//    number of dependent loads, no matter how many blocks are stored.
+//
+//    Nodes, leaves and pages are allocated on demand and are never freed
+//    until the map itself is destroyed. Writers are serialized by the map's
+//    lock, and each new node is completely initialized before it is published
+//    with an interlocked exchange. Because of this, "find" and "findPreceding"
+//    never take the lock and may run concurrently with writers.
+//
+//    Each page also keeps an occupancy bitmap, which lets "findPreceding"
+//    locate the closest mapped block at or below an arbitrary address. That is
+//    how an interior pointer can be resolved to the block that contains it.
+//
+//    The template parameter T must be a pointer type. NULL is reserved to mean
+//    "not mapped".
+//
+template <typename T>
+class PageMap
+{
+public:
+    enum {
+        kPageSize     = 1 << PAGEMAP_PAGE_SHIFT,
+        kSlotBits     = PAGEMAP_PAGE_SHIFT - PAGEMAP_GRANULE_SHIFT,
+        kSlots        = 1 << kSlotBits,                             // Value slots per page.
+        kWordBits     = sizeof(UINT_PTR) * 8,
+        kBitmapWords  = kSlots / kWordBits,
+        kPageBits     = PAGEMAP_ADDRESS_BITS - PAGEMAP_PAGE_SHIFT,  // Significant bits of a page number.
+        kLeafBits     = kPageBits / 3,
+        kNodeBits     = kPageBits / 3,
+        kRootBits     = kPageBits - kLeafBits - kNodeBits,
+        kLeafLength   = 1 << kLeafBits,
+        kNodeLength   = 1 << kNodeBits,
+        kRootLength   = 1 << kRootBits
+    };
+
+    // A page holds the values of all blocks which begin within one page of
+    // address space, indexed by their offset within the page.
+    struct page_t {
+        T        slots [kSlots];        // Mapped values, NULL if the slot is empty.
+        UINT_PTR bitmap [kBitmapWords]; // One bit per non-empty slot.
+        UINT32   count;                 // Number of non-empty slots.
+    };
+
+    // Leaves map the low bits of a page number to pages.
+    struct leaf_t {
+        page_t * volatile pages [kLeafLength];
+    };
+
+    // Interior nodes map the middle bits of a page number to leaves.
+    struct node_t {
+        leaf_t * volatile leaves [kNodeLength];
+    };
+
+    // Constructor
+    PageMap ()
+    {
+        m_lock.Initialize();
+        ZeroMemory((PVOID)m_root, sizeof(m_root));
+        m_bytes = sizeof(*this);
+        m_count = 0;
+    }
+
+    // Destructor
+    ~PageMap ()
+    {
+        // Free every node, leaf and page reachable from the root.
+        m_lock.Enter();
+        for (UINT32 r = 0; r < kRootLength; r++) {
+            node_t *node = m_root[r];
+            if (node == NULL)
+                continue;
+            for (UINT32 n = 0; n < kNodeLength; n++) {
+                leaf_t *leaf = node->leaves[n];
+                if (leaf == NULL)
+                    continue;
+                for (UINT32 l = 0; l < kLeafLength; l++) {
+                    delete leaf->pages[l];
+                }
+                delete leaf;
+            }
+            delete node;
+        }
+        m_lock.Leave();
+
+        m_lock.Delete();
+    }
+
+    // erase - Removes the value mapped to the specified address.
+    //
+    //  - address (IN): The address whose mapping is to be removed.
+    //
+    //  Return Value:
+    //
+    //    Returns the value that was mapped to the address, or NULL if the
+    //    address was not mapped.
+    //
+    T erase (LPCVOID address)
+    {
+        if (!isMappable(address))
+            return NULL;
+
+        CriticalSectionLocker<> cs(m_lock);
+        page_t *page = getPage((UINT_PTR)address >> PAGEMAP_PAGE_SHIFT);
+        if (page == NULL)
+            return NULL;
+
+        UINT32 slot = slotOf(address);
+        T value = page->slots[slot];
+        if (value == NULL)
+            return NULL;
+
+        page->slots[slot] = NULL;
+        page->bitmap[slot / kWordBits] &= ~((UINT_PTR)1 << (slot % kWordBits));
+        page->count--;
+        m_count--;
+        return value;
+    }
+
+    // find - Obtains the value mapped to the specified address. This function
+    //   does not take the map's lock.
+    //
+    //  - address (IN): The address to look up.
+    //
+    //  Return Value:
+    //
+    //    Returns the value mapped to the address, or NULL if the address is
+    //    not mapped.
+    //
+    T find (LPCVOID address) const
+    {
+        if (!isMappable(address))
+            return NULL;
+
+        page_t *page = getPage((UINT_PTR)address >> PAGEMAP_PAGE_SHIFT);
+        if (page == NULL)
+            return NULL;
+
+        return page->slots[slotOf(address)];
+    }
+
+    // findPreceding - Obtains the mapped value with the highest address that
+    //   is less than or equal to the specified address. This function does not
+    //   take the map's lock. Empty leaves and nodes are skipped as a whole, so
+    //   the cost grows with the number of populated pages that are scanned,
+    //   not with the distance.
+    //
+    //  - address (IN): The address at which to start searching downwards.
+    //
+    //  - maxdistance (IN): Maximum distance, in bytes, below "address" at which
+    //      a mapped value may be found.
+    //
+    //  - key (OUT): Receives the address to which the returned value is
+    //      mapped. May be NULL.
+    //
+    //  Return Value:
+    //
+    //    Returns the closest preceding value, or NULL if no value is mapped
+    //    within "maxdistance" bytes below the address.
+    //
+    T findPreceding (LPCVOID address, SIZE_T maxdistance, LPCVOID *key) const
+    {
+        UINT_PTR addr = (UINT_PTR)address;
+        if ((addr >> PAGEMAP_PAGE_SHIFT) >> kPageBits) {
+            // Above the mappable range. Start from the highest mappable address.
+            if (maxdistance < addr - kMaxAddress)
+                return NULL;
+            maxdistance -= addr - kMaxAddress;
+            addr = kMaxAddress;
+        }
+        UINT_PTR limit = (addr > maxdistance) ? addr - maxdistance : 0;
+        UINT_PTR pagenumber = addr >> PAGEMAP_PAGE_SHIFT;
+        INT32    slot = (INT32)slotOf((LPCVOID)addr);
+
+        for (;;) {
+            node_t *node = m_root[pagenumber >> (kNodeBits + kLeafBits)];
+            leaf_t *leaf = (node != NULL) ? node->leaves[(pagenumber >> kLeafBits) & (kNodeLength - 1)] : NULL;
+            page_t *page = (leaf != NULL) ? leaf->pages[pagenumber & (kLeafLength - 1)] : NULL;
+
+            if (page != NULL) {
+                // Scan the occupancy bitmap downwards, starting at the slot.
+                for (slot = highestBitAtOrBelow(page->bitmap, slot); slot >= 0;
+                    slot = highestBitAtOrBelow(page->bitmap, slot - 1)) {
+                    UINT_PTR found = (pagenumber << PAGEMAP_PAGE_SHIFT) | ((UINT_PTR)slot << PAGEMAP_GRANULE_SHIFT);
+                    if (found < limit)
+                        return NULL;
+                    T value = page->slots[slot];
+                    if (value != NULL) {
+                        if (key != NULL)
+                            *key = (LPCVOID)found;
+                        return value;
+                    }
+                    // The slot was emptied by a concurrent writer. Keep looking.
+                }
+            }
+            else if (leaf == NULL) {
+                // Skip the whole unpopulated range covered by the missing
+                // node or leaf.
+                pagenumber &= (node == NULL) ? ~(UINT_PTR)(kNodeLength * kLeafLength - 1) : ~(UINT_PTR)(kLeafLength - 1);
+            }
+
+            // Move on to the last slot of the preceding page.
+            if ((pagenumber == 0) || ((pagenumber << PAGEMAP_PAGE_SHIFT) <= limit))
+                return NULL;
+            pagenumber--;
+            slot = kSlots - 1;
+        }
+    }
+
+    // insert - Maps a value to the specified address.
+    //
+    //  - address (IN): The address to map. It must be aligned to the
+    //      allocation granularity and must lie in the user-mode address range.
+    //
+    //  - value (IN): The value to map to the address. Must not be NULL.
+    //
+    //  Return Value:
+    //
+    //    Returns TRUE if the value was mapped. Returns FALSE if the address can
+    //    not be mapped or if a value is already mapped to the address. In that
+    //    case the map is left unchanged.
+    //
+    BOOL insert (LPCVOID address, T value)
+    {
+        assert(value != NULL);
+        if (!isMappable(address))
+            return FALSE;
+
+        UINT_PTR pagenumber = (UINT_PTR)address >> PAGEMAP_PAGE_SHIFT;
+        CriticalSectionLocker<> cs(m_lock);
+
+        // Create any missing level on the way down.
+        node_t *node = m_root[pagenumber >> (kNodeBits + kLeafBits)];
+        if (node == NULL) {
+            node = new node_t;
+            ZeroMemory(node, sizeof(node_t));
+            m_bytes += sizeof(node_t);
+            publish((PVOID volatile*)&m_root[pagenumber >> (kNodeBits + kLeafBits)], node);
+        }
+        leaf_t *leaf = node->leaves[(pagenumber >> kLeafBits) & (kNodeLength - 1)];
+        if (leaf == NULL) {
+            leaf = new leaf_t;
+            ZeroMemory(leaf, sizeof(leaf_t));
+            m_bytes += sizeof(leaf_t);
+            publish((PVOID volatile*)&node->leaves[(pagenumber >> kLeafBits) & (kNodeLength - 1)], leaf);
+        }
+        page_t *page = leaf->pages[pagenumber & (kLeafLength - 1)];
+        if (page == NULL) {
+            page = new page_t;
+            ZeroMemory(page, sizeof(page_t));
+            m_bytes += sizeof(page_t);
+            publish((PVOID volatile*)&leaf->pages[pagenumber & (kLeafLength - 1)], page);
+        }
+
+        UINT32 slot = slotOf(address);
+        if (page->slots[slot] != NULL) {
+            // Addresses in the map must be unique.
+            return FALSE;
+        }
+        page->slots[slot] = value;
+        page->bitmap[slot / kWordBits] |= (UINT_PTR)1 << (slot % kWordBits);
+        page->count++;
+        m_count++;
+        return TRUE;
+    }
+
+    // isMappable - Determines whether the specified address can be stored in
+    //   a PageMap.
+    //
+    //  - address (IN): The address to check.
+    //
+    //  Return Value:
+    //
+    //    Returns true if the address is aligned to the allocation granularity
+    //    and lies within the range of addresses covered by the map.
+    //
+    static bool isMappable (LPCVOID address)
+    {
+        UINT_PTR addr = (UINT_PTR)address;
+        return ((addr & ((1 << PAGEMAP_GRANULE_SHIFT) - 1)) == 0) &&
+            (((addr >> PAGEMAP_PAGE_SHIFT) >> kPageBits) == 0);
+    }
+
+    // memoryUsage - Obtains the amount of memory used by the map itself.
+    //
+    //  Return Value:
+    //
+    //    Returns the number of bytes allocated for the root, nodes, leaves and
+    //    pages of the map.
+    //
+    SIZE_T memoryUsage () const
+    {
+        return m_bytes;
+    }
+
+    // size - Obtains the number of values currently stored in the map.
+    //
+    //  Return Value:
+    //
+    //    Returns the number of mapped addresses.
+    //
+    SIZE_T size () const
+    {
+        return m_count;
+    }
+
+private:
+    // Don't allow copies of page maps.
+    PageMap (const PageMap &other);
+    PageMap& operator = (const PageMap &other);
+
+    static const UINT_PTR kMaxAddress = (((UINT_PTR)1 << kPageBits) << PAGEMAP_PAGE_SHIFT) - 1;
+
+    // getPage - Walks the radix tree down to the page for a page number,
+    //   without creating any missing levels.
+    page_t* getPage (UINT_PTR pagenumber) const
+    {
+        node_t *node = m_root[pagenumber >> (kNodeBits + kLeafBits)];
+        if (node == NULL)
+            return NULL;
+        leaf_t *leaf = node->leaves[(pagenumber >> kLeafBits) & (kNodeLength - 1)];
+        if (leaf == NULL)
+            return NULL;
+        return leaf->pages[pagenumber & (kLeafLength - 1)];
+    }
+
+    // highestBitAtOrBelow - Finds the highest set bit in a page's occupancy
+    //   bitmap whose index is less than or equal to "slot". Returns -1 if there
+    //   is no such bit.
+    static INT32 highestBitAtOrBelow (const UINT_PTR *bitmap, INT32 slot)
+    {
+        if (slot < 0)
+            return -1;
+        INT32    word = slot / kWordBits;
+        UINT_PTR bits = bitmap[word];
+        UINT32   bit = slot % kWordBits;
+        if (bit != kWordBits - 1)
+            bits &= ((UINT_PTR)1 << (bit + 1)) - 1;
+        for (;;) {
+            unsigned long index;
+#if defined(_WIN64) || defined(VLD_64BIT_ADDRESSES)
+            if (_BitScanReverse64(&index, bits))
+#else
+            if (_BitScanReverse(&index, bits))
+#endif
+                return word * kWordBits + (INT32)index;
+            if (--word < 0)
+                return -1;
+            bits = bitmap[word];
+        }
+    }
+
+    // publish - Makes a fully initialized node visible to lock-free readers.
+    static void publish (PVOID volatile *target, PVOID node)
+    {
+        InterlockedExchangePointer(target, node);
+    }
+
+    static UINT32 slotOf (LPCVOID address)
+    {
+        return (UINT32)(((UINT_PTR)address & (kPageSize - 1)) >> PAGEMAP_GRANULE_SHIFT);
+    }
+
+    // Private data members.
+    mutable CriticalSection  m_lock;               // Serializes writers. Readers never take it.
+    node_t * volatile        m_root [kRootLength]; // Top level of the radix tree.
+    SIZE_T                   m_bytes;              // Memory used by the map, in bytes.
+    SIZE_T                   m_count;              // Number of mapped addresses.
+};
@@ -0,0 +1,553 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - CallStack Storage and StackTable Implementations
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// The parts of the CallStack class which don't depend on the platform: the
+// storage of the frames, and the StackTable which interns them. The stack
+// walkers and the symbol resolution are in callstack.cpp on Windows and in
+// linux/callstack.cpp on Linux.
+
+#include "stdafx.h"
+#define VLDBUILD
+#include "callstack.h"  // This class' header.
+#include "utility.h"    // Provides CalculateCRC32.
+#include "vldheap.h"    // Provides internal new and delete operators.
+
+// A CallStack is kept for every distinct call stack. Keep it small.
+typedef char checkCallStackSize[(sizeof(CallStack) == 2 * sizeof(void*) + 16 + 3 * sizeof(LONG64)) ? 1 : -1];
+
+// Constructor - Initializes the CallStack with a size and capacity of zero.
+//   No memory is allocated until the first frame is pushed.
+//
+//  - method (IN): The method used by getStackTrace to walk the stack.
+//
+CallStack::CallStack (method_e method)
+{
+    m_frames    = NULL;
+    m_resolved  = NULL;
+    m_size      = 0;
+    m_capacity  = 0;
+    m_hashValue = 0;
+    m_status    = 0x0;
+    m_method    = (UINT8)method;
+    m_liveBytes = 0;
+    m_liveBlocks = 0;
+    m_dbOffset  = 0;
+}
+
+// Destructor - Frees all memory allocated to the CallStack.
+//
+CallStack::~CallStack ()
+{
+    delete [] m_frames;
+    m_frames = NULL;
+
+    delete [] m_resolved;
+    m_resolved = NULL;
+}
+
+// operator == - Equality operator. Compares the CallStack to another CallStack
+//   for equality. Two CallStacks are equal if they are the same size and if
+//   every frame in each is identical to the corresponding frame in the other.
+//
+//  other (IN) - Reference to the CallStack to compare the current CallStack
+//    against for equality.
+//
+//  Return Value:
+//
+//    Returns true if the two CallStacks are equal. Otherwise returns false.
+//
+BOOL CallStack::operator == (const CallStack &other) const
+{
+    if (this == &other) {
+        // Interned call stacks are shared by all of the blocks that have them.
+        return TRUE;
+    }
+    if ((m_size != other.m_size) || (m_hashValue != other.m_hashValue)) {
+        // They can't be equal if the sizes or hashes are different.
+        return FALSE;
+    }
+
+    // Compare every frame.
+    return (m_size == 0) ||
+        (memcmp(m_frames, other.m_frames, m_size * sizeof(UINT_PTR)) == 0);
+}
+
+// clear - Resets the CallStack, returning it to a state where no frames have
+//   been pushed onto it, readying it for reuse.
+//
+//   Note: Calling this function does not release the memory allocated for
+//     frames. We give up a bit of memory-usage efficiency here in favor of
+//     performance of push operations.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID CallStack::clear ()
+{
+    m_size      = 0;
+    m_hashValue = 0;
+    if (m_resolved)
+    {
+        delete [] m_resolved;
+        m_resolved = NULL;
+    }
+}
+
+// dropresolved - Frees the human readable rendition of the CallStack, and
+//   forgets what was learnt from its function names, so that it is resolved
+//   again the next time it is reported. Must be called with g_heapMapLock
+//   held, like resolve.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID CallStack::dropResolved ()
+{
+    delete [] m_resolved;
+    m_resolved = NULL;
+    m_status &= ~(CALLSTACK_STATUS_STARTUPCRT | CALLSTACK_STATUS_NOTSTARTUPCRT | CALLSTACK_STATUS_INTERNALFRAMES);
+}
+
+// isresolved - Determines whether the CallStack has already been resolved
+//   with the given option. A rendition made with the other option is freed.
+//
+//  - showInternalFrames (IN): The option with which the CallStack is to be
+//      resolved.
+//
+//  Return Value:
+//
+//    Returns true if the saved rendition can be used.
+//
+bool CallStack::isResolved (BOOL showInternalFrames)
+{
+    if (m_resolved == NULL)
+        return false;
+    if (((m_status & CALLSTACK_STATUS_INTERNALFRAMES) != 0) == (showInternalFrames != FALSE))
+        return true;
+    dropResolved();
+    return false;
+}
+
+// push_back - Pushes a frame's program counter onto the CallStack.
+//
+//   Note: This function will allocate additional memory as necessary to make
+//     room for new program counter addresses. The capacity grows geometrically
+//     and is trimmed by getStackTrace once the stack has been traced.
+//
+//  - programcounter (IN): The program counter address of the frame to be pushed
+//      onto the CallStack.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID CallStack::push_back (const UINT_PTR programcounter)
+{
+    if (m_size == m_capacity) {
+        // At current capacity. Allocate additional storage.
+        UINT32 capacity = (m_capacity == 0) ? CALLSTACK_MIN_CAPACITY : m_capacity * 2;
+        UINT_PTR *frames = new UINT_PTR [capacity];
+        if (m_size != 0)
+            memcpy(frames, m_frames, m_size * sizeof(UINT_PTR));
+        delete [] m_frames;
+        m_frames = frames;
+        m_capacity = capacity;
+    }
+
+    m_frames[m_size++] = programcounter;
+}
+
+// assign - Replaces the frames of the CallStack with a copy of the specified
+//   frames, allocating exactly as much memory as needed to store them.
+//
+//  - frames (IN): Array of program counter addresses.
+//
+//  - count (IN): Number of elements in "frames".
+//
+//  Return Value:
+//
+//    None.
+//
+VOID CallStack::assign (const UINT_PTR *frames, UINT32 count)
+{
+    if (count > m_capacity) {
+        delete [] m_frames;
+        m_frames = new UINT_PTR [count];
+        m_capacity = count;
+    }
+    if (count != 0)
+        memcpy(m_frames, frames, count * sizeof(UINT_PTR));
+    m_size = count;
+}
+
+// trim - Gives up any frame capacity which exceeds the current size.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID CallStack::trim ()
+{
+    if (m_capacity == m_size)
+        return;
+    UINT_PTR *frames = NULL;
+    if (m_size != 0) {
+        frames = new UINT_PTR [m_size];
+        memcpy(frames, m_frames, m_size * sizeof(UINT_PTR));
+    }
+    delete [] m_frames;
+    m_frames = frames;
+    m_capacity = m_size;
+}
+
+// getStackTrace - Traces the stack as far back as possible, or until 'maxdepth'
+//   frames have been traced, using the method that the CallStack was created
+//   with. Populates the CallStack with one entry for each stack frame traced.
+//
+//  - maxdepth (IN): Maximum number of frames to trace back.
+//
+//  - context (IN): The context at which VLD's code was entered. Used for
+//      determining the starting point of the stack trace.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID CallStack::getStackTrace (UINT32 maxdepth, const context_t& context)
+{
+    switch (m_method) {
+    case safe: {
+        getStackTraceSafe(maxdepth, context);
+        trim();
+
+        // StackWalk64 doesn't provide a hash. Generate one from the frames.
+        DWORD hashcode = 0xD202EF8D;
+        for (UINT32 index = 0; index < m_size; index++) {
+            hashcode = CalculateCRC32(m_frames[index], hashcode);
+        }
+        m_hashValue = hashcode;
+        break;
+    }
+    default:
+        getStackTraceFast(maxdepth, context);
+        break;
+    }
+}
+
+// getStackTraceFast - Traces the stack as far back as possible, or until
+//   'maxdepth' frames have been traced. Populates the CallStack with one entry
+//   for each stack frame traced.
+//
+//   Note: This function uses a very efficient method to walk the stack from
+//     frame to frame, so it is quite fast. However, unconventional stack frames
+//     (such as those created when frame pointer omission optimization is used)
+//     will not be successfully walked by this function and will cause the
+//     stack trace to terminate prematurely.
+//
+//  - maxdepth (IN): Maximum number of frames to trace back.
+//
+//  - framepointer (IN): Frame (base) pointer at which to begin the stack trace.
+//      If NULL, then the stack trace will begin at this function.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID CallStack::getStackTraceFast (UINT32 maxdepth, const context_t& context)
+{
+    // Frames are collected on the stack and then copied into an exactly sized
+    // array.
+    UINT_PTR frames [CALLSTACK_FAST_FRAMES + 1];
+    DWORD    hash;
+    UINT32   size = captureFast(maxdepth, context, frames, hash);
+    assign(frames, size);
+    m_hashValue = hash;
+}
+
+// Constructor - Initializes the StackTable with no call stacks.
+//
+StackTable::StackTable ()
+{
+    ZeroMemory((PVOID)m_buckets, sizeof(m_buckets));
+    m_count = 0;
+}
+
+// capture - Traces the stack and returns the canonical CallStack for it,
+//   adding one to the table if the stack has not been seen before.
+//
+//  - method (IN): The method used to walk the stack.
+//
+//  - maxdepth (IN): Maximum number of frames to trace back.
+//
+//  - context (IN): The context at which VLD's code was entered. Used for
+//      determining the starting point of the stack trace.
+//
+//  Return Value:
+//
+//    Returns the interned CallStack. It is owned by the table and must not be
+//    deleted by the caller.
+//
+CallStack* StackTable::capture (CallStack::method_e method, UINT32 maxdepth, const context_t& context)
+{
+    CallStack *callstack;
+    if (method == CallStack::safe) {
+        callstack = new CallStack(CallStack::safe);
+        callstack->getStackTrace(maxdepth, context);
+        CallStack *existing = find(m_buckets[bucket(callstack->m_hashValue)], NULL,
+            callstack->m_hashValue, callstack->m_frames, callstack->m_size);
+        if (existing != NULL) {
+            delete callstack;
+            return existing;
+        }
+        return insert(callstack);
+    }
+
+    UINT_PTR frames [CALLSTACK_FAST_FRAMES + 1];
+    DWORD    hash;
+    UINT32   size = CallStack::captureFast(maxdepth, context, frames, hash);
+    callstack = find(m_buckets[bucket(hash)], NULL, hash, frames, size);
+    if (callstack != NULL) {
+        // Seen before. Nothing needs to be copied.
+        return callstack;
+    }
+
+    callstack = new CallStack(CallStack::fast);
+    callstack->assign(frames, size);
+    callstack->m_hashValue = hash;
+    return insert(callstack);
+}
+
+// clear - Deletes all of the call stacks in the table. Must only be called
+//   when no block references them any more.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID StackTable::clear ()
+{
+    for (UINT32 index = 0; index < STACKTABLE_BUCKETS; index++) {
+        entry_t *entry = m_buckets[index];
+        while (entry != NULL) {
+            entry_t *next = entry->next;
+            delete entry->callStack;
+            delete entry;
+            entry = next;
+        }
+        m_buckets[index] = NULL;
+    }
+    m_count = 0;
+}
+
+// dropresolved - Drops the saved renditions of the call stacks which have a
+//   frame in the given address range. Called when the module at that range is
+//   unloaded: the module loaded there next would otherwise be reported with
+//   the old module's symbols. Must be called with g_heapMapLock held.
+//
+//  - low (IN): Lowest address of the range.
+//
+//  - high (IN): Highest address of the range.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID StackTable::dropResolved (UINT_PTR low, UINT_PTR high)
+{
+    for (UINT32 index = 0; index < STACKTABLE_BUCKETS; index++) {
+        for (const entry_t *entry = m_buckets[index]; entry != NULL; entry = entry->next) {
+            CallStack *callstack = entry->callStack;
+            if ((callstack->m_resolved == NULL) && !(callstack->m_status & CALLSTACK_STATUS_STARTUPCRT))
+                continue;
+            for (UINT32 frame = 0; frame < callstack->m_size; frame++) {
+                if ((callstack->m_frames[frame] >= low) && (callstack->m_frames[frame] <= high)) {
+                    callstack->dropResolved();
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// find - Searches part of a bucket for a call stack.
+//
+//  - first (IN): First entry to search.
+//
+//  - last (IN): Entry at which to stop searching, or NULL to search up to the
+//      end of the bucket.
+//
+//  - hash (IN): Hash of the call stack.
+//
+//  - frames (IN): Frames of the call stack.
+//
+//  - count (IN): Number of frames.
+//
+//  Return Value:
+//
+//    Returns the matching CallStack, or NULL if there is none.
+//
+CallStack* StackTable::find (const entry_t *first, const entry_t *last, DWORD hash, const UINT_PTR *frames, UINT32 count) const
+{
+    for (const entry_t *entry = first; entry != last; entry = entry->next) {
+        if (entry->callStack->matches(hash, frames, count))
+            return entry->callStack;
+    }
+    return NULL;
+}
+
+// insert - Adds a new call stack to the table. If another thread adds the
+//   same stack first, that one is kept instead.
+//
+//  - callstack (IN): The call stack to add. The table takes ownership of it.
+//
+//  Return Value:
+//
+//    Returns the canonical CallStack, which is either the one that was passed
+//    in or the one that was added by the other thread.
+//
+CallStack* StackTable::insert (CallStack *callstack)
+{
+    entry_t *entry = new entry_t;
+    entry->callStack = callstack;
+    entry->lastBytes = 0;
+    entry->startBytes = 0;
+    entry->intervals = 0;
+
+    entry_t * volatile *head = &m_buckets[bucket(callstack->m_hashValue)];
+    entry_t *first = *head;
+    for (;;) {
+        entry->next = first;
+        entry_t *previous = (entry_t*)InterlockedCompareExchangePointer((PVOID volatile*)head, entry, first);
+        if (previous == first) {
+            InterlockedIncrement(&m_count);
+            return callstack;
+        }
+
+        // Other stacks were added to the bucket in the meantime. Check them
+        // before trying again.
+        CallStack *existing = find(previous, first, callstack->m_hashValue, callstack->m_frames, callstack->m_size);
+        if (existing != NULL) {
+            delete entry;
+            delete callstack;
+            return existing;
+        }
+        first = previous;
+    }
+}
+
+// findGrowingSites - Compares the bytes in use of every call stack with the
+//   previous call, and finds the ones which have grown at every call for the
+//   given number of intervals. Only reads the call stacks' counters, so it
+//   doesn't take any lock. Must not be called by more than one thread.
+//
+//  - intervals (IN): Number of consecutive intervals of growth after which a
+//      site is reported. The count starts over once a site has been reported.
+//
+//  - sites (OUT): Receives the growing sites.
+//
+//  - maxsites (IN): Number of elements in the sites array.
+//
+//  Return Value:
+//
+//    Returns the number of growing sites stored in the array.
+//
+SIZE_T StackTable::findGrowingSites (UINT32 intervals, growingsite_t *sites, SIZE_T maxsites)
+{
+    SIZE_T count = 0;
+    for (UINT32 index = 0; index < STACKTABLE_BUCKETS; index++) {
+        for (entry_t *entry = m_buckets[index]; entry != NULL; entry = entry->next) {
+            LONG64 bytes = entry->callStack->getLiveBytes();
+            if (bytes > entry->lastBytes) {
+                if (entry->intervals == 0)
+                    entry->startBytes = entry->lastBytes;
+                entry->intervals++;
+            }
+            else {
+                entry->intervals = 0;
+            }
+            entry->lastBytes = bytes;
+
+            if ((entry->intervals >= intervals) && (count < maxsites)) {
+                growingsite_t &site = sites[count++];
+                site.callStack = entry->callStack;
+                site.bytes = bytes;
+                site.growth = bytes - entry->startBytes;
+                entry->intervals = 0;
+            }
+        }
+    }
+    return count;
+}
+
+// findLargestSites - Finds the call stacks with the most bytes in use. Only
+//   reads the call stacks' counters, so it doesn't look at the blocks, and
+//   doesn't take any lock.
+//
+//  - sites (OUT): Receives the largest sites, by decreasing bytes in use.
+//
+//  - maxsites (IN): Number of elements in the sites array.
+//
+//  - bytes (OUT): Receives the bytes in use with any of the call stacks.
+//
+//  - blocks (OUT): Receives the number of blocks in use with any of the call
+//      stacks.
+//
+//  Return Value:
+//
+//    Returns the number of sites stored in the array.
+//
+SIZE_T StackTable::findLargestSites (heapsite_t *sites, SIZE_T maxsites, SIZE_T &bytes, SIZE_T &blocks) const
+{
+    SIZE_T count = 0;
+    bytes = 0;
+    blocks = 0;
+    for (UINT32 index = 0; index < STACKTABLE_BUCKETS; index++) {
+        for (const entry_t *entry = m_buckets[index]; entry != NULL; entry = entry->next) {
+            LONG64 sitebytes = entry->callStack->getLiveBytes();
+            LONG64 siteblocks = entry->callStack->getLiveBlocks();
+            if (siteblocks <= 0)
+                continue;
+            if (sitebytes < 0)
+                sitebytes = 0;
+            bytes += (SIZE_T)sitebytes;
+            blocks += (SIZE_T)siteblocks;
+
+            // Insert the site in order, dropping the smallest one if the
+            // array is full.
+            SIZE_T position = count;
+            while ((position > 0) && (sites[position - 1].bytes < (SIZE_T)sitebytes))
+                position--;
+            if (position >= maxsites)
+                continue;
+            if (count < maxsites)
+                count++;
+            memmove(sites + position + 1, sites + position, (count - position - 1) * sizeof(heapsite_t));
+            sites[position].callStack = entry->callStack;
+            sites[position].bytes = (SIZE_T)sitebytes;
+            sites[position].count = (SIZE_T)siteblocks;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,220 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Sharded Allocation Statistics
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef VLDBUILD
+#error \
+"This header should only be included by Visual Leak Detector when building it from source. \
+Applications should never include this header."
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include "linux/platform.h"
+#endif
+#include "vld_def.h"
+
+#define STATISTICS_SHARDS       64          // Number of counter shards. Must be a power of two.
+#define STATISTICS_CACHE_LINE   64
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The Statistics Class
+//
+//    Keeps the process-wide allocation statistics (current, total and peak
+//    bytes, and block counts) without a global lock. The total bytes and the
+//    block counts are kept in STATISTICS_SHARDS cache-line sized shards, one
+//    of which is updated by each thread, selected by its thread ID, with
+//    interlocked operations. Readers add the shards up.
+//
+//    The bytes in use are kept in a single counter instead, which every
+//    allocation and free updates, so that the peak is tracked on the exact
+//    figure: it is the largest value that the counter ever held. The counter
+//    and the peak each have a cache line of their own, apart from the shards
+//    and from each other, and the peak is only written, with a
+//    compare-exchange, when the counter exceeds the last peak read. Once the
+//    program's memory use has levelled off, the peak's line is only ever read,
+//    and stays shared by all of the cores.
+//
+class Statistics
+{
+public:
+    Statistics ()
+    {
+        reset();
+    }
+
+    // allocated - Records a new block.
+    //
+    //  - size (IN): Size, in bytes, of the new block.
+    //
+    //  Return Value:
+    //
+    //    None.
+    //
+    VOID allocated (SIZE_T size)
+    {
+        shard_t &shard = currentShard();
+        InterlockedExchangeAdd64(&shard.allocBytes, (LONG64)size);
+        InterlockedIncrement64(&shard.allocCount);
+        updatePeak(InterlockedExchangeAdd64(&m_currentBytes.value, (LONG64)size) + (LONG64)size);
+    }
+
+    // freed - Records that a block was freed.
+    //
+    //  - size (IN): Size, in bytes, of the freed block.
+    //
+    //  Return Value:
+    //
+    //    None.
+    //
+    VOID freed (SIZE_T size)
+    {
+        InterlockedIncrement64(&currentShard().freeCount);
+        InterlockedExchangeAdd64(&m_currentBytes.value, -(LONG64)size);
+    }
+
+    // resized - Records that a block was reallocated in place. The grand
+    //   total is adjusted by the difference, as if the block had been
+    //   allocated with the new size to begin with.
+    //
+    //  - oldsize (IN): Previous size, in bytes, of the block.
+    //
+    //  - newsize (IN): New size, in bytes, of the block.
+    //
+    //  Return Value:
+    //
+    //    None.
+    //
+    VOID resized (SIZE_T oldsize, SIZE_T newsize)
+    {
+        shard_t &shard = currentShard();
+        LONG64 delta = (LONG64)newsize - (LONG64)oldsize;
+        InterlockedExchangeAdd64(&shard.allocBytes, delta);
+        updatePeak(InterlockedExchangeAdd64(&m_currentBytes.value, delta) + delta);
+    }
+
+    // get - Adds up the shards. Does not take any lock.
+    //
+    //  - stats (OUT): Receives the statistics.
+    //
+    //  Return Value:
+    //
+    //    None.
+    //
+    VOID get (VLD_STATISTICS *stats) const
+    {
+        LONG64 allocBytes = 0, allocCount = 0, freeCount = 0;
+        for (UINT32 index = 0; index < STATISTICS_SHARDS; index++) {
+            const shard_t &shard = m_shards[index];
+            allocBytes += shard.allocBytes;
+            allocCount += shard.allocCount;
+            freeCount  += shard.freeCount;
+        }
+
+        stats->currentBytes  = clamp(m_currentBytes.value);
+        stats->peakBytes     = clamp(m_peakBytes.value);
+        stats->totalBytes    = clamp(allocBytes);
+        stats->currentBlocks = clamp(allocCount - freeCount);
+        stats->totalBlocks   = clamp(allocCount);
+    }
+
+    // current - Returns the number of bytes in use. Reads a single counter,
+    //   so it is cheap enough to be checked on every allocation.
+    //
+    //  Return Value:
+    //
+    //    Returns the number of bytes in use.
+    //
+    LONG64 current () const
+    {
+        return m_currentBytes.value;
+    }
+
+    // reset - Clears all of the statistics. Not thread safe.
+    //
+    //  Return Value:
+    //
+    //    None.
+    //
+    VOID reset ()
+    {
+        ZeroMemory(m_shards, sizeof(m_shards));
+        m_currentBytes.value = 0;
+        m_peakBytes.value = 0;
+    }
+
+private:
+    // Each shard occupies its own cache line so that threads updating
+    // different shards don't contend.
+    struct __declspec(align(STATISTICS_CACHE_LINE)) shard_t {
+        LONG64 volatile allocBytes; // Sum of the sizes of all allocated blocks.
+        LONG64 volatile allocCount; // Number of allocated blocks.
+        LONG64 volatile freeCount;  // Number of freed blocks.
+    };
+
+    // A counter which is updated by every thread, alone on its cache line.
+    struct __declspec(align(STATISTICS_CACHE_LINE)) counter_t {
+        LONG64 volatile value;
+    };
+
+    shard_t& currentShard ()
+    {
+#ifdef _WIN32
+        // Windows thread IDs are multiples of four.
+        return m_shards[(GetCurrentThreadId() >> 2) & (STATISTICS_SHARDS - 1)];
+#else
+        return m_shards[GetCurrentThreadId() & (STATISTICS_SHARDS - 1)];
+#endif
+    }
+
+    // updatePeak - Raises the peak to a value of the bytes in use. Most calls
+    //   only read the peak: it is written only if the value exceeds it.
+    VOID updatePeak (LONG64 value)
+    {
+        LONG64 peak = m_peakBytes.value;
+        while (value > peak) {
+            LONG64 previous = InterlockedCompareExchange64(&m_peakBytes.value, value, peak);
+            if (previous == peak)
+                break;
+            peak = previous;
+        }
+    }
+
+    static SIZE_T clamp (LONG64 value)
+    {
+        if (value < 0)
+            return 0;
+#if !defined(_WIN64) && !defined(VLD_64BIT_ADDRESSES)
+        if ((ULONG64)value > SIZE_MAX)
+            return SIZE_MAX;
+#endif
+        return (SIZE_T)value;
+    }
+
+    shard_t                  m_shards [STATISTICS_SHARDS];
+    counter_t                m_currentBytes;   // Bytes in use.
+    counter_t                m_peakBytes;      // Largest value that m_currentBytes ever held.
+};
@@ -3,6 +3,7 @@
 #include <cassert>
 #include <cerrno>
 #include <cstdio>
+#ifdef _WIN32
 #include <windows.h>
 #if _WIN32_WINNT < 0x0600 // Windows XP or earlier, no GetProcessIdOfThread()
 #include <winternl.h>
@@ -12,3 +13,8 @@
 #endif
 #define DBGHELP_TRANSLATE_TCHAR
 #include "dbghelp.h"    // Provides portable executable (PE) image access functions.
+#else
+#include <memory>       // Included ahead of vldheap.h, which redefines new.
+#include <string>
+#include "linux/platform.h"
+#endif
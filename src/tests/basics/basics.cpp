@@ -2,6 +2,7 @@
 //
 
 #include "stdafx.h"
+#include <windows.h>
 #include "vld.h"
 #include "Allocs.h"
 
@@ -140,6 +141,131 @@ TEST_P(TestBasics, GetProcMalloc)
     ASSERT_EQ(correctLeaks, leaks);
 }
 
+TEST(TestStatistics, HeapAlloc)
+{
+    const size_t size = 1000;
+    VLD_STATISTICS before = { 0 };
+    ASSERT_TRUE(VLDGetStatistics(&before));
+
+    HANDLE heap = GetProcessHeap();
+    void* block = HeapAlloc(heap, 0, size);
+    ASSERT_TRUE(block != NULL);
+
+    VLD_STATISTICS during = { 0 };
+    ASSERT_TRUE(VLDGetStatistics(&during));
+    EXPECT_EQ(before.currentBytes + size, during.currentBytes);
+    EXPECT_EQ(before.currentBlocks + 1, during.currentBlocks);
+    EXPECT_EQ(before.totalBytes + size, during.totalBytes);
+    EXPECT_EQ(before.totalBlocks + 1, during.totalBlocks);
+    EXPECT_GE(during.peakBytes, during.currentBytes);
+
+    HeapFree(heap, 0, block);
+
+    VLD_STATISTICS after = { 0 };
+    ASSERT_TRUE(VLDGetStatistics(&after));
+    EXPECT_EQ(before.currentBytes, after.currentBytes);
+    EXPECT_EQ(before.currentBlocks, after.currentBlocks);
+    EXPECT_EQ(during.totalBytes, after.totalBytes);
+    EXPECT_GE(after.peakBytes, during.currentBytes);
+}
+
+TEST(TestCountingOnly, HeapAlloc)
+{
+    VLDMarkAllLeaksAsReported();
+    UINT options = VLDGetOptions();
+    VLDSetOptions(options | VLD_OPT_NO_STACK_CAPTURE, 256, 64);
+
+    HANDLE heap = GetProcessHeap();
+    int prev = static_cast<int>(VLDGetLeaksCount());
+    void* block = HeapAlloc(heap, 0, 1000);
+    ASSERT_TRUE(block != NULL);
+    int total = static_cast<int>(VLDGetLeaksCount());
+    EXPECT_EQ(prev + 1, total);
+
+    // The leak has no call stack, so it's only counted in the report.
+    EXPECT_EQ(1, static_cast<int>(VLDReportThreadLeaks(GetCurrentThreadId())));
+
+    HeapFree(heap, 0, block);
+    VLDSetOptions(options, 256, 64);
+    EXPECT_EQ(prev, static_cast<int>(VLDGetLeaksCount()));
+}
+
+struct SnapshotDiff {
+    size_t groups;
+    size_t blocks;
+    size_t bytes;
+};
+
+static void __cdecl CountSnapshotBlocks(const wchar_t *callstack, const VLD_SNAPSHOT_BLOCK *blocks, size_t count, void *context)
+{
+    UNREFERENCED_PARAMETER(callstack);
+    SnapshotDiff *diff = static_cast<SnapshotDiff*>(context);
+    diff->groups++;
+    diff->blocks += count;
+    for (size_t i = 0; i < count; i++)
+        diff->bytes += blocks[i].size;
+}
+
+TEST(TestSnapshot, Diff)
+{
+    HANDLE heap = GetProcessHeap();
+    void* kept = HeapAlloc(heap, 0, 10);
+    ASSERT_TRUE(kept != NULL);
+    VLD_SNAPSHOT before = VLDTakeSnapshot();
+    ASSERT_TRUE(before != NULL);
+
+    // Allocated in between the snapshots: three from the same call stack,
+    // and one that is freed again.
+    void* blocks[3];
+    for (int i = 0; i < 3; i++)
+        blocks[i] = HeapAlloc(heap, 0, 100);
+    void* freed = HeapAlloc(heap, 0, 1000);
+    HeapFree(heap, 0, kept);
+    HeapFree(heap, 0, freed);
+    VLD_SNAPSHOT after = VLDTakeSnapshot();
+    ASSERT_TRUE(after != NULL);
+
+    SnapshotDiff diff = { 0, 0, 0 };
+    EXPECT_EQ(3u, VLDDiffSnapshots(before, after, CountSnapshotBlocks, &diff));
+    EXPECT_EQ(1u, diff.groups);
+    EXPECT_EQ(3u, diff.blocks);
+    EXPECT_EQ(300u, diff.bytes);
+    EXPECT_EQ(0u, VLDDiffSnapshots(after, after, NULL, NULL));
+
+    // Blocks freed after the later snapshot are left out.
+    HeapFree(heap, 0, blocks[0]);
+    EXPECT_EQ(2u, VLDDiffSnapshots(before, after, NULL, NULL));
+
+    for (int i = 1; i < 3; i++)
+        HeapFree(heap, 0, blocks[i]);
+    VLDFreeSnapshot(before);
+    VLDFreeSnapshot(after);
+}
+
+TEST(TestHeapProfile, Dump)
+{
+    wchar_t path[MAX_PATH];
+    ASSERT_NE(0u, GetTempPathW(MAX_PATH, path));
+    wcscat_s(path, L"vld_heap_profile.txt");
+
+    HANDLE heap = GetProcessHeap();
+    void* block = HeapAlloc(heap, 0, 12345);
+    ASSERT_TRUE(block != NULL);
+    int sites = VLDDumpHeapProfile(path);
+    HeapFree(heap, 0, block);
+    EXPECT_GE(sites, 1);
+
+    FILE* file = NULL;
+    ASSERT_EQ(0, _wfopen_s(&file, path, L"r, ccs=UTF-8"));
+    wchar_t line[256];
+    ASSERT_TRUE(fgetws(line, _countof(line), file) != NULL);
+    EXPECT_TRUE(wcsstr(line, L"heap profile") != NULL);
+    fclose(file);
+    DeleteFileW(path);
+
+    EXPECT_EQ(-1, VLDDumpHeapProfile(NULL));
+}
+
 INSTANTIATE_TEST_CASE_P(FreeVal,
     TestBasics,
     ::testing::Bool());
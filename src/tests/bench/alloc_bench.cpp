@@ -0,0 +1,430 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Allocation Overhead Benchmark (Linux)
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Measures what tracking costs per allocation: the time a malloc and free
+// pair takes with libvld.so preloaded, which goes through the whole tracking
+// path (the interposed functions, CaptureContext, mapBlock and the stack
+// capture on malloc, unmapBlock on free), next to the same pair without it.
+// Usage:
+//
+//   vld_alloc_bench [options] [filter]
+//
+//   --threads=1,2,4,8           Numbers of threads allocating at once.
+//   --sizes=small,mixed,large   Block sizes: 16 to 256 bytes, 16 bytes to
+//                               16 KB (log-uniform), or 4 to 16 KB.
+//   --lifetimes=immediate,short,long
+//                               Blocks are freed right away, after 64 more
+//                               allocations by the same thread, or after
+//                               16384 more allocations by all threads.
+//   --depths=1,16,64            Frames on the stack above the allocating
+//                               function, as far as the program goes.
+//   --operations=200000         Allocations per workload, over all threads.
+//   --vld=PATH                  libvld.so to preload.
+//
+// Every combination of the options is a workload, named
+// alloc_<size>_<lifetime>_d<depth>_t<threads>. Only those whose name contains
+// "filter" are run. The workloads run in two child processes, one without and
+// one with libvld.so, so VLD's options (e.g. VldStackWalkMethod=safe) are
+// taken from the environment. The results are printed in the format of the
+// other benchmarks: the ns/op of a tracked allocation, followed by
+//
+//   raw_ns       ns/op without VLD.
+//   overhead_ns  ns/op added by VLD.
+//   slowdown     Tracked time over untracked time.
+//   scaling      Throughput at n threads, relative to n times the throughput
+//                of the same workload on 1 thread, where n is the number of
+//                threads or of processors, whichever is less. 1 is perfect.
+//   raw_scaling  The same, without VLD.
+//
+// The ns/op are wall clock time over all threads, divided by the number of
+// allocations. This file must be compiled with -fno-omit-frame-pointer, so
+// that the frame pointer walk reaches the requested depth.
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.h"
+
+namespace {
+
+const char *const kSizeNames []     = { "small", "mixed", "large" };
+const char *const kLifetimeNames [] = { "immediate", "short", "long" };
+const size_t      kShortLived       = 64;     // Blocks alive at once per thread, for "short".
+const size_t      kLongLived        = 16384;  // Blocks alive at once over all threads, for "long".
+const size_t      kWarmupOperations = 10000;
+
+struct options_t {
+    std::vector<unsigned> threads;
+    std::vector<unsigned> sizes;      // Indices in kSizeNames.
+    std::vector<unsigned> lifetimes;  // Indices in kLifetimeNames.
+    std::vector<unsigned> depths;
+    size_t                operations;
+    std::string           vld;
+    std::string           filter;
+};
+
+struct workload_t {
+    std::string name;
+    unsigned    size;
+    unsigned    lifetime;
+    unsigned    depth;
+    unsigned    threads;
+};
+
+struct worker_t {
+    const workload_t       *workload;
+    size_t                  operations;
+    size_t                  live;      // Blocks kept alive by this thread.
+    unsigned long long      seed;
+    std::atomic<unsigned>  *ready;     // Number of threads waiting to start.
+    std::atomic<bool>      *go;
+    size_t                  checksum;
+};
+
+// Splits a comma separated list.
+std::vector<std::string> split (const std::string &list)
+{
+    std::vector<std::string> items;
+    size_t start = 0;
+    for (;;) {
+        size_t end = list.find(',', start);
+        items.push_back(list.substr(start, end - start));
+        if (end == std::string::npos)
+            return items;
+        start = end + 1;
+    }
+}
+
+bool parseNumbers (const std::string &list, std::vector<unsigned> &numbers)
+{
+    std::vector<std::string> items = split(list);
+    numbers.clear();
+    for (size_t i = 0; i < items.size(); i++) {
+        unsigned number = (unsigned)strtoul(items[i].c_str(), NULL, 10);
+        if (number == 0)
+            return false;
+        numbers.push_back(number);
+    }
+    return true;
+}
+
+template <size_t N>
+bool parseNames (const std::string &list, const char *const (&names) [N], std::vector<unsigned> &indices)
+{
+    std::vector<std::string> items = split(list);
+    indices.clear();
+    for (size_t i = 0; i < items.size(); i++) {
+        size_t index = 0;
+        while ((index < N) && (items[i] != names[index]))
+            index++;
+        if (index == N)
+            return false;
+        indices.push_back((unsigned)index);
+    }
+    return true;
+}
+
+// Reads the options, which the parent passes on to its children unchanged.
+bool parseOptions (int argc, char *argv [], options_t &options, std::vector<std::string> &passed)
+{
+    parseNumbers("1,2,4,8", options.threads);
+    parseNames("small,mixed,large", kSizeNames, options.sizes);
+    parseNames("immediate,short,long", kLifetimeNames, options.lifetimes);
+    parseNumbers("1,16,64", options.depths);
+    options.operations = 200000;
+#ifdef VLD_LIBRARY_PATH
+    options.vld = VLD_LIBRARY_PATH;
+#endif
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        size_t equals = argument.find('=');
+        std::string name = argument.substr(0, equals);
+        std::string value = (equals != std::string::npos) ? argument.substr(equals + 1) : "";
+        bool valid = true;
+        if (name == "--threads")
+            valid = parseNumbers(value, options.threads);
+        else if (name == "--sizes")
+            valid = parseNames(value, kSizeNames, options.sizes);
+        else if (name == "--lifetimes")
+            valid = parseNames(value, kLifetimeNames, options.lifetimes);
+        else if (name == "--depths")
+            valid = parseNumbers(value, options.depths);
+        else if (name == "--operations")
+            valid = (options.operations = (size_t)strtoull(value.c_str(), NULL, 10)) != 0;
+        else if (name == "--vld")
+            options.vld = value;
+        else if ((name == "--child") || (argument[0] != '-'))
+            valid = true;
+        else
+            valid = false;
+        if (!valid) {
+            fprintf(stderr, "Invalid option: %s\n", argv[i]);
+            return false;
+        }
+        if (name == "--child")
+            continue;
+        if (argument[0] != '-')
+            options.filter = argument;
+        passed.push_back(argument);
+    }
+    return true;
+}
+
+std::vector<workload_t> makeWorkloads (const options_t &options)
+{
+    std::vector<workload_t> workloads;
+    for (size_t s = 0; s < options.sizes.size(); s++) {
+        for (size_t l = 0; l < options.lifetimes.size(); l++) {
+            for (size_t d = 0; d < options.depths.size(); d++) {
+                for (size_t t = 0; t < options.threads.size(); t++) {
+                    workload_t workload;
+                    workload.size = options.sizes[s];
+                    workload.lifetime = options.lifetimes[l];
+                    workload.depth = options.depths[d];
+                    workload.threads = options.threads[t];
+                    workload.name = std::string("alloc_") + kSizeNames[workload.size] + "_" +
+                        kLifetimeNames[workload.lifetime] + "_d" + std::to_string(workload.depth) +
+                        "_t" + std::to_string(workload.threads);
+                    if (workload.name.find(options.filter) != std::string::npos)
+                        workloads.push_back(workload);
+                }
+            }
+        }
+    }
+    return workloads;
+}
+
+size_t blockSize (unsigned size, BenchRandom &random)
+{
+    unsigned long long value = random.next();
+    switch (size) {
+    case 0:
+        return 16 + (size_t)(value % 241);
+
+    case 1: {
+        size_t base = (size_t)16 << (value % 11);
+        return base + (size_t)((value >> 8) % base);
+    }
+
+    default:
+        return 4096 + (size_t)(value % 12289);
+    }
+}
+
+// The measured loop. Each block is written to, so that the compiler can't
+// drop the allocations, and freed once "live" more blocks have been
+// allocated.
+__attribute__((noinline)) size_t allocate (worker_t &worker)
+{
+    BenchRandom random(worker.seed);
+    std::vector<void*> ring(worker.live, (void*)NULL);
+    size_t checksum = 0;
+    size_t next = 0;
+
+    worker.ready->fetch_sub(1);
+    while (!worker.go->load())
+        std::this_thread::yield();
+
+    for (size_t i = 0; i < worker.operations; i++) {
+        char *block = (char*)malloc(blockSize(worker.workload->size, random));
+        block[0] = (char)i;
+        checksum += (size_t)block[0];
+        if (worker.live == 0) {
+            free(block);
+            continue;
+        }
+        free(ring[next]);
+        ring[next] = block;
+        if (++next == worker.live)
+            next = 0;
+    }
+    for (size_t i = 0; i < ring.size(); i++)
+        free(ring[i]);
+    return checksum;
+}
+
+// Calls allocate() with depth - 1 more frames on the stack.
+__attribute__((noinline)) size_t descend (worker_t &worker, unsigned depth)
+{
+    if (depth <= 1)
+        return allocate(worker);
+    size_t checksum = descend(worker, depth - 1);
+    // Prevents the recursion from being turned into a loop.
+    benchKeep(depth);
+    return checksum;
+}
+
+void runWorker (worker_t *worker)
+{
+    // The thread's first allocation sets up VLD's thread local storage.
+    free(malloc(1));
+    worker->checksum = descend(*worker, worker->workload->depth);
+}
+
+// Runs a workload and returns the wall clock time it took, in nanoseconds.
+unsigned long long runWorkload (const workload_t &workload, size_t operations)
+{
+    std::atomic<unsigned> ready(workload.threads);
+    std::atomic<bool> go(false);
+    std::vector<worker_t> workers(workload.threads);
+    for (unsigned t = 0; t < workload.threads; t++) {
+        worker_t &worker = workers[t];
+        worker.workload = &workload;
+        worker.operations = operations / workload.threads;
+        worker.live = (workload.lifetime == 0) ? 0 :
+            (workload.lifetime == 1) ? kShortLived : kLongLived / workload.threads;
+        worker.seed = t + 1;
+        worker.ready = &ready;
+        worker.go = &go;
+        worker.checksum = 0;
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < workload.threads; t++)
+        threads.push_back(std::thread(runWorker, &workers[t]));
+    while (ready.load() != 0)
+        std::this_thread::yield();
+
+    BenchState state;
+    state.start();
+    go.store(true);
+    for (unsigned t = 0; t < workload.threads; t++)
+        threads[t].join();
+    state.stop(operations);
+
+    size_t checksum = 0;
+    for (unsigned t = 0; t < workload.threads; t++)
+        checksum += workers[t].checksum;
+    benchKeep(checksum);
+    return state.nanoseconds();
+}
+
+// Runs the workloads, in this process, and prints "<name> <nanoseconds>" for
+// each of them.
+int runChild (const options_t &options)
+{
+    std::vector<workload_t> workloads = makeWorkloads(options);
+    if (!workloads.empty())
+        runWorkload(workloads[0], kWarmupOperations);
+    for (size_t i = 0; i < workloads.size(); i++) {
+        unsigned long long nanoseconds = runWorkload(workloads[i], options.operations);
+        printf("%s %llu\n", workloads[i].name.c_str(), nanoseconds);
+        fflush(stdout);
+    }
+    return EXIT_SUCCESS;
+}
+
+std::string quote (const std::string &argument)
+{
+    std::string quoted = "'";
+    for (size_t i = 0; i < argument.size(); i++) {
+        if (argument[i] == '\'')
+            quoted += "'\\''";
+        else
+            quoted += argument[i];
+    }
+    return quoted + "'";
+}
+
+// Runs the workloads in a child process, with the given library preloaded,
+// and reads the ns/op of each of them. The child's standard error, where VLD
+// writes its report, is discarded.
+bool runChildProcess (const std::string &preload, const std::vector<std::string> &arguments,
+    size_t operations, std::map<std::string, double> &results)
+{
+    char path [4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0)
+        return false;
+    path[length] = '\0';
+
+    std::string command = preload.empty() ? "env -u LD_PRELOAD " : "env LD_PRELOAD=" + quote(preload) + " ";
+    command += quote(path) + " --child";
+    for (size_t i = 0; i < arguments.size(); i++)
+        command += " " + quote(arguments[i]);
+    command += " 2>/dev/null";
+
+    FILE *child = popen(command.c_str(), "r");
+    if (child == NULL)
+        return false;
+    char name [256];
+    unsigned long long nanoseconds;
+    while (fscanf(child, "%255s %llu", name, &nanoseconds) == 2)
+        results[name] = (double)nanoseconds / (double)operations;
+    return pclose(child) == 0;
+}
+
+} // namespace
+
+int main (int argc, char *argv [])
+{
+    options_t options;
+    std::vector<std::string> arguments;
+    if (!parseOptions(argc, argv, options, arguments))
+        return EXIT_FAILURE;
+    if ((argc > 1) && (strcmp(argv[1], "--child") == 0))
+        return runChild(options);
+
+    if (access(options.vld.c_str(), R_OK) != 0) {
+        fprintf(stderr, "libvld.so not found. Pass its path with --vld=PATH.\n");
+        return EXIT_FAILURE;
+    }
+    std::map<std::string, double> raw, tracked;
+    if (!runChildProcess("", arguments, options.operations, raw) ||
+        !runChildProcess(options.vld, arguments, options.operations, tracked)) {
+        fprintf(stderr, "The child process failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned processors = std::thread::hardware_concurrency();
+    if (processors == 0)
+        processors = 1;
+    printf("# benchmark\toperations\tns/op\tcounters\n");
+    std::vector<workload_t> workloads = makeWorkloads(options);
+    for (size_t i = 0; i < workloads.size(); i++) {
+        const workload_t &workload = workloads[i];
+        double rawns = raw[workload.name];
+        double trackedns = tracked[workload.name];
+        printf("%s\t%zu\t%.2f\tthreads=%u\traw_ns=%.2f\toverhead_ns=%.2f\tslowdown=%.2f",
+            workload.name.c_str(), options.operations, trackedns, workload.threads,
+            rawns, trackedns - rawns, (rawns > 0.0) ? trackedns / rawns : 0.0);
+
+        // Scaling is relative to the same workload on 1 thread, if it was run.
+        std::string single = workload.name.substr(0, workload.name.rfind("_t")) + "_t1";
+        if ((raw.count(single) != 0) && (tracked.count(single) != 0)) {
+            double parallel = (double)std::min(workload.threads, processors);
+            printf("\tscaling=%.2f\traw_scaling=%.2f",
+                tracked[single] / (trackedns * parallel), raw[single] / (rawns * parallel));
+        }
+        printf("\n");
+    }
+    return EXIT_SUCCESS;
+}
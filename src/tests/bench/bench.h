@@ -0,0 +1,173 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Core Benchmark Harness
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The BenchState Class
+//
+//    Each benchmark receives a BenchState. The benchmark performs any setup,
+//    then brackets the measured loop with start() and stop(), and finally may
+//    attach named counters (memory usage, hit rates...) to its result.
+//
+//    Results are printed one line per benchmark, tab separated, so that they
+//    can be compared between runs by scripts:
+//
+//      <name> <operations> <ns/op> [<counter>=<value> ...]
+//
+class BenchState
+{
+public:
+    typedef std::chrono::steady_clock clock_t;
+
+    BenchState () : m_operations(0), m_nanoseconds(0) {}
+
+    // start - Starts (or resumes) timing the benchmark.
+    void start ()
+    {
+        m_start = clock_t::now();
+    }
+
+    // stop - Stops timing the benchmark.
+    //
+    //  - operations (IN): Number of operations performed since start().
+    //
+    void stop (unsigned long long operations)
+    {
+        clock_t::time_point end = clock_t::now();
+        m_nanoseconds += (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(end - m_start).count();
+        m_operations += operations;
+    }
+
+    // nanoseconds - Obtains the total time measured so far.
+    unsigned long long nanoseconds () const
+    {
+        return m_nanoseconds;
+    }
+
+    // counter - Attaches a named value to the benchmark's result.
+    void counter (const char *name, double value)
+    {
+        m_counters.push_back(std::make_pair(std::string(name), value));
+    }
+
+    // print - Writes the result line for the benchmark.
+    void print (const char *name) const
+    {
+        double nsperop = (m_operations != 0) ? (double)m_nanoseconds / (double)m_operations : 0.0;
+        printf("%s\t%llu\t%.2f", name, m_operations, nsperop);
+        for (size_t i = 0; i < m_counters.size(); i++) {
+            printf("\t%s=%.2f", m_counters[i].first.c_str(), m_counters[i].second);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+private:
+    clock_t::time_point                          m_start;
+    unsigned long long                           m_operations;
+    unsigned long long                           m_nanoseconds;
+    std::vector<std::pair<std::string, double> > m_counters;
+};
+
+typedef std::function<void (BenchState &state)> benchfunc_t;
+
+// Benchmarks register themselves, at static initialization time, by defining
+// a BenchRegistrar. Use the BENCHMARK macro rather than using it directly.
+// Families of parameterized benchmarks may instead call benchRegister once
+// for each combination of parameters, from the constructor of a static
+// object.
+struct benchentry_t {
+    std::string  name;
+    benchfunc_t  func;
+};
+
+inline std::vector<benchentry_t>& benchRegistry ()
+{
+    static std::vector<benchentry_t> registry;
+    return registry;
+}
+
+inline void benchRegister (const std::string &name, const benchfunc_t &func)
+{
+    benchentry_t entry = { name, func };
+    benchRegistry().push_back(entry);
+}
+
+class BenchRegistrar
+{
+public:
+    BenchRegistrar (const char *name, benchfunc_t func)
+    {
+        benchRegister(name, func);
+    }
+};
+
+// Defines and registers a benchmark function:
+//
+//   BENCHMARK(map_insert)
+//   {
+//       ...setup...
+//       state.start();
+//       ...measured loop...
+//       state.stop(count);
+//   }
+//
+#define BENCHMARK(name) \
+    static void bench_##name (BenchState &state); \
+    static BenchRegistrar registrar_##name (#name, bench_##name); \
+    static void bench_##name (BenchState &state)
+
+// Prevents the compiler from optimizing away a computed value.
+template <typename T>
+inline void benchKeep (const T &value)
+{
+    static volatile T sink;
+    sink = value;
+}
+
+// A small, fast, deterministic pseudo-random number generator (xorshift), so
+// that runs are reproducible.
+class BenchRandom
+{
+public:
+    explicit BenchRandom (unsigned long long seed = 0x9E3779B97F4A7C15ULL) : m_state(seed | 1) {}
+
+    unsigned long long next ()
+    {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 7;
+        m_state ^= m_state << 17;
+        return m_state;
+    }
+
+private:
+    unsigned long long m_state;
+};
@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Core Benchmark Runner
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Runs the benchmarks of VLD's internal data structures. Usage:
+//
+//   core_bench [filter]
+//
+// Only benchmarks whose name contains "filter" are run.
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "bench.h"
+
+// VLD's containers allocate through "new(__FILE__, __LINE__)", which normally
+// allocates from VLD's private heap. The benchmarks measure the containers,
+// not the private heap, so forward these to the global operators.
+void* operator new (size_t size, const char *, int)
+{
+    return ::operator new(size);
+}
+
+void* operator new [] (size_t size, const char *, int)
+{
+    return ::operator new [] (size);
+}
+
+void operator delete (void *block, const char *, int)
+{
+    ::operator delete(block);
+}
+
+void operator delete [] (void *block, const char *, int)
+{
+    ::operator delete [] (block);
+}
+
+int main (int argc, char *argv [])
+{
+    const char *filter = (argc > 1) ? argv[1] : NULL;
+
+    printf("# benchmark\toperations\tns/op\tcounters\n");
+    std::vector<benchentry_t> &registry = benchRegistry();
+    for (size_t i = 0; i < registry.size(); i++) {
+        if ((filter != NULL) && (strstr(registry[i].name.c_str(), filter) == NULL))
+            continue;
+        BenchState state;
+        registry[i].func(state);
+        state.print(registry[i].name.c_str());
+    }
+    return EXIT_SUCCESS;
+}
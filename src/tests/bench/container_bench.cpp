@@ -0,0 +1,575 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Container Benchmarks
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Compares VLD's lightweight containers (Set and Map, built on the Tree
+// template) with std::set, std::map and an open addressing hash set, the
+// usual alternative for an index of blocks. Each container is measured on:
+//
+//   insert   Inserting every key into an empty container.
+//   find     Finding keys, in random order.
+//   erase    Erasing every key, in random order.
+//   iterate  Iterating over every key.
+//   churn    Erasing a random key and inserting a new one, like the hooks do
+//            when the program frees a block and allocates another.
+//
+// with sequential keys, random keys and pointer-like keys (ascending, 16 byte
+// aligned addresses with gaps between them, like the blocks of a heap), from
+// 1K to 1M entries. Set VLD_BENCH_MAX_ENTRIES=10000000 to also run them with
+// 10M entries, which takes a while. find and churn are also run by several
+// threads sharing one container ("_contended"): VLD's containers take their
+// internal lock, the others are guarded by a std::mutex.
+//
+// The benchmarks are named <container>_<operation>_<keys>_<entries>, e.g.
+// vld_set_find_random_100k, and are ordered so that the containers measured
+// on the same workload are next to each other. A family is selected with a
+// filter such as "_churn_" or "std_map_".
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.h"
+
+#define VLDBUILD
+#include "map.h"
+#include "set.h"
+
+namespace {
+
+const size_t   kReserve           = 64;      // Same as BLOCK_MAP_RESERVE in blocktracker.cpp.
+const size_t   kMinOperations     = 1000000; // Small containers are measured repeatedly, until at least this many operations are timed.
+const size_t   kDefaultMaxEntries = 1000000;
+const unsigned kThreadCount       = 4;
+
+enum keys_e {
+    sequentialKeys,
+    randomKeys,
+    pointerKeys
+};
+
+enum operation_e {
+    insertOp,
+    findOp,
+    eraseOp,
+    iterateOp,
+    churnOp
+};
+
+struct benchparams_t {
+    operation_e operation;
+    keys_e      keys;
+    size_t      entries;
+    unsigned    threads;
+};
+
+// Generates count distinct keys, in the order in which they are inserted. No
+// key is 0 or ~0, which the OpenHashSet reserves.
+std::vector<UINT_PTR> makeKeys (keys_e kind, size_t count)
+{
+    std::vector<UINT_PTR> keys;
+    keys.reserve(count);
+    BenchRandom random;
+    UINT_PTR address = 0x10000000;
+    for (UINT_PTR index = 1; keys.size() < count; index++) {
+        UINT_PTR key;
+        switch (kind) {
+        case sequentialKeys:
+            key = index;
+            break;
+
+        case randomKeys:
+            // Multiplying by an odd constant is a bijection, so the keys are
+            // distinct.
+            key = index * (UINT_PTR)0xD6E8FEB86659FD93ULL;
+            break;
+
+        default:
+            key = address;
+            address += 16 * (1 + (UINT_PTR)(random.next() % 8));
+            break;
+        }
+        if ((key != 0) && (key != ~(UINT_PTR)0))
+            keys.push_back(key);
+    }
+    return keys;
+}
+
+// The first count keys, in random order.
+std::vector<UINT_PTR> shuffled (const std::vector<UINT_PTR> &keys, size_t count)
+{
+    std::vector<UINT_PTR> order(keys.begin(), keys.begin() + count);
+    BenchRandom random(42);
+    for (size_t i = order.size() - 1; i > 0; i--) {
+        std::swap(order[i], order[(size_t)(random.next() % (i + 1))]);
+    }
+    return order;
+}
+
+// The containers are wrapped in classes with the same interface. "locked" is
+// true for the containers which have a lock of their own.
+class VldSet
+{
+public:
+    static const bool locked = true;
+
+    VldSet ()
+    {
+        m_set.reserve(kReserve);
+    }
+    bool insert (UINT_PTR key)
+    {
+        return m_set.insert(key) != m_set.end();
+    }
+    bool find (UINT_PTR key) const
+    {
+        return m_set.find(key) != m_set.end();
+    }
+    void erase (UINT_PTR key)
+    {
+        m_set.erase(key);
+    }
+    UINT_PTR sum () const
+    {
+        UINT_PTR sum = 0;
+        for (Set<UINT_PTR>::Iterator it = m_set.begin(); it != m_set.end(); ++it)
+            sum += *it;
+        return sum;
+    }
+
+private:
+    Set<UINT_PTR> m_set;
+};
+
+class VldMap
+{
+public:
+    static const bool locked = true;
+
+    VldMap ()
+    {
+        m_map.reserve(kReserve);
+    }
+    bool insert (UINT_PTR key)
+    {
+        return m_map.insert(key, key) != m_map.end();
+    }
+    bool find (UINT_PTR key) const
+    {
+        return m_map.find(key) != m_map.end();
+    }
+    void erase (UINT_PTR key)
+    {
+        m_map.erase(key);
+    }
+    UINT_PTR sum () const
+    {
+        UINT_PTR sum = 0;
+        for (Map<UINT_PTR, UINT_PTR>::Iterator it = m_map.begin(); it != m_map.end(); ++it)
+            sum += (*it).second;
+        return sum;
+    }
+
+private:
+    Map<UINT_PTR, UINT_PTR> m_map;
+};
+
+class StdSet
+{
+public:
+    static const bool locked = false;
+
+    bool insert (UINT_PTR key)
+    {
+        return m_set.insert(key).second;
+    }
+    bool find (UINT_PTR key) const
+    {
+        return m_set.find(key) != m_set.end();
+    }
+    void erase (UINT_PTR key)
+    {
+        m_set.erase(key);
+    }
+    UINT_PTR sum () const
+    {
+        UINT_PTR sum = 0;
+        for (std::set<UINT_PTR>::const_iterator it = m_set.begin(); it != m_set.end(); ++it)
+            sum += *it;
+        return sum;
+    }
+
+private:
+    std::set<UINT_PTR> m_set;
+};
+
+class StdMap
+{
+public:
+    static const bool locked = false;
+
+    bool insert (UINT_PTR key)
+    {
+        return m_map.insert(std::make_pair(key, key)).second;
+    }
+    bool find (UINT_PTR key) const
+    {
+        return m_map.find(key) != m_map.end();
+    }
+    void erase (UINT_PTR key)
+    {
+        m_map.erase(key);
+    }
+    UINT_PTR sum () const
+    {
+        UINT_PTR sum = 0;
+        for (std::map<UINT_PTR, UINT_PTR>::const_iterator it = m_map.begin(); it != m_map.end(); ++it)
+            sum += it->second;
+        return sum;
+    }
+
+private:
+    std::map<UINT_PTR, UINT_PTR> m_map;
+};
+
+// The slots of the OpenHashSet which hold no key.
+const UINT_PTR kEmpty  = 0;
+const UINT_PTR kErased = ~(UINT_PTR)0;
+const size_t   kNone   = ~(size_t)0;
+
+// A hash set with open addressing and linear probing. The keys are hashed by
+// multiplying them with the golden ratio (Fibonacci hashing), which spreads
+// aligned addresses well. Erased keys leave a tombstone, and the table is
+// rebuilt once more than half of its slots have been used.
+class OpenHashSet
+{
+public:
+    static const bool locked = false;
+
+    OpenHashSet () : m_slots(16, kEmpty), m_shift(60), m_used(0), m_count(0) {}
+
+    bool insert (UINT_PTR key)
+    {
+        if ((m_used + 1) * 2 > m_slots.size())
+            rehash();
+        size_t mask = m_slots.size() - 1;
+        size_t tombstone = kNone;
+        size_t index = hash(key);
+        for (;; index = (index + 1) & mask) {
+            UINT_PTR slot = m_slots[index];
+            if (slot == key)
+                return false;
+            if (slot == kEmpty)
+                break;
+            if ((slot == kErased) && (tombstone == kNone))
+                tombstone = index;
+        }
+        if (tombstone != kNone)
+            index = tombstone;
+        else
+            m_used++;
+        m_slots[index] = key;
+        m_count++;
+        return true;
+    }
+    bool find (UINT_PTR key) const
+    {
+        return locate(key) != kNone;
+    }
+    void erase (UINT_PTR key)
+    {
+        size_t index = locate(key);
+        if (index != kNone) {
+            m_slots[index] = kErased;
+            m_count--;
+        }
+    }
+    UINT_PTR sum () const
+    {
+        UINT_PTR sum = 0;
+        for (size_t index = 0; index < m_slots.size(); index++) {
+            if ((m_slots[index] != kEmpty) && (m_slots[index] != kErased))
+                sum += m_slots[index];
+        }
+        return sum;
+    }
+
+private:
+    size_t hash (UINT_PTR key) const
+    {
+        return (size_t)(((UINT64)key * 0x9E3779B97F4A7C15ULL) >> m_shift);
+    }
+    size_t locate (UINT_PTR key) const
+    {
+        size_t mask = m_slots.size() - 1;
+        for (size_t index = hash(key);; index = (index + 1) & mask) {
+            UINT_PTR slot = m_slots[index];
+            if (slot == key)
+                return index;
+            if (slot == kEmpty)
+                return kNone;
+        }
+    }
+    // Doubles the table if the keys fill more than a quarter of it, otherwise
+    // only drops the tombstones.
+    void rehash ()
+    {
+        size_t capacity = m_slots.size();
+        if ((m_count + 1) * 4 > capacity) {
+            capacity *= 2;
+            m_shift--;
+        }
+        std::vector<UINT_PTR> slots(capacity, kEmpty);
+        slots.swap(m_slots);
+        m_used = 0;
+        m_count = 0;
+        for (size_t index = 0; index < slots.size(); index++) {
+            if ((slots[index] != kEmpty) && (slots[index] != kErased))
+                insert(slots[index]);
+        }
+    }
+
+    std::vector<UINT_PTR> m_slots;
+    unsigned              m_shift; // 64 - log2(number of slots).
+    size_t                m_used;  // Slots holding a key or a tombstone.
+    size_t                m_count; // Slots holding a key.
+};
+
+// Guards a container which has no lock of its own with a std::mutex, so that
+// it can be shared by several threads. Containers which have their own lock
+// are shared as they are.
+template <typename Container, bool = Container::locked>
+class Shared
+{
+public:
+    bool insert (UINT_PTR key)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return m_container.insert(key);
+    }
+    bool find (UINT_PTR key)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return m_container.find(key);
+    }
+    void erase (UINT_PTR key)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_container.erase(key);
+    }
+    UINT_PTR sum ()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+        return m_container.sum();
+    }
+
+private:
+    Container  m_container;
+    std::mutex m_lock;
+};
+
+template <typename Container>
+class Shared<Container, true> : public Container
+{
+};
+
+// Runs body(thread) on each of the threads, or directly on the calling
+// thread if there is only one, and measures the total time taken.
+template <typename Body>
+void runThreads (BenchState &state, unsigned threadCount, unsigned long long operations, Body body)
+{
+    state.start();
+    if (threadCount == 1) {
+        body(0);
+    }
+    else {
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < threadCount; t++) {
+            threads.push_back(std::thread(body, t));
+        }
+        for (size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+    }
+    state.stop(operations);
+}
+
+// Measures one operation on one container. insert, erase and iterate are
+// repeated on a new container until kMinOperations have been timed; find and
+// churn run kMinOperations on the same container. Each thread finds or
+// churns its own share of the keys.
+template <typename Container>
+void run (BenchState &state, const benchparams_t &params)
+{
+    const size_t entries = params.entries;
+    const unsigned threads = params.threads;
+    // Churn inserts the spare keys, after the initial entries, and recycles
+    // the keys it erases.
+    size_t spares = (params.operation == churnOp) ? std::max(entries, (size_t)threads) : 0;
+    std::vector<UINT_PTR> keys = makeKeys(params.keys, entries + spares);
+    std::vector<UINT_PTR> order = shuffled(keys, entries);
+    size_t operations = std::max(entries, kMinOperations);
+    size_t repetitions = std::max((size_t)1, kMinOperations / entries);
+    UINT_PTR result = 0;
+
+    switch (params.operation) {
+    case insertOp:
+    case eraseOp:
+    case iterateOp:
+        for (size_t repetition = 0; repetition < repetitions; repetition++) {
+            Container *container = new Container;
+            if (params.operation == insertOp) {
+                state.start();
+                for (size_t i = 0; i < entries; i++)
+                    result += container->insert(keys[i]);
+                state.stop(entries);
+            }
+            else {
+                for (size_t i = 0; i < entries; i++)
+                    container->insert(keys[i]);
+                state.start();
+                if (params.operation == eraseOp) {
+                    for (size_t i = 0; i < entries; i++)
+                        container->erase(order[i]);
+                }
+                else {
+                    result += container->sum();
+                }
+                state.stop(entries);
+            }
+            delete container;
+        }
+        break;
+
+    case findOp:
+    case churnOp: {
+        Container *container = new Container;
+        for (size_t i = 0; i < entries; i++)
+            container->insert(keys[i]);
+        std::vector<UINT_PTR> results(threads, 0);
+        runThreads(state, threads, operations, [&] (unsigned thread) {
+            size_t first = entries * thread / threads;
+            size_t count = entries * (thread + 1) / threads - first;
+            size_t threadOperations = operations / threads;
+            UINT_PTR found = 0;
+            if (params.operation == findOp) {
+                for (size_t i = 0, index = 0; i < threadOperations; i++) {
+                    found += container->find(order[first + index]);
+                    if (++index == count)
+                        index = 0;
+                }
+            }
+            else {
+                // The thread's live keys are order[first, first + count), in
+                // random order, and its spare keys follow the initial keys.
+                std::vector<UINT_PTR> live(order.begin() + first, order.begin() + first + count);
+                size_t spareFirst = entries + spares * thread / threads;
+                std::vector<UINT_PTR> spare(keys.begin() + spareFirst, keys.begin() + entries + spares * (thread + 1) / threads);
+                BenchRandom random(thread + 1);
+                for (size_t i = 0, next = 0; i < threadOperations; i++) {
+                    size_t index = (size_t)(random.next() % live.size());
+                    container->erase(live[index]);
+                    found += container->insert(spare[next]);
+                    std::swap(live[index], spare[next]);
+                    if (++next == spare.size())
+                        next = 0;
+                }
+            }
+            results[thread] = found;
+        });
+        for (unsigned t = 0; t < threads; t++)
+            result += results[t];
+        delete container;
+        break;
+    }
+    }
+    benchKeep(result);
+    state.counter("entries", (double)entries);
+    state.counter("threads", threads);
+}
+
+typedef void (*runner_t) (BenchState &state, const benchparams_t &params);
+
+struct containerentry_t {
+    const char *name;
+    runner_t    run;        // Runs a benchmark on one thread.
+    runner_t    runShared;  // Runs a benchmark on several threads.
+};
+
+// Registers every combination of container, operation, keys and size.
+class ContainerBenchRegistrar
+{
+public:
+    ContainerBenchRegistrar ()
+    {
+        static const containerentry_t containers [] = {
+            { "vld_set",   run<VldSet>,      run<Shared<VldSet> > },
+            { "vld_map",   run<VldMap>,      run<Shared<VldMap> > },
+            { "std_set",   run<StdSet>,      run<Shared<StdSet> > },
+            { "std_map",   run<StdMap>,      run<Shared<StdMap> > },
+            { "open_hash", run<OpenHashSet>, run<Shared<OpenHashSet> > },
+        };
+        static const char *operations [] = { "insert", "find", "erase", "iterate", "churn" };
+        static const char *keys [] = { "sequential", "random", "pointer" };
+        static const char *sizes [] = { "1k", "10k", "100k", "1m", "10m" };
+
+        size_t maxEntries = kDefaultMaxEntries;
+        const char *option = getenv("VLD_BENCH_MAX_ENTRIES");
+        if (option != NULL)
+            maxEntries = (size_t)strtoull(option, NULL, 10);
+
+        for (int operation = insertOp; operation <= churnOp; operation++) {
+            bool contended = (operation == findOp) || (operation == churnOp);
+            for (int key = sequentialKeys; key <= pointerKeys; key++) {
+                size_t entries = 1000;
+                for (size_t size = 0; (size < _countof(sizes)) && (entries <= maxEntries); size++, entries *= 10) {
+                    for (size_t container = 0; container < _countof(containers); container++) {
+                        std::string name = std::string(containers[container].name) + "_" + operations[operation] +
+                            "_" + keys[key] + "_" + sizes[size];
+                        benchparams_t params = { (operation_e)operation, (keys_e)key, entries, 1 };
+                        add(name, containers[container].run, params);
+                        if (contended) {
+                            params.threads = kThreadCount;
+                            add(name + "_contended", containers[container].runShared, params);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static void add (const std::string &name, runner_t runner, const benchparams_t &params)
+    {
+        benchRegister(name, [runner, params] (BenchState &state) {
+            runner(state, params);
+        });
+    }
+};
+
+ContainerBenchRegistrar s_registrar;
+
+} // namespace
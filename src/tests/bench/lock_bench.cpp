@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Lock Benchmarks
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Measures the cost of the CriticalSection which guards VLD's containers,
+// uncontended (the common case: one thread allocating), re-entered, and
+// contended by several threads, next to std::mutex as a baseline. Note that
+// glibc elides the atomic instructions of uncontended std::mutex operations
+// while the process has a single thread, which CriticalSection can't do
+// because VLD's locks are taken from every thread.
+
+#include <cassert>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bench.h"
+
+#include "criticalsection.h"
+
+namespace {
+
+const unsigned long long kIterations       = 10000000;
+const unsigned long long kThreadIterations = 1000000;
+const unsigned           kThreadCount      = 4;
+
+// Runs body(iterations) on threadCount threads at once and measures the
+// total time taken.
+template <typename Body>
+void runThreads (BenchState &state, unsigned threadCount, unsigned long long iterations, Body body)
+{
+    std::vector<std::thread> threads;
+    state.start();
+    for (unsigned t = 0; t < threadCount; t++) {
+        threads.push_back(std::thread(body, iterations));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    state.stop(threadCount * iterations);
+}
+
+} // namespace
+
+BENCHMARK(lock_enter_leave)
+{
+    CriticalSection lock;
+    lock.Initialize();
+    unsigned long long counter = 0;
+    state.start();
+    for (unsigned long long i = 0; i < kIterations; i++) {
+        CriticalSectionLocker<> cs(lock);
+        counter++;
+    }
+    state.stop(kIterations);
+    benchKeep(counter);
+    lock.Delete();
+    state.counter("bytes", (double)sizeof(CriticalSection));
+}
+
+BENCHMARK(lock_enter_leave_std_mutex)
+{
+    std::mutex lock;
+    unsigned long long counter = 0;
+    state.start();
+    for (unsigned long long i = 0; i < kIterations; i++) {
+        std::lock_guard<std::mutex> guard(lock);
+        counter++;
+    }
+    state.stop(kIterations);
+    benchKeep(counter);
+    state.counter("bytes", (double)sizeof(std::mutex));
+}
+
+BENCHMARK(lock_reenter)
+{
+    CriticalSection lock;
+    lock.Initialize();
+    lock.Enter();
+    unsigned long long counter = 0;
+    state.start();
+    for (unsigned long long i = 0; i < kIterations; i++) {
+        CriticalSectionLocker<> cs(lock);
+        counter++;
+    }
+    state.stop(kIterations);
+    lock.Leave();
+    benchKeep(counter);
+    lock.Delete();
+}
+
+BENCHMARK(lock_contended)
+{
+    CriticalSection lock;
+    lock.Initialize();
+    unsigned long long counter = 0;
+    runThreads(state, kThreadCount, kThreadIterations, [&] (unsigned long long iterations) {
+        for (unsigned long long i = 0; i < iterations; i++) {
+            CriticalSectionLocker<> cs(lock);
+            counter++;
+        }
+    });
+    assert(counter == kThreadCount * kThreadIterations);
+    benchKeep(counter);
+    lock.Delete();
+    state.counter("threads", kThreadCount);
+}
+
+BENCHMARK(lock_contended_std_mutex)
+{
+    std::mutex lock;
+    unsigned long long counter = 0;
+    runThreads(state, kThreadCount, kThreadIterations, [&] (unsigned long long iterations) {
+        for (unsigned long long i = 0; i < iterations; i++) {
+            std::lock_guard<std::mutex> guard(lock);
+            counter++;
+        }
+    });
+    benchKeep(counter);
+    state.counter("threads", kThreadCount);
+}
@@ -0,0 +1,229 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - PageMap Benchmarks
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Compares the radix PageMap used as VLD's block index with the Map used for
+// the per-heap block maps, on the operations performed by the allocation
+// hooks: insert on allocation, find and erase on free, and resolving an
+// interior pointer to the block which contains it.
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include "bench.h"
+
+#define VLDBUILD
+#include "pagemap.h"
+#include "map.h"
+
+namespace {
+
+const size_t kBlockCount      = 200000;
+const size_t kScanCount       = 2000;  // Blocks used by the (linear) Map interior pointer scan.
+const size_t kBlockMapReserve = 64;    // Same as BLOCK_MAP_RESERVE in blocktracker.cpp.
+const UINT_PTR kGranule       = (UINT_PTR)1 << PAGEMAP_GRANULE_SHIFT;
+
+struct fakeblock_t {
+    LPCVOID address;
+    SIZE_T  size;
+};
+
+// Lays out blocks the way a heap would: contiguous, granule aligned, with
+// mostly small sizes. The addresses are never dereferenced.
+std::vector<fakeblock_t> makeBlocks (size_t count)
+{
+    std::vector<fakeblock_t> blocks(count);
+    BenchRandom random;
+    UINT_PTR address = 0x10000000;
+    for (size_t i = 0; i < count; i++) {
+        SIZE_T size = 8 + (SIZE_T)(random.next() % 248);
+        blocks[i].address = (LPCVOID)address;
+        blocks[i].size = size;
+        address += (size + 2 * kGranule - 1) & ~(UINT_PTR)(kGranule - 1);
+    }
+    return blocks;
+}
+
+// Frees happen in a different order than allocations.
+std::vector<fakeblock_t> shuffled (std::vector<fakeblock_t> blocks)
+{
+    BenchRandom random(42);
+    for (size_t i = blocks.size() - 1; i > 0; i--) {
+        std::swap(blocks[i], blocks[(size_t)(random.next() % (i + 1))]);
+    }
+    return blocks;
+}
+
+typedef PageMap<const fakeblock_t*>     BlockPageMap;
+typedef Map<LPCVOID, const fakeblock_t*> BlockTreeMap;
+
+} // namespace
+
+BENCHMARK(pagemap_insert)
+{
+    std::vector<fakeblock_t> blocks = makeBlocks(kBlockCount);
+    BlockPageMap *map = new BlockPageMap;
+    state.start();
+    for (size_t i = 0; i < blocks.size(); i++) {
+        map->insert(blocks[i].address, &blocks[i]);
+    }
+    state.stop(blocks.size());
+    state.counter("bytes_per_block", (double)map->memoryUsage() / (double)map->size());
+    delete map;
+}
+
+BENCHMARK(map_insert)
+{
+    std::vector<fakeblock_t> blocks = makeBlocks(kBlockCount);
+    BlockTreeMap *map = new BlockTreeMap;
+    map->reserve(kBlockMapReserve);
+    state.start();
+    for (size_t i = 0; i < blocks.size(); i++) {
+        map->insert(blocks[i].address, &blocks[i]);
+    }
+    state.stop(blocks.size());
+    state.counter("bytes_per_block", (double)sizeof(Tree<Pair<LPCVOID, const fakeblock_t*> >::node_t));
+    delete map;
+}
+
+BENCHMARK(pagemap_find)
+{
+    std::vector<fakeblock_t> blocks = makeBlocks(kBlockCount);
+    std::vector<fakeblock_t> order = shuffled(blocks);
+    BlockPageMap *map = new BlockPageMap;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        map->insert(blocks[i].address, &blocks[i]);
+    }
+    size_t hits = 0;
+    state.start();
+    for (size_t i = 0; i < order.size(); i++) {
+        hits += (map->find(order[i].address) != NULL);
+    }
+    state.stop(order.size());
+    assert(hits == order.size());
+    benchKeep(hits);
+    delete map;
+}
+
+BENCHMARK(map_find)
+{
+    std::vector<fakeblock_t> blocks = makeBlocks(kBlockCount);
+    std::vector<fakeblock_t> order = shuffled(blocks);
+    BlockTreeMap *map = new BlockTreeMap;
+    map->reserve(kBlockMapReserve);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        map->insert(blocks[i].address, &blocks[i]);
+    }
+    size_t hits = 0;
+    state.start();
+    for (size_t i = 0; i < order.size(); i++) {
+        hits += (map->find(order[i].address) != map->end());
+    }
+    state.stop(order.size());
+    assert(hits == order.size());
+    benchKeep(hits);
+    delete map;
+}
+
+BENCHMARK(pagemap_erase)
+{
+    std::vector<fakeblock_t> blocks = makeBlocks(kBlockCount);
+    std::vector<fakeblock_t> order = shuffled(blocks);
+    BlockPageMap *map = new BlockPageMap;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        map->insert(blocks[i].address, &blocks[i]);
+    }
+    state.start();
+    for (size_t i = 0; i < order.size(); i++) {
+        map->erase(order[i].address);
+    }
+    state.stop(order.size());
+    assert(map->size() == 0);
+    delete map;
+}
+
+BENCHMARK(map_erase)
+{
+    std::vector<fakeblock_t> blocks = makeBlocks(kBlockCount);
+    std::vector<fakeblock_t> order = shuffled(blocks);
+    BlockTreeMap *map = new BlockTreeMap;
+    map->reserve(kBlockMapReserve);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        map->insert(blocks[i].address, &blocks[i]);
+    }
+    state.start();
+    for (size_t i = 0; i < order.size(); i++) {
+        map->erase(order[i].address);
+    }
+    state.stop(order.size());
+    delete map;
+}
+
+BENCHMARK(pagemap_interior)
+{
+    std::vector<fakeblock_t> blocks = makeBlocks(kBlockCount);
+    std::vector<fakeblock_t> order = shuffled(blocks);
+    BlockPageMap *map = new BlockPageMap;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        map->insert(blocks[i].address, &blocks[i]);
+    }
+    size_t hits = 0;
+    state.start();
+    for (size_t i = 0; i < order.size(); i++) {
+        LPCVOID interior = (LPCVOID)((UINT_PTR)order[i].address + order[i].size / 2);
+        LPCVOID key = NULL;
+        const fakeblock_t *block = map->findPreceding(interior, 64 * 1024, &key);
+        hits += ((block != NULL) && (key == order[i].address));
+    }
+    state.stop(order.size());
+    assert(hits == order.size());
+    benchKeep(hits);
+    delete map;
+}
+
+// Without an ordered lookup, VLD resolves an interior pointer by scanning
+// every block of every heap. This is what the radix map replaces.
+BENCHMARK(map_interior_scan)
+{
+    std::vector<fakeblock_t> blocks = makeBlocks(kScanCount);
+    std::vector<fakeblock_t> order = shuffled(blocks);
+    BlockTreeMap *map = new BlockTreeMap;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        map->insert(blocks[i].address, &blocks[i]);
+    }
+    size_t hits = 0;
+    state.start();
+    for (size_t i = 0; i < order.size(); i++) {
+        UINT_PTR interior = (UINT_PTR)order[i].address + order[i].size / 2;
+        for (BlockTreeMap::Iterator it = map->begin(); it != map->end(); ++it) {
+            UINT_PTR start = (UINT_PTR)(*it).first;
+            if ((interior >= start) && (interior < start + (*it).second->size)) {
+                hits++;
+                break;
+            }
+        }
+    }
+    state.stop(order.size());
+    assert(hits == order.size());
+    benchKeep(hits);
+    delete map;
+}
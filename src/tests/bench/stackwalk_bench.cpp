@@ -0,0 +1,124 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Stack Walk Benchmarks
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Measures the cost of capturing a call stack with each of the Linux stack
+// walkers, at several stack depths, in ns per captured frame. The walks start
+// at the bottom of a chain of recursive calls, like they start in the
+// allocation hooks. This file must be compiled with -fno-omit-frame-pointer,
+// otherwise the frame pointer walk ends at the first frame.
+
+#ifndef _WIN32
+
+#include "bench.h"
+
+#include "linux/stackwalk.h"
+
+namespace {
+
+const unsigned long long kCaptures  = 200000;
+const UINT32             kMaxFrames = 256;
+
+enum walker_e {
+    framePointers,
+    unwindTables
+};
+
+struct walkstate_t {
+    walker_e    walker;
+    BenchState *bench;
+    UINT32      frames;  // Frames captured by the last walk.
+};
+
+__declspec(noinline) void measure (walkstate_t &state)
+{
+    UINT_PTR frames [kMaxFrames];
+    UINT32   count = 0;
+    state.bench->start();
+    for (unsigned long long i = 0; i < kCaptures; i++) {
+        if (state.walker == framePointers) {
+            count = WalkFramePointers((UINT_PTR)__builtin_frame_address(0), frames, kMaxFrames);
+        }
+        else {
+            count = WalkUnwindTables((UINT_PTR)__builtin_return_address(0), frames, kMaxFrames);
+        }
+    }
+    state.bench->stop(kCaptures);
+    benchKeep(frames[0]);
+    state.frames = count;
+}
+
+// Adds "depth" frames to the stack, then measures the walker.
+__declspec(noinline) UINT32 recurse (walkstate_t &state, UINT32 depth)
+{
+    if (depth == 0) {
+        measure(state);
+        return state.frames;
+    }
+    UINT32 frames = recurse(state, depth - 1);
+    // Prevents the recursion from being turned into a loop.
+    benchKeep(depth);
+    return frames;
+}
+
+void runWalker (BenchState &state, walker_e walker, UINT32 depth)
+{
+    walkstate_t walk = { walker, &state, 0 };
+    recurse(walk, depth);
+    double nanoseconds = (double)state.nanoseconds() / (double)kCaptures;
+    state.counter("frames", walk.frames);
+    state.counter("ns/frame", (walk.frames != 0) ? nanoseconds / walk.frames : 0.0);
+}
+
+} // namespace
+
+BENCHMARK(stackwalk_framepointers_8)
+{
+    runWalker(state, framePointers, 8);
+}
+
+BENCHMARK(stackwalk_framepointers_32)
+{
+    runWalker(state, framePointers, 32);
+}
+
+BENCHMARK(stackwalk_framepointers_64)
+{
+    runWalker(state, framePointers, 64);
+}
+
+BENCHMARK(stackwalk_unwind_8)
+{
+    runWalker(state, unwindTables, 8);
+}
+
+BENCHMARK(stackwalk_unwind_32)
+{
+    runWalker(state, unwindTables, 32);
+}
+
+BENCHMARK(stackwalk_unwind_64)
+{
+    runWalker(state, unwindTables, 64);
+}
+
+#endif // _WIN32
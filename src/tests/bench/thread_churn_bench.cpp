@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Thread Churn Benchmark
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Measures the cost of many short-lived threads entering VLD, in the way a
+// server's thread pool churns threads. Usage:
+//
+//   thread_churn_bench [threads]
+//
+// The benchmark runs the churn in a child process, then reports the time per
+// thread, the child's private memory once all threads have exited, and how
+// long the child took to exit (which includes VLD's shutdown and leak report).
+
+#include <windows.h>
+#include <psapi.h>
+#include <cstdlib>
+#include <cstdio>
+#include <vld.h>
+#include "bench.h"
+
+#pragma comment(lib, "psapi.lib")
+
+#define CHURN_DEFAULT_THREADS   100000
+#define CHURN_BATCH             64      // Threads alive at the same time.
+
+static DWORD WINAPI churnThread (LPVOID)
+{
+    // Enter VLD's allocation hooks once, like a pool task would.
+    void *block = malloc(64);
+    free(block);
+    return 0;
+}
+
+static int runChild (UINT32 threads)
+{
+    BenchState state;
+    HANDLE batch [CHURN_BATCH];
+
+    state.start();
+    for (UINT32 created = 0; created < threads; ) {
+        UINT32 count = 0;
+        while ((count < CHURN_BATCH) && (created < threads)) {
+            batch[count] = CreateThread(NULL, 0, churnThread, NULL, 0, NULL);
+            if (batch[count] == NULL) {
+                fprintf(stderr, "CreateThread failed (error=%lu).\n", GetLastError());
+                return EXIT_FAILURE;
+            }
+            count++;
+            created++;
+        }
+        WaitForMultipleObjects(count, batch, TRUE, INFINITE);
+        for (UINT32 index = 0; index < count; index++) {
+            CloseHandle(batch[index]);
+        }
+    }
+    state.stop(threads);
+
+    PROCESS_MEMORY_COUNTERS_EX memory = { 0 };
+    memory.cb = sizeof(memory);
+    GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&memory, sizeof(memory));
+
+    // Hand the results and the time at which main returns to the parent.
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    printf("%llu %llu %llu\n", state.nanoseconds(), (unsigned long long)memory.PrivateUsage,
+        (unsigned long long)now.QuadPart);
+    fflush(stdout);
+    return EXIT_SUCCESS;
+}
+
+int main (int argc, char *argv [])
+{
+    if ((argc > 2) && (strcmp(argv[1], "--child") == 0)) {
+        return runChild((UINT32)strtoul(argv[2], NULL, 10));
+    }
+
+    UINT32 threads = (argc > 1) ? (UINT32)strtoul(argv[1], NULL, 10) : CHURN_DEFAULT_THREADS;
+
+    // Run the churn in a child process, reading its results through a pipe.
+    SECURITY_ATTRIBUTES security = { sizeof(security), NULL, TRUE };
+    HANDLE readPipe, writePipe;
+    if (!CreatePipe(&readPipe, &writePipe, &security, 0)) {
+        return EXIT_FAILURE;
+    }
+    SetHandleInformation(readPipe, HANDLE_FLAG_INHERIT, 0);
+
+    char path [MAX_PATH];
+    GetModuleFileNameA(NULL, path, MAX_PATH);
+    char commandLine [MAX_PATH + 64];
+    sprintf_s(commandLine, "\"%s\" --child %u", path, threads);
+
+    STARTUPINFOA startupInfo = { sizeof(startupInfo) };
+    startupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startupInfo.hStdOutput = writePipe;
+    startupInfo.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+    startupInfo.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    PROCESS_INFORMATION processInformation = { 0 };
+    if (!CreateProcessA(NULL, commandLine, NULL, NULL, TRUE, 0, NULL, NULL, &startupInfo, &processInformation)) {
+        return EXIT_FAILURE;
+    }
+    CloseHandle(writePipe);
+
+    // The child's output is small enough to fit in the pipe's buffer, so it
+    // can be read after the child has exited.
+    WaitForSingleObject(processInformation.hProcess, INFINITE);
+    LARGE_INTEGER exited, frequency;
+    QueryPerformanceCounter(&exited);
+    QueryPerformanceFrequency(&frequency);
+
+    char output [256] = { 0 };
+    DWORD read = 0;
+    ReadFile(readPipe, output, sizeof(output) - 1, &read, NULL);
+    CloseHandle(readPipe);
+    CloseHandle(processInformation.hThread);
+    CloseHandle(processInformation.hProcess);
+
+    unsigned long long nanoseconds = 0, privateBytes = 0, returned = 0;
+    if (sscanf_s(output, "%llu %llu %llu", &nanoseconds, &privateBytes, &returned) != 3) {
+        fprintf(stderr, "The child process failed.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("# benchmark\toperations\tns/op\tcounters\n");
+    printf("thread_churn\t%u\t%.2f\tprivate_mb=%.2f\texit_ms=%.2f\n", threads,
+        (double)nanoseconds / threads, (double)privateBytes / (1024.0 * 1024.0),
+        (double)(exited.QuadPart - (LONGLONG)returned) * 1000.0 / (double)frequency.QuadPart);
+    return EXIT_SUCCESS;
+}
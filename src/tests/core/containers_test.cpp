@@ -0,0 +1,196 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Container Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Tests of the Tree, Map and Set templates.
+
+#include <algorithm>
+#include <set>
+#include <vector>
+#include <gtest/gtest.h>
+
+#define VLDBUILD
+#include "map.h"
+#include "set.h"
+
+namespace {
+
+const size_t kEntries = 5000;
+
+// The keys 0 to kEntries - 1, shuffled with a fixed seed.
+std::vector<size_t> shuffledKeys ()
+{
+    std::vector<size_t> keys;
+    for (size_t key = 0; key < kEntries; key++)
+        keys.push_back(key);
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    for (size_t index = keys.size() - 1; index > 0; index--) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        std::swap(keys[index], keys[state % (index + 1)]);
+    }
+    return keys;
+}
+
+template <typename Tk>
+size_t countEntries (const Set<Tk> &set)
+{
+    size_t count = 0;
+    for (typename Set<Tk>::Iterator it = set.begin(); it != set.end(); ++it)
+        count++;
+    return count;
+}
+
+} // namespace
+
+TEST(SetTest, IteratesInOrder)
+{
+    Set<size_t> set;
+    std::vector<size_t> keys = shuffledKeys();
+    for (size_t index = 0; index < keys.size(); index++)
+        ASSERT_TRUE(set.insert(keys[index]) != set.end());
+
+    size_t expected = 0;
+    for (Set<size_t>::Iterator it = set.begin(); it != set.end(); ++it)
+        ASSERT_EQ(expected++, *it);
+    EXPECT_EQ(kEntries, expected);
+
+    // Backwards too.
+    Set<size_t>::Iterator it = set.find(kEntries - 1);
+    for (size_t key = kEntries - 1; key > 0; key--) {
+        ASSERT_TRUE(it != set.end());
+        ASSERT_EQ(key, *it);
+        it = it - 1;
+    }
+    EXPECT_TRUE(it == set.begin());
+    EXPECT_TRUE(it - 1 == set.end());
+}
+
+TEST(SetTest, RejectsDuplicates)
+{
+    Set<int> set;
+    EXPECT_TRUE(set.insert(42) != set.end());
+    EXPECT_TRUE(set.insert(42) == set.end());
+    EXPECT_EQ(1u, countEntries(set));
+}
+
+TEST(SetTest, FindsAndErases)
+{
+    Set<size_t> set;
+    set.reserve(64);
+    std::vector<size_t> keys = shuffledKeys();
+    for (size_t index = 0; index < keys.size(); index++)
+        set.insert(keys[index]);
+
+    // Erase the odd keys, half by key and half by iterator.
+    for (size_t index = 0; index < keys.size(); index++) {
+        size_t key = keys[index];
+        if ((key % 2) == 0)
+            continue;
+        if ((key % 4) == 1) {
+            set.erase(key);
+        }
+        else {
+            Set<size_t>::Iterator it = set.find(key);
+            ASSERT_TRUE(it != set.end());
+            set.erase(it);
+        }
+    }
+
+    for (size_t key = 0; key < kEntries; key++) {
+        Set<size_t>::Iterator it = set.find(key);
+        if ((key % 2) == 0) {
+            ASSERT_TRUE(it != set.end());
+            EXPECT_EQ(key, *it);
+        }
+        else {
+            ASSERT_TRUE(it == set.end());
+        }
+    }
+    EXPECT_EQ(kEntries / 2, countEntries(set));
+
+    // The freed nodes are reused.
+    for (size_t key = 1; key < kEntries; key += 2)
+        ASSERT_TRUE(set.insert(key) != set.end());
+    EXPECT_EQ(kEntries, countEntries(set));
+}
+
+TEST(SetTest, MatchesStdSetUnderChurn)
+{
+    Set<UINT_PTR> set;
+    std::set<UINT_PTR> reference;
+    unsigned long long state = 12345;
+    for (size_t step = 0; step < 20000; step++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        UINT_PTR key = (UINT_PTR)(state % 1024) * 16;
+        if ((state >> 32) % 3 == 0) {
+            set.erase(key);
+            reference.erase(key);
+        }
+        else {
+            bool inserted = reference.insert(key).second;
+            ASSERT_EQ(inserted, set.insert(key) != set.end());
+        }
+    }
+
+    std::set<UINT_PTR>::const_iterator expected = reference.begin();
+    for (Set<UINT_PTR>::Iterator it = set.begin(); it != set.end(); ++it, ++expected) {
+        ASSERT_TRUE(expected != reference.end());
+        ASSERT_EQ(*expected, *it);
+    }
+    EXPECT_TRUE(expected == reference.end());
+}
+
+TEST(MapTest, MapsKeysToValues)
+{
+    Map<LPCVOID, size_t> map;
+    map.reserve(64);
+    std::vector<size_t> keys = shuffledKeys();
+    for (size_t index = 0; index < keys.size(); index++) {
+        LPCVOID block = (LPCVOID)((keys[index] + 1) * MEMORY_ALLOCATION_ALIGNMENT);
+        ASSERT_TRUE(map.insert(block, keys[index] * 3) != map.end());
+    }
+
+    // A second insert of a key fails, and keeps the first value.
+    EXPECT_TRUE(map.insert((LPCVOID)MEMORY_ALLOCATION_ALIGNMENT, 7) == map.end());
+
+    size_t count = 0;
+    LPCVOID previous = NULL;
+    for (Map<LPCVOID, size_t>::Iterator it = map.begin(); it != map.end(); ++it, count++) {
+        EXPECT_LT(previous, (*it).first);
+        EXPECT_EQ(((UINT_PTR)(*it).first / MEMORY_ALLOCATION_ALIGNMENT - 1) * 3, (*it).second);
+        previous = (*it).first;
+    }
+    EXPECT_EQ(kEntries, count);
+
+    Map<LPCVOID, size_t>::Iterator it = map.find((LPCVOID)(10 * MEMORY_ALLOCATION_ALIGNMENT));
+    ASSERT_TRUE(it != map.end());
+    EXPECT_EQ(27u, (*it).second);
+    map.erase(it);
+    EXPECT_TRUE(map.find((LPCVOID)(10 * MEMORY_ALLOCATION_ALIGNMENT)) == map.end());
+    map.erase((LPCVOID)(11 * MEMORY_ALLOCATION_ALIGNMENT));
+    EXPECT_TRUE(map.find((LPCVOID)(11 * MEMORY_ALLOCATION_ALIGNMENT)) == map.end());
+    EXPECT_TRUE(map.find((LPCVOID)(12 * MEMORY_ALLOCATION_ALIGNMENT)) != map.end());
+}
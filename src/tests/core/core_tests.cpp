@@ -0,0 +1,57 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Tracking Core Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Unit tests of VLD's tracking core: the containers (tree.h, map.h, set.h),
+// the page map, the CallStack storage and the StackTable, the statistics, the
+// futex lock, the ELF symbol tables, the DWARF line tables and the report
+// formatting. They are built by the CMake build, against the
+// vld_core library, and run with ctest or directly (vld_core_tests
+// [--gtest_filter=...]).
+//
+// The core allocates its internal blocks with the "new" macro of vldheap.h.
+// In libvld.so they come from the C library's allocator, through the real
+// functions (see linux/vldheap.cpp); here, they come from the global
+// operators.
+
+#include <cstddef>
+#include <new>
+
+void* operator new (size_t size, const char *, int)
+{
+    return ::operator new(size);
+}
+
+void* operator new [] (size_t size, const char *, int)
+{
+    return ::operator new [] (size);
+}
+
+void operator delete (void *block, const char *, int)
+{
+    ::operator delete(block);
+}
+
+void operator delete [] (void *block, const char *, int)
+{
+    ::operator delete [] (block);
+}
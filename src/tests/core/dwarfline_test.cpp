@@ -0,0 +1,180 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - DWARF Line Table Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Tests of the DWARF line tables, on fixture libraries built from the same
+// three sources with DWARF 4 and with DWARF 5 (see fixtures/lines_*.cpp): two
+// compilation units with line information, and one without between them.
+
+#include <cstring>
+#include <dlfcn.h>
+#include <gtest/gtest.h>
+
+#define VLDBUILD
+#include "linux/dwarfline.h"
+
+namespace {
+
+struct fixture_t {
+    const char *path;     // The fixture library.
+    UINT16      version;  // DWARF version of its line tables.
+};
+
+const fixture_t kFixtures [] = {
+    { VLD_FIXTURE_LINES4, 4 },
+    { VLD_FIXTURE_LINES5, 5 },
+};
+
+typedef int (*linefunction_t) ();
+
+class LineTableTest : public ::testing::TestWithParam<fixture_t>
+{
+protected:
+    virtual void SetUp ()
+    {
+        m_handle = dlopen(GetParam().path, RTLD_NOW | RTLD_LOCAL);
+        ASSERT_TRUE(m_handle != NULL) << dlerror();
+        Dl_info info;
+        ASSERT_NE(0, dladdr(dlsym(m_handle, "fixture_second"), &info));
+        m_base = (UINT_PTR)info.dli_fbase;
+        ASSERT_TRUE(m_file.open(GetParam().path));
+        ASSERT_TRUE(m_table.load(m_file));
+    }
+
+    virtual void TearDown ()
+    {
+        m_table.clear();
+        m_file.close();
+        if (m_handle != NULL)
+            dlclose(m_handle);
+    }
+
+    // Address of one of the fixture's symbols, relative to its load address.
+    UINT_PTR offsetOf (const char *name)
+    {
+        void *symbol = dlsym(m_handle, name);
+        EXPECT_TRUE(symbol != NULL) << name;
+        return (UINT_PTR)symbol - m_base;
+    }
+
+    // The line of one of the fixture's functions, which returns it.
+    int lineOf (const char *name)
+    {
+        linefunction_t function = (linefunction_t)dlsym(m_handle, name);
+        EXPECT_TRUE(function != NULL) << name;
+        return (function != NULL) ? function() : 0;
+    }
+
+    void      *m_handle;
+    UINT_PTR   m_base;
+    ElfFile    m_file;
+    LineTable  m_table;
+};
+
+// Returns true if a path names the given source file.
+bool isFile (LPCSTR path, const char *name)
+{
+    SIZE_T length = strlen(path);
+    SIZE_T nameLength = strlen(name);
+    return (length >= nameLength) && (strcmp(path + length - nameLength, name) == 0) &&
+        ((length == nameLength) || (path[length - nameLength - 1] == '/'));
+}
+
+} // namespace
+
+TEST_P(LineTableTest, ReadsTheFixtureVersion)
+{
+    // Both units' line programs have the version the fixture was built with.
+    elfsection_t lines;
+    ASSERT_TRUE(m_file.findSection(".debug_line", lines));
+    UINT32 units = 0;
+    for (SIZE_T offset = 0; offset + 6 <= lines.size; units++) {
+        UINT32 length;
+        UINT16 version;
+        memcpy(&length, lines.data + offset, sizeof(length));
+        memcpy(&version, lines.data + offset + 4, sizeof(version));
+        ASSERT_LT(length, 0xFFFFFFF0u);
+        EXPECT_EQ(GetParam().version, version);
+        offset += 4 + length;
+    }
+    EXPECT_EQ(2u, units);
+}
+
+TEST_P(LineTableTest, FindsLinesAtKnownAddresses)
+{
+    UINT_PTR first = offsetOf("fixture_first_a");
+    UINT_PTR next = offsetOf("fixture_first_b");
+    ASSERT_LT(first + 1, next);
+
+    lineinfo_t info;
+    ASSERT_TRUE(m_table.find(first, info));
+    EXPECT_PRED2(isFile, info.file, "lines_first.cpp");
+    EXPECT_EQ(lineOf("fixture_first_a"), (int)info.line);
+    EXPECT_EQ(0u, info.displacement);
+
+    ASSERT_TRUE(m_table.find(first + 1, info));
+    EXPECT_EQ(lineOf("fixture_first_a"), (int)info.line);
+    EXPECT_EQ(1u, info.displacement);
+
+    // The row of the next function starts at its first instruction.
+    ASSERT_TRUE(m_table.find(next - 1, info));
+    EXPECT_EQ(lineOf("fixture_first_a"), (int)info.line);
+    ASSERT_TRUE(m_table.find(next, info));
+    EXPECT_EQ(lineOf("fixture_first_b"), (int)info.line);
+    EXPECT_EQ(0u, info.displacement);
+
+    ASSERT_TRUE(m_table.find(offsetOf("fixture_second") + 2, info));
+    EXPECT_PRED2(isFile, info.file, "lines_second.cpp");
+    EXPECT_EQ(lineOf("fixture_second"), (int)info.line);
+}
+
+TEST_P(LineTableTest, StopsAtUnitBoundaries)
+{
+    // The first unit's sequence ends where its code does; the unit without
+    // line information follows, and is not attributed to the last row before
+    // it.
+    UINT_PTR end = offsetOf("fixture_first_end");
+    UINT_PTR nodebug = offsetOf("fixture_nodebug");
+    UINT_PTR second = offsetOf("fixture_second");
+    ASSERT_LE(end, nodebug);
+    ASSERT_LT(nodebug, second);
+
+    lineinfo_t info;
+    ASSERT_TRUE(m_table.find(end - 1, info));
+    EXPECT_PRED2(isFile, info.file, "lines_first.cpp");
+    EXPECT_EQ(lineOf("fixture_first_b"), (int)info.line);
+    EXPECT_FALSE(m_table.find(end, info));
+    EXPECT_FALSE(m_table.find(nodebug, info));
+    EXPECT_FALSE(m_table.find(second - 1, info));
+
+    // The next unit starts with its own file.
+    ASSERT_TRUE(m_table.find(second, info));
+    EXPECT_PRED2(isFile, info.file, "lines_second.cpp");
+    EXPECT_EQ(0u, info.displacement);
+
+    // Nothing before the first sequence.
+    EXPECT_FALSE(m_table.find(0, info));
+    EXPECT_FALSE(m_table.find(offsetOf("fixture_first_a") - 1, info));
+}
+
+INSTANTIATE_TEST_CASE_P(Versions, LineTableTest, ::testing::ValuesIn(kFixtures));
@@ -0,0 +1,38 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Line Table Test Fixture, First Unit
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+// The first compilation unit of the line table fixtures (see
+// dwarfline_test.cpp). Each function is on a single line, and returns its
+// line number. The fixtures are built without optimization, so the functions
+// and the label which ends the unit's code are emitted in order.
+
+extern "C" int fixture_first_a () { return __LINE__; }
+extern "C" int fixture_first_b () { return __LINE__; }
+
+// The end of the unit's code, where its line sequence ends.
+__asm__ (
+    "    .text\n"
+    "    .globl fixture_first_end\n"
+    "fixture_first_end:\n"
+);
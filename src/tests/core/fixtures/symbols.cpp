@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Symbol Table Test Fixture
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+// A shared library whose only purpose is its symbol table, read by the tests
+// of the SymbolTable and the Symbolizer (symbolizer_test.cpp). The functions
+// are laid out by hand, so that the tests know their sizes and the gaps
+// between them; they are never called.
+//
+//   offset  symbol                           binding  size
+//   0       fixture_sized                    global   16
+//   0       fixture_weak_alias               weak     16
+//   16      (no symbol)
+//   32      fixture_unsized                  global   0 (32 bytes of code)
+//   64      fixture_local                    local    16
+//   80      _ZN7fixture7mangledEi            global   16
+//   96      fixture_last                     global   16
+//
+// The stripped copy of the library only has the dynamic symbols: the local
+// one is gone.
+
+#define FIXTURE_FUNCTION(name, binding)         \
+    "    ." binding " " name "\n"               \
+    "    .type " name ", @function\n"           \
+    name ":\n"
+
+__asm__ (
+    "    .text\n"
+    "    .p2align 4\n"
+    "    .weak fixture_weak_alias\n"
+    "    .type fixture_weak_alias, @function\n"
+    "    .set fixture_weak_alias, fixture_sized\n"
+    "    .size fixture_weak_alias, 16\n"
+    FIXTURE_FUNCTION("fixture_sized", "globl")
+    "    .fill 16, 1, 0\n"
+    "    .size fixture_sized, 16\n"
+    "    .fill 16, 1, 0\n"
+    FIXTURE_FUNCTION("fixture_unsized", "globl")
+    "    .fill 32, 1, 0\n"
+    FIXTURE_FUNCTION("fixture_local", "local")
+    "    .fill 16, 1, 0\n"
+    "    .size fixture_local, 16\n"
+    FIXTURE_FUNCTION("_ZN7fixture7mangledEi", "globl")
+    "    .fill 16, 1, 0\n"
+    "    .size _ZN7fixture7mangledEi, 16\n"
+    FIXTURE_FUNCTION("fixture_last", "globl")
+    "    .fill 16, 1, 0\n"
+    "    .size fixture_last, 16\n"
+);
@@ -0,0 +1,181 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Futex Lock Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Tests of the Linux futex lock: recursion, TryEnter, the waiters flag and
+// the wake-up of contended threads.
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#define VLDBUILD
+#include "linux/futexlock.h"
+
+namespace {
+
+const UINT32 kWaiters = 0x80000000;
+
+// The lock's single word, read as the futex syscall sees it.
+UINT32 wordOf (const FutexLock &lock)
+{
+    return __atomic_load_n((const UINT32*)&lock, __ATOMIC_ACQUIRE);
+}
+
+// Returns true once the waiters flag is set, or false if it isn't set within
+// a few seconds.
+bool waitForWaiters (const FutexLock &lock)
+{
+    for (int poll = 0; poll < 5000; poll++) {
+        if ((wordOf(lock) & kWaiters) != 0)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+} // namespace
+
+TEST(FutexLockTest, CountsRecursion)
+{
+    FutexLock lock;
+    lock.Initialize();
+    EXPECT_FALSE(lock.IsLocked());
+
+    for (int depth = 0; depth < 3; depth++)
+        lock.Enter();
+    EXPECT_TRUE(lock.IsLocked());
+    EXPECT_TRUE(lock.IsLockedByCurrentThread());
+    EXPECT_EQ((UINT32)GetCurrentThreadId(), wordOf(lock) & 0x003FFFFF);
+
+    // The lock is held until the last Leave.
+    lock.Leave();
+    lock.Leave();
+    EXPECT_TRUE(lock.IsLockedByCurrentThread());
+    lock.Leave();
+    EXPECT_FALSE(lock.IsLocked());
+    EXPECT_EQ(0u, wordOf(lock));
+    lock.Delete();
+}
+
+TEST(FutexLockTest, TryEnterFailsForOtherThreads)
+{
+    FutexLock lock;
+    lock.Initialize();
+    ASSERT_TRUE(lock.TryEnter());
+    EXPECT_TRUE(lock.TryEnter());
+
+    bool acquired = true;
+    bool owned = true;
+    std::thread([&] {
+        acquired = lock.TryEnter();
+        owned = lock.IsLockedByCurrentThread();
+    }).join();
+    EXPECT_FALSE(acquired);
+    EXPECT_FALSE(owned);
+
+    lock.Leave();
+    lock.Leave();
+    std::thread([&] {
+        acquired = lock.TryEnter();
+        if (acquired)
+            lock.Leave();
+    }).join();
+    EXPECT_TRUE(acquired);
+    EXPECT_EQ(0u, wordOf(lock));
+}
+
+TEST(FutexLockTest, StopsAtTheRecursionLimit)
+{
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    FutexLock lock;
+    lock.Initialize();
+    lock.Enter();
+    for (UINT32 depth = 0; depth < FutexLock::MAX_RECURSION; depth++)
+        ASSERT_TRUE(lock.TryEnter());
+
+    // The count is full: TryEnter fails without touching the waiters flag,
+    // and Enter stops the process, even when asserts are compiled out.
+    EXPECT_FALSE(lock.TryEnter());
+    EXPECT_EQ(0u, wordOf(lock) & kWaiters);
+    EXPECT_DEATH(lock.Enter(), "re-entered too many times");
+
+    for (UINT32 depth = 0; depth <= FutexLock::MAX_RECURSION; depth++)
+        lock.Leave();
+    EXPECT_EQ(0u, wordOf(lock));
+}
+
+TEST(FutexLockTest, WakesASleepingWaiter)
+{
+    FutexLock lock;
+    lock.Initialize();
+    lock.Enter();
+
+    // The other thread spins, then sets the waiters flag and sleeps.
+    bool entered = false;
+    std::thread waiter([&] {
+        lock.Enter();
+        entered = true;
+        lock.Leave();
+    });
+    ASSERT_TRUE(waitForWaiters(lock));
+    EXPECT_FALSE(__atomic_load_n(&entered, __ATOMIC_ACQUIRE));
+
+    // Leaving with the flag set wakes it; it takes the lock with the flag
+    // still set, and clears the word when it leaves.
+    lock.Leave();
+    waiter.join();
+    EXPECT_TRUE(entered);
+    EXPECT_EQ(0u, wordOf(lock));
+}
+
+TEST(FutexLockTest, SerializesContendedThreads)
+{
+    // The threads hold the lock long enough to make some of them sleep. A
+    // lost wake-up hangs the test; a broken exclusion loses increments.
+    const int kThreads = 8;
+    const int kRounds = 20000;
+    FutexLock lock;
+    lock.Initialize();
+    volatile long counter = 0;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < kThreads; thread++) {
+        threads.push_back(std::thread([&] {
+            for (int round = 0; round < kRounds; round++) {
+                lock.Enter();
+                lock.Enter();
+                long value = counter;
+                if ((round % 64) == 0)
+                    std::this_thread::yield();
+                counter = value + 1;
+                lock.Leave();
+                lock.Leave();
+            }
+        }));
+    }
+    for (size_t thread = 0; thread < threads.size(); thread++)
+        threads[thread].join();
+
+    EXPECT_EQ((long)kThreads * kRounds, counter);
+    EXPECT_EQ(0u, wordOf(lock));
+}
@@ -0,0 +1,194 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Page Map Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Tests of the PageMap template, across the boundaries of its pages, leaves
+// and interior nodes.
+
+#include <map>
+#include <gtest/gtest.h>
+
+#define VLDBUILD
+#include "pagemap.h"
+
+namespace {
+
+typedef PageMap<void*> TestMap;
+
+const UINT_PTR kGranule  = (UINT_PTR)1 << PAGEMAP_GRANULE_SHIFT;
+const UINT_PTR kPage     = TestMap::kPageSize;
+const UINT_PTR kLeafSpan = kPage * TestMap::kLeafLength;   // Address space covered by one leaf.
+const UINT_PTR kNodeSpan = kLeafSpan * TestMap::kNodeLength; // Address space covered by one interior node.
+const UINT_PTR kTop      = (((UINT_PTR)1 << TestMap::kPageBits) << PAGEMAP_PAGE_SHIFT) - kGranule; // Highest mappable address.
+
+// The value mapped to an address by the tests: never NULL, and different for
+// every address.
+void* valueOf (UINT_PTR address)
+{
+    return (void*)(address + 1);
+}
+
+} // namespace
+
+TEST(PageMapTest, MapsAddressesAcrossBoundaries)
+{
+    // Pairs of addresses on both sides of a page, a leaf and a node boundary,
+    // and the lowest and highest mappable addresses.
+    const UINT_PTR addresses [] = {
+        0, kGranule,
+        kPage - kGranule, kPage,
+        kLeafSpan - kGranule, kLeafSpan,
+        kNodeSpan - kGranule, kNodeSpan,
+        kTop - kPage, kTop,
+    };
+    const size_t count = sizeof(addresses) / sizeof(addresses[0]);
+
+    TestMap map;
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_TRUE(map.insert((LPCVOID)addresses[i], valueOf(addresses[i])));
+    }
+    EXPECT_EQ(count, map.size());
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(valueOf(addresses[i]), map.find((LPCVOID)addresses[i]));
+    }
+
+    // The neighbours of the mapped addresses are not mapped.
+    EXPECT_EQ(NULL, map.find((LPCVOID)(kPage + kGranule)));
+    EXPECT_EQ(NULL, map.find((LPCVOID)(kLeafSpan - 2 * kGranule)));
+    EXPECT_EQ(NULL, map.find((LPCVOID)(kNodeSpan + kPage)));
+
+    // A second insert fails, and keeps the first value.
+    EXPECT_FALSE(map.insert((LPCVOID)kPage, valueOf(0)));
+    EXPECT_EQ(valueOf(kPage), map.find((LPCVOID)kPage));
+
+    // Erasing one side of a boundary leaves the other side mapped.
+    EXPECT_EQ(valueOf(kLeafSpan), map.erase((LPCVOID)kLeafSpan));
+    EXPECT_EQ(NULL, map.find((LPCVOID)kLeafSpan));
+    EXPECT_EQ(valueOf(kLeafSpan - kGranule), map.find((LPCVOID)(kLeafSpan - kGranule)));
+    EXPECT_EQ(NULL, map.erase((LPCVOID)kLeafSpan));
+    EXPECT_EQ(count - 1, map.size());
+
+    // An erased address can be mapped again.
+    EXPECT_TRUE(map.insert((LPCVOID)kLeafSpan, valueOf(kLeafSpan)));
+    EXPECT_EQ(count, map.size());
+}
+
+TEST(PageMapTest, RejectsUnmappableAddresses)
+{
+    TestMap map;
+    EXPECT_FALSE(TestMap::isMappable((LPCVOID)(kPage + 1)));
+    EXPECT_FALSE(TestMap::isMappable((LPCVOID)(kTop + kGranule)));
+    EXPECT_TRUE(TestMap::isMappable((LPCVOID)kTop));
+
+    EXPECT_FALSE(map.insert((LPCVOID)(kPage + 1), valueOf(kPage)));
+    EXPECT_FALSE(map.insert((LPCVOID)(kTop + kGranule), valueOf(kTop)));
+    EXPECT_EQ(0u, map.size());
+    EXPECT_EQ(NULL, map.find((LPCVOID)(kPage + 1)));
+    EXPECT_EQ(NULL, map.erase((LPCVOID)(kTop + kGranule)));
+}
+
+TEST(PageMapTest, FindsPrecedingAcrossBoundaries)
+{
+    TestMap map;
+    LPCVOID key = NULL;
+
+    // Nothing is mapped yet.
+    EXPECT_EQ(NULL, map.findPreceding((LPCVOID)kNodeSpan, kNodeSpan, &key));
+
+    // An interior pointer resolves to the block which contains it, in the
+    // same page or in a following one.
+    ASSERT_TRUE(map.insert((LPCVOID)(kPage - kGranule), valueOf(kPage - kGranule)));
+    EXPECT_EQ(valueOf(kPage - kGranule), map.findPreceding((LPCVOID)(kPage - 1), kPage, &key));
+    EXPECT_EQ((LPCVOID)(kPage - kGranule), key);
+    EXPECT_EQ(valueOf(kPage - kGranule), map.findPreceding((LPCVOID)(3 * kPage + 8), 3 * kPage, &key));
+    EXPECT_EQ((LPCVOID)(kPage - kGranule), key);
+
+    // The search stops at the maximum distance.
+    EXPECT_EQ(NULL, map.findPreceding((LPCVOID)(3 * kPage + 8), 2 * kPage, &key));
+
+    // The search crosses leaves and interior nodes which are not populated.
+    EXPECT_EQ(valueOf(kPage - kGranule), map.findPreceding((LPCVOID)(kLeafSpan + 8), kLeafSpan, NULL));
+    EXPECT_EQ(valueOf(kPage - kGranule), map.findPreceding((LPCVOID)(2 * kNodeSpan), 2 * kNodeSpan, &key));
+    EXPECT_EQ((LPCVOID)(kPage - kGranule), key);
+
+    // ... and the populated ones.
+    ASSERT_TRUE(map.insert((LPCVOID)(kLeafSpan - kGranule), valueOf(kLeafSpan - kGranule)));
+    ASSERT_TRUE(map.insert((LPCVOID)kNodeSpan, valueOf(kNodeSpan)));
+    EXPECT_EQ(valueOf(kLeafSpan - kGranule), map.findPreceding((LPCVOID)(kLeafSpan + kPage), kNodeSpan, &key));
+    EXPECT_EQ((LPCVOID)(kLeafSpan - kGranule), key);
+    EXPECT_EQ(valueOf(kLeafSpan - kGranule), map.findPreceding((LPCVOID)(kNodeSpan - 1), kNodeSpan, &key));
+    EXPECT_EQ(valueOf(kNodeSpan), map.findPreceding((LPCVOID)kNodeSpan, 0, &key));
+    EXPECT_EQ((LPCVOID)kNodeSpan, key);
+
+    // Erased blocks are skipped.
+    EXPECT_EQ(valueOf(kLeafSpan - kGranule), map.erase((LPCVOID)(kLeafSpan - kGranule)));
+    EXPECT_EQ(valueOf(kPage - kGranule), map.findPreceding((LPCVOID)(kNodeSpan - 1), kNodeSpan, &key));
+    EXPECT_EQ((LPCVOID)(kPage - kGranule), key);
+
+    // Addresses above the mappable range search down from its top.
+    ASSERT_TRUE(map.insert((LPCVOID)kTop, valueOf(kTop)));
+    EXPECT_EQ(valueOf(kTop), map.findPreceding((LPCVOID)(kTop + kPage), kPage, &key));
+    EXPECT_EQ((LPCVOID)kTop, key);
+    EXPECT_EQ(NULL, map.findPreceding((LPCVOID)(kTop + kPage), kGranule, &key));
+}
+
+TEST(PageMapTest, MatchesStdMapUnderChurn)
+{
+    // Blocks are inserted and erased at pseudo-random addresses around a leaf
+    // boundary, and every lookup is checked against a std::map.
+    TestMap map;
+    std::map<UINT_PTR, void*> reference;
+    const UINT_PTR base = kLeafSpan - 4 * kPage;
+    const UINT_PTR span = 8 * kPage;
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < 20000; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        UINT_PTR address = base + (UINT_PTR)(state % span) / kGranule * kGranule;
+        if (reference.count(address) != 0) {
+            EXPECT_EQ(reference[address], map.erase((LPCVOID)address));
+            reference.erase(address);
+        }
+        else {
+            EXPECT_TRUE(map.insert((LPCVOID)address, valueOf(address)));
+            reference[address] = valueOf(address);
+        }
+
+        // Look up an interior pointer, a little way after the address.
+        UINT_PTR interior = address + (UINT_PTR)(state >> 40) % (2 * kPage);
+        std::map<UINT_PTR, void*>::iterator preceding = reference.upper_bound(interior);
+        LPCVOID key = NULL;
+        void *found = map.findPreceding((LPCVOID)interior, 2 * kPage, &key);
+        if ((preceding == reference.begin()) || (interior - (--preceding)->first > 2 * kPage)) {
+            EXPECT_EQ(NULL, found);
+        }
+        else {
+            EXPECT_EQ(preceding->second, found);
+            EXPECT_EQ((LPCVOID)preceding->first, key);
+        }
+    }
+    EXPECT_EQ(reference.size(), map.size());
+    for (std::map<UINT_PTR, void*>::iterator it = reference.begin(); it != reference.end(); ++it) {
+        EXPECT_EQ(it->second, map.find((LPCVOID)it->first));
+    }
+}
@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Report Formatting Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Tests of the report functions in utility.cpp: the message encodings, the
+// memory dumps and the string and hashing helpers.
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <gtest/gtest.h>
+
+#define VLDBUILD
+#include "utility.h"
+
+namespace {
+
+// Sends the report to a temporary file, whose contents are then compared
+// with the expected report.
+class ReportTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp ()
+    {
+        m_file = tmpfile();
+        ASSERT_TRUE(m_file != NULL);
+        SetReportFile(m_file, FALSE, FALSE);
+    }
+
+    virtual void TearDown ()
+    {
+        SetReportFile(NULL, TRUE, FALSE);
+        SetReportEncoding(ascii);
+        fclose(m_file);
+    }
+
+    // Returns everything which has been reported so far.
+    std::string report ()
+    {
+        std::string contents;
+        fflush(m_file);
+        rewind(m_file);
+        char buffer [256];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), m_file)) > 0)
+            contents.append(buffer, count);
+        return contents;
+    }
+
+    FILE *m_file;
+};
+
+TEST_F(ReportTest, FormatsMessages)
+{
+    Report(L"---------- Block %zu at %p: %zu bytes ----------\n", (size_t)12, (void*)0x1000, (size_t)48);
+    Report(L"  Leak Hash: 0x%08X, Count: %u, Total %zu bytes\n", 0xDEADBEEFu, 3u, (size_t)144);
+    Report(L"    %ls (%u): %s!%s()\n", L"main.cpp", 12u, "leaky", "main");
+    EXPECT_EQ("---------- Block 12 at 0x1000: 48 bytes ----------\n"
+              "  Leak Hash: 0xDEADBEEF, Count: 3, Total 144 bytes\n"
+              "    main.cpp (12): leaky!main()\n", report());
+}
+
+TEST_F(ReportTest, EncodesNonAsciiCharacters)
+{
+    Report(L"café €\n");
+    SetReportEncoding(unicode);
+    Report(L"café €\n");
+    EXPECT_EQ("caf? ?\n" "caf\xC3\xA9 \xE2\x82\xAC\n", report());
+}
+
+TEST_F(ReportTest, TruncatesLongMessages)
+{
+    std::wstring message(MAXREPORTLENGTH * 2, L'x');
+    Report(L"%ls", message.c_str());
+    EXPECT_EQ(std::string(MAXREPORTLENGTH, 'x'), report());
+}
+
+TEST_F(ReportTest, DumpsMemory)
+{
+    const char data [] = "Visual Leak\tDetector";
+    DumpMemoryA(data, sizeof(data));
+    EXPECT_EQ("    56 69 73 75    61 6C 20 4C    65 61 6B 09    44 65 74 65     Visual.L eak.Dete\n"
+              "    63 74 6F 72    00                                            ctor.... ........\n",
+              report());
+}
+
+TEST(UtilityTest, HashesAddresses)
+{
+    EXPECT_EQ(CalculateCRC32(0x12345678), CalculateCRC32(0x12345678));
+    EXPECT_NE(CalculateCRC32(0x12345678), CalculateCRC32(0x12345679));
+    EXPECT_NE(CalculateCRC32(0x12345678, 0), CalculateCRC32(0x12345678));
+    // Chaining the hashes of several values depends on their order.
+    EXPECT_NE(CalculateCRC32(2, CalculateCRC32(1)), CalculateCRC32(1, CalculateCRC32(2)));
+}
+
+TEST(UtilityTest, ConvertsStringsToBool)
+{
+    EXPECT_TRUE(StrToBool(L"yes"));
+    EXPECT_TRUE(StrToBool(L"On"));
+    EXPECT_TRUE(StrToBool(L"TRUE"));
+    EXPECT_TRUE(StrToBool(L"1"));
+    EXPECT_FALSE(StrToBool(L"no"));
+    EXPECT_FALSE(StrToBool(L"off"));
+    EXPECT_FALSE(StrToBool(L"0"));
+    EXPECT_FALSE(StrToBool(L""));
+}
+
+TEST(UtilityTest, AppendsStrings)
+{
+    LPWSTR string = new WCHAR [1];
+    string[0] = L'\0';
+    string = AppendString(string, L"Visual ");
+    string = AppendString(string, L"");
+    string = AppendString(string, NULL);
+    string = AppendString(string, L"Leak Detector");
+    EXPECT_STREQ(L"Visual Leak Detector", string);
+    delete [] string;
+}
+
+} // namespace
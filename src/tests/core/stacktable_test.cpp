@@ -0,0 +1,193 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - StackTable Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Tests of the CallStack storage and of the StackTable, which interns the
+// call stacks captured by both stack walking methods.
+
+#include <gtest/gtest.h>
+
+#define VLDBUILD
+#include "callstack.h"
+#include "utility.h"
+
+namespace {
+
+// Captures the call stack of its caller, like the hooked allocation functions
+// do. The caller's return address is the first frame of the stack. Only a few
+// frames are captured, so that the walk stays within code built with frame
+// pointers.
+__attribute__((noinline))
+CallStack* captureHere (StackTable &table, CallStack::method_e method, UINT32 maxdepth, UINT_PTR &returnAddress)
+{
+    CAPTURE_CONTEXT();
+    returnAddress = GET_RETURN_ADDRESS(context_);
+    return table.capture(method, maxdepth, context_);
+}
+
+__attribute__((noinline))
+CallStack* captureNested (StackTable &table, CallStack::method_e method, UINT32 maxdepth, UINT_PTR &returnAddress)
+{
+    CallStack *callstack = captureHere(table, method, maxdepth, returnAddress);
+    // Keeps the call from being turned into a jump.
+    __asm__ __volatile__ ("" : : : "memory");
+    return callstack;
+}
+
+class StackTableTest : public ::testing::TestWithParam<CallStack::method_e>
+{
+protected:
+    virtual void TearDown ()
+    {
+        m_table.clear();
+    }
+
+    StackTable m_table;
+};
+
+TEST(CallStackTest, StoresFrames)
+{
+    CallStack first, second;
+    for (UINT_PTR frame = 1; frame <= 100; frame++) {
+        first.push_back(frame * 0x10);
+        second.push_back(frame * 0x10);
+    }
+    ASSERT_EQ(100u, first.size());
+    EXPECT_EQ(0x10u, first[0]);
+    EXPECT_EQ(0x640u, first[99]);
+    EXPECT_TRUE(first == second);
+
+    second.push_back(0x650);
+    EXPECT_FALSE(first == second);
+
+    first.clear();
+    EXPECT_EQ(0u, first.size());
+}
+
+TEST_P(StackTableTest, InternsTheSameSite)
+{
+    CallStack *callstacks [3];
+    UINT_PTR   returnAddresses [3];
+    for (int index = 0; index < 3; index++)
+        callstacks[index] = captureHere(m_table, GetParam(), 2, returnAddresses[index]);
+
+    ASSERT_TRUE(callstacks[0] != NULL);
+    EXPECT_EQ(callstacks[0], callstacks[1]);
+    EXPECT_EQ(callstacks[0], callstacks[2]);
+    EXPECT_EQ(1u, m_table.size());
+    ASSERT_EQ(2u, callstacks[0]->size());
+    EXPECT_EQ(returnAddresses[0], (*callstacks[0])[0]);
+}
+
+TEST_P(StackTableTest, SeparatesDifferentSites)
+{
+    UINT_PTR returnAddresses [2];
+    CallStack *first = captureHere(m_table, GetParam(), 2, returnAddresses[0]);
+    CallStack *second = captureHere(m_table, GetParam(), 2, returnAddresses[1]);
+
+    EXPECT_NE(first, second);
+    EXPECT_EQ(2u, m_table.size());
+    EXPECT_EQ(returnAddresses[0], (*first)[0]);
+    EXPECT_EQ(returnAddresses[1], (*second)[0]);
+    EXPECT_EQ((*first)[1], (*second)[1]);
+}
+
+TEST_P(StackTableTest, LimitsTheDepth)
+{
+    UINT_PTR returnAddress;
+    CallStack *shallow = captureNested(m_table, GetParam(), 1, returnAddress);
+    CallStack *deep = captureNested(m_table, GetParam(), 3, returnAddress);
+
+    ASSERT_EQ(1u, shallow->size());
+    ASSERT_EQ(3u, deep->size());
+    EXPECT_EQ(returnAddress, (*deep)[0]);
+    EXPECT_NE(shallow, deep);
+
+    m_table.clear();
+    EXPECT_EQ(0u, m_table.size());
+}
+
+INSTANTIATE_TEST_CASE_P(Methods, StackTableTest, ::testing::Values(CallStack::fast, CallStack::safe));
+
+TEST(StackTableGrowthTest, FindsGrowingSites)
+{
+    StackTable table;
+    UINT_PTR returnAddress;
+    CallStack *growing = captureHere(table, CallStack::fast, 2, returnAddress);
+    CallStack *steady = captureHere(table, CallStack::fast, 2, returnAddress);
+    steady->addLiveBlock(4096);
+
+    // A site is reported once it has grown at each of the last 3 calls.
+    growingsite_t sites [4];
+    EXPECT_EQ(0u, table.findGrowingSites(3, sites, 4));
+    growing->addLiveBlock(100);
+    EXPECT_EQ(0u, table.findGrowingSites(3, sites, 4));
+    growing->addLiveBlock(100);
+    EXPECT_EQ(0u, table.findGrowingSites(3, sites, 4));
+    growing->addLiveBlock(100);
+    ASSERT_EQ(1u, table.findGrowingSites(3, sites, 4));
+    EXPECT_EQ(growing, sites[0].callStack);
+    EXPECT_EQ(300, sites[0].bytes);
+    EXPECT_EQ(300, sites[0].growth);
+
+    for (int i = 0; i < 3; i++)
+        growing->removeLiveBlock(100);
+    steady->removeLiveBlock(4096);
+    table.clear();
+}
+
+TEST(StackTableGrowthTest, FindsLargestSites)
+{
+    StackTable table;
+    UINT_PTR returnAddress;
+    CallStack *small = captureHere(table, CallStack::fast, 2, returnAddress);
+    CallStack *large = captureHere(table, CallStack::fast, 3, returnAddress);
+    CallStack *freed = captureHere(table, CallStack::fast, 4, returnAddress);
+    small->addLiveBlock(10);
+    small->addLiveBlock(20);
+    large->addLiveBlock(4096);
+    freed->addLiveBlock(8192);
+    freed->removeLiveBlock(8192);
+
+    // The sites are ordered by bytes, and the ones without blocks are left
+    // out, but all of the sites are added to the totals.
+    heapsite_t sites [2];
+    SIZE_T bytes, blocks;
+    ASSERT_EQ(2u, table.findLargestSites(sites, 2, bytes, blocks));
+    EXPECT_EQ(large, sites[0].callStack);
+    EXPECT_EQ(4096u, sites[0].bytes);
+    EXPECT_EQ(1u, sites[0].count);
+    EXPECT_EQ(small, sites[1].callStack);
+    EXPECT_EQ(30u, sites[1].bytes);
+    EXPECT_EQ(2u, sites[1].count);
+    EXPECT_EQ(4126u, bytes);
+    EXPECT_EQ(3u, blocks);
+
+    // Only the largest sites fit.
+    ASSERT_EQ(1u, table.findLargestSites(sites, 1, bytes, blocks));
+    EXPECT_EQ(large, sites[0].callStack);
+    EXPECT_EQ(4126u, bytes);
+
+    table.clear();
+}
+
+} // namespace
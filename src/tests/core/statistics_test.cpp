@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Statistics Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Tests of the sharded allocation statistics.
+
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#define VLDBUILD
+#include "statistics.h"
+
+TEST(StatisticsTest, TracksTheExactPeak)
+{
+    // A short-lived block sets the peak, even though it is freed before the
+    // statistics are read.
+    Statistics stats;
+    stats.allocated(60000);
+    stats.freed(60000);
+    stats.allocated(10);
+
+    VLD_STATISTICS result;
+    stats.get(&result);
+    EXPECT_EQ(10u, result.currentBytes);
+    EXPECT_EQ(60000u, result.peakBytes);
+    EXPECT_EQ(60010u, result.totalBytes);
+    EXPECT_EQ(1u, result.currentBlocks);
+    EXPECT_EQ(2u, result.totalBlocks);
+
+    // Growing a block in place raises the peak too.
+    stats.resized(10, 70000);
+    stats.get(&result);
+    EXPECT_EQ(70000u, result.currentBytes);
+    EXPECT_EQ(70000u, result.peakBytes);
+    EXPECT_EQ(70000, stats.current());
+}
+
+TEST(StatisticsTest, KeepsTheSharedCountersOnTheirOwnLines)
+{
+    // One cache line per shard, one for the bytes in use and one for the
+    // peak.
+    EXPECT_EQ((size_t)(STATISTICS_SHARDS + 2) * STATISTICS_CACHE_LINE, sizeof(Statistics));
+    EXPECT_EQ((size_t)STATISTICS_CACHE_LINE, alignof(Statistics));
+}
+
+TEST(StatisticsTest, AddsUpTheThreads)
+{
+    // Every thread holds up to kBlocks blocks at once: the peak is between
+    // one thread's and all of the threads' largest use.
+    const int kThreads = 8;
+    const int kBlocks = 100;
+    const SIZE_T kSize = 1000;
+    Statistics stats;
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < kThreads; thread++) {
+        threads.push_back(std::thread([&stats] {
+            for (int round = 0; round < 10; round++) {
+                for (int block = 0; block < kBlocks; block++)
+                    stats.allocated(kSize);
+                for (int block = 0; block < kBlocks; block++)
+                    stats.freed(kSize);
+            }
+        }));
+    }
+    for (size_t thread = 0; thread < threads.size(); thread++)
+        threads[thread].join();
+
+    VLD_STATISTICS result;
+    stats.get(&result);
+    EXPECT_EQ(0u, result.currentBytes);
+    EXPECT_EQ(0u, result.currentBlocks);
+    EXPECT_EQ(kThreads * 10 * kBlocks * kSize, result.totalBytes);
+    EXPECT_GE(result.peakBytes, kBlocks * kSize);
+    EXPECT_LE(result.peakBytes, kThreads * kBlocks * kSize);
+}
@@ -0,0 +1,231 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Symbolizer Tests
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Tests of the ELF symbol tables and of the Symbolizer, on the fixture
+// library built from fixtures/symbols.cpp and on its stripped copy, which
+// only has the dynamic symbols.
+
+#include <atomic>
+#include <cstring>
+#include <dlfcn.h>
+#include <elf.h>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#define VLDBUILD
+#include "linux/symbolizer.h"
+
+namespace {
+
+const char kLibrary []  = VLD_FIXTURE_SYMBOLS;
+const char kStripped [] = VLD_FIXTURE_SYMBOLS_STRIPPED;
+
+// The fixture library, loaded so that the addresses of its functions, relative
+// to its load address, can be found with dlsym.
+class SymbolTableTest : public ::testing::Test
+{
+protected:
+    static void SetUpTestCase ()
+    {
+        s_handle = dlopen(kLibrary, RTLD_NOW | RTLD_LOCAL);
+        ASSERT_TRUE(s_handle != NULL) << dlerror();
+        Dl_info info;
+        ASSERT_NE(0, dladdr(dlsym(s_handle, "fixture_sized"), &info));
+        s_base = (UINT_PTR)info.dli_fbase;
+    }
+
+    static void TearDownTestCase ()
+    {
+        dlclose(s_handle);
+        s_handle = NULL;
+    }
+
+    // Address of one of the fixture's functions, relative to its load address.
+    static UINT_PTR offsetOf (const char *name)
+    {
+        void *symbol = dlsym(s_handle, name);
+        EXPECT_TRUE(symbol != NULL) << name;
+        return (UINT_PTR)symbol - s_base;
+    }
+
+    static void   *s_handle;
+    static UINT_PTR s_base;
+};
+
+void    *SymbolTableTest::s_handle = NULL;
+UINT_PTR SymbolTableTest::s_base = 0;
+
+// Looks up an address, and returns the name found, or "" if none was.
+std::string findName (SymbolTable &table, UINT_PTR address, SIZE_T &displacement)
+{
+    displacement = (SIZE_T)-1;
+    LPCSTR name = table.find(address, displacement);
+    return (name != NULL) ? name : "";
+}
+
+} // namespace
+
+TEST_F(SymbolTableTest, FindsTheContainingFunction)
+{
+    ElfFile file;
+    ASSERT_TRUE(file.open(kLibrary));
+    SymbolTable table;
+    ASSERT_TRUE(table.load(file));
+
+    // Aliases are kept once, under the preferred name: the global symbol
+    // rather than the weak one.
+    UINT_PTR sized = offsetOf("fixture_sized");
+    EXPECT_EQ(sized, offsetOf("fixture_weak_alias"));
+    SIZE_T displacement;
+    EXPECT_EQ("fixture_sized", findName(table, sized, displacement));
+    EXPECT_EQ(0u, displacement);
+    EXPECT_EQ("fixture_sized", findName(table, sized + 15, displacement));
+    EXPECT_EQ(15u, displacement);
+
+    // A function with a size ends there: the gap after it has no function.
+    EXPECT_EQ("", findName(table, sized + 16, displacement));
+    EXPECT_EQ("", findName(table, sized + 31, displacement));
+
+    // A function without a size extends to the next symbol, which may be a
+    // local one.
+    UINT_PTR unsized = offsetOf("fixture_unsized");
+    EXPECT_EQ(sized + 32, unsized);
+    EXPECT_EQ("fixture_unsized", findName(table, unsized + 31, displacement));
+    EXPECT_EQ(31u, displacement);
+    EXPECT_EQ("fixture_local", findName(table, unsized + 32, displacement));
+    EXPECT_EQ(0u, displacement);
+
+    // The index is sorted: every function is found by a binary search, up
+    // to the last one.
+    UINT_PTR last = offsetOf("fixture_last");
+    EXPECT_EQ("fixture_last", findName(table, last + 8, displacement));
+    EXPECT_EQ(8u, displacement);
+    EXPECT_NE("fixture_last", findName(table, last + 16, displacement));
+    EXPECT_EQ("", findName(table, 0, displacement));
+}
+
+TEST_F(SymbolTableTest, FallsBackToTheDynamicSymbols)
+{
+    ElfFile full, stripped;
+    ASSERT_TRUE(full.open(kLibrary));
+    ASSERT_TRUE(stripped.open(kStripped));
+    elfsection_t section;
+    ASSERT_FALSE(stripped.findSection((UINT32)SHT_SYMTAB, section));
+
+    SymbolTable fullTable, table;
+    ASSERT_TRUE(fullTable.load(full));
+    ASSERT_TRUE(table.load(stripped));
+    EXPECT_LT(table.size(), fullTable.size());
+    EXPECT_NE(0u, table.size());
+
+    // The global functions are still found; without the local symbol, the
+    // function without a size extends over it.
+    SIZE_T displacement;
+    UINT_PTR unsized = offsetOf("fixture_unsized");
+    EXPECT_EQ("fixture_sized", findName(table, offsetOf("fixture_sized") + 4, displacement));
+    EXPECT_EQ("fixture_unsized", findName(table, unsized + 32, displacement));
+    EXPECT_EQ(32u, displacement);
+    EXPECT_EQ("fixture::mangled(int)", findName(table, offsetOf("_ZN7fixture7mangledEi"), displacement));
+}
+
+TEST_F(SymbolTableTest, CachesDemangledNames)
+{
+    ElfFile file;
+    ASSERT_TRUE(file.open(kLibrary));
+    SymbolTable table;
+    ASSERT_TRUE(table.load(file));
+
+    // The threads demangle the name at the same time; all of them get the
+    // one name which is kept.
+    const int kThreads = 8;
+    UINT_PTR mangled = offsetOf("_ZN7fixture7mangledEi");
+    std::atomic<bool> go(false);
+    LPCSTR names [kThreads];
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < kThreads; thread++) {
+        threads.push_back(std::thread([&, thread] {
+            while (!go.load())
+                std::this_thread::yield();
+            SIZE_T displacement;
+            names[thread] = table.find(mangled + 1, displacement);
+        }));
+    }
+    go.store(true);
+    for (size_t thread = 0; thread < threads.size(); thread++)
+        threads[thread].join();
+
+    ASSERT_TRUE(names[0] != NULL);
+    EXPECT_STREQ("fixture::mangled(int)", names[0]);
+    for (int thread = 1; thread < kThreads; thread++)
+        EXPECT_EQ(names[0], names[thread]);
+
+    // Later lookups return the cached name; names which aren't mangled are
+    // returned as they are in the string table.
+    SIZE_T displacement;
+    EXPECT_EQ(names[0], table.find(mangled, displacement));
+    LPCSTR plain = table.find(offsetOf("fixture_last"), displacement);
+    EXPECT_STREQ("fixture_last", plain);
+    EXPECT_EQ(plain, table.find(offsetOf("fixture_last"), displacement));
+}
+
+TEST_F(SymbolTableTest, PublishesEachModuleOnce)
+{
+    // The threads resolve addresses in the same module at the same time, so
+    // that they race to load and publish it: all of them must end up with
+    // the module which was published.
+    const int kThreads = 8;
+    Symbolizer symbolizer;
+    UINT_PTR address = s_base + offsetOf("fixture_sized") + 2;
+    std::atomic<bool> go(false);
+    symbolinfo_t infos [kThreads];
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < kThreads; thread++) {
+        threads.push_back(std::thread([&, thread] {
+            while (!go.load())
+                std::this_thread::yield();
+            symbolizer.resolve(address, kLibrary, s_base, infos[thread]);
+        }));
+    }
+    go.store(true);
+    for (size_t thread = 0; thread < threads.size(); thread++)
+        threads[thread].join();
+
+    for (int thread = 0; thread < kThreads; thread++) {
+        EXPECT_EQ(infos[0].module, infos[thread].module);
+        EXPECT_STREQ("fixture_sized", infos[thread].function);
+        EXPECT_EQ(2u, infos[thread].displacement);
+    }
+    EXPECT_STREQ(kLibrary, infos[0].module);
+
+    // The same file at another bias, or another file, is another module.
+    symbolinfo_t info;
+    symbolizer.resolve(address, kLibrary, s_base + 0x1000, info);
+    EXPECT_NE(infos[0].module, info.module);
+    symbolizer.resolve(address, kStripped, s_base, info);
+    EXPECT_NE(infos[0].module, info.module);
+    EXPECT_STREQ("fixture_sized", info.function);
+    symbolizer.resolve(address, kLibrary, s_base, info);
+    EXPECT_EQ(infos[0].module, info.module);
+}
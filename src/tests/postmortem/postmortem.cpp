@@ -0,0 +1,434 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Post-Mortem Block Database Report
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Reports the blocks recorded in a block database (see the BlockDatabase
+// option and vld_blockdb.h), typically one left behind by a process which
+// crashed or was killed. Usage:
+//
+//   vld-postmortem [--profile] <block database file>
+//
+// By default, every block which was still in use is listed with its call
+// stack, like in a leak report. With --profile, the blocks are grouped by
+// allocation site instead, largest first, in the format of VLDDumpHeapProfile.
+//
+// On Windows, the call stacks are resolved with DbgHelp from the modules
+// recorded in the database, which must still be present at the same paths.
+// Elsewhere, frames are shown as module offsets.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <dbghelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#endif
+
+#include "../../vld_blockdb.h"
+
+namespace {
+
+const int kHeapProfileFormat = 1;   // Same as HEAPPROFILE_FORMAT in vld.cpp.
+
+struct module_t {
+    unsigned long long base;
+    unsigned long long size;
+    std::string        path;    // UTF-8.
+    std::string        name;    // File name part of path.
+};
+
+struct site_t {
+    unsigned long long stack;   // Offset of the stack record.
+    unsigned long long bytes;
+    unsigned long long count;
+};
+
+// The parts of a block database which are in use.
+struct blockdb_t {
+    VLD_BLOCKDB_HEADER                header;
+    std::vector<VLD_BLOCKDB_BLOCK>    blocks;     // Records of the blocks in use, by serial number.
+    std::vector<unsigned char>        records;    // The stack and module records, from blockLimit.
+    std::vector<module_t>             modules;    // Sorted by base address.
+};
+
+// utf8 - Converts a null terminated UTF-16 string to UTF-8.
+std::string utf8 (const unsigned short *text, size_t maxlength)
+{
+    std::string result;
+    for (size_t i = 0; (i < maxlength) && (text[i] != 0); i++) {
+        unsigned long c = text[i];
+        if ((c >= 0xD800) && (c < 0xDC00) && (i + 1 < maxlength) && (text[i + 1] >= 0xDC00) && (text[i + 1] < 0xE000)) {
+            c = 0x10000 + ((c - 0xD800) << 10) + (text[i + 1] - 0xDC00);
+            i++;
+        }
+        if (c < 0x80) {
+            result += (char)c;
+        }
+        else if (c < 0x800) {
+            result += (char)(0xC0 | (c >> 6));
+            result += (char)(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000) {
+            result += (char)(0xE0 | (c >> 12));
+            result += (char)(0x80 | ((c >> 6) & 0x3F));
+            result += (char)(0x80 | (c & 0x3F));
+        }
+        else {
+            result += (char)(0xF0 | (c >> 18));
+            result += (char)(0x80 | ((c >> 12) & 0x3F));
+            result += (char)(0x80 | ((c >> 6) & 0x3F));
+            result += (char)(0x80 | (c & 0x3F));
+        }
+    }
+    return result;
+}
+
+// readat - Reads part of a file.
+bool readAt (FILE *file, unsigned long long offset, void *buffer, size_t bytes)
+{
+    if (bytes == 0)
+        return true;
+#ifdef _WIN32
+    if (_fseeki64(file, (long long)offset, SEEK_SET) != 0)
+#else
+    if (fseeko(file, (off_t)offset, SEEK_SET) != 0)
+#endif
+        return false;
+    return fread(buffer, bytes, 1, file) == 1;
+}
+
+// record - Obtains a stack or module record, or NULL if the offset is invalid.
+const unsigned char* record (const blockdb_t &db, unsigned long long offset, size_t bytes)
+{
+    if ((offset < db.header.blockLimit) || (offset - db.header.blockLimit + bytes > db.records.size()))
+        return NULL;
+    return &db.records[(size_t)(offset - db.header.blockLimit)];
+}
+
+// stackframes - Obtains the frames of a stack record.
+std::vector<unsigned long long> stackFrames (const blockdb_t &db, unsigned long long offset)
+{
+    std::vector<unsigned long long> frames;
+    const unsigned char *data = record(db, offset, sizeof(VLD_BLOCKDB_STACK));
+    if (data == NULL)
+        return frames;
+    VLD_BLOCKDB_STACK stack;
+    memcpy(&stack, data, sizeof(stack));
+    data = record(db, offset, sizeof(VLD_BLOCKDB_STACK) + (size_t)stack.frameCount * sizeof(unsigned long long));
+    if (data == NULL)
+        return frames;
+    frames.resize(stack.frameCount);
+    if (stack.frameCount != 0)
+        memcpy(&frames[0], data + sizeof(VLD_BLOCKDB_STACK), stack.frameCount * sizeof(unsigned long long));
+    return frames;
+}
+
+// load - Reads the parts of a block database which are in use.
+bool load (const char *path, blockdb_t &db)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "vld-postmortem: cannot open %s\n", path);
+        return false;
+    }
+    bool valid = readAt(file, 0, &db.header, sizeof(db.header)) &&
+        (memcmp(db.header.magic, VLD_BLOCKDB_MAGIC, sizeof(db.header.magic)) == 0) &&
+        (db.header.version == VLD_BLOCKDB_VERSION) && (db.header.blockSize >= sizeof(VLD_BLOCKDB_BLOCK)) &&
+        (db.header.headerSize <= db.header.blockEnd) && (db.header.blockEnd <= db.header.blockLimit) &&
+        (db.header.blockLimit <= db.header.capacity);
+    if (!valid) {
+        fprintf(stderr, "vld-postmortem: %s is not a block database of a supported version\n", path);
+        fclose(file);
+        return false;
+    }
+
+    // Block records.
+    unsigned long long count = (db.header.blockEnd - db.header.headerSize) / db.header.blockSize;
+    std::vector<unsigned char> blocks((size_t)(count * db.header.blockSize));
+    if (!readAt(file, db.header.headerSize, blocks.empty() ? NULL : &blocks[0], blocks.size())) {
+        fprintf(stderr, "vld-postmortem: %s is truncated\n", path);
+        fclose(file);
+        return false;
+    }
+    for (unsigned long long i = 0; i < count; i++) {
+        VLD_BLOCKDB_BLOCK block;
+        memcpy(&block, &blocks[(size_t)(i * db.header.blockSize)], sizeof(block));
+        if (block.state == VLD_BLOCKDB_ALLOCATED)
+            db.blocks.push_back(block);
+    }
+    std::sort(db.blocks.begin(), db.blocks.end(), [] (const VLD_BLOCKDB_BLOCK &a, const VLD_BLOCKDB_BLOCK &b) {
+        return a.serialNumber < b.serialNumber;
+    });
+
+    // Stack and module records. The end may be past the capacity if the
+    // database was full.
+    unsigned long long end = std::min(db.header.stackEnd, db.header.capacity);
+    if (end > db.header.blockLimit) {
+        db.records.resize((size_t)(end - db.header.blockLimit));
+        if (!readAt(file, db.header.blockLimit, &db.records[0], db.records.size())) {
+            fprintf(stderr, "vld-postmortem: %s is truncated\n", path);
+            fclose(file);
+            return false;
+        }
+    }
+    fclose(file);
+
+    for (unsigned long long offset = db.header.modules; offset != 0; ) {
+        const unsigned char *data = record(db, offset, sizeof(VLD_BLOCKDB_MODULE));
+        if (data == NULL)
+            break;
+        VLD_BLOCKDB_MODULE dbmodule;
+        memcpy(&dbmodule, data, sizeof(dbmodule));
+        module_t module;
+        module.base = dbmodule.base;
+        module.size = dbmodule.size;
+        module.path = utf8(dbmodule.path, sizeof(dbmodule.path) / sizeof(dbmodule.path[0]));
+        size_t slash = module.path.find_last_of("\\/");
+        module.name = (slash != std::string::npos) ? module.path.substr(slash + 1) : module.path;
+        db.modules.push_back(module);
+        // The list only ever links to older records, which are at lower offsets.
+        if (dbmodule.next >= offset)
+            break;
+        offset = dbmodule.next;
+    }
+    std::sort(db.modules.begin(), db.modules.end(), [] (const module_t &a, const module_t &b) {
+        return a.base < b.base;
+    });
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The Symbolizer Class
+//
+//    Resolves the frames of the call stacks to "file (line): module!function()"
+//    lines, in the same format as Visual Leak Detector's reports, using the
+//    modules recorded in the block database.
+//
+class Symbolizer
+{
+public:
+    explicit Symbolizer (const blockdb_t &db) : m_db(db)
+    {
+#ifdef _WIN32
+        // DbgHelp accepts any value which identifies the session when the
+        // modules are loaded explicitly.
+        m_session = (HANDLE)&m_db;
+        SymSetOptions(SYMOPT_DEFERRED_LOADS | SYMOPT_LOAD_LINES | SYMOPT_UNDNAME | SYMOPT_FAIL_CRITICAL_ERRORS);
+        m_initialized = (SymInitializeW(m_session, NULL, FALSE) != FALSE);
+        for (size_t i = 0; m_initialized && (i < m_db.modules.size()); i++) {
+            std::wstring path;
+            int length = MultiByteToWideChar(CP_UTF8, 0, m_db.modules[i].path.c_str(), -1, NULL, 0);
+            if (length > 0) {
+                path.resize((size_t)length);
+                MultiByteToWideChar(CP_UTF8, 0, m_db.modules[i].path.c_str(), -1, &path[0], length);
+                SymLoadModuleExW(m_session, NULL, path.c_str(), NULL, m_db.modules[i].base,
+                    (DWORD)m_db.modules[i].size, NULL, 0);
+            }
+        }
+#endif
+    }
+
+    ~Symbolizer ()
+    {
+#ifdef _WIN32
+        if (m_initialized)
+            SymCleanup(m_session);
+#endif
+    }
+
+    // resolve - Obtains the line of a frame, in the report format.
+    std::string resolve (unsigned long long address)
+    {
+        char line [1024];
+        const module_t *module = findModule(address);
+        if (module == NULL) {
+            snprintf(line, sizeof(line), "    0x%016llX (Module name unavailable)\n", address);
+            return line;
+        }
+#ifdef _WIN32
+        if (m_initialized) {
+            union {
+                SYMBOL_INFO info;
+                char        buffer [sizeof(SYMBOL_INFO) + 256];
+            } symbol;
+            memset(&symbol, 0, sizeof(symbol));
+            symbol.info.SizeOfStruct = sizeof(SYMBOL_INFO);
+            symbol.info.MaxNameLen = 256 - 1;
+            DWORD64 displacement = 0;
+            if (SymFromAddr(m_session, address, &displacement, &symbol.info)) {
+                IMAGEHLP_LINE64 source;
+                memset(&source, 0, sizeof(source));
+                source.SizeOfStruct = sizeof(source);
+                DWORD linedisplacement = 0;
+                std::string prefix;
+                if (SymGetLineFromAddr64(m_session, address, &linedisplacement, &source)) {
+                    char location [512];
+                    snprintf(location, sizeof(location), "%s (%lu): ", source.FileName, source.LineNumber);
+                    prefix = location;
+                }
+                if (displacement == 0)
+                    snprintf(line, sizeof(line), "    %s%s!%s()\n", prefix.c_str(), module->name.c_str(), symbol.info.Name);
+                else
+                    snprintf(line, sizeof(line), "    %s%s!%s() + 0x%llX bytes\n", prefix.c_str(), module->name.c_str(),
+                        symbol.info.Name, (unsigned long long)displacement);
+                return line;
+            }
+        }
+#endif
+        snprintf(line, sizeof(line), "    %s!0x%llX\n", module->name.c_str(), address - module->base);
+        return line;
+    }
+
+    // resolvestack - Obtains the lines of a whole call stack.
+    std::string resolveStack (unsigned long long offset)
+    {
+        if (offset == 0)
+            return "    Not captured.\n";
+        std::map<unsigned long long, std::string>::iterator it = m_stacks.find(offset);
+        if (it != m_stacks.end())
+            return it->second;
+        std::vector<unsigned long long> frames = stackFrames(m_db, offset);
+        std::string lines;
+        for (size_t i = 0; i < frames.size(); i++) {
+            lines += resolve(frames[i]);
+        }
+        if (lines.empty())
+            lines = "    Not available.\n";
+        m_stacks[offset] = lines;
+        return lines;
+    }
+
+private:
+    const module_t* findModule (unsigned long long address) const
+    {
+        for (size_t i = m_db.modules.size(); i > 0; i--) {
+            const module_t &module = m_db.modules[i - 1];
+            if (module.base <= address)
+                return (address < module.base + module.size) ? &module : NULL;
+        }
+        return NULL;
+    }
+
+    const blockdb_t                            &m_db;
+    std::map<unsigned long long, std::string>   m_stacks;   // Resolved call stacks, by offset.
+#ifdef _WIN32
+    HANDLE                                      m_session;
+    bool                                        m_initialized;
+#endif
+};
+
+// reportblocks - Lists the blocks in use, like a leak report.
+void reportBlocks (const blockdb_t &db, Symbolizer &symbolizer)
+{
+    unsigned long long total = 0;
+    for (size_t i = 0; i < db.blocks.size(); i++) {
+        const VLD_BLOCKDB_BLOCK &block = db.blocks[i];
+        printf("---------- Block %llu at 0x%016llX: %llu bytes ----------\n", block.serialNumber, block.address, block.size);
+        printf("  TID: %u\n", block.threadId);
+        printf("  Call Stack:\n");
+        fputs(symbolizer.resolveStack(block.stack).c_str(), stdout);
+        printf("\n");
+        total += block.size;
+    }
+    if (db.blocks.empty())
+        printf("No blocks were in use.\n");
+    else
+        printf("%llu blocks (%llu bytes) were in use.\n", (unsigned long long)db.blocks.size(), total);
+}
+
+// reportprofile - Lists the allocation sites, in the format of
+//   VLDDumpHeapProfile.
+void reportProfile (const blockdb_t &db, Symbolizer &symbolizer)
+{
+    std::map<unsigned long long, site_t> bystack;
+    unsigned long long total = 0;
+    for (size_t i = 0; i < db.blocks.size(); i++) {
+        site_t &site = bystack[db.blocks[i].stack];
+        site.stack = db.blocks[i].stack;
+        site.bytes += db.blocks[i].size;
+        site.count++;
+        total += db.blocks[i].size;
+    }
+    std::vector<site_t> sites;
+    for (std::map<unsigned long long, site_t>::iterator it = bystack.begin(); it != bystack.end(); ++it) {
+        sites.push_back(it->second);
+    }
+    std::stable_sort(sites.begin(), sites.end(), [] (const site_t &a, const site_t &b) { return a.bytes > b.bytes; });
+
+    printf("Visual Leak Detector heap profile, format %d\n", kHeapProfileFormat);
+    printf("Process: %u\n", db.header.processId);
+    printf("In use: %llu bytes in %llu blocks from %llu allocation sites\n", total,
+        (unsigned long long)db.blocks.size(), (unsigned long long)sites.size());
+    for (size_t i = 0; i < sites.size(); i++) {
+        printf("\n---------- Site %llu: %llu bytes in %llu blocks ----------\n", (unsigned long long)i + 1,
+            sites[i].bytes, sites[i].count);
+        printf("  Call Stack:\n");
+        fputs(symbolizer.resolveStack(sites[i].stack).c_str(), stdout);
+    }
+}
+
+} // namespace
+
+int main (int argc, char *argv [])
+{
+    bool profile = false;
+    const char *path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--profile") == 0)
+            profile = true;
+        else if ((argv[i][0] != '-') && (path == NULL))
+            path = argv[i];
+        else {
+            path = NULL;
+            break;
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: vld-postmortem [--profile] <block database file>\n");
+        return EXIT_FAILURE;
+    }
+
+    blockdb_t db;
+    if (!load(path, db))
+        return EXIT_FAILURE;
+
+    printf("Visual Leak Detector post-mortem report of %s\n", path);
+    printf("Process %u %s.\n", db.header.processId, (db.header.status == VLD_BLOCKDB_EXITED) ?
+        "exited normally: the blocks in use are its memory leaks" : "did not exit normally: it crashed, was killed or is still running");
+    if (db.header.status == VLD_BLOCKDB_FULL)
+        printf("WARNING: The block database was full. Some blocks or call stacks were not recorded.\n");
+    printf("\n");
+
+    Symbolizer symbolizer(db);
+    if (profile)
+        reportProfile(db, symbolizer);
+    else
+        reportBlocks(db, symbolizer);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,644 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Allocation Trace Replay
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// Replays an allocation event trace, recorded with the TraceFile option (see
+// vld_trace.h), against VLD's tracking core: the BlockTracker class, which
+// both backends derive from. The traces are recorded by the Windows backend
+// only; the Linux backend has no TraceFile option. A trace can be replayed on
+// either platform, by a process of the same or a larger pointer size. This
+// tool is built by the CMake build, which links the tracking core. Usage:
+//
+//   vld-replay [--fast] [--allocate] <trace file>
+//   vld-replay --generate <trace file>
+//
+//     --generate  Write a small synthetic trace instead of replaying one, so
+//                 that the replay can be tested where no trace was recorded.
+//                 Its threads allocate, reallocate and free blocks, some of
+//                 them freed by another thread; kGenerateThreads *
+//                 kGenerateBlocks / kGenerateLeakEvery blocks are left live.
+//     --fast      Replay as fast as possible. Each thread only waits for the
+//                 previous event on the same address, instead of for every
+//                 event that preceded it in the trace.
+//     --allocate  Also allocate, reallocate and free the blocks with the C
+//                 runtime, to include the allocator in the measurements.
+//
+// Each thread of the trace is replayed by a thread of its own. The results are
+// printed in the same format as the core benchmarks, one line per operation:
+//
+//   <name> <operations> <ns/op> [<counter>=<value> ...]
+//
+// with the latency percentiles (in nanoseconds) as counters, followed by the
+// overall throughput and the peak memory used by the tracking structures.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+// Bytes currently allocated, and the most ever allocated at once, by the
+// tracking structures.
+std::atomic<size_t> g_metadataBytes(0);
+std::atomic<size_t> g_metadataPeak(0);
+
+} // namespace
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Memory accounting
+//
+//    VLD's containers allocate through "new(__FILE__, __LINE__)", which
+//    normally allocates from VLD's private heap. Here every allocation gets a
+//    small header which records its size, and whether it was made by the
+//    containers, so that the memory used by the tracking structures can be
+//    measured separately from the replay's own memory.
+//
+struct allocheader_t {
+    size_t size;        // Size of the allocation, without the header.
+    size_t metadata;    // Non-zero if the allocation was made by the tracking structures.
+};
+
+static void* allocate (size_t size, bool metadata)
+{
+    allocheader_t *header = (allocheader_t*)malloc(sizeof(allocheader_t) + size);
+    if (header == NULL)
+        throw std::bad_alloc();
+    header->size = size;
+    header->metadata = metadata;
+    if (metadata) {
+        size_t current = g_metadataBytes.fetch_add(size) + size;
+        size_t peak = g_metadataPeak.load();
+        while ((current > peak) && !g_metadataPeak.compare_exchange_weak(peak, current));
+    }
+    return header + 1;
+}
+
+static void release (void *block)
+{
+    if (block == NULL)
+        return;
+    allocheader_t *header = (allocheader_t*)block - 1;
+    if (header->metadata)
+        g_metadataBytes.fetch_sub(header->size);
+    free(header);
+}
+
+void* operator new (size_t size)
+{
+    return allocate(size, false);
+}
+
+void* operator new [] (size_t size)
+{
+    return allocate(size, false);
+}
+
+void* operator new (size_t size, const char *, int)
+{
+    return allocate(size, true);
+}
+
+void* operator new [] (size_t size, const char *, int)
+{
+    return allocate(size, true);
+}
+
+void operator delete (void *block)
+{
+    release(block);
+}
+
+void operator delete [] (void *block)
+{
+    release(block);
+}
+
+void operator delete (void *block, const char *, int)
+{
+    release(block);
+}
+
+void operator delete [] (void *block, const char *, int)
+{
+    release(block);
+}
+
+// Included after the operators above, which must not be renamed by the "new"
+// macro of vldheap.h.
+#define VLDBUILD
+#include "../../vld_trace.h"
+#include "../../blocktracker.h"
+#include "../../utility.h"
+
+namespace {
+
+const UINT32 kSpinsBeforeYield = 64;   // Spins before a waiting thread yields its time slice.
+const UINT64 kNoSlot = (UINT64)-1;
+
+// The synthetic trace of --generate.
+const UINT32 kGenerateThreads   = 4;        // Threads of the trace.
+const UINT32 kGenerateBlocks    = 1024;     // Blocks allocated by each thread.
+const UINT32 kGenerateWindow    = 16;       // Blocks each thread keeps live before it frees the oldest.
+const UINT32 kGenerateLeakEvery = 64;       // One block in this many is never freed.
+const UINT64 kGenerateHeap      = 0x10000;  // Handle of the only heap of the trace.
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  The ReplayCore Class
+//
+//    Drives the tracking core: the replayed blocks are mapped, unmapped and
+//    remapped by the same BlockTracker functions, under the same lock, as the
+//    blocks allocated by a program. Call stacks aren't captured, and nothing
+//    is reported.
+//
+class ReplayCore : public BlockTracker
+{
+public:
+    ReplayCore ()
+    {
+        g_heapMapLock.Initialize();
+        initializeTracking();
+        ZeroMemory(&m_context, sizeof(m_context));
+    }
+
+    ~ReplayCore ()
+    {
+        freeTracking();
+        g_heapMapLock.Delete();
+    }
+
+    // mapblock - Tracks an allocated block.
+    VOID mapBlock (HANDLE heap, LPCVOID mem, SIZE_T size, DWORD threadId)
+    {
+        blockinfo_t *info = NULL;
+        BlockTracker::mapBlock(heap, mem, size, false, false, threadId, info);
+    }
+
+    // unmapblock - Tracks a freed block.
+    VOID unmapBlock (HANDLE heap, LPCVOID mem)
+    {
+        BlockTracker::unmapBlock(heap, mem, m_context);
+    }
+
+    // remapblock - Tracks a reallocated block.
+    VOID remapBlock (HANDLE heap, LPCVOID mem, LPCVOID newmem, SIZE_T size, DWORD threadId)
+    {
+        blockinfo_t *info = NULL;
+        BlockTracker::remapBlock(heap, mem, newmem, size, false, false, threadId, info, m_context);
+    }
+
+    // countblocks - Obtains the number of blocks still tracked.
+    SIZE_T countBlocks ()
+    {
+        CriticalSectionLocker<> cs(g_heapMapLock);
+        SIZE_T count = 0;
+        for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
+            BlockMap &blockmap = (*heapit).second->blockMap;
+            for (BlockMap::Iterator blockit = blockmap.begin(); blockit != blockmap.end(); ++blockit) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+private:
+    context_t m_context;    // Context of every replayed free: mismatched frees aren't reported.
+};
+
+// An event of the trace, prepared for replaying. Each block, from its
+// allocation to its free, is given a slot, which holds its address when it
+// is reallocated by the C runtime (--allocate).
+struct replayop_t {
+    UINT64  dependency;  // Index of the previous event on the same address, or kNoSlot.
+    UINT64  slot;        // Slot of the block at address.
+    UINT64  oldSlot;     // VLD_TRACE_REALLOC: slot of the block at oldAddress, or kNoSlot.
+    LPCVOID heap;
+    LPCVOID address;
+    LPCVOID oldAddress;
+    SIZE_T  size;
+    DWORD   threadId;
+    UINT32  op;
+};
+
+struct replaythread_t {
+    std::vector<UINT64> ops;            // Indices of the thread's events, in order.
+    std::vector<UINT32> latencies [3];  // Nanoseconds per event, by op.
+};
+
+struct replay_t {
+    std::vector<replayop_t>        ops;
+    std::vector<replaythread_t>    threads;
+    std::vector<void*>             slots;   // Addresses of the blocks allocated by --allocate.
+    std::vector<std::atomic<UINT8> > done;  // Per event, non-zero once the event has been replayed.
+    std::atomic<UINT64>            next;    // Index of the next event, when replaying the original interleaving.
+    ReplayCore                    *core;
+    bool                           fast;
+    bool                           allocate;
+};
+
+// load - Reads a trace and prepares its events for replaying.
+bool load (const char *path, replay_t &replay)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "vld-replay: cannot open %s\n", path);
+        return false;
+    }
+    // Version 1 headers end before droppedEvents.
+    VLD_TRACE_HEADER header;
+    memset(&header, 0, sizeof(header));
+    const size_t headerV1 = offsetof(VLD_TRACE_HEADER, droppedEvents);
+    if ((fread(&header, headerV1, 1, file) != 1) ||
+        (memcmp(header.magic, VLD_TRACE_MAGIC, sizeof(header.magic)) != 0) ||
+        (header.version < 1) || (header.version > VLD_TRACE_VERSION) ||
+        (header.headerSize < ((header.version >= 2) ? sizeof(header) : headerV1)) ||
+        (header.eventSize < sizeof(VLD_TRACE_EVENT)) ||
+        ((header.version >= 2) && (fread(&header.droppedEvents, sizeof(header.droppedEvents), 1, file) != 1))) {
+        fprintf(stderr, "vld-replay: %s is not a trace file of a supported version\n", path);
+        fclose(file);
+        return false;
+    }
+    if (header.pointerSize > sizeof(void*)) {
+        fprintf(stderr, "vld-replay: %s was recorded by a %u-bit process\n", path, header.pointerSize * 8);
+        fclose(file);
+        return false;
+    }
+    if (header.droppedEvents != 0) {
+        fprintf(stderr, "vld-replay: warning: %llu events were dropped while %s was recorded\n",
+            header.droppedEvents, path);
+    }
+    fseek(file, (long)header.headerSize, SEEK_SET);
+
+    std::vector<VLD_TRACE_EVENT> events;
+    events.reserve((size_t)header.eventCount);
+    std::vector<char> record(header.eventSize);
+    for (UINT64 i = 0; i < header.eventCount; i++) {
+        if (fread(&record[0], header.eventSize, 1, file) != 1)
+            break;
+        VLD_TRACE_EVENT event;
+        memcpy(&event, &record[0], sizeof(event));
+        events.push_back(event);
+    }
+    fclose(file);
+
+    // Events of different threads are written out of order.
+    std::stable_sort(events.begin(), events.end(),
+        [] (const VLD_TRACE_EVENT &a, const VLD_TRACE_EVENT &b) { return a.time < b.time; });
+
+    std::unordered_map<UINT64, UINT64> lastop;    // Address -> index of the last event on it.
+    std::unordered_map<UINT64, UINT64> liveslot;  // Address -> slot of the live block.
+    std::unordered_map<DWORD, size_t>  threads;   // Thread ID -> replay thread.
+    UINT64 slots = 0;
+    replay.ops.resize(events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        const VLD_TRACE_EVENT &event = events[i];
+        replayop_t &op = replay.ops[i];
+        op.op         = event.op;
+        op.heap       = (LPCVOID)(UINT_PTR)event.heap;
+        op.address    = (LPCVOID)(UINT_PTR)event.address;
+        op.oldAddress = (LPCVOID)(UINT_PTR)event.oldAddress;
+        op.size       = (SIZE_T)event.size;
+        op.threadId   = event.threadId;
+        op.slot       = kNoSlot;
+        op.oldSlot    = kNoSlot;
+
+        // A reallocation depends on the last event on either address.
+        std::unordered_map<UINT64, UINT64>::iterator it = lastop.find(event.address);
+        op.dependency = (it != lastop.end()) ? it->second : kNoSlot;
+        if (event.op == VLD_TRACE_REALLOC) {
+            it = lastop.find(event.oldAddress);
+            if ((it != lastop.end()) && ((op.dependency == kNoSlot) || (it->second > op.dependency)))
+                op.dependency = it->second;
+            lastop[event.oldAddress] = i;
+        }
+        lastop[event.address] = i;
+
+        switch (event.op) {
+        case VLD_TRACE_ALLOC:
+            op.slot = liveslot[event.address] = slots++;
+            break;
+        case VLD_TRACE_FREE:
+            it = liveslot.find(event.address);
+            if (it != liveslot.end()) {
+                op.slot = it->second;
+                liveslot.erase(it);
+            }
+            break;
+        case VLD_TRACE_REALLOC:
+            it = liveslot.find(event.oldAddress);
+            if (it != liveslot.end()) {
+                op.oldSlot = it->second;
+                liveslot.erase(it);
+            }
+            op.slot = liveslot[event.address] = slots++;
+            break;
+        default:
+            fprintf(stderr, "vld-replay: unknown event %u in %s\n", event.op, path);
+            return false;
+        }
+
+        std::unordered_map<DWORD, size_t>::iterator thread = threads.find(event.threadId);
+        if (thread == threads.end()) {
+            thread = threads.insert(std::make_pair(event.threadId, replay.threads.size())).first;
+            replay.threads.push_back(replaythread_t());
+        }
+        replay.threads[thread->second].ops.push_back(i);
+    }
+    replay.slots.assign((size_t)slots, NULL);
+    return true;
+}
+
+// waitfor - Waits until the given event has been replayed.
+void waitFor (const replay_t &replay, UINT64 index)
+{
+    UINT32 spins = 0;
+    while (replay.done[index].load(std::memory_order_acquire) == 0) {
+        if (++spins >= kSpinsBeforeYield) {
+            std::this_thread::yield();
+            spins = 0;
+        }
+    }
+}
+
+// waitturn - Waits until all of the events before the given one have been
+//   replayed.
+void waitTurn (const replay_t &replay, UINT64 index)
+{
+    UINT32 spins = 0;
+    while (replay.next.load(std::memory_order_acquire) != index) {
+        if (++spins >= kSpinsBeforeYield) {
+            std::this_thread::yield();
+            spins = 0;
+        }
+    }
+}
+
+// perform - Replays one event.
+void perform (replay_t &replay, const replayop_t &op)
+{
+    HANDLE heap = (HANDLE)op.heap;
+    switch (op.op) {
+    case VLD_TRACE_ALLOC:
+        if (replay.allocate)
+            replay.slots[(size_t)op.slot] = malloc(op.size);
+        replay.core->mapBlock(heap, op.address, op.size, op.threadId);
+        break;
+
+    case VLD_TRACE_FREE:
+        replay.core->unmapBlock(heap, op.address);
+        if (replay.allocate && (op.slot != kNoSlot)) {
+            free(replay.slots[(size_t)op.slot]);
+            replay.slots[(size_t)op.slot] = NULL;
+        }
+        break;
+
+    case VLD_TRACE_REALLOC:
+        if (replay.allocate) {
+            void *block = NULL;
+            if (op.oldSlot != kNoSlot) {
+                block = replay.slots[(size_t)op.oldSlot];
+                replay.slots[(size_t)op.oldSlot] = NULL;
+            }
+            replay.slots[(size_t)op.slot] = realloc(block, op.size);
+        }
+        replay.core->remapBlock(heap, op.oldAddress, op.address, op.size, op.threadId);
+        break;
+    }
+}
+
+// replaythread - Replays the events of one thread of the trace.
+void replayThread (replay_t &replay, replaythread_t &thread)
+{
+    typedef std::chrono::steady_clock clock;
+    for (size_t i = 0; i < thread.ops.size(); i++) {
+        UINT64 index = thread.ops[i];
+        const replayop_t &op = replay.ops[(size_t)index];
+        if (!replay.fast)
+            waitTurn(replay, index);
+        else if (op.dependency != kNoSlot)
+            waitFor(replay, op.dependency);
+
+        clock::time_point start = clock::now();
+        perform(replay, op);
+        clock::time_point end = clock::now();
+
+        LONGLONG ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        thread.latencies[op.op - VLD_TRACE_ALLOC].push_back((ns < 0xFFFFFFFF) ? (UINT32)ns : 0xFFFFFFFF);
+        replay.done[index].store(1, std::memory_order_release);
+        if (!replay.fast)
+            replay.next.store(index + 1, std::memory_order_release);
+    }
+}
+
+// percentile - Obtains a percentile of sorted latencies.
+double percentile (const std::vector<UINT32> &sorted, double fraction)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t index = (size_t)(fraction * (double)(sorted.size() - 1) + 0.5);
+    return (double)sorted[index];
+}
+
+// printlatencies - Prints the result line of one operation.
+void printLatencies (const char *name, std::vector<UINT32> &latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0.0;
+    for (size_t i = 0; i < latencies.size(); i++) {
+        total += (double)latencies[i];
+    }
+    double mean = latencies.empty() ? 0.0 : total / (double)latencies.size();
+    printf("%s\t%llu\t%.2f\tp50=%.2f\tp90=%.2f\tp99=%.2f\tp999=%.2f\tmax=%.2f\n", name,
+        (unsigned long long)latencies.size(), mean, percentile(latencies, 0.50), percentile(latencies, 0.90),
+        percentile(latencies, 0.99), percentile(latencies, 0.999), percentile(latencies, 1.0));
+}
+
+// generateaddress - Obtains the address of a block of the synthetic trace:
+//   thread's block-th block, or the block it was reallocated to.
+UINT64 generateAddress (UINT32 thread, UINT32 block, bool reallocated)
+{
+    return 0x100000 + ((((UINT64)thread * kGenerateBlocks + block) * 2 + (reallocated ? 1 : 0)) * 0x100);
+}
+
+// generate - Writes the synthetic trace of --generate. The threads take turns,
+//   so the trace is the same on every run. No stack file is written: the
+//   events reference no call stack.
+bool generate (const char *path)
+{
+    std::vector<VLD_TRACE_EVENT> events;
+    UINT64 time = 0;
+    UINT32 random = 12345;
+    std::vector<std::vector<UINT64> > addresses(kGenerateThreads, std::vector<UINT64>(kGenerateBlocks, 0));
+    for (UINT32 block = 0; block < kGenerateBlocks + kGenerateWindow; block++) {
+        for (UINT32 thread = 0; thread < kGenerateThreads; thread++) {
+            VLD_TRACE_EVENT event;
+            memset(&event, 0, sizeof(event));
+            event.heap = kGenerateHeap;
+            event.threadId = 100 + thread;
+            if (block < kGenerateBlocks) {
+                random = random * 1103515245 + 12345;
+                event.time = time++;
+                event.address = addresses[thread][block] = generateAddress(thread, block, false);
+                event.size = 8 + ((random >> 16) % 248);
+                event.op = VLD_TRACE_ALLOC;
+                events.push_back(event);
+            }
+            if ((block > 0) && (block <= kGenerateBlocks) && ((block % 4) == 0)) {
+                // Grow the previous block.
+                event.time = time++;
+                event.oldAddress = addresses[thread][block - 1];
+                event.address = addresses[thread][block - 1] = generateAddress(thread, block - 1, true);
+                event.size = 256 + ((random >> 8) % 256);
+                event.op = VLD_TRACE_REALLOC;
+                events.push_back(event);
+            }
+            if ((block >= kGenerateWindow) && (((block - kGenerateWindow) % kGenerateLeakEvery) != 0)) {
+                // Free the oldest block, sometimes from the next thread.
+                UINT32 oldest = block - kGenerateWindow;
+                event.time = time++;
+                event.oldAddress = 0;
+                event.address = addresses[thread][oldest];
+                event.size = 0;
+                event.threadId = 100 + (((oldest % 8) == 5) ? (thread + 1) % kGenerateThreads : thread);
+                event.op = VLD_TRACE_FREE;
+                events.push_back(event);
+            }
+        }
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "vld-replay: cannot create %s\n", path);
+        return false;
+    }
+    VLD_TRACE_HEADER header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VLD_TRACE_MAGIC, sizeof(header.magic));
+    header.version     = VLD_TRACE_VERSION;
+    header.headerSize  = sizeof(header);
+    header.eventSize   = sizeof(VLD_TRACE_EVENT);
+    header.pointerSize = sizeof(void*);
+    header.frequency   = 1000000000;
+    header.eventCount  = events.size();
+    bool written = (fwrite(&header, sizeof(header), 1, file) == 1) &&
+        (fwrite(&events[0], sizeof(VLD_TRACE_EVENT), events.size(), file) == events.size());
+    written = (fclose(file) == 0) && written;
+    if (!written) {
+        fprintf(stderr, "vld-replay: cannot write %s\n", path);
+        return false;
+    }
+    printf("# %s: %llu events, %u threads, %u live blocks\n", path, (unsigned long long)events.size(),
+        kGenerateThreads, kGenerateThreads * kGenerateBlocks / kGenerateLeakEvery);
+    return true;
+}
+
+} // namespace
+
+int main (int argc, char *argv [])
+{
+    replay_t replay;
+    replay.fast = false;
+    replay.allocate = false;
+    const char *path = NULL;
+    if ((argc == 3) && (strcmp(argv[1], "--generate") == 0))
+        return generate(argv[2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--fast") == 0)
+            replay.fast = true;
+        else if (strcmp(argv[i], "--allocate") == 0)
+            replay.allocate = true;
+        else if ((argv[i][0] != '-') && (path == NULL))
+            path = argv[i];
+        else {
+            path = NULL;
+            break;
+        }
+    }
+    if (path == NULL) {
+        fprintf(stderr, "usage: vld-replay [--fast] [--allocate] <trace file>\n"
+                        "       vld-replay --generate <trace file>\n");
+        return EXIT_FAILURE;
+    }
+    if (!load(path, replay))
+        return EXIT_FAILURE;
+
+    std::vector<std::atomic<UINT8> > done(replay.ops.size());
+    replay.done.swap(done);
+    for (size_t i = 0; i < replay.ops.size(); i++) {
+        replay.done[i].store(0);
+    }
+    replay.next.store(0);
+    // The core's warnings, about the events which are missing from the trace,
+    // would disturb the measurements.
+    SetReportFile(NULL, FALSE, FALSE);
+    size_t baseline = g_metadataBytes.load();
+    g_metadataPeak.store(baseline);
+    replay.core = new ReplayCore;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < replay.threads.size(); i++) {
+        threads.push_back(std::thread(replayThread, std::ref(replay), std::ref(replay.threads[i])));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    std::vector<UINT32> latencies [3];
+    for (size_t i = 0; i < replay.threads.size(); i++) {
+        for (int op = 0; op < 3; op++) {
+            latencies[op].insert(latencies[op].end(),
+                replay.threads[i].latencies[op].begin(), replay.threads[i].latencies[op].end());
+        }
+    }
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double opspersecond = (seconds > 0.0) ? (double)replay.ops.size() / seconds : 0.0;
+
+    printf("# %s: %llu events, %llu threads, %s%s\n", path, (unsigned long long)replay.ops.size(),
+        (unsigned long long)replay.threads.size(), replay.fast ? "as fast as possible" : "original interleaving",
+        replay.allocate ? ", with allocations" : "");
+    printf("# operation\toperations\tns/op\tcounters\n");
+    printLatencies("replay_alloc", latencies[VLD_TRACE_ALLOC - VLD_TRACE_ALLOC]);
+    printLatencies("replay_free", latencies[VLD_TRACE_FREE - VLD_TRACE_ALLOC]);
+    printLatencies("replay_realloc", latencies[VLD_TRACE_REALLOC - VLD_TRACE_ALLOC]);
+    printf("replay_total\t%llu\t%.2f\tops_per_sec=%.2f\tpeak_metadata_bytes=%llu\tlive_blocks=%llu\n",
+        (unsigned long long)replay.ops.size(), (replay.ops.empty()) ? 0.0 : seconds * 1e9 / (double)replay.ops.size(),
+        opspersecond, (unsigned long long)(g_metadataPeak.load() - baseline),
+        (unsigned long long)replay.core->countBlocks());
+    fflush(stdout);
+
+    for (size_t i = 0; i < replay.slots.size(); i++) {
+        free(replay.slots[i]);
+    }
+    delete replay.core;
+    return EXIT_SUCCESS;
+}
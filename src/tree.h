@@ -29,6 +29,7 @@
 Applications should never include this header."
 #endif
 
+#include <cassert>
 #include "vldheap.h" // Provides internal new and delete operators.
 #include "criticalsection.h"
 
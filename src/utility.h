@@ -30,12 +30,18 @@ Applications should never include this header."
 #endif
 
 #include <cstdio>
+#ifdef _WIN32
 #include <windows.h>
 #include <intrin.h>
+#else
+#include "linux/platform.h"
+#endif
 
 #ifdef _WIN64
 #define ADDRESSFORMAT       L"0x%.16X"   // Format string for 64-bit addresses
 #define ADDRESSCPPFORMAT    L"0x{:016X}" // Format string for 64-bit addresses
+#elif defined(VLD_64BIT_ADDRESSES)
+#define ADDRESSFORMAT       L"0x%.16lX"  // Format string for 64-bit addresses (glibc)
 #else
 #define ADDRESSFORMAT       L"0x%.8X"    // Format string for 32-bit addresses
 #define ADDRESSCPPFORMAT    L"0x{:08X}"  // Format string for 32-bit addresses
@@ -68,6 +74,8 @@ struct context_t
     DWORD64 Rbp;
     DWORD64 Rsp;
     DWORD64 Rip;
+#elif !defined(_WIN32)
+    UINT_PTR bp;    // Frame pointer of the function which captured the context.
 #endif // _M_IX86
 };
 
@@ -88,6 +96,16 @@ struct context_t
     context_.Rbp = _ctx.Rbp; context_.Rsp = _ctx.Rsp; context_.Rip = _ctx.Rip;  \
     context_.fp = (UINT_PTR)_ReturnAddress();}
 #define GET_RETURN_ADDRESS(context)  (context.fp)
+#elif !defined(_WIN32)
+// On Linux, the return address into the code which called the hooked
+// function locates the first frame to report, and the hooked function's frame
+// pointer is where the frame pointer walk starts.
+#define CAPTURE_CONTEXT()                                                       \
+    context_t context_;                                                         \
+    context_.fp = (UINT_PTR)__builtin_return_address(0);                        \
+    context_.func = 0;                                                          \
+    context_.bp = (UINT_PTR)__builtin_frame_address(0);
+#define GET_RETURN_ADDRESS(context)  (context.fp)
 #else
 // If you want to retarget Visual Leak Detector to another processor
 // architecture then you'll need to provide an architecture-specific macro to
@@ -97,7 +115,9 @@ struct context_t
 #endif // _M_IX86 || _M_X64
 
 // Miscellaneous definitions
+#ifdef _WIN32
 #define R2VA(moduleBase, rva)  (((PBYTE)moduleBase) + rva) // Relative Virtual Address to Virtual Address conversion.
+#endif
 #define BYTEFORMATBUFFERLENGTH 4
 #define HEXDUMPLINELENGTH      58
 
@@ -107,6 +127,7 @@ enum encoding_e {
     unicode
 };
 
+#ifdef _WIN32
 // This structure allows us to build a table of APIs which should be patched
 // through to replacement functions provided by VLD.
 struct patchentry_t
@@ -123,16 +144,19 @@ struct moduleentry_t
     UINT_PTR        moduleBase;       // The base address of the exporting module (filled in at runtime when the modules are loaded).
     patchentry_t*   patchTable;
 };
+#endif // _WIN32
 
 // Utility functions. See function definitions for details.
 VOID DumpMemoryA (LPCVOID address, SIZE_T length);
 VOID DumpMemoryW (LPCVOID address, SIZE_T length);
+#ifdef _WIN32
 BOOL FindImport (HMODULE importmodule, HMODULE exportmodule, LPCSTR exportmodulename, LPCSTR importname);
 BOOL FindPatch (HMODULE importmodule, LPCSTR exportmodulename, LPCVOID replacement);
 VOID InsertReportDelay ();
 BOOL IsModulePatched (HMODULE importmodule, moduleentry_t patchtable [], UINT tablesize);
 BOOL PatchImport (HMODULE importmodule, moduleentry_t *module);
 BOOL PatchModule (HMODULE importmodule, moduleentry_t patchtable [], UINT tablesize);
+#endif // _WIN32
 VOID Print (LPWSTR message);
 VOID Report (LPCWSTR format, ...);
 #ifndef NDEBUG
@@ -144,23 +168,29 @@ VOID Report (LPCWSTR format, ...);
 #define DbgReport(...)
 #define DbgTrace(...)
 #endif
+#ifdef _WIN32
 VOID RestoreImport (HMODULE importmodule, moduleentry_t* module);
 VOID RestoreModule (HMODULE importmodule, moduleentry_t patchtable [], UINT tablesize);
+#endif
 VOID SetReportEncoding (encoding_e encoding);
 VOID SetReportFile (FILE *file, BOOL copydebugger, BOOL copytostdout);
 LPWSTR AppendString (LPWSTR dest, LPCWSTR source);
 BOOL StrToBool (LPCWSTR s);
+#ifdef _WIN32
 #if _WIN32_WINNT < 0x0600 // Windows XP or earlier, no GetProcessIdOfThread()
 DWORD _GetProcessIdOfThread (HANDLE thread);
 #define GetProcessIdOfThread _GetProcessIdOfThread
 #endif
 void ConvertModulePathToAscii( LPCWSTR modulename, LPSTR * modulenamea );
+#endif
 DWORD CalculateCRC32(UINT_PTR p, UINT startValue = 0xD202EF8D);
+#ifdef _WIN32
 // Formats a message string using the specified message and variable
 // list of arguments.
 void GetFormattedMessage(DWORD last_error);
 HMODULE GetCallingModule(UINT_PTR pCaller);
 DWORD FilterFunction(long);
+#endif
 BOOL LoadBoolOption(LPCWSTR optionname, LPCWSTR defaultvalue, LPCWSTR inipath);
 UINT LoadIntOption(LPCWSTR optionname, UINT defaultvalue, LPCWSTR inipath);
 VOID LoadStringOption(LPCWSTR optionname, LPWSTR outputbuffer, UINT buffersize, LPCWSTR inipath);
\ No newline at end of file
@@ -26,6 +26,7 @@
 #pragma comment(lib, "dbghelp.lib")
 
 #include <sys/stat.h>
+#include <math.h>
 
 #define VLDBUILD         // Declares that we are building Visual Leak Detector.
 #include "callstack.h"   // Provides a class for handling call stacks.
@@ -38,9 +39,10 @@
 #include "loaderlock.h"
 #include "tchar.h"
 
-#define BLOCK_MAP_RESERVE   64  // This should strike a balance between memory use and a desire to minimize heap hits.
-#define HEAP_MAP_RESERVE    2   // Usually there won't be more than a few heaps in the process, so this should be small.
 #define MODULE_SET_RESERVE  16  // There are likely to be several modules loaded in the process.
+#define HEAPPROFILE_FORMAT       1      // Version of the heap profile file format.
+#define HEAPPROFILE_MAX_THREADS  8      // Maximum number of threads aggregating a heap profile.
+#define HEAPPROFILE_PARALLEL_MIN 65536  // Heap profiles of fewer blocks are aggregated on the calling thread.
 
 // Imported global variables.
 extern vldblockheader_t *g_vldBlockList;
@@ -51,7 +53,6 @@ extern CriticalSection   g_vldHeapLock;
 HANDLE           g_currentProcess; // Pseudo-handle for the current process.
 HANDLE           g_currentThread;  // Pseudo-handle for the current thread.
 HANDLE           g_processHeap;    // Handle to the process's heap (COM allocations come from here).
-CriticalSection  g_heapMapLock;    // Serializes access to the heap and block maps.
 ReportHookSet*   g_pReportHooks;
 DbgHelp g_DbgHelp;
 ImageDirectoryEntries g_Ide;
@@ -294,6 +295,9 @@ BOOL WINAPI DllEntryPoint(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpReserved
         if (!_CRT_INIT(hinstDLL, fdwReason, lpReserved))
             return(FALSE);
 
+    if (fdwReason == DLL_THREAD_DETACH)
+        g_vld.releaseTls();
+
     if (fdwReason == DLL_PROCESS_DETACH || fdwReason == DLL_THREAD_DETACH)
         if (!_CRT_INIT(hinstDLL, fdwReason, lpReserved))
             return(FALSE);
@@ -344,9 +348,6 @@ VisualLeakDetector::VisualLeakDetector ()
 
     // Initialize configuration options and related private data.
     _wcsnset_s(m_forcedModuleList, MAXMODULELISTLENGTH, '\0', _TRUNCATE);
-    m_maxDataDump    = 0xffffffff;
-    m_maxTraceFrames = 0xffffffff;
-    m_options        = 0x0;
     m_reportFile     = NULL;
     wcsncpy_s(m_reportFilePath, MAX_PATH, VLD_DEFAULT_REPORT_FILE_NAME, _TRUNCATE);
     m_status         = 0x0;
@@ -373,7 +374,11 @@ VisualLeakDetector::VisualLeakDetector ()
         LdrUnlockLoaderLock = (LdrUnlockLoaderLock_t)GetProcAddress(ntdll, "LdrUnlockLoaderLock");
     }
 
-    // Load configuration options.
+    // Load configuration options. The tracking options have their defaults
+    // set by BlockTracker.
+    m_monitorThread    = NULL;
+    m_monitorStop      = NULL;
+    m_traceFilePath[0] = '\0';
     configure();
     if (m_options & VLD_OPT_VLDOFF) {
         Report(L"Visual Leak Detector is turned off.\n");
@@ -406,27 +411,27 @@ VisualLeakDetector::VisualLeakDetector ()
 
     LoaderLock ll;
 
-    g_heapMapLock.Initialize();
+    g_heapMapLock.Initialize(L"g_heapMapLock");
     g_vldHeap         = HeapCreate(0x0, 0, 0);
-    g_vldHeapLock.Initialize();
+    g_vldHeapLock.Initialize(L"g_vldHeapLock");
     g_pReportHooks    = new ReportHookSet;
 
     // Initialize remaining private data.
-    m_heapMap         = new HeapMap;
-    m_heapMap->reserve(HEAP_MAP_RESERVE);
+    initializeTracking();
     m_iMalloc         = NULL;
-    m_requestCurr     = 1;
-    m_totalAlloc      = 0;
-    m_curAlloc        = 0;
-    m_maxAlloc        = 0;
     m_loadedModules   = new ModuleSet();
-    m_optionsLock.Initialize();
-    m_modulesLock.Initialize();
+    m_modulesLock.Initialize(L"m_modulesLock");
     m_selfTestFile    = __FILE__;
     m_selfTestLine    = 0;
-    m_tlsIndex        = TlsAlloc();
-    m_tlsLock.Initialize();
+    m_tlsLock.Initialize(L"m_tlsLock");
     m_tlsMap          = new TlsMap;
+    m_tlsFreeList     = NULL;
+
+    // Open the block database before attaching to any module, so that every
+    // module and block gets recorded.
+    DWORD blockdberror = ERROR_SUCCESS;
+    if ((m_blockDbPath[0] != '\0') && !m_blockDb.open(m_blockDbPath, m_blockDbSize))
+        blockdberror = GetLastError();
 
     if (m_options & VLD_OPT_SELF_TEST) {
         // Self-test mode has been enabled. Intentionally leak a small amount of
@@ -454,14 +459,6 @@ VisualLeakDetector::VisualLeakDetector ()
         InsertReportDelay();
     }
 
-    // This is highly unlikely to happen, but just in case, check to be sure
-    // we got a valid TLS index.
-    if (m_tlsIndex == TLS_OUT_OF_INDEXES) {
-        Report(L"ERROR: Visual Leak Detector could not be installed because thread local"
-            L"  storage could not be allocated.");
-        return;
-    }
-
     // Initialize the symbol handler. We use it for obtaining source file/line
     // number information and function names for the memory leak report.
     LPWSTR symbolpath = buildSymbolSearchPath();
@@ -514,6 +511,32 @@ VisualLeakDetector::VisualLeakDetector ()
             L"  Unicode characters, so the report will also be sent to a file. If no file has\n"
             L"  been specified, the default file name is \"" VLD_DEFAULT_REPORT_FILE_NAME L"\".\n");
     }
+
+    if (m_monitorInterval != 0) {
+        // Start the leak growth monitor. It runs at a low priority and only
+        // reads the per-site counters, so it barely disturbs the program.
+        m_monitorStop = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (m_monitorStop != NULL)
+            m_monitorThread = CreateThread(NULL, 0, monitorProc, NULL, CREATE_SUSPENDED, NULL);
+        if (m_monitorThread != NULL) {
+            SetThreadPriority(m_monitorThread, THREAD_PRIORITY_LOWEST);
+            ResumeThread(m_monitorThread);
+        }
+        else {
+            Report(L"WARNING: Visual Leak Detector: The leak growth monitor couldn't be started (error=%lu).\n",
+                GetLastError());
+        }
+    }
+    if ((m_traceFilePath[0] != '\0') && !m_trace.open(m_traceFilePath)) {
+        Report(L"WARNING: Visual Leak Detector: The event trace %s couldn't be created (error=%lu).\n",
+            m_traceFilePath, GetLastError());
+        m_traceFilePath[0] = '\0';
+    }
+    if (blockdberror != ERROR_SUCCESS) {
+        Report(L"WARNING: Visual Leak Detector: The block database %s couldn't be created (error=%lu).\n",
+            m_blockDbPath, blockdberror);
+        m_blockDbPath[0] = '\0';
+    }
     reportConfig();
 }
 
@@ -523,15 +546,23 @@ bool VisualLeakDetector::waitForAllVLDThreads()
     DWORD dwCurProcessID = GetCurrentProcessId();
     int waitcount = 0;
 
-    // See if any threads that have ever entered VLD's code are still active.
-    CriticalSectionLocker<> cs(m_tlsLock);
-    for (TlsMap::Iterator tlsit = m_tlsMap->begin(); tlsit != m_tlsMap->end(); ++tlsit) {
-        if ((*tlsit).second->threadId == GetCurrentThreadId()) {
+    // See if any threads that have entered VLD's code are still active. Only
+    // live threads are in the TlsMap, as exiting threads remove themselves.
+    // Take a copy of their IDs, because exiting threads need m_tlsLock.
+    Set<DWORD> threadIds;
+    {
+        CriticalSectionLocker<> cs(m_tlsLock);
+        for (TlsMap::Iterator tlsit = m_tlsMap->begin(); tlsit != m_tlsMap->end(); ++tlsit) {
+            threadIds.insert((*tlsit).first);
+        }
+    }
+    for (Set<DWORD>::Iterator threadit = threadIds.begin(); threadit != threadIds.end(); ++threadit) {
+        if (*threadit == GetCurrentThreadId()) {
             // Don't wait for the current thread to exit.
             continue;
         }
 
-        HANDLE thread = OpenThread(SYNCHRONIZE | THREAD_QUERY_INFORMATION, FALSE, (*tlsit).second->threadId);
+        HANDLE thread = OpenThread(SYNCHRONIZE | THREAD_QUERY_INFORMATION, FALSE, *threadit);
         if (thread == NULL) {
             // Couldn't query this thread. We'll assume that it exited.
             continue; // XXX should we check GetLastError()?
@@ -631,8 +662,24 @@ VisualLeakDetector::~VisualLeakDetector ()
         if (kernelBase != NULL)
             RestoreImport(kernelBase, ntdllPatch);
 
+        if (m_monitorThread != NULL) {
+            // Stop the leak growth monitor. If the process is exiting, the
+            // thread has already been terminated.
+            SetEvent(m_monitorStop);
+            WaitForSingleObject(m_monitorThread, VLD_MONITOR_STOP_TIMEOUT);
+            CloseHandle(m_monitorThread);
+            m_monitorThread = NULL;
+        }
+        if (m_monitorStop != NULL) {
+            CloseHandle(m_monitorStop);
+            m_monitorStop = NULL;
+        }
+
         BOOL threadsactive = waitForAllVLDThreads();
 
+        // No more events can be recorded. Write the remaining ones.
+        m_trace.close();
+
         if (m_status & VLD_STATUS_NEVER_ENABLED) {
             // Visual Leak Detector started with leak detection disabled and
             // it was never enabled at runtime. A lot of good that does.
@@ -643,15 +690,7 @@ VisualLeakDetector::~VisualLeakDetector ()
             SIZE_T leaks_count = ReportLeaks();
 
             // Show a summary.
-            if (leaks_count == 0) {
-                Report(L"No memory leaks detected.\n");
-            }
-            else {
-                Report(L"Visual Leak Detector detected %Iu memory leak", leaks_count);
-                Report((leaks_count > 1) ? L"s (%Iu bytes).\n" : L" (%Iu bytes).\n", m_curAlloc);
-                Report(L"Largest number used: %Iu bytes.\n", m_maxAlloc);
-                Report(L"Total allocations: %Iu bytes.\n", m_totalAlloc);
-            }
+            reportSummary(leaks_count);
         }
 
         // Free resources used by the symbol handler.
@@ -661,18 +700,12 @@ VisualLeakDetector::~VisualLeakDetector ()
                 GetLastError());
         }
 
-        {
-            // Free internally allocated resources used by the heapmap and blockmap.
-            CriticalSectionLocker<> cs(g_heapMapLock);
-            for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
-                BlockMap *blockmap = &(*heapit).second->blockMap;
-                for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
-                    delete (*blockit).second;
-                }
-                delete blockmap;
-            }
-            delete m_heapMap;
-        }
+        // The blocks still in the block database are the leaks. Mark it as
+        // complete.
+        m_blockDb.close();
+
+        // Free internally allocated resources used by the heapmap and blockmap.
+        freeTracking();
         delete m_loadedModules;
 
         {
@@ -682,11 +715,20 @@ VisualLeakDetector::~VisualLeakDetector ()
                 delete (*tlsit).second;
             }
             delete m_tlsMap;
+            m_tlsMap = NULL;
+            while (m_tlsFreeList != NULL) {
+                tls_t *tls = m_tlsFreeList;
+                m_tlsFreeList = tls->next;
+                delete tls;
+            }
         }
         if (threadsactive) {
             Report(L"WARNING: Visual Leak Detector: Some threads appear to have not terminated normally.\n"
                 L"  This could cause inaccurate leak detection results, including false positives.\n");
         }
+#ifdef VLD_LOCK_PROFILING
+        reportLockStatistics();
+#endif
         Report(L"Visual Leak Detector is now exiting.\n");
 
         delete g_pReportHooks;
@@ -696,8 +738,9 @@ VisualLeakDetector::~VisualLeakDetector ()
     }
     else {
         // VLD failed to load properly.
-        delete m_heapMap;
+        freeTracking();
         delete m_tlsMap;
+        m_tlsMap = NULL;
         delete g_pReportHooks;
         g_pReportHooks = NULL;
     }
@@ -709,10 +752,6 @@ VisualLeakDetector::~VisualLeakDetector ()
     g_heapMapLock.Delete();
     g_vldHeapLock.Delete();
 
-    if (m_tlsIndex != TLS_OUT_OF_INDEXES) {
-        TlsFree(m_tlsIndex);
-    }
-
     if (m_reportFile != NULL) {
         fclose(m_reportFile);
     }
@@ -797,6 +836,8 @@ VOID VisualLeakDetector::attachToLoadedModules (ModuleSet *newmodules)
         if (state == 0 || state == 2)
             continue;
 
+        m_blockDb.addModule((*newit).addrLow, (*newit).addrHigh - (*newit).addrLow, (*newit).path.c_str());
+
         DWORD64 modulebase = (DWORD64) (*newit).addrLow;
         LPCWSTR modulename = (*newit).name.c_str();
         LPCWSTR modulepath = (*newit).path.c_str();
@@ -1151,6 +1192,21 @@ VOID VisualLeakDetector::configure ()
     if (m_maxTraceFrames < 1) {
         m_maxTraceFrames = VLD_DEFAULT_MAX_TRACE_FRAMES;
     }
+    m_sampleRate = LoadIntOption(L"SampleRate", 0, inipath);
+    m_minTrackedSize = LoadIntOption(L"MinTrackedSize", 0, inipath);
+    m_maxTrackedSize = LoadIntOption(L"MaxTrackedSize", 0, inipath);
+    if (m_maxTrackedSize == 0) {
+        m_maxTrackedSize = (SIZE_T)-1;
+    }
+    m_mapUntrackedSizes = (LoadBoolOption(L"MapUntrackedSizes", L"yes", inipath) != FALSE);
+    m_peakHysteresis = LoadIntOption(L"PeakSnapshotHysteresis", 0, inipath);
+    m_peakInterval = LoadIntOption(L"PeakSnapshotInterval", VLD_DEFAULT_PEAK_INTERVAL, inipath);
+    m_peak.trigger = (LONG64)m_peakHysteresis;
+    m_monitorInterval = LoadIntOption(L"MonitorInterval", 0, inipath);
+    m_monitorIntervals = LoadIntOption(L"MonitorIntervals", VLD_DEFAULT_MONITOR_INTERVALS, inipath);
+    if (m_monitorIntervals < 1) {
+        m_monitorIntervals = VLD_DEFAULT_MONITOR_INTERVALS;
+    }
 
     // Read the force-include module list.
     LoadStringOption(L"ForceIncludeModules", m_forcedModuleList, MAXMODULELISTLENGTH, inipath);
@@ -1169,6 +1225,22 @@ VOID VisualLeakDetector::configure ()
     WCHAR* path = _wfullpath(m_reportFilePath, filename, MAX_PATH);
     assert(path);
 
+    // Read the event trace file, if any.
+    LoadStringOption(L"TraceFile", filename, MAX_PATH, inipath);
+    if ((filename[0] == '\0') || (_wfullpath(m_traceFilePath, filename, MAX_PATH) == NULL)) {
+        m_traceFilePath[0] = '\0';
+    }
+
+    // Read the block database file, if any.
+    LoadStringOption(L"BlockDatabase", filename, MAX_PATH, inipath);
+    if ((filename[0] == '\0') || (_wfullpath(m_blockDbPath, filename, MAX_PATH) == NULL)) {
+        m_blockDbPath[0] = '\0';
+    }
+    UINT blockdbsize = LoadIntOption(L"BlockDatabaseSize", BLOCKDB_DEFAULT_SIZE, inipath);
+    if (blockdbsize != 0) {
+        m_blockDbSize = (ULONG64)blockdbsize * 1024 * 1024;
+    }
+
     LoadStringOption(L"ReportTo", buffer, buffersize, inipath);
     if (_wcsicmp(buffer, L"both") == 0) {
         m_options |= (VLD_OPT_REPORT_TO_DEBUGGER | VLD_OPT_REPORT_TO_FILE);
@@ -1201,6 +1273,9 @@ VOID VisualLeakDetector::configure ()
     if (_wcsicmp(buffer, L"safe") == 0) {
         m_options |= VLD_OPT_SAFE_STACK_WALK;
     }
+    else if (_wcsicmp(buffer, L"none") == 0) {
+        m_options |= VLD_OPT_NO_STACK_CAPTURE;
+    }
 
     if (LoadBoolOption(L"ValidateHeapAllocs", L"", inipath)) {
         m_options |= VLD_OPT_VALIDATE_HEAPFREE;
@@ -1238,53 +1313,18 @@ BOOL VisualLeakDetector::enabled ()
     return ((tls->flags & VLD_TLS_ENABLED) != 0);
 }
 
-// eraseduplicates - Erases, from the block maps, blocks that appear to be
-//   duplicate leaks of an already identified leak.
-//
-//  - element (IN): BlockMap Iterator referencing the block of which to search
-//      for duplicates.
-//
-//  Return Value:
-//
-//    Returns the number of duplicate blocks erased from the block map.
-//
-SIZE_T VisualLeakDetector::eraseDuplicates (const BlockMap::Iterator &element, Set<blockinfo_t*> &aggregatedLeaks)
-{
-    blockinfo_t *elementinfo = (*element).second;
+// The calling thread's thread local storage structure. This is a plain
+// pointer, so it needs neither dynamic initialization nor destruction.
+static thread_local tls_t* t_tls = NULL;
 
-    if (elementinfo->callStack == NULL)
-        return 0;
-
-    SIZE_T       erased = 0;
-    // Iterate through all block maps, looking for blocks with the same size
-    // and callstack as the specified element.
-    CriticalSectionLocker<> cs(g_heapMapLock);
-    for (HeapMap::Iterator heapit = m_heapMap->begin(); heapit != m_heapMap->end(); ++heapit) {
-        BlockMap *blockmap = &(*heapit).second->blockMap;
-        for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
-            if (blockit == element) {
-                // Don't delete the element of which we are searching for
-                // duplicates.
-                continue;
-            }
-            blockinfo_t *info = (*blockit).second;
-            if (info->callStack == NULL)
-                continue;
-            Set<blockinfo_t*>::Iterator it = aggregatedLeaks.find(info);
-            if (it != aggregatedLeaks.end())
-                continue;
-            if ((info->size == elementinfo->size) && (*(info->callStack) == *(elementinfo->callStack))) {
-                // Found a duplicate. Mark it.
-                aggregatedLeaks.insert(info);
-                erased++;
-            }
-        }
-    }
-
-    return erased;
-}
+// Set by the outermost UntrackedContext while the calling thread makes an
+// allocation which is ignored. It is kept out of tls_t, so that ignoring an
+// allocation never creates the structure.
+static thread_local bool t_untracked = false;
 
 // gettls - Obtains the thread local storage structure for the calling thread.
+//   The structure is cached in a thread_local pointer, so only the first call
+//   made by each thread takes m_tlsLock.
 //
 //  Return Value:
 //
@@ -1294,8 +1334,7 @@ SIZE_T VisualLeakDetector::eraseDuplicates (const BlockMap::Iterator &element, S
 tls_t* VisualLeakDetector::getTls ()
 {
     // Get the pointer to this thread's thread local storage structure.
-    tls_t* tls = (tls_t*)TlsGetValue(m_tlsIndex);
-    assert(GetLastError() == ERROR_SUCCESS);
+    tls_t* tls = t_tls;
 
     if (tls == NULL) {
         DWORD threadId = GetCurrentThreadId();
@@ -1303,13 +1342,22 @@ tls_t* VisualLeakDetector::getTls ()
         CriticalSectionLocker<> cs(m_tlsLock);
         TlsMap::Iterator it = m_tlsMap->find(threadId);
         if (it == m_tlsMap->end()) {
-            // This thread's thread local storage structure has not been allocated.
-            tls = new tls_t;
+            // This thread's thread local storage structure has not been
+            // allocated. Reuse one from a thread that has exited, if possible.
+            tls = m_tlsFreeList;
+            if (tls != NULL) {
+                m_tlsFreeList = tls->next;
+            }
+            else {
+                tls = new tls_t;
+                tls->traceRing = NULL;
+            }
 
-            // Add this thread's TLS to the TlsSet.
+            // Add this thread's TLS to the TlsMap.
             m_tlsMap->insert(threadId, tls);
         } else {
-            // Already had a thread with this ID
+            // Already had a thread with this ID. Its previous owner must have
+            // exited without VLD being notified.
             tls = (*it).second;
         }
 
@@ -1317,310 +1365,191 @@ tls_t* VisualLeakDetector::getTls ()
         tls->flags = 0x0;
         tls->oldFlags = 0x0;
         tls->threadId = threadId;
+        tls->heap = NULL;
         tls->blockWithoutGuard = NULL;
-        TlsSetValue(m_tlsIndex, tls);
+        tls->newBlockWithoutGuard = NULL;
+        tls->size = 0;
+        tls->requestedSize = 0;
+        tls->sampleRandom = (threadId * 2654435761u) ^ GetTickCount();
+        if (tls->sampleRandom == 0)
+            tls->sampleRandom = 1;
+        tls->sampleBytes = (m_sampleRate != 0) ? nextSampleInterval(tls->sampleRandom) : 0;
+        tls->next = NULL;
+        t_tls = tls;
     }
 
     return tls;
 }
 
-// mapblock - Tracks memory allocations. Information about allocated blocks is
-//   collected and then the block is mapped to this information.
-//
-//  - heap (IN): Handle to the heap from which the block has been allocated.
-//
-//  - mem (IN): Pointer to the memory block being allocated.
-//
-//  - size (IN): Size, in bytes, of the memory block being allocated.
-//
-//  - addrOfRetAddr (IN): Address of return address at the time this allocation
-//      first entered VLD's code. This is used from determining the starting
-//      point for the stack trace.
+// releasetls - Reclaims the thread local storage structure of the calling
+//   thread, which is exiting. The structure is removed from the TlsMap and put
+//   on the free list, so that the map only ever holds live threads.
 //
-//  - crtalloc (IN): Should be set to TRUE if this allocation is a CRT memory
-//      block. Otherwise should be FALSE.
+//  Note: If the thread allocates memory after VLD has been notified of its
+//    exit (e.g. from a DLL notified after VLD), a new structure is assigned
+//    to it and is not reclaimed until VLD exits.
 //
 //  Return Value:
 //
 //    None.
 //
-VOID VisualLeakDetector::mapBlock (HANDLE heap, LPCVOID mem, SIZE_T size, bool debugcrtalloc, bool ucrt, DWORD threadId, blockinfo_t* &pblockInfo)
+VOID VisualLeakDetector::releaseTls ()
 {
-    CriticalSectionLocker<> cs(g_heapMapLock);
-
-    // Record the block's information.
-    blockinfo_t* blockinfo = new blockinfo_t();
-    blockinfo->callStack = NULL;
-    pblockInfo = blockinfo;
-    blockinfo->threadId = threadId;
-    blockinfo->serialNumber = m_requestCurr++;
-    blockinfo->size = size;
-    blockinfo->reported = false;
-    blockinfo->debugCrtAlloc = debugcrtalloc;
-    blockinfo->ucrt = ucrt;
-
-    if (SIZE_MAX - m_totalAlloc > size)
-        m_totalAlloc += size;
-    else
-        m_totalAlloc = SIZE_MAX;
-    m_curAlloc += size;
+    tls_t* tls = t_tls;
+    if ((tls == NULL) || (m_options & VLD_OPT_VLDOFF))
+        return;
+    t_tls = NULL;
 
-    if (m_curAlloc > m_maxAlloc)
-        m_maxAlloc = m_curAlloc;
+    CriticalSectionLocker<> cs(m_tlsLock);
+    if (m_tlsMap == NULL)
+        return;
+    TlsMap::Iterator it = m_tlsMap->find(tls->threadId);
+    if ((it != m_tlsMap->end()) && ((*it).second == tls)) {
+        m_tlsMap->erase(it);
+    }
+    tls->next = m_tlsFreeList;
+    m_tlsFreeList = tls;
+}
 
-    // Insert the block's information into the block map.
-    HeapMap::Iterator heapit = m_heapMap->find(heap);
-    if (heapit == m_heapMap->end()) {
-        // We haven't mapped this heap to a block map yet. Do it now.
-        mapHeap(heap);
-        heapit = m_heapMap->find(heap);
-        assert(heapit != m_heapMap->end());
-    }
-    BlockMap* blockmap = &(*heapit).second->blockMap;
-    BlockMap::Iterator blockit = blockmap->insert(mem, blockinfo);
-    if (blockit == blockmap->end()) {
-        // A block with this address has already been allocated. The
-        // previously allocated block must have been freed (probably by some
-        // mechanism unknown to VLD), or the heap wouldn't have allocated it
-        // again. Replace the previously allocated info with the new info.
-        blockit = blockmap->find(mem);
-        blockinfo_t* info = (*blockit).second;
-        m_curAlloc -= info->size;
-        Report(L"VLD: New allocation at already allocated address: 0x%p with size: %u and new size: %u\n", mem, info->size, size);
-        delete info;
-        blockmap->erase(blockit);
-        blockmap->insert(mem, blockinfo);
-    }
-}
-
-// mapheap - Tracks heap creation. Creates a block map for tracking individual
-//   allocations from the newly created heap and then maps the heap to this
-//   block map.
-//
-//  - heap (IN): Handle to the newly created heap.
+// ismappedrequest - Decides whether a heap block is mapped, when blocks outside
+//   the tracked size range are ignored. The hooks of the CRT, MFC and COM
+//   allocators have already checked the size requested from them, which is
+//   smaller than the heap block (by the debug CRT header, for instance), so
+//   their decision is followed for the blocks which they allocate. Other
+//   blocks are requested from the heap directly.
+//
+//  - size (IN): Size, in bytes, of the heap block.
 //
 //  Return Value:
 //
-//    None.
+//    Returns true if the block must be mapped.
 //
-VOID VisualLeakDetector::mapHeap (HANDLE heap)
+bool VisualLeakDetector::isMappedRequest (SIZE_T size)
 {
-    CriticalSectionLocker<> cs(g_heapMapLock);
-
-    // Create a new block map for this heap and insert it into the heap map.
-    heapinfo_t* heapinfo = new heapinfo_t;
-    heapinfo->blockMap.reserve(BLOCK_MAP_RESERVE);
-    heapinfo->flags = 0x0;
-
-    HeapMap::Iterator heapit = m_heapMap->insert(heap, heapinfo);
-    if (heapit == m_heapMap->end()) {
-        // Somehow this heap has been created twice without being destroyed,
-        // or at least it was destroyed without VLD's knowledge. Unmap the heap
-        // from the existing heapinfo, and remap it to the new one.
-        Report(L"WARNING: Visual Leak Detector detected a duplicate heap (" ADDRESSFORMAT L").\n", heap);
-        heapit = m_heapMap->find(heap);
-        unmapHeap((*heapit).first);
-        m_heapMap->insert(heap, heapinfo);
+    if (t_untracked)
+        return false;
+    tls_t* tls = t_tls;
+    if (tls != NULL) {
+        if (GET_RETURN_ADDRESS(tls->context) != NULL)
+            return true;
     }
+    return isTrackedSize(size);
 }
 
-// unmapblock - Tracks memory blocks that are freed. Unmaps the specified block
-//   from the block's information, relinquishing internally allocated resources.
+// sampleallocation - Decides whether an allocation is tracked, when only
+//   sampled allocations are, by charging its size to the calling thread's
+//   sampling interval. The heap hooks call it before they capture the context,
+//   so that the allocations which aren't sampled cost nothing else.
+//   Reallocations of tracked blocks are always tracked, so that the block map
+//   never holds stale addresses. The blocks of the CRT, MFC and COM allocations
+//   follow the decision made by their hooks (see sampleRequest), without being
+//   charged again.
 //
-//  - heap (IN): Handle to the heap to which this block is being freed.
+//  - heap (IN): Handle to the heap of the block.
 //
-//  - mem (IN): Pointer to the memory block being freed.
+//  - mem (IN): Pointer to the allocated block, or to the block which was
+//      reallocated.
+//
+//  - newmem (IN): Pointer to the reallocated block, or NULL.
+//
+//  - size (IN): Size, in bytes, of the allocated block.
 //
 //  Return Value:
 //
-//    None.
+//    Returns true if the allocation must be recorded.
 //
-VOID VisualLeakDetector::unmapBlock (HANDLE heap, LPCVOID mem, const context_t &context)
+bool VisualLeakDetector::sampleAllocation (HANDLE heap, LPCVOID mem, LPCVOID newmem, SIZE_T size)
 {
-    if (NULL == mem)
-        return;
+    tls_t *tls = getTls();
+    if (tls->flags & VLD_TLS_SAMPLED)
+        return true;
+    if ((newmem != NULL) && isBlockMapped(heap, mem))
+        return true;
+    if (t_untracked)
+        return false;
 
-    // Find this heap's block map.
-    CriticalSectionLocker<> cs(g_heapMapLock);
-    HeapMap::Iterator heapit = m_heapMap->find(heap);
-    if (heapit == m_heapMap->end()) {
-        // We don't have a block map for this heap. We must not have monitored
-        // this allocation (probably happened before VLD was initialized).
-        return;
-    }
+    tls->sampleBytes -= (LONG64)size;
+    if (tls->sampleBytes > 0)
+        return false;
 
-    // Find this block in the block map.
-    BlockMap           *blockmap = &(*heapit).second->blockMap;
-    BlockMap::Iterator  blockit = blockmap->find(mem);
-    if (blockit == blockmap->end())
-    {
-        // This memory block is not in the block map. We must not have monitored this
-        // allocation (probably happened before VLD was initialized).
-
-        // This can also result from allocating on one heap, and freeing on another heap.
-        // This is an especially bad way to corrupt the application.
-        // Now we have to search through every heap and every single block in each to make
-        // sure that this is indeed the case.
-        if (m_options & VLD_OPT_VALIDATE_HEAPFREE)
-        {
-            HANDLE other_heap = NULL;
-            blockinfo_t* alloc_block = findAllocedBlock(mem, other_heap); // other_heap is an out parameter
-            bool diff = other_heap != heap; // Check indeed if the other heap is different
-            if (alloc_block && alloc_block->callStack && diff)
-            {
-                Report(L"CRITICAL ERROR!: VLD reports that memory was allocated in one heap and freed in another.\nThis will result in a corrupted heap.\nAllocation Call stack.\n");
-                Report(L"---------- Block %Iu at " ADDRESSFORMAT L": %Iu bytes ----------\n", alloc_block->serialNumber, mem, alloc_block->size);
-                Report(L"  TID: %u\n", alloc_block->threadId);
-                Report(L"  Call Stack:\n");
-                alloc_block->callStack->dump(m_options & VLD_OPT_TRACE_INTERNAL_FRAMES);
-
-                // Now we need a way to print the current callstack at this point:
-                CallStack* stack_here = CallStack::Create();
-                stack_here->getStackTrace(m_maxTraceFrames, context);
-                Report(L"Deallocation Call stack.\n");
-                Report(L"---------- Block %Iu at " ADDRESSFORMAT L": %Iu bytes ----------\n", alloc_block->serialNumber, mem, alloc_block->size);
-                Report(L"  Call Stack:\n");
-                stack_here->dump(FALSE);
-                // Now it should be safe to delete our temporary callstack
-                delete stack_here;
-                stack_here = NULL;
-                if (IsDebuggerPresent())
-                    DebugBreak();
-            }
-        }
-        return;
-    }
-
-    // Free the blockinfo_t structure and erase it from the block map.
-    blockinfo_t *info = (*blockit).second;
-    m_curAlloc -= info->size;
-    delete info;
-    blockmap->erase(blockit);
+    tls->sampleBytes = nextSampleInterval(tls->sampleRandom);
+    return true;
 }
 
-// unmapheap - Tracks heap destruction. Unmaps the specified heap from its block
-//   map. The block map is cleared and deleted, relinquishing internally
-//   allocated resources.
+// samplerequest - Decides whether an allocation of the CRT, MFC or COM
+//   allocators is tracked, when only sampled allocations are, by charging the
+//   requested size to the calling thread's sampling interval. Their hooks call
+//   it before they capture the context, so that the allocations which aren't
+//   sampled cost nothing else. An allocation made inside another one, by the
+//   allocator, follows the decision made for the outer allocation.
 //
-//  - heap (IN): Handle to the heap which is being destroyed.
+//  - size (IN): Size, in bytes, requested from the allocator.
 //
 //  Return Value:
 //
-//    None.
+//    Returns true if the allocation must be recorded.
 //
-VOID VisualLeakDetector::unmapHeap (HANDLE heap)
+bool VisualLeakDetector::sampleRequest (SIZE_T size)
 {
-    // Find this heap's block map.
-    CriticalSectionLocker<> cs(g_heapMapLock);
-    HeapMap::Iterator heapit = m_heapMap->find(heap);
-    if (heapit == m_heapMap->end()) {
-        // This heap hasn't been mapped. We must not have monitored this heap's
-        // creation (probably happened before VLD was initialized).
-        return;
-    }
+    if (t_untracked)
+        return false;
+    tls_t *tls = getTls();
+    if (GET_RETURN_ADDRESS(tls->context) != NULL)
+        return true;
 
-    // Free all of the blockinfo_t structures stored in the block map.
-    heapinfo_t *heapinfo = (*heapit).second;
-    BlockMap   *blockmap = &heapinfo->blockMap;
-    for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit) {
-        m_curAlloc -= (*blockit).second->size;
-        delete (*blockit).second;
-    }
-    delete heapinfo;
+    tls->sampleBytes -= (LONG64)size;
+    if (tls->sampleBytes > 0)
+        return false;
 
-    // Remove this heap's block map from the heap map.
-    m_heapMap->erase(heapit);
+    // The heap hooks track the heap block of the allocation without charging
+    // it again.
+    tls->sampleBytes = nextSampleInterval(tls->sampleRandom);
+    tls->flags |= VLD_TLS_SAMPLED;
+    return true;
 }
 
-// remapblock - Tracks reallocations. Unmaps a block from its previously
-//   collected information and remaps it to updated information.
+// reportMismatchedFree - Called by BlockTracker::unmapBlock, with the heap map
+//   lock held, when a block being freed isn't in the freeing heap's block map
+//   and VLD_OPT_VALIDATE_HEAPFREE is set. Searches every heap for the block and
+//   reports a critical error if it was allocated in another heap: this is an
+//   especially bad way to corrupt the application.
 //
-//  Note: If the block itself remains at the same address, then the block's
-//   information can simply be updated rather than having to actually erase and
-//   reinsert the block.
-//
-//  - heap (IN): Handle to the heap from which the memory is being reallocated.
-//
-//  - mem (IN): Pointer to the memory block being reallocated.
-//
-//  - newmem (IN): Pointer to the memory block being returned to the caller
-//      that requested the reallocation. This pointer may or may not be the same
-//      as the original memory block (as pointed to by "mem").
-//
-//  - size (IN): Size, in bytes, of the new memory block.
+//  - heap (IN): Handle to the heap to which this block is being freed.
 //
-//  - framepointer (IN): The frame pointer at which this reallocation entered
-//      VLD's code. Used for determining the starting point of the stack trace.
+//  - mem (IN): Pointer to the memory block being freed.
 //
-//  - crtalloc (IN): Should be set to TRUE if this reallocation is for a CRT
-//      memory block. Otherwise should be set to FALSE.
+//  - context (IN): Context of the call which frees the block.
 //
 //  Return Value:
 //
 //    None.
 //
-VOID VisualLeakDetector::remapBlock (HANDLE heap, LPCVOID mem, LPCVOID newmem, SIZE_T size,
-    bool debugcrtalloc, bool ucrt, DWORD threadId, blockinfo_t* &pblockInfo, const context_t &context)
+VOID VisualLeakDetector::reportMismatchedFree (HANDLE heap, LPCVOID mem, const context_t &context)
 {
-    CriticalSectionLocker<> cs(g_heapMapLock);
-
-    if (newmem != mem) {
-        // The block was not reallocated in-place. Instead the old block was
-        // freed and a new block allocated to satisfy the new size.
-        unmapBlock(heap, mem, context);
-        mapBlock(heap, newmem, size, debugcrtalloc, ucrt, threadId, pblockInfo);
-        return;
-    }
-
-    // The block was reallocated in-place. Find the existing blockinfo_t
-    // entry in the block map and update it with the new callstack and size.
-    HeapMap::Iterator heapit = m_heapMap->find(heap);
-    if (heapit == m_heapMap->end()) {
-        // We haven't mapped this heap to a block map yet. Obviously the
-        // block has also not been mapped to a blockinfo_t entry yet either,
-        // so treat this reallocation as a brand-new allocation (this will
-        // also map the heap to a new block map).
-        mapBlock(heap, newmem, size, debugcrtalloc, ucrt, threadId, pblockInfo);
-        return;
-    }
-
-    // Find the block's blockinfo_t structure so that we can update it.
-    BlockMap           *blockmap = &(*heapit).second->blockMap;
-    BlockMap::Iterator  blockit = blockmap->find(mem);
-    if (blockit == blockmap->end()) {
-        // The block hasn't been mapped to a blockinfo_t entry yet.
-        // Treat this reallocation as a new allocation.
-        mapBlock(heap, newmem, size, debugcrtalloc, ucrt, threadId, pblockInfo);
-        return;
-    }
-
-    // Found the blockinfo_t entry for this block. Update it with
-    // a new callstack and new size.
-    blockinfo_t* info = (*blockit).second;
-    if (info->callStack)
+    HANDLE other_heap = NULL;
+    blockinfo_t* alloc_block = findAllocedBlock(mem, other_heap); // other_heap is an out parameter
+    bool diff = other_heap != heap; // Check indeed if the other heap is different
+    if (alloc_block && alloc_block->callStack && diff)
     {
-        info->callStack.reset();
-    }
+        Report(L"CRITICAL ERROR!: VLD reports that memory was allocated in one heap and freed in another.\nThis will result in a corrupted heap.\nAllocation Call stack.\n");
+        Report(L"---------- Block %Iu at " ADDRESSFORMAT L": %Iu bytes ----------\n", alloc_block->serialNumber, mem, alloc_block->size);
+        Report(L"  TID: %u\n", alloc_block->threadId);
+        Report(L"  Call Stack:\n");
+        alloc_block->callStack->dump(m_options & VLD_OPT_TRACE_INTERNAL_FRAMES);
 
-    if (m_totalAlloc < SIZE_MAX)
-    {
-        m_totalAlloc -= info->size;
-        if (SIZE_MAX - m_totalAlloc > size)
-            m_totalAlloc += size;
-        else
-            m_totalAlloc = SIZE_MAX;
+        // Now we need a way to print the current callstack at this point:
+        CallStack* stack_here = CallStack::Create();
+        stack_here->getStackTrace(m_maxTraceFrames, context);
+        Report(L"Deallocation Call stack.\n");
+        Report(L"---------- Block %Iu at " ADDRESSFORMAT L": %Iu bytes ----------\n", alloc_block->serialNumber, mem, alloc_block->size);
+        Report(L"  Call Stack:\n");
+        stack_here->dump(FALSE);
+        // Now it should be safe to delete our temporary callstack
+        delete stack_here;
+        stack_here = NULL;
+        if (IsDebuggerPresent())
+            DebugBreak();
     }
-
-    m_curAlloc -= info->size;
-    m_curAlloc += size;
-
-    if (m_curAlloc > m_maxAlloc)
-        m_maxAlloc = m_curAlloc;
-
-    info->threadId = threadId;
-    // Update the block's size.
-    info->size = size;
-    pblockInfo = info;
 }
 
 // reportconfig - Generates a brief report summarizing Visual Leak Detector's
@@ -1650,6 +1579,27 @@ VOID VisualLeakDetector::reportConfig ()
     if (m_maxTraceFrames != VLD_DEFAULT_MAX_TRACE_FRAMES) {
         Report(L"    Limiting stack traces to %u frames.\n", m_maxTraceFrames);
     }
+    if (m_sampleRate != 0) {
+        Report(L"    Sampling one allocation every %Iu bytes on average.\n", m_sampleRate);
+    }
+    if (m_peakHysteresis != 0) {
+        Report(L"    Snapshotting allocation sites at each new peak of %Iu more bytes (at most every %u ms).\n",
+            m_peakHysteresis, m_peakInterval);
+    }
+    if (m_monitorThread != NULL) {
+        Report(L"    Monitoring allocation sites that grow for %u intervals of %u ms.\n",
+            m_monitorIntervals, m_monitorInterval);
+    }
+    if (m_trace.isOpen()) {
+        Report(L"    Tracing allocation events to %s\n", m_traceFilePath);
+    }
+    if (m_blockDb.isOpen()) {
+        Report(L"    Recording the tracked blocks in %s (%I64u MB)\n", m_blockDbPath, m_blockDbSize / (1024 * 1024));
+    }
+    if ((m_minTrackedSize != 0) || (m_maxTrackedSize != (SIZE_T)-1)) {
+        Report(L"    Only capturing call stacks for blocks of %Iu to %Iu bytes%s.\n", m_minTrackedSize, m_maxTrackedSize,
+            m_mapUntrackedSizes ? L"" : L", ignoring other blocks");
+    }
     if (m_options & VLD_OPT_UNICODE_REPORT) {
         Report(L"    Generating a Unicode (UTF-16) encoded report.\n");
     }
@@ -1667,6 +1617,9 @@ VOID VisualLeakDetector::reportConfig ()
     if (m_options & VLD_OPT_SAFE_STACK_WALK) {
         Report(L"    Using the \"safe\" (but slow) stack walking method.\n");
     }
+    if (m_options & VLD_OPT_NO_STACK_CAPTURE) {
+        Report(L"    Counting leaks without capturing call stacks.\n");
+    }
     if (m_options & VLD_OPT_SELF_TEST) {
         Report(L"    Performing a memory leak self-test.\n");
     }
@@ -1704,60 +1657,6 @@ bool VisualLeakDetector::isDebugCrtAlloc( LPCVOID block, blockinfo_t* info )
     return info->debugCrtAlloc;
 }
 
-// getleakscount - Calculate number of memory leaks.
-//
-//  - heap (IN): Handle to the heap for which to generate a memory leak
-//      report.
-//
-//  Return Value:
-//
-//    None.
-//
-SIZE_T VisualLeakDetector::getLeaksCount (heapinfo_t* heapinfo, DWORD threadId)
-{
-    BlockMap* blockmap   = &heapinfo->blockMap;
-    SIZE_T memoryleaks = 0;
-
-    for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
-    {
-        // Found a block which is still in the BlockMap. We've identified a
-        // potential memory leak.
-        LPCVOID block = (*blockit).first;
-        blockinfo_t* info = (*blockit).second;
-        if (info->reported)
-            continue;
-
-        if (threadId != ((DWORD)-1) && info->threadId != threadId)
-            continue;
-
-        if (isDebugCrtAlloc(block, info)) {
-            // This block is allocated to a CRT heap, so the block has a CRT
-            // memory block header pretended to it.
-            int blockUse = getCrtBlockUse(block, info->ucrt);
-            // Leaks identified as CRT_USE_IGNORE should not be ignored here otherwise
-            // DynamicLoader/Thread test will randomly fail with less leaks being reported.
-            if (CRT_USE_TYPE(blockUse) == CRT_USE_FREE ||
-                CRT_USE_TYPE(blockUse) == CRT_USE_INTERNAL) {
-                // This block is marked as being used internally by the CRT.
-                // The CRT will free the block after VLD is destroyed.
-                continue;
-            }
-        }
-
-        if (m_options & VLD_OPT_SKIP_CRTSTARTUP_LEAKS) {
-            // Check for crt startup allocations
-            if (info->callStack && info->callStack->isCrtStartupAlloc()) {
-                info->reported = true;
-                continue;
-            }
-        }
-
-        memoryleaks ++;
-    }
-
-    return memoryleaks;
-}
-
 // reportleaks - Generates a memory leak report for the specified heap.
 //
 //  - heap (IN): Handle to the heap for which to generate a memory leak
@@ -1784,6 +1683,7 @@ SIZE_T VisualLeakDetector::reportHeapLeaks (HANDLE heap)
     // Generate a memory leak report for heap.
     bool firstLeak = true;
     SIZE_T leaks_count = reportLeaks(heapinfo, firstLeak, aggregatedLeaks);
+    leaks_count += reportUntracedLeaks(heap);
 
     // Show a summary.
     if (leaks_count != 0) {
@@ -1821,178 +1721,6 @@ size_t VisualLeakDetector::getCrtBlockSize(LPCVOID block, bool ucrt)
     }
 }
 
-SIZE_T VisualLeakDetector::reportLeaks (heapinfo_t* heapinfo, bool &firstLeak, Set<blockinfo_t*> &aggregatedLeaks, DWORD threadId)
-{
-    BlockMap* blockmap   = &heapinfo->blockMap;
-    SIZE_T leaksFound = 0;
-
-    for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
-    {
-        // Found a block which is still in the BlockMap. We've identified a
-        // potential memory leak.
-        LPCVOID block = (*blockit).first;
-        blockinfo_t* info = (*blockit).second;
-        if (info->reported)
-            continue;
-
-        if (threadId != ((DWORD)-1) && info->threadId != threadId)
-            continue;
-
-        Set<blockinfo_t*>::Iterator it = aggregatedLeaks.find(info);
-        if (it != aggregatedLeaks.end())
-            continue;
-
-        LPCVOID address = block;
-        SIZE_T size = info->size;
-
-        if (isDebugCrtAlloc( block, info )) {
-            // This block is allocated to a CRT heap, so the block has a CRT
-            // memory block header pretended to it.
-            int blockUse = getCrtBlockUse( block, info->ucrt );
-            // Leaks identified as CRT_USE_IGNORE should not be ignored here otherwise
-            // DynamicLoader/Thread test will randomly fail with less leaks being reported.
-            if (CRT_USE_TYPE(blockUse) == CRT_USE_FREE ||
-                CRT_USE_TYPE(blockUse) == CRT_USE_INTERNAL)
-            {
-                // This block is marked as being used internally by the CRT.
-                // The CRT will free the block after VLD is destroyed.
-                continue;
-            }
-
-            // The CRT header is more or less transparent to the user, so
-            // the information about the contained block will probably be
-            // more useful to the user. Accordingly, that's the information
-            // we'll include in the report.
-            address = CRTDBGBLOCKDATA(block);
-            size = getCrtBlockSize(block, info->ucrt);
-        }
-
-        if (m_options & VLD_OPT_SKIP_CRTSTARTUP_LEAKS) {
-            // Check for crt startup allocations
-            if (info->callStack && info->callStack->isCrtStartupAlloc()) {
-                info->reported = true;
-                continue;
-            }
-        }
-
-        // It looks like a real memory leak.
-        if (firstLeak) { // A confusing way to only display this message once
-            Report(L"WARNING: Visual Leak Detector detected memory leaks!\n");
-            firstLeak = false;
-        }
-        SIZE_T blockLeaksCount = 1;
-        Report(L"---------- Block %Iu at " ADDRESSFORMAT L": %Iu bytes ----------\n", info->serialNumber, address, size);
-#ifdef _DEBUG
-        if (info->debugCrtAlloc)
-        {
-            crtdbgblockheader_t* crtheader = (crtdbgblockheader_t*)block;
-            Report(L"  CRT Alloc ID: %Iu\n", crtheader->request);
-            assert(size == getCrtBlockSize(block, info->ucrt));
-        }
-#endif
-        assert(info->callStack);
-        if (m_options & VLD_OPT_AGGREGATE_DUPLICATES) {
-            // Aggregate all other leaks which are duplicates of this one
-            // under this same heading, to cut down on clutter.
-            SIZE_T erased = eraseDuplicates(blockit, aggregatedLeaks);
-
-            // add only the number that were erased, since the 'one left over'
-            // is already recorded as a leak
-            blockLeaksCount += erased;
-        }
-
-        DWORD callstackCRC = 0;
-        if (info->callStack)
-            callstackCRC = CalculateCRC32(info->size, info->callStack->getHashValue());
-        Report(L"  Leak Hash: 0x%08X, Count: %Iu, Total %Iu bytes\n", callstackCRC, blockLeaksCount, size * blockLeaksCount);
-        leaksFound += blockLeaksCount;
-
-        // Dump the call stack.
-        if (blockLeaksCount == 1)
-            Report(L"  Call Stack (TID %u):\n", info->threadId);
-        else
-            Report(L"  Call Stack:\n");
-        if (info->callStack)
-            info->callStack->dump(m_options & VLD_OPT_TRACE_INTERNAL_FRAMES);
-
-        // Dump the data in the user data section of the memory block.
-        if (m_maxDataDump != 0) {
-            Report(L"  Data:\n");
-            if (m_options & VLD_OPT_UNICODE_REPORT) {
-                DumpMemoryW(address, (m_maxDataDump < size) ? m_maxDataDump : size);
-            }
-            else {
-                DumpMemoryA(address, (m_maxDataDump < size) ? m_maxDataDump : size);
-            }
-        }
-        Report(L"\n\n");
-    }
-
-    return leaksFound;
-}
-
-VOID VisualLeakDetector::markAllLeaksAsReported (heapinfo_t* heapinfo, DWORD threadId)
-{
-    BlockMap* blockmap   = &heapinfo->blockMap;
-
-    for (BlockMap::Iterator blockit = blockmap->begin(); blockit != blockmap->end(); ++blockit)
-    {
-        blockinfo_t* info = (*blockit).second;
-        if (threadId == ((DWORD)-1) || info->threadId == threadId)
-            info->reported = true;
-    }
-}
-
-// FindAllocedBlock - Find if a particular memory allocation is tracked inside of VLD.
-//     This is a really good example of how to iterate through the data structures
-//     that represent heaps and their associated memory blocks.
-// Pre Condition: Be VERY sure that this is only called within a block that already has
-// acquired a critical section for m_maplock.
-//
-// mem - The particular memory address to search for.
-//
-//  Return Value:
-//   If mem is found, it will return the blockinfo_t pointer, otherwise NULL
-//
-blockinfo_t* VisualLeakDetector::findAllocedBlock(LPCVOID mem, __out HANDLE& heap)
-{
-    heap = NULL;
-    blockinfo_t* result = NULL;
-    // Iterate through all heaps
-    CriticalSectionLocker<> cs(g_heapMapLock);
-    for (HeapMap::Iterator it = m_heapMap->begin();
-        it != m_heapMap->end();
-        ++it)
-    {
-        HANDLE heap_handle  = (*it).first;
-        (heap_handle); // unused
-        heapinfo_t* heapPtr = (*it).second;
-
-        // Iterate through all memory blocks in each heap
-        BlockMap& p_block_map = heapPtr->blockMap;
-        for (BlockMap::Iterator iter = p_block_map.begin();
-            iter != p_block_map.end();
-            ++iter)
-        {
-            if ((*iter).first == mem)
-            {
-                // Found the block.
-                blockinfo_t* alloc_block = (*iter).second;
-                heap = heap_handle;
-                result = alloc_block;
-                break;
-            }
-        }
-
-        if (result)
-        {
-            break;
-        }
-    }
-
-    return result;
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Static Leak Detection Functions (Callbacks)
@@ -2329,9 +2057,24 @@ VOID VisualLeakDetector::RefreshModules()
     }
 
     // Start using the new set of loaded modules.
-    CriticalSectionLocker<> cs(m_modulesLock);
-    ModuleSet* oldmodules = m_loadedModules;
-    m_loadedModules = newmodules;
+    ModuleSet* oldmodules;
+    {
+        CriticalSectionLocker<> cs(m_modulesLock);
+        oldmodules = m_loadedModules;
+        m_loadedModules = newmodules;
+    }
+
+    // The call stacks through the modules which were unloaded must be
+    // resolved again: another module may be loaded at the same address.
+    if (oldmodules != NULL) {
+        CriticalSectionLocker<> cs(g_heapMapLock);
+        for (ModuleSet::Iterator oldit = oldmodules->begin(); oldit != oldmodules->end(); ++oldit) {
+            ModuleSet::Iterator newit = newmodules->find(*oldit);
+            if ((newit != newmodules->end()) && ((*newit).addrLow == (*oldit).addrLow) && ((*newit).path == (*oldit).path))
+                continue;
+            m_stackTable.dropResolved((*oldit).addrLow, (*oldit).addrHigh);
+        }
+    }
 
     // Free resources used by the old module list.
     delete oldmodules;
@@ -2409,6 +2152,7 @@ SIZE_T VisualLeakDetector::ReportLeaks( )
         heapinfo_t* heapinfo = (*heapit).second;
         leaksCount += reportLeaks(heapinfo, firstLeak, aggregatedLeaks);
     }
+    leaksCount += reportUntracedLeaks();
     return leaksCount;
 }
 
@@ -2430,9 +2174,49 @@ SIZE_T VisualLeakDetector::ReportThreadLeaks( DWORD threadId )
         heapinfo_t* heapinfo = (*heapit).second;
         leaksCount += reportLeaks(heapinfo, firstLeak, aggregatedLeaks, threadId);
     }
+    leaksCount += reportUntracedLeaks(NULL, threadId);
     return leaksCount;
 }
 
+// getleakdata - Determines whether a mapped block counts as a leak, and
+//   obtains the address and size of its user data. Blocks used internally by
+//   the CRT are not leaks: the CRT frees them after VLD is destroyed.
+//
+//  - block (IN): Pointer to the mapped block.
+//
+//  - info (IN): The block's information.
+//
+//  - address (OUT): Receives the address of the block's user data.
+//
+//  - size (OUT): Receives the size, in bytes, of the block's user data.
+//
+//  Return Value:
+//
+//    Returns true if the block counts as a leak.
+//
+bool VisualLeakDetector::getLeakData (LPCVOID block, blockinfo_t* info, LPCVOID &address, SIZE_T &size)
+{
+    address = block;
+    size = info->size;
+    if (isDebugCrtAlloc(block, info)) {
+        // This block is allocated to a CRT heap, so the block has a CRT
+        // memory block header pretended to it.
+        int blockUse = getCrtBlockUse(block, info->ucrt);
+        // Leaks identified as CRT_USE_IGNORE should not be ignored here otherwise
+        // DynamicLoader/Thread test will randomly fail with less leaks being reported.
+        if (CRT_USE_TYPE(blockUse) == CRT_USE_FREE ||
+            CRT_USE_TYPE(blockUse) == CRT_USE_INTERNAL)
+            return false;
+
+        // The CRT header is more or less transparent to the user, so the
+        // information about the contained block will probably be more useful
+        // to the user.
+        address = CRTDBGBLOCKDATA(block);
+        size = getCrtBlockSize(block, info->ucrt);
+    }
+    return true;
+}
+
 VOID VisualLeakDetector::MarkAllLeaksAsReported( )
 {
     if (m_options & VLD_OPT_VLDOFF) {
@@ -2604,7 +2388,7 @@ void VisualLeakDetector::GlobalEnableLeakDetection ()
 CONST UINT32 OptionsMask = VLD_OPT_AGGREGATE_DUPLICATES | VLD_OPT_MODULE_LIST_INCLUDE |
     VLD_OPT_SAFE_STACK_WALK | VLD_OPT_SLOW_DEBUGGER_DUMP | VLD_OPT_START_DISABLED |
     VLD_OPT_TRACE_INTERNAL_FRAMES | VLD_OPT_SKIP_HEAPFREE_LEAKS | VLD_OPT_VALIDATE_HEAPFREE |
-    VLD_OPT_SKIP_CRTSTARTUP_LEAKS;
+    VLD_OPT_SKIP_CRTSTARTUP_LEAKS | VLD_OPT_NO_STACK_CAPTURE;
 
 UINT32 VisualLeakDetector::GetOptions()
 {
@@ -2779,6 +2563,19 @@ void VisualLeakDetector::setupReporting()
 blockinfo_t* VisualLeakDetector::getAllocationBlockInfo(void* alloc)
 {
     // should be called under g_heapMapLock
+    blockinfo_t* info = m_blockIndex->find(alloc);
+    if (info != NULL)
+        return info;
+
+    // The address may be the user data of a debug CRT block, which is mapped
+    // by the address of its CRT header.
+    LPCVOID header = CRTDBGBLOCKHEADER(alloc);
+    info = m_blockIndex->find(header);
+    if ((info != NULL) && isDebugCrtAlloc(header, info))
+        return info;
+    if (m_unindexedBlocks == 0)
+        return NULL;
+
     for (HeapMap::Iterator heapiter = m_heapMap->begin(); heapiter != m_heapMap->end(); ++heapiter)
     {
         HANDLE heap = (*heapiter).first;
@@ -2816,7 +2613,7 @@ const wchar_t* VisualLeakDetector::GetAllocationResolveResults(void* alloc, BOOL
 
     CriticalSectionLocker<> cs(g_heapMapLock);
     blockinfo_t* info = getAllocationBlockInfo(alloc);
-    if (info != NULL)
+    if ((info != NULL) && (info->callStack))
     {
         int unresolvedFunctionsCount = info->callStack->resolve(showInternalFrames);
         _ASSERT(unresolvedFunctionsCount == 0);
@@ -2900,7 +2697,246 @@ int VisualLeakDetector::ResolveCallstacks()
     return unresolvedFunctionsCount;
 }
 
-CaptureContext::CaptureContext(void* func, context_t& context, BOOL debug, BOOL ucrt) : m_context(context) {
+BOOL VisualLeakDetector::GetStatistics(VLD_STATISTICS *stats)
+{
+    if ((stats == NULL) || (m_options & VLD_OPT_VLDOFF))
+        return FALSE;
+
+    // The statistics are sharded, so no lock is needed to read them.
+    m_stats.get(stats);
+    return TRUE;
+}
+
+int VisualLeakDetector::GetLockStatistics(VLD_LOCK_STATISTICS *stats, int count)
+{
+#ifdef VLD_LOCK_PROFILING
+    int total = 0;
+    for (LONG index = 0; index < LockProfiler::GetCount(); index++) {
+        const lockprofile_t *profile = LockProfiler::Get(index);
+        if (profile == NULL)
+            continue;
+        if ((stats != NULL) && (total < count)) {
+            VLD_LOCK_STATISTICS &lock = stats[total];
+            wcsncpy_s(lock.name, _countof(lock.name), profile->name, _TRUNCATE);
+            lock.acquisitions = profile->acquisitions;
+            lock.contentions  = profile->contentions;
+            lock.waitNs       = LockProfiler::TicksToNanoseconds(profile->waitTicks);
+            lock.maxHoldNs    = LockProfiler::TicksToNanoseconds(profile->maxHoldTicks);
+        }
+        total++;
+    }
+    return total;
+#else
+    UNREFERENCED_PARAMETER(stats);
+    UNREFERENCED_PARAMETER(count);
+    return 0;
+#endif // VLD_LOCK_PROFILING
+}
+
+// A share of the blocks aggregated by one thread of VLDDumpHeapProfile.
+struct heapprofileslice_t {
+    liveblock_t     *blocks;    // The blocks to aggregate.
+    SIZE_T           count;     // Number of blocks.
+    heapsite_t      *sites;     // Receives one site per call stack. Has room for count sites.
+    SIZE_T           siteCount; // Receives the number of sites.
+};
+
+// aggregatesites - Adds up the blocks of a heap profile slice by call stack.
+//   Runs on a thread of its own for all but the first slice. It only touches
+//   the slice, so no lock is needed.
+//
+//  - param (IN): The heapprofileslice_t.
+//
+//  Return Value:
+//
+//    Returns 0.
+//
+static DWORD WINAPI aggregateSites (LPVOID param)
+{
+    heapprofileslice_t *slice = (heapprofileslice_t*)param;
+    qsort(slice->blocks, slice->count, sizeof(liveblock_t), BlockTracker::compareBlockCallStacks);
+    slice->siteCount = 0;
+    for (SIZE_T index = 0; index < slice->count; index++) {
+        const liveblock_t &block = slice->blocks[index];
+        if ((slice->siteCount == 0) || (slice->sites[slice->siteCount - 1].callStack != block.callStack)) {
+            heapsite_t &site = slice->sites[slice->siteCount++];
+            site.callStack = block.callStack;
+            site.bytes = 0;
+            site.count = 0;
+        }
+        heapsite_t &site = slice->sites[slice->siteCount - 1];
+        site.bytes += block.size;
+        site.count++;
+    }
+    return 0;
+}
+
+// DumpHeapProfile - Writes the in-use bytes and number of blocks of every
+//   allocation site to a file. See VLDDumpHeapProfile.
+//
+//  - path (IN): Path of the file to write.
+//
+//  Return Value:
+//
+//    Returns the number of allocation sites written, or -1 if the profile
+//    couldn't be written.
+//
+int VisualLeakDetector::DumpHeapProfile(CONST WCHAR *path)
+{
+    if ((path == NULL) || (m_options & VLD_OPT_VLDOFF))
+        return -1;
+
+    SIZE_T count, watermark;
+    liveblock_t *blocks = copyLiveBlocks(count, watermark);
+    heapsite_t *sites = (count != 0) ? new heapsite_t [count] : NULL;
+
+    // Aggregate the blocks in parallel, one slice per processor, unless there
+    // are too few of them for it to pay off. The call stacks are interned, so
+    // only their pointers need to be compared.
+    heapprofileslice_t slices [HEAPPROFILE_MAX_THREADS];
+    HANDLE threads [HEAPPROFILE_MAX_THREADS];
+    UINT32 sliceCount = 1;
+    if (count >= HEAPPROFILE_PARALLEL_MIN) {
+        SYSTEM_INFO systemInfo;
+        GetSystemInfo(&systemInfo);
+        sliceCount = min((UINT32)systemInfo.dwNumberOfProcessors, (UINT32)HEAPPROFILE_MAX_THREADS);
+        sliceCount = max(sliceCount, 1u);
+    }
+    SIZE_T first = 0;
+    for (UINT32 index = 0; index < sliceCount; index++) {
+        SIZE_T last = (count * (index + 1)) / sliceCount;
+        slices[index].blocks = blocks + first;
+        slices[index].count = last - first;
+        slices[index].sites = sites + first;
+        slices[index].siteCount = 0;
+        first = last;
+    }
+    for (UINT32 index = 1; index < sliceCount; index++) {
+        threads[index] = CreateThread(NULL, 0, aggregateSites, &slices[index], 0, NULL);
+        if (threads[index] == NULL) {
+            // Do it on this thread instead.
+            aggregateSites(&slices[index]);
+        }
+    }
+    aggregateSites(&slices[0]);
+    for (UINT32 index = 1; index < sliceCount; index++) {
+        if (threads[index] != NULL) {
+            WaitForSingleObject(threads[index], INFINITE);
+            CloseHandle(threads[index]);
+        }
+    }
+    delete [] blocks;
+
+    // Merge the sites found by each slice.
+    SIZE_T siteCount = 0;
+    for (UINT32 index = 0; index < sliceCount; index++) {
+        memmove(sites + siteCount, slices[index].sites, slices[index].siteCount * sizeof(heapsite_t));
+        siteCount += slices[index].siteCount;
+    }
+    if (sliceCount > 1) {
+        qsort(sites, siteCount, sizeof(heapsite_t), BlockTracker::compareSiteCallStacks);
+        SIZE_T merged = 0;
+        for (SIZE_T index = 0; index < siteCount; index++) {
+            if ((merged != 0) && (sites[merged - 1].callStack == sites[index].callStack)) {
+                sites[merged - 1].bytes += sites[index].bytes;
+                sites[merged - 1].count += sites[index].count;
+            }
+            else {
+                sites[merged++] = sites[index];
+            }
+        }
+        siteCount = merged;
+    }
+    qsort(sites, siteCount, sizeof(heapsite_t), BlockTracker::compareSiteBytes);
+
+    // Resolve the call stacks. Each one is only resolved once, however many
+    // profiles are written.
+    const WCHAR **resolved = (siteCount != 0) ? new const WCHAR* [siteCount] : NULL;
+    {
+        LoaderLock ll;
+        CriticalSectionLocker<> cs(g_heapMapLock);
+        for (SIZE_T index = 0; index < siteCount; index++) {
+            resolved[index] = NULL;
+            if (sites[index].callStack != NULL)
+                resolved[index] = sites[index].callStack->getResolvedCallstack(m_options & VLD_OPT_TRACE_INTERNAL_FRAMES);
+        }
+    }
+
+    int written = -1;
+    FILE *file = NULL;
+    if ((_wfopen_s(&file, path, L"w, ccs=UTF-8") == 0) && (file != NULL)) {
+        SIZE_T totalBytes = 0;
+        for (SIZE_T index = 0; index < siteCount; index++)
+            totalBytes += sites[index].bytes;
+
+        fwprintf(file, L"Visual Leak Detector heap profile, format %u\n", HEAPPROFILE_FORMAT);
+        fwprintf(file, L"Process: %lu\n", GetCurrentProcessId());
+        fwprintf(file, L"Uptime: %I64u ms\n", GetTickCount64());
+        fwprintf(file, L"Next block: %Iu\n", watermark);
+        fwprintf(file, L"In use: %Iu bytes in %Iu blocks from %Iu allocation sites\n", totalBytes, count, siteCount);
+        for (SIZE_T index = 0; index < siteCount; index++) {
+            fwprintf(file, L"\n---------- Site %Iu: %Iu bytes in %Iu blocks ----------\n",
+                index + 1, sites[index].bytes, sites[index].count);
+            fwprintf(file, L"  Call Stack:\n");
+            if (resolved[index] != NULL)
+                fputws(resolved[index], file);
+            else
+                fwprintf(file, L"    %s\n", (sites[index].callStack != NULL) ? L"Not available." : L"Not captured.");
+        }
+        written = (int)siteCount;
+        fclose(file);
+    }
+
+    delete [] resolved;
+    delete [] sites;
+    return written;
+}
+
+// monitorproc - Thread procedure of the leak growth monitor (see the
+//   MonitorInterval option). Checks the allocation sites once per interval
+//   until m_monitorStop is signaled.
+//
+//  - param (IN): Unused.
+//
+//  Return Value:
+//
+//    Returns 0.
+//
+DWORD __stdcall VisualLeakDetector::monitorProc (LPVOID param)
+{
+    UNREFERENCED_PARAMETER(param);
+    while (WaitForSingleObject(g_vld.m_monitorStop, g_vld.m_monitorInterval) == WAIT_TIMEOUT) {
+        g_vld.checkGrowingSites();
+    }
+    return 0;
+}
+
+#ifdef VLD_LOCK_PROFILING
+// reportlockstatistics - Reports the contention statistics of VLD's named
+//   locks. Only available when VLD is built with VLD_LOCK_PROFILING.
+//
+//  Return Value:
+//
+//    None.
+//
+VOID VisualLeakDetector::reportLockStatistics ()
+{
+    VLD_LOCK_STATISTICS stats [LOCKPROFILE_MAX_LOCKS];
+    int count = GetLockStatistics(stats, (int)_countof(stats));
+    if (count > (int)_countof(stats))
+        count = (int)_countof(stats);
+
+    Report(L"Visual Leak Detector lock statistics:\n");
+    Report(L"  %-24s %14s %14s %16s %16s\n", L"Lock", L"Acquisitions", L"Contended", L"Wait (us)", L"Max hold (us)");
+    for (int index = 0; index < count; index++) {
+        const VLD_LOCK_STATISTICS &lock = stats[index];
+        Report(L"  %-24s %14I64u %14I64u %16I64u %16I64u\n", lock.name, lock.acquisitions, lock.contentions,
+            lock.waitNs / 1000, lock.maxHoldNs / 1000);
+    }
+}
+#endif // VLD_LOCK_PROFILING
+
+CaptureContext::CaptureContext(void* func, context_t& context, SIZE_T size, BOOL debug, BOOL ucrt) : m_context(context) {
     context.func = reinterpret_cast<UINT_PTR>(func);
     m_tls = g_vld.getTls();
 
@@ -2917,6 +2953,7 @@ CaptureContext::CaptureContext(void* func, context_t& context, BOOL debug, BOOL
         // This is the first call to enter VLD for the current allocation.
         // Record the current frame pointer.
         m_tls->context = m_context;
+        m_tls->requestedSize = size;
     }
 }
 
@@ -2946,9 +2983,19 @@ CaptureContext::~CaptureContext() {
                 pblockInfo, m_tls->context);
         }
 
-        CallStack* callstack = CallStack::Create();
-        callstack->getStackTrace(g_vld.m_maxTraceFrames, m_tls->context);
-        pblockInfo->callStack.reset(callstack);
+        if ((pblockInfo != NULL) && g_vld.captureStack(m_tls->requestedSize, m_tls->threadId)) {
+            g_vld.attachStack(pblockInfo, g_vld.m_stackTable.capture((g_vld.m_options & VLD_OPT_SAFE_STACK_WALK) ?
+                CallStack::safe : CallStack::fast, g_vld.m_maxTraceFrames, m_tls->context));
+        }
+        if (m_tls->newBlockWithoutGuard == NULL) {
+            g_vld.traceEvent(VLD_TRACE_ALLOC, m_tls->heap, m_tls->blockWithoutGuard, NULL, m_tls->size,
+                (pblockInfo != NULL) ? pblockInfo->callStack : NULL);
+        }
+        else {
+            g_vld.traceEvent(VLD_TRACE_REALLOC, m_tls->heap, m_tls->newBlockWithoutGuard, m_tls->blockWithoutGuard,
+                m_tls->size, (pblockInfo != NULL) ? pblockInfo->callStack : NULL);
+        }
+        g_vld.checkPeak();
     }
 
     // Reset thread local flags and variables for the next allocation.
@@ -2976,10 +3023,28 @@ void CaptureContext::Reset() {
 #elif defined(_M_X64)
     m_tls->context.Rbp = m_tls->context.Rsp = m_tls->context.Rip = NULL;
 #endif
-    m_tls->flags &= ~(VLD_TLS_DEBUGCRTALLOC | VLD_TLS_UCRT);
+    m_tls->flags &= ~(VLD_TLS_DEBUGCRTALLOC | VLD_TLS_UCRT | VLD_TLS_SAMPLED);
+    m_tls->requestedSize = 0;
     Set(NULL, NULL, NULL, NULL);
 }
 
+UntrackedContext::UntrackedContext() {
+    // An allocation made inside another one, by the allocator, follows the
+    // decision made for the outer allocation. A thread which has no tls_t yet
+    // isn't inside a tracked allocation.
+    tls_t *tls = t_tls;
+    m_bFirst = !t_untracked && ((tls == NULL) || (GET_RETURN_ADDRESS(tls->context) == NULL));
+    if (m_bFirst) {
+        t_untracked = true;
+    }
+}
+
+UntrackedContext::~UntrackedContext() {
+    if (m_bFirst) {
+        t_untracked = false;
+    }
+}
+
 BOOL CaptureContext::IsExcludedModule() {
     HMODULE hModule = GetCallingModule(m_context.fp);
     if (hModule == g_vld.m_dbghlpBase)
@@ -239,6 +239,7 @@ __declspec(dllimport) void VLDGetReportFilename(wchar_t *filename);
 // VLD_OPT_START_DISABLED
 // VLD_OPT_SKIP_HEAPFREE_LEAKS
 // VLD_OPT_VALIDATE_HEAPFREE
+// VLD_OPT_NO_STACK_CAPTURE
 //
 // maxDataDump: maximum number of user-data bytes to dump for each leaked block.
 //
@@ -318,6 +319,134 @@ __declspec(dllimport) int VLDSetReportHook(int mode,  VLD_REPORT_HOOK pfnNewHook
 //
 __declspec(dllexport) int VLDResolveCallstacks();
 
+// VLDGetStatistics - Obtains the allocation statistics of all blocks tracked
+//   by Visual Leak Detector since it was loaded. This function doesn't take any
+//   of Visual Leak Detector's locks, so it is cheap enough to be polled.
+//
+//  Note: The statistics are gathered per thread and added up when this
+//    function is called. They are exact once concurrent allocations have
+//    completed.
+//
+//  stats: Receives the statistics.
+//
+//  Return Value:
+//
+//    VLD_BOOL: TRUE if the statistics were obtained.
+//
+__declspec(dllimport) VLD_BOOL VLDGetStatistics(VLD_STATISTICS *stats);
+
+// VLDSetCaptureFilter - Chooses the blocks that still get a call stack when
+//   call stack capture is turned off (VLD_OPT_NO_STACK_CAPTURE, or
+//   StackWalkMethod = none). Leaks without a call stack are only counted; this
+//   allows switching to full capture for the allocations of interest at runtime.
+//
+//  minSize: Size, in bytes, of the smallest block to capture.
+//
+//  maxSize: Size, in bytes, of the largest block to capture. Pass a value
+//    smaller than minSize to capture no blocks (the default).
+//
+//  threadId: ID of the thread whose blocks are captured, or 0 for any thread.
+//
+//  Return Value:
+//
+//    None.
+//
+__declspec(dllimport) void VLDSetCaptureFilter(size_t minSize, size_t maxSize, VLD_UINT threadId);
+
+// VLDSetTrackedSizeRange - Sets the range of requested allocation sizes for
+//   which call stacks are captured, like the MinTrackedSize and MaxTrackedSize
+//   options.
+//
+//  minSize: Size, in bytes, of the smallest block to capture.
+//
+//  maxSize: Size, in bytes, of the largest block to capture, or 0 for no limit.
+//
+//  mapOthers: If TRUE, blocks outside the range are still tracked and counted
+//    as leaks, without a call stack. If FALSE, they are ignored altogether.
+//
+//  Return Value:
+//
+//    None.
+//
+__declspec(dllimport) void VLDSetTrackedSizeRange(size_t minSize, size_t maxSize, VLD_BOOL mapOthers);
+
+// VLDGetLockStatistics - Obtains the contention statistics of Visual Leak
+//   Detector's internal locks. They are only gathered if Visual Leak Detector
+//   was built with VLD_LOCK_PROFILING defined; otherwise no locks are reported.
+//
+//  Note: The statistics are read without taking the locks, so they may be
+//    slightly out of date while other threads are allocating memory.
+//
+//  stats: Array that receives the statistics of up to count locks. May be
+//    NULL if count is zero.
+//
+//  count: Number of elements in the stats array.
+//
+//  Return Value:
+//
+//    int: The number of profiled locks, which may be larger than count.
+//
+__declspec(dllimport) int VLDGetLockStatistics(VLD_LOCK_STATISTICS *stats, int count);
+
+// VLDTakeSnapshot - Records which blocks are currently allocated, so that
+//   VLDDiffSnapshots can later tell which blocks were allocated in between two
+//   points of the program and are still alive. Taking a snapshot holds the
+//   heap map lock for a single pass over the tracked blocks; the snapshot
+//   itself is only a sorted array of their serial numbers.
+//
+//  Return Value:
+//
+//    VLD_SNAPSHOT: The snapshot, or NULL if Visual Leak Detector is turned off.
+//      It must be freed with VLDFreeSnapshot.
+//
+__declspec(dllimport) VLD_SNAPSHOT VLDTakeSnapshot();
+
+// VLDDiffSnapshots - Finds the blocks which are in one snapshot but not in an
+//   earlier one, and passes them to a callback grouped by call stack. The two
+//   snapshots are compared without any lock; the details of the blocks found
+//   are then looked up in a single pass over the tracked blocks. Blocks which
+//   have been freed since the later snapshot was taken are left out.
+//
+//  before: The earlier snapshot. If NULL, every block in after is reported.
+//
+//  after: The later snapshot.
+//
+//  callback: Called once for each call stack with the blocks allocated from
+//    it, ordered by serial number. May be NULL to only count the blocks.
+//
+//  context: Passed to the callback.
+//
+//  Return Value:
+//
+//    size_t: The number of blocks in after which are not in before, and are
+//      still allocated.
+//
+__declspec(dllimport) size_t VLDDiffSnapshots(VLD_SNAPSHOT before, VLD_SNAPSHOT after, VLD_SNAPSHOT_CALLBACK callback, void *context);
+
+// VLDFreeSnapshot - Frees a snapshot returned by VLDTakeSnapshot.
+//
+//  snapshot: The snapshot to free. May be NULL.
+//
+//  Return Value:
+//
+//    None.
+//
+__declspec(dllimport) void VLDFreeSnapshot(VLD_SNAPSHOT snapshot);
+
+// VLDDumpHeapProfile - Writes a heap profile: the bytes currently allocated
+//   from each call stack, and how many blocks they are in, sorted by bytes.
+//   Unlike a leak report it can be written at any time and as often as
+//   needed, and the file always has the same format.
+//
+//  path: Path of the file to write. An existing file is replaced.
+//
+//  Return Value:
+//
+//    int: The number of allocation sites written, or -1 if the profile
+//      couldn't be written.
+//
+__declspec(dllimport) int VLDDumpHeapProfile(const wchar_t *path);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
@@ -346,5 +475,13 @@ __declspec(dllexport) int VLDResolveCallstacks();
 #define VLDGetModulesList(a, b) (FALSE)
 #define VLDSetReportOptions(a, b)
 #define VLDResolveCallstacks() (0)
+#define VLDGetStatistics(a) (FALSE)
+#define VLDSetCaptureFilter(a, b, c)
+#define VLDSetTrackedSizeRange(a, b, c)
+#define VLDGetLockStatistics(a, b) (0)
+#define VLDTakeSnapshot() (NULL)
+#define VLDDiffSnapshots(a, b, c, d) (0)
+#define VLDFreeSnapshot(a)
+#define VLDDumpHeapProfile(a) (-1)
 
 #endif // _DEBUG
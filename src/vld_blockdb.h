@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Block Database File Format
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+// This header describes the file written when the "BlockDatabase" option is
+// set. It may be included by tools which read it.
+//
+// The block database mirrors the blocks tracked by Visual Leak Detector in a
+// memory-mapped file, so that the leaks and the heap usage of a process can
+// still be reported after the process crashed or was killed: the operating
+// system writes the mapped pages to the file even if the process doesn't exit
+// normally. The file has a fixed size, chosen when it is created, and is
+// little-endian:
+//
+//  * It starts with a VLD_BLOCKDB_HEADER.
+//
+//  * Block records (VLD_BLOCKDB_BLOCK) follow the header, up to blockEnd,
+//    which never exceeds blockLimit. A record whose state is
+//    VLD_BLOCKDB_ALLOCATED describes a block which was in use. Records of
+//    freed blocks are reused for new blocks.
+//
+//  * Stack records (VLD_BLOCKDB_STACK, each followed by its frameCount program
+//    counter addresses) and module records (VLD_BLOCKDB_MODULE) are appended
+//    from blockLimit up to stackEnd, or to capacity if stackEnd is larger.
+//    They are never moved or removed. Module records are linked from the
+//    header.
+//
+// Records refer to each other by their offset from the start of the file, so
+// the file can be read without mapping it at any particular address. An
+// offset of 0 refers to nothing.
+//
+// The records are updated with plain memory stores while the process runs.
+// The fields of a record are written before its state, so a crash may lose the
+// last few updates, but never leaves a record half written, except for the
+// stack of a block, which may be 0 for the most recent allocations.
+
+#define VLD_BLOCKDB_MAGIC       "VLDBLKDB"  // VLD_BLOCKDB_HEADER.magic
+#define VLD_BLOCKDB_VERSION     1
+
+// VLD_BLOCKDB_HEADER.status
+#define VLD_BLOCKDB_RUNNING     1   // The process hasn't exited, or it crashed or was killed.
+#define VLD_BLOCKDB_FULL        2   // Like VLD_BLOCKDB_RUNNING, but some blocks couldn't be recorded.
+#define VLD_BLOCKDB_EXITED      3   // The process exited normally.
+
+// VLD_BLOCKDB_BLOCK.state
+#define VLD_BLOCKDB_FREE        0   // The record isn't used.
+#define VLD_BLOCKDB_ALLOCATED   1   // The block was in use.
+
+typedef struct _VLD_BLOCKDB_HEADER {
+    char               magic [8];       // VLD_BLOCKDB_MAGIC, not null terminated.
+    unsigned int       version;         // VLD_BLOCKDB_VERSION.
+    unsigned int       headerSize;      // Size of this header, in bytes.
+    unsigned int       blockSize;       // Size of each block record, in bytes.
+    unsigned int       pointerSize;     // Size of a pointer in the process: 4 or 8.
+    unsigned int       processId;       // ID of the process.
+    unsigned int       status;          // VLD_BLOCKDB_RUNNING, VLD_BLOCKDB_FULL or VLD_BLOCKDB_EXITED.
+    unsigned long long startTime;       // When the process started using the file (FILETIME, UTC).
+    unsigned long long capacity;        // Size of the file, in bytes.
+    unsigned long long blockEnd;        // Offset of the end of the block records.
+    unsigned long long blockLimit;      // Offset of the end of the space for block records.
+    unsigned long long stackEnd;        // Offset of the end of the stack and module records.
+    unsigned long long freeList;        // Offset of the first free block record, linked by their next field.
+    unsigned long long modules;         // Offset of the most recently loaded module's record.
+} VLD_BLOCKDB_HEADER;
+
+typedef struct _VLD_BLOCKDB_BLOCK {
+    unsigned long long address;         // Address of the block.
+    unsigned long long size;            // Size of the block, in bytes.
+    unsigned long long heap;            // Handle of the heap from which the block was allocated.
+    unsigned long long serialNumber;    // Allocation request number.
+    unsigned long long stack;           // Offset of the VLD_BLOCKDB_STACK of the allocation, or 0.
+    unsigned long long next;            // VLD_BLOCKDB_FREE: offset of the next free record, or 0.
+    unsigned int       threadId;        // ID of the allocating thread.
+    unsigned int       state;           // VLD_BLOCKDB_FREE or VLD_BLOCKDB_ALLOCATED.
+} VLD_BLOCKDB_BLOCK;
+
+typedef struct _VLD_BLOCKDB_STACK {
+    unsigned int       frameCount;      // Number of frames which follow, as unsigned long long each.
+    unsigned int       reserved;
+} VLD_BLOCKDB_STACK;
+
+typedef struct _VLD_BLOCKDB_MODULE {
+    unsigned long long next;            // Offset of the previous module's record, or 0.
+    unsigned long long base;            // Base address of the module.
+    unsigned long long size;            // Size of the module's image, in bytes.
+    unsigned short     path [260];      // Full path of the module (UTF-16, null terminated).
+} VLD_BLOCKDB_MODULE;
@@ -42,8 +42,43 @@
 #define VLD_OPT_SKIP_HEAPFREE_LEAKS     0x1000 //   If set, VLD skip HeapFree memory leaks.
 #define VLD_OPT_VALIDATE_HEAPFREE       0x2000 //   If set, VLD verifies and reports heap consistency for HeapFree calls.
 #define VLD_OPT_SKIP_CRTSTARTUP_LEAKS   0x4000 //   If set, VLD skip crt srtartup memory leaks.
+#define VLD_OPT_NO_STACK_CAPTURE        0x8000 //   If set, no call stacks are captured. Leaks are only counted.
 
 #define VLD_RPTHOOK_INSTALL  0
 #define VLD_RPTHOOK_REMOVE   1
 
 typedef int (__cdecl * VLD_REPORT_HOOK)(int reportType, wchar_t *message, int *returnValue);
+
+// Allocation statistics, as returned by VLDGetStatistics.
+typedef struct _VLD_STATISTICS {
+    size_t currentBytes;    // Bytes currently allocated in tracked blocks.
+    size_t peakBytes;       // Largest number of bytes allocated at once (see VLDGetStatistics).
+    size_t totalBytes;      // Sum of the sizes of all tracked allocations.
+    size_t currentBlocks;   // Number of tracked blocks currently allocated.
+    size_t totalBlocks;     // Number of tracked allocations.
+} VLD_STATISTICS;
+
+// Contention statistics of one of Visual Leak Detector's locks, as returned by
+// VLDGetLockStatistics.
+typedef struct _VLD_LOCK_STATISTICS {
+    wchar_t            name [32];      // Name of the lock.
+    unsigned long long acquisitions;   // Number of times the lock was acquired.
+    unsigned long long contentions;    // Number of acquisitions that had to wait for another thread.
+    unsigned long long waitNs;         // Total time spent waiting for the lock, in nanoseconds.
+    unsigned long long maxHoldNs;      // Longest time the lock was held at a time, in nanoseconds.
+} VLD_LOCK_STATISTICS;
+
+// Handle to a heap snapshot, as returned by VLDTakeSnapshot.
+typedef struct _VLD_SNAPSHOT *VLD_SNAPSHOT;
+
+// A block passed to a VLD_SNAPSHOT_CALLBACK by VLDDiffSnapshots.
+typedef struct _VLD_SNAPSHOT_BLOCK {
+    size_t       serialNumber;  // Allocation request number of the block.
+    const void  *address;       // Address of the block, when the snapshots were compared.
+    size_t       size;          // Size of the block, in bytes.
+    unsigned int threadId;      // ID of the allocating thread.
+} VLD_SNAPSHOT_BLOCK;
+
+// Receives the blocks found by VLDDiffSnapshots which were allocated with the
+// same call stack. callstack is NULL if no call stack was captured for them.
+typedef void (__cdecl * VLD_SNAPSHOT_CALLBACK)(const wchar_t *callstack, const VLD_SNAPSHOT_BLOCK *blocks, size_t count, void *context);
@@ -154,12 +154,14 @@ LPVOID VisualLeakDetector::_RtlAllocateHeap (HANDLE heap, DWORD flags, SIZE_T si
     // Allocate the block.
     LPVOID block = RtlAllocateHeap(heap, flags, size);
 
-    if ((block == NULL) || !g_vld.enabled())
+    // Check the size first: ignored sizes must not cost anything else.
+    if ((block == NULL) || !g_vld.isMappedHeapSize(size) || !g_vld.enabled())
         return block;
 
-    if (!g_DbgHelp.IsLockedByCurrentThread()) { // skip dbghelp.dll calls
+    if (!g_DbgHelp.IsLockedByCurrentThread() && // skip dbghelp.dll calls
+        g_vld.isSampled(heap, block, NULL, size)) {
         CAPTURE_CONTEXT();
-        CaptureContext cc(RtlAllocateHeap, context_);
+        CaptureContext cc(RtlAllocateHeap, context_, size);
         cc.Set(heap, block, NULL, size);
     }
 
@@ -173,12 +175,14 @@ LPVOID VisualLeakDetector::_HeapAlloc (HANDLE heap, DWORD flags, SIZE_T size)
     // Allocate the block.
     LPVOID block = HeapAlloc(heap, flags, size);
 
-    if ((block == NULL) || !g_vld.enabled())
+    // Check the size first: ignored sizes must not cost anything else.
+    if ((block == NULL) || !g_vld.isMappedHeapSize(size) || !g_vld.enabled())
         return block;
 
-    if (!g_DbgHelp.IsLockedByCurrentThread()) { // skip dbghelp.dll calls
+    if (!g_DbgHelp.IsLockedByCurrentThread() && // skip dbghelp.dll calls
+        g_vld.isSampled(heap, block, NULL, size)) {
         CAPTURE_CONTEXT();
-        CaptureContext cc(HeapAlloc, context_);
+        CaptureContext cc(HeapAlloc, context_, size);
         cc.Set(heap, block, NULL, size);
     }
 
@@ -213,6 +217,8 @@ BYTE VisualLeakDetector::_RtlFreeHeap (HANDLE heap, DWORD flags, LPVOID mem)
 
         // Unmap the block from the specified heap.
         g_vld.unmapBlock(heap, mem, context_);
+        if (mem != NULL)
+            g_vld.traceEvent(VLD_TRACE_FREE, heap, mem, NULL, 0, NULL);
     }
 
     status = RtlFreeHeap(heap, flags, mem);
@@ -234,6 +240,8 @@ BOOL VisualLeakDetector::_HeapFree (HANDLE heap, DWORD flags, LPVOID mem)
 
         // Unmap the block from the specified heap.
         g_vld.unmapBlock(heap, mem, context_);
+        if (mem != NULL)
+            g_vld.traceEvent(VLD_TRACE_FREE, heap, mem, NULL, 0, NULL);
     }
 
     status = m_HeapFree(heap, flags, mem);
@@ -267,12 +275,28 @@ LPVOID VisualLeakDetector::_RtlReAllocateHeap (HANDLE heap, DWORD flags, LPVOID
 
     // Reallocate the block.
     LPVOID newmem = RtlReAllocateHeap(heap, flags, mem, size);
-    if ((newmem == NULL) || !g_vld.enabled())
+    if (newmem == NULL)
         return newmem;
 
-    if (!g_DbgHelp.IsLockedByCurrentThread()) { // skip dbghelp.dll calls
+    if (!g_vld.isMappedHeapSize(size)) {
+        // Blocks of the new size are ignored. Stop tracking the old block,
+        // if it was tracked.
+        if (g_vld.isBlockMapped(heap, mem)) {
+            CAPTURE_CONTEXT();
+            context_.func = reinterpret_cast<UINT_PTR>(RtlReAllocateHeap);
+            g_vld.unmapBlock(heap, mem, context_);
+            g_vld.traceEvent(VLD_TRACE_FREE, heap, mem, NULL, 0, NULL);
+        }
+        return newmem;
+    }
+
+    if (!g_vld.enabled())
+        return newmem;
+
+    if (!g_DbgHelp.IsLockedByCurrentThread() && // skip dbghelp.dll calls
+        g_vld.isSampled(heap, mem, newmem, size)) {
         CAPTURE_CONTEXT();
-        CaptureContext cc(RtlReAllocateHeap, context_);
+        CaptureContext cc(RtlReAllocateHeap, context_, size);
         cc.Set(heap, mem, newmem, size);
     }
 
@@ -286,12 +310,28 @@ LPVOID VisualLeakDetector::_HeapReAlloc (HANDLE heap, DWORD flags, LPVOID mem, S
 
     // Reallocate the block.
     LPVOID newmem = HeapReAlloc(heap, flags, mem, size);
-    if ((newmem == NULL) || !g_vld.enabled())
+    if (newmem == NULL)
+        return newmem;
+
+    if (!g_vld.isMappedHeapSize(size)) {
+        // Blocks of the new size are ignored. Stop tracking the old block,
+        // if it was tracked.
+        if (g_vld.isBlockMapped(heap, mem)) {
+            CAPTURE_CONTEXT();
+            context_.func = reinterpret_cast<UINT_PTR>(HeapReAlloc);
+            g_vld.unmapBlock(heap, mem, context_);
+            g_vld.traceEvent(VLD_TRACE_FREE, heap, mem, NULL, 0, NULL);
+        }
+        return newmem;
+    }
+
+    if (!g_vld.enabled())
         return newmem;
 
-    if (!g_DbgHelp.IsLockedByCurrentThread()) { // skip dbghelp.dll calls
+    if (!g_DbgHelp.IsLockedByCurrentThread() && // skip dbghelp.dll calls
+        g_vld.isSampled(heap, mem, newmem, size)) {
         CAPTURE_CONTEXT();
-        CaptureContext cc(HeapReAlloc, context_);
+        CaptureContext cc(HeapReAlloc, context_, size);
         cc.Set(heap, mem, newmem, size);
     }
 
@@ -386,8 +426,13 @@ LPVOID VisualLeakDetector::_CoTaskMemAlloc (SIZE_T size)
         pCoTaskMemAlloc = (CoTaskMemAlloc_t)g_vld._RGetProcAddress(ole32, "CoTaskMemAlloc");
     }
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size)) {
+        UntrackedContext uc;
+        return pCoTaskMemAlloc(size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pCoTaskMemAlloc, context_);
+    CaptureContext cc((void*)pCoTaskMemAlloc, context_, size);
 
     // Do the allocation. The block will be mapped by _RtlAllocateHeap.
     return pCoTaskMemAlloc(size);
@@ -418,8 +463,13 @@ LPVOID VisualLeakDetector::_CoTaskMemRealloc (LPVOID mem, SIZE_T size)
         pCoTaskMemRealloc = (CoTaskMemRealloc_t)g_vld._RGetProcAddress(ole32, "CoTaskMemRealloc");
     }
 
+    if (!g_vld.isMappedSize(size) || !g_vld.isSampled(size, mem)) {
+        UntrackedContext uc;
+        return pCoTaskMemRealloc(mem, size);
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)pCoTaskMemRealloc, context_);
+    CaptureContext cc((void*)pCoTaskMemRealloc, context_, size);
 
     // Do the allocation. The block will be mapped by _RtlReAllocateHeap.
     return pCoTaskMemRealloc(mem, size);
@@ -468,11 +518,16 @@ LPVOID VisualLeakDetector::Alloc (_In_ SIZE_T size)
     PRINT_HOOKED_FUNCTION();
     UINT_PTR* cVtablePtr = (UINT_PTR*)((UINT_PTR*)m_iMalloc)[0];
     UINT_PTR iMallocAlloc = cVtablePtr[3];
+    assert(m_iMalloc != NULL);
+    if (!isMappedSize(size) || !isSampled(size)) {
+        UntrackedContext uc;
+        return (m_iMalloc) ? m_iMalloc->Alloc(size) : NULL;
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)iMallocAlloc, context_);
+    CaptureContext cc((void*)iMallocAlloc, context_, size);
 
     // Do the allocation. The block will be mapped by _RtlAllocateHeap.
-    assert(m_iMalloc != NULL);
     return (m_iMalloc) ? m_iMalloc->Alloc(size) : NULL;
 }
 
@@ -580,11 +635,16 @@ LPVOID VisualLeakDetector::Realloc (_In_opt_ LPVOID mem, _In_ SIZE_T size)
     PRINT_HOOKED_FUNCTION();
     UINT_PTR* cVtablePtr = (UINT_PTR*)((UINT_PTR*)m_iMalloc)[0];
     UINT_PTR iMallocRealloc = cVtablePtr[4];
+    assert(m_iMalloc != NULL);
+    if (!isMappedSize(size) || !isSampled(size, mem)) {
+        UntrackedContext uc;
+        return (m_iMalloc) ? m_iMalloc->Realloc(mem, size) : NULL;
+    }
+
     CAPTURE_CONTEXT();
-    CaptureContext cc((void*)iMallocRealloc, context_);
+    CaptureContext cc((void*)iMallocRealloc, context_, size);
 
     // Do the allocation. The block will be mapped by _RtlReAllocateHeap.
-    assert(m_iMalloc != NULL);
     return (m_iMalloc) ? m_iMalloc->Realloc(mem, size) : NULL;
 }
 
@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  Visual Leak Detector - Allocation Event Trace File Format
+//  Copyright (c) 2005-2014 VLD Team
+//
+//  This library is free software; you can redistribute it and/or
+//  modify it under the terms of the GNU Lesser General Public
+//  License as published by the Free Software Foundation; either
+//  version 2.1 of the License, or (at your option) any later version.
+//
+//  This library is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//  Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public
+//  License along with this library; if not, write to the Free Software
+//  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+//
+//  See COPYING.txt for the full terms of the GNU Lesser General Public License.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// This header describes the files written when the "TraceFile" option is set.
+// It may be included by tools which read them.
+//
+// A trace consists of two files, both little-endian:
+//
+//  * The event file (the TraceFile path) starts with a VLD_TRACE_HEADER,
+//    followed by eventCount VLD_TRACE_EVENT records. Events are appended in
+//    batches by a background thread, so they are in order for each thread,
+//    but events of different threads may be interleaved out of order: sort
+//    them by time to obtain the history of the process. The header is
+//    updated after every batch, so the file is consistent up to the last
+//    batch even if the process is terminated. Events are dropped, rather
+//    than delay the program, when a thread allocates faster than they are
+//    written; droppedEvents counts them. A trace with dropped events may free
+//    blocks whose allocation it doesn't have.
+//
+//  * The stack file (the TraceFile path followed by ".stacks") starts with a
+//    VLD_TRACE_STACK_HEADER, followed by one VLD_TRACE_STACK record for every
+//    call stack referenced by the events, each followed by its frameCount
+//    program counter addresses (unsigned long long each). A stack is written
+//    before the first batch of events which references it.
+//
+// All fields are 64 bits wide where their value may be a pointer, so the
+// format is the same for 32-bit and 64-bit processes.
+
+#define VLD_TRACE_MAGIC         "VLDTRACE"  // VLD_TRACE_HEADER.magic
+#define VLD_TRACE_STACK_MAGIC   "VLDSTACK"  // VLD_TRACE_STACK_HEADER.magic
+#define VLD_TRACE_VERSION       2           // Version 1 had no droppedEvents.
+
+// Operations recorded by VLD_TRACE_EVENT.op.
+#define VLD_TRACE_ALLOC     1   // A block was allocated at address.
+#define VLD_TRACE_FREE      2   // The block at address was freed. It may not have been tracked.
+#define VLD_TRACE_REALLOC   3   // The block at oldAddress was reallocated at address.
+
+typedef struct _VLD_TRACE_HEADER {
+    char               magic [8];       // VLD_TRACE_MAGIC, not null terminated.
+    unsigned int       version;         // VLD_TRACE_VERSION.
+    unsigned int       headerSize;      // Size of this header, in bytes.
+    unsigned int       eventSize;       // Size of each event, in bytes.
+    unsigned int       pointerSize;     // Size of a pointer in the traced process: 4 or 8.
+    unsigned int       processId;       // ID of the traced process.
+    unsigned int       reserved;
+    unsigned long long frequency;       // Timestamp ticks per second.
+    unsigned long long startTime;       // Timestamp at which the trace started (QueryPerformanceCounter).
+    unsigned long long eventCount;      // Number of events in the file.
+    unsigned long long droppedEvents;   // Number of events which were not recorded (version 2).
+} VLD_TRACE_HEADER;
+
+typedef struct _VLD_TRACE_EVENT {
+    unsigned long long time;            // Ticks since startTime.
+    unsigned long long heap;            // Handle of the heap.
+    unsigned long long address;         // Address of the block.
+    unsigned long long oldAddress;      // VLD_TRACE_REALLOC: previous address of the block. Otherwise 0.
+    unsigned long long size;            // VLD_TRACE_ALLOC and VLD_TRACE_REALLOC: size of the block. Otherwise 0.
+    unsigned long long stackId;         // ID of the call stack in the stack file, or 0 if none was captured.
+    unsigned int       threadId;        // ID of the thread.
+    unsigned int       op;              // VLD_TRACE_ALLOC, VLD_TRACE_FREE or VLD_TRACE_REALLOC.
+} VLD_TRACE_EVENT;
+
+typedef struct _VLD_TRACE_STACK_HEADER {
+    char               magic [8];       // VLD_TRACE_STACK_MAGIC, not null terminated.
+    unsigned int       version;         // VLD_TRACE_VERSION.
+    unsigned int       headerSize;      // Size of this header, in bytes.
+} VLD_TRACE_STACK_HEADER;
+
+typedef struct _VLD_TRACE_STACK {
+    unsigned long long stackId;         // ID referenced by VLD_TRACE_EVENT.stackId.
+    unsigned int       frameCount;      // Number of frames which follow.
+    unsigned int       reserved;
+} VLD_TRACE_STACK;
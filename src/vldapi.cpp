@@ -147,6 +147,46 @@ __declspec(dllexport) int VLDResolveCallstacks()
     return g_vld.ResolveCallstacks();
 }
 
+__declspec(dllexport) BOOL VLDGetStatistics(VLD_STATISTICS *stats)
+{
+    return g_vld.GetStatistics(stats);
+}
+
+__declspec(dllexport) void VLDSetCaptureFilter(size_t minSize, size_t maxSize, UINT threadId)
+{
+    g_vld.SetCaptureFilter(minSize, maxSize, threadId);
+}
+
+__declspec(dllexport) void VLDSetTrackedSizeRange(size_t minSize, size_t maxSize, BOOL mapOthers)
+{
+    g_vld.SetTrackedSizeRange(minSize, maxSize, mapOthers);
+}
+
+__declspec(dllexport) int VLDGetLockStatistics(VLD_LOCK_STATISTICS *stats, int count)
+{
+    return g_vld.GetLockStatistics(stats, count);
+}
+
+__declspec(dllexport) VLD_SNAPSHOT VLDTakeSnapshot()
+{
+    return g_vld.TakeSnapshot();
+}
+
+__declspec(dllexport) size_t VLDDiffSnapshots(VLD_SNAPSHOT before, VLD_SNAPSHOT after, VLD_SNAPSHOT_CALLBACK callback, void *context)
+{
+    return g_vld.DiffSnapshots(before, after, callback, context);
+}
+
+__declspec(dllexport) void VLDFreeSnapshot(VLD_SNAPSHOT snapshot)
+{
+    g_vld.FreeSnapshot(snapshot);
+}
+
+__declspec(dllexport) int VLDDumpHeapProfile(CONST WCHAR *path)
+{
+    return g_vld.DumpHeapProfile(path);
+}
+
 /// Internal function for tests. Not safe to use because Vld own returned string
 __declspec(dllexport) const wchar_t* VldInternalGetAllocationCallstack(void* alloc, BOOL showInternalFrames)
 {
@@ -29,8 +29,13 @@
 Applications should never include this header."
 #endif
 
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include "linux/platform.h"
+#endif
 
+#ifdef _WIN32
 #define GAPSIZE 4
 
 // Memory block header structure used internally by the debug CRT. All blocks
@@ -84,6 +89,7 @@ typedef char checkDebugHeapBlockSize[
 // Macro to strip off any sub-type information stored in a block's "use type".
 #define CRT_USE_TYPE(use) (use & 0xFFFF)
 #define _BLOCK_TYPE_IS_VALID(use) (_BLOCK_TYPE(use) == _CLIENT_BLOCK || (use) == _NORMAL_BLOCK || _BLOCK_TYPE(use) == _CRT_BLOCK || (use) == _IGNORE_BLOCK)
+#endif // _WIN32
 
 // Memory block header structure used internally by VLD. All internally
 // allocated blocks are allocated from VLD's private heap and have this header
@@ -101,12 +107,17 @@ struct vldblockheader_t
 // Data-to-Header and Header-to-Data conversion
 #define VLDBLOCKHEADER(d) (vldblockheader_t*)(((PBYTE)d) - sizeof(vldblockheader_t))
 #define VLDBLOCKDATA(h) (LPVOID)(((PBYTE)h) + sizeof(vldblockheader_t))
+#ifdef _WIN32
 #define CRTDBGBLOCKHEADER(d) (crtdbgblockheader_t*)(((PBYTE)d) - sizeof(crtdbgblockheader_t))
 #define CRTDBGBLOCKDATA(h) (LPVOID)(((PBYTE)h) + sizeof(crtdbgblockheader_t))
+#endif
 
-// new and delete operators for allocating from VLD's private heap.
+// new and delete operators for allocating from VLD's private heap. On Linux,
+// the global delete operators are the interposed ones (see vld_hooks.cpp).
+#ifdef _WIN32
 void operator delete (void *block);
 void operator delete [] (void *block);
+#endif
 void operator delete (void *block, const char *file, int line);
 void operator delete [] (void *block, const char *file, int line);
 void* operator new (size_t size, const char *file, int line);
@@ -33,12 +33,13 @@
 #pragma push_macro("new")
 #undef new
 #include <string>
-#include <memory>
 #pragma pop_macro("new")
 #include <windows.h>
 #include "vld_def.h"
 #include "version.h"
+#include "blocktracker.h" // Provides the platform-neutral tracking core.
 #include "callstack.h"  // Provides a custom class for handling call stacks.
+#include "eventtrace.h" // Provides the binary allocation event trace.
 #include "map.h"        // Provides a custom STL-like map template.
 #include "ntapi.h"      // Provides access to NT APIs.
 #include "set.h"        // Provides a custom STL-like set template.
@@ -99,33 +100,6 @@ typedef void* (__cdecl *_aligned_offset_realloc_dbg_t) (void *, size_t, size_t,
 typedef void* (__cdecl *_aligned_recalloc_dbg_t) (void *, size_t, size_t, size_t, int, const char *, int);
 typedef void* (__cdecl *_aligned_offset_recalloc_dbg_t) (void *, size_t, size_t, size_t, size_t, int, const char *, int);
 
-// Data is collected for every block allocated from any heap in the process.
-// The data is stored in this structure and these structures are stored in
-// a BlockMap which maps each of these structures to its corresponding memory
-// block.
-struct blockinfo_t {
-    std::unique_ptr<CallStack> callStack;
-    DWORD      threadId;
-    SIZE_T     serialNumber;
-    SIZE_T     size;
-    bool       reported;
-    bool       debugCrtAlloc;
-    bool       ucrt;
-};
-
-// BlockMaps map memory blocks (via their addresses) to blockinfo_t structures.
-typedef Map<LPCVOID, blockinfo_t*> BlockMap;
-
-// Information about each heap in the process is kept in this map. Primarily
-// this is used for mapping heaps to all of the blocks allocated from those
-// heaps.
-struct heapinfo_t {
-    BlockMap blockMap;   // Map of all blocks allocated from this heap.
-    UINT32   flags;      // Heap status flags
-};
-
-// HeapMaps map heaps (via their handles) to BlockMaps.
-typedef Map<HANDLE, heapinfo_t*> HeapMap;
 typedef std::basic_string<wchar_t, std::char_traits<wchar_t>, vldallocator<wchar_t> > vldstring;
 
 // This structure stores information, primarily the virtual address range, about
@@ -167,12 +141,18 @@ struct tls_t {
 #define VLD_TLS_DISABLED 0x2 	  //   If set, memory leak detection is disabled for the current thread.
 #define VLD_TLS_ENABLED  0x4 	  //   If set, memory leak detection is enabled for the current thread.
 #define VLD_TLS_UCRT     0x8      //   If set, the current allocation is a UCRT allocation.
+#define VLD_TLS_SAMPLED  0x10     //   If set, the current allocation was sampled by the hook which set the context.
     UINT32	    oldFlags;         // Thread-local status old flags
     DWORD 	    threadId;         // Thread ID of the thread that owns this TLS structure.
     HANDLE      heap;
     LPVOID      blockWithoutGuard; // Store pointer to block.
     LPVOID      newBlockWithoutGuard;
     SIZE_T      size;
+    SIZE_T      requestedSize;    // Size requested by the current allocation, from the hook which set the context.
+    LONG64      sampleBytes;      // Bytes left to allocate before the next sampled allocation (see SampleRate).
+    UINT32      sampleRandom;     // State of the random number generator used for choosing sampling intervals.
+    tracering_t *traceRing;       // Ring buffer of this thread's trace events. Kept when the structure is reused.
+    tls_t      *next;             // Next structure on the free list, once the owning thread has exited.
 };
 
 // Allocation state:
@@ -180,13 +160,14 @@ struct tls_t {
 // 2. HeapAlloc set tls->heap, tls->blockWithoutGuard, tls->newBlockWithoutGuard and tls->size
 // 3. Allocation function reset tls data, map block and capture callstack to tls->blockWithoutGuard
 
-// The TlsSet allows VLD to keep track of all thread local storage structures
-// allocated in the process.
+// The TlsMap allows VLD to keep track of the thread local storage structures
+// of all live threads in the process. The structures of threads that have
+// exited are kept on a free list for reuse.
 typedef Map<DWORD,tls_t*> TlsMap;
 
 class CaptureContext {
 public:
-    CaptureContext(void* func, context_t& context, BOOL debug = FALSE, BOOL ucrt = FALSE);
+    CaptureContext(void* func, context_t& context, SIZE_T size, BOOL debug = FALSE, BOOL ucrt = FALSE);
     ~CaptureContext();
     __forceinline void Set(HANDLE heap, LPVOID mem, LPVOID newmem, SIZE_T size);
 private:
@@ -203,6 +184,24 @@ private:
     const context_t& m_context;
 };
 
+// Used by the hooks of the CRT, MFC and COM allocators in place of a
+// CaptureContext, when the requested size is outside the tracked size range
+// and untracked sizes aren't mapped, or when the allocation isn't sampled: the
+// heap hooks then ignore the heap block of the allocation, whatever its size,
+// and no context is captured. It doesn't create the thread's tls_t, so a
+// thread's first allocation is ignored without taking the TLS lock.
+class UntrackedContext {
+public:
+    UntrackedContext();
+    ~UntrackedContext();
+private:
+    // Disallow certain operations
+    UntrackedContext(const UntrackedContext&);
+    UntrackedContext& operator=(const UntrackedContext&);
+private:
+    BOOL m_bFirst;
+};
+
 class CallStack;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -231,10 +230,15 @@ class CallStack;
 //   memory leaks. However, this implementation of IMalloc is actually just a
 //   thin wrapper around the system's implementation of IMalloc.
 //
-class VisualLeakDetector : public IMalloc
+//   The heap and block maps, and everything built on them, are kept by the
+//   BlockTracker base class, which the Linux backend shares.
+//
+class VisualLeakDetector : public IMalloc, public BlockTracker
 {
     friend class CallStack;
     friend class CaptureContext;
+    friend class UntrackedContext;
+    friend BOOL WINAPI DllEntryPoint (HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpReserved);
 public:
     VisualLeakDetector();
     ~VisualLeakDetector();
@@ -275,8 +279,19 @@ public:
     VOID SetModulesList(CONST WCHAR *modules, BOOL includeModules);
     bool GetModulesList(WCHAR *modules, UINT size);
     int ResolveCallstacks();
+    BOOL GetStatistics(VLD_STATISTICS *stats);
+    int GetLockStatistics(VLD_LOCK_STATISTICS *stats, int count);
+    int DumpHeapProfile(CONST WCHAR *path);
     const wchar_t* GetAllocationResolveResults(void* alloc, BOOL showInternalFrames);
 
+    // Sampling, checked by the hooks of the CRT, MFC and COM allocators with
+    // the requested size, before they construct a CaptureContext. Inline,
+    // because it is called for every allocation.
+    bool isSampled (SIZE_T size, LPCVOID mem = NULL)
+    {
+        return (m_sampleRate == 0) || (mem != NULL) || sampleRequest(size);
+    }
+
     static NTSTATUS __stdcall _LdrLoadDll (LPWSTR searchpath, PULONG flags, unicodestring_t *modulename,
         PHANDLE modulehandle);
     static NTSTATUS __stdcall _LdrLoadDllWin8 (DWORD_PTR reserved, PULONG flags, unicodestring_t *modulename,
@@ -300,31 +315,48 @@ private:
     BOOL GetIniFilePath(LPTSTR lpPath, SIZE_T cchPath);
     VOID   configure ();
     BOOL   enabled ();
-    SIZE_T eraseDuplicates (const BlockMap::Iterator &element, Set<blockinfo_t*> &aggregatedLeak);
     tls_t* getTls ();
-    VOID   mapBlock (HANDLE heap, LPCVOID mem, SIZE_T size, bool crtalloc, bool ucrt, DWORD threadId, blockinfo_t* &pblockInfo);
-    VOID   mapHeap (HANDLE heap);
-    VOID   remapBlock (HANDLE heap, LPCVOID mem, LPCVOID newmem, SIZE_T size,
-        bool crtalloc, bool ucrt, DWORD threadId, blockinfo_t* &pblockInfo, const context_t &context);
+    VOID   releaseTls ();
+    // Sampling, checked by the heap hooks before they construct a
+    // CaptureContext. Inline, because it is called for every allocation.
+    bool   isSampled (HANDLE heap, LPCVOID mem, LPCVOID newmem, SIZE_T size)
+    {
+        return (m_sampleRate == 0) || sampleAllocation(heap, mem, newmem, size);
+    }
+    bool   sampleAllocation (HANDLE heap, LPCVOID mem, LPCVOID newmem, SIZE_T size);
+    bool   sampleRequest (SIZE_T size);
+    // Size filter of the heap hooks. Inline, because it is called for every
+    // block, before any other work.
+    bool   isMappedHeapSize (SIZE_T size)
+    {
+        return m_mapUntrackedSizes || isMappedRequest(size);
+    }
+    bool   isMappedRequest (SIZE_T size);
+    bool   getLeakData (LPCVOID block, blockinfo_t *info, LPCVOID &address, SIZE_T &size);
+    VOID   reportMismatchedFree (HANDLE heap, LPCVOID mem, const context_t &context);
+    // Event trace. Inline, because it is called for every allocation and free.
+    VOID   traceEvent (UINT32 op, HANDLE heap, LPCVOID address, LPCVOID oldAddress, SIZE_T size, const CallStack *callstack)
+    {
+        if (m_trace.isOpen())
+            m_trace.append(getTls()->traceRing, op, heap, address, oldAddress, size, callstack);
+    }
     VOID   reportConfig ();
+#ifdef VLD_LOCK_PROFILING
+    VOID   reportLockStatistics ();
+#endif
     static bool   isDebugCrtAlloc(LPCVOID block, blockinfo_t* info);
     SIZE_T reportHeapLeaks (HANDLE heap);
     static int    getCrtBlockUse (LPCVOID block, bool ucrt);
     static size_t getCrtBlockSize(LPCVOID block, bool ucrt);
-    SIZE_T getLeaksCount (heapinfo_t* heapinfo, DWORD threadId = (DWORD)-1);
-    SIZE_T reportLeaks(heapinfo_t* heapinfo, bool &firstLeak, Set<blockinfo_t*> &aggregatedLeaks, DWORD threadId = (DWORD)-1);
-    VOID   markAllLeaksAsReported (heapinfo_t* heapinfo, DWORD threadId = (DWORD)-1);
-    VOID   unmapBlock (HANDLE heap, LPCVOID mem, const context_t &context);
-    VOID   unmapHeap (HANDLE heap);
     int    resolveStacks(heapinfo_t* heapinfo);
 
     // Static functions (callbacks)
     static BOOL __stdcall addLoadedModule (PCWSTR modulepath, DWORD64 modulebase, ULONG modulesize, PVOID context);
     static BOOL __stdcall detachFromModule (PCWSTR modulepath, DWORD64 modulebase, ULONG modulesize, PVOID context);
+    static DWORD __stdcall monitorProc (LPVOID param);
 
     // Utils
     static bool isModuleExcluded (UINT_PTR returnaddress);
-    blockinfo_t* findAllocedBlock(LPCVOID, __out HANDLE& heap);
     blockinfo_t* getAllocationBlockInfo(void* alloc);
     void setupReporting();
     void checkInternalMemoryLeaks();
@@ -362,19 +394,14 @@ private:
     // Private data
     ////////////////////////////////////////////////////////////////////////////////
     WCHAR                m_forcedModuleList [MAXMODULELISTLENGTH]; // List of modules to be forcefully included in leak detection.
-    HeapMap             *m_heapMap;           // Map of all active heaps in the process.
     IMalloc             *m_iMalloc;           // Pointer to the system implementation of IMalloc.
 
-    SIZE_T               m_requestCurr;       // Current request number.
-    SIZE_T               m_totalAlloc;        // Grand total - sum of all allocations.
-    SIZE_T               m_curAlloc;          // Total amount currently allocated.
-    SIZE_T               m_maxAlloc;          // Largest ever allocated at once.
     ModuleSet           *m_loadedModules;     // Contains information about all modules loaded in the process.
-    SIZE_T               m_maxDataDump;       // Maximum number of user-data bytes to dump for each leaked block.
-    UINT32               m_maxTraceFrames;    // Maximum number of frames per stack trace for each leaked block.
+    HANDLE               m_monitorThread;     // The leak growth monitor thread.
+    HANDLE               m_monitorStop;       // Signaled to stop the leak growth monitor thread.
+    WCHAR                m_traceFilePath [MAX_PATH]; // Path of the event trace file, or empty if there is no trace.
+    EventTrace           m_trace;             // Binary trace of allocation events.
     CriticalSection      m_modulesLock;       // Protects accesses to the "loaded modules" ModuleSet.
-    CriticalSection      m_optionsLock;       // Serializes access to the heap and block maps.
-    UINT32               m_options;           // Configuration options.
 
     static patchentry_t  m_kernelbasePatch [];
     static patchentry_t  m_kernel32Patch [];
@@ -390,9 +417,9 @@ private:
 #define VLD_STATUS_INSTALLED            0x2   //   If set, VLD was successfully installed.
 #define VLD_STATUS_NEVER_ENABLED        0x4   //   If set, VLD started disabled, and has not yet been manually enabled.
 #define VLD_STATUS_FORCE_REPORT_TO_FILE 0x8   //   If set, the leak report is being forced to a file.
-    DWORD                m_tlsIndex;          // Thread-local storage index.
     CriticalSection      m_tlsLock;           // Protects accesses to the Set of TLS structures.
-    TlsMap              *m_tlsMap;            // Set of all thread-local storage structures for the process.
+    TlsMap              *m_tlsMap;            // Set of the thread-local storage structures of all live threads.
+    tls_t               *m_tlsFreeList;       // Thread-local storage structures of exited threads, for reuse.
     HMODULE              m_vldBase;           // Visual Leak Detector's own module handle (base address).
     HMODULE              m_dbghlpBase;
 
@@ -408,4 +435,5 @@ private:
 // Configuration option default values
 #define VLD_DEFAULT_MAX_DATA_DUMP    256
 #define VLD_DEFAULT_MAX_TRACE_FRAMES 64
+#define VLD_MONITOR_STOP_TIMEOUT     1000  // Time, in milliseconds, to wait for the monitor thread to stop.
 #define VLD_DEFAULT_REPORT_FILE_NAME L".\\memory_leak_report.txt"